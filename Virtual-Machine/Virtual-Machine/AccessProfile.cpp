@@ -0,0 +1,234 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <algorithm>
+
+#include "AccessProfile.h"
+
+
+/**
+ * @brief Constructs an empty profile.
+ *
+ * @param cpu Pointer to the CPU object whose symbols name addresses in the heatmap.
+ * @param windowInstructions Instructions per working set window.
+ */
+AccessProfile::AccessProfile(CPU* cpu, uint64_t windowInstructions)
+{
+    cpuPtr = cpu;
+    this->windowInstructions = windowInstructions;
+    windowCountdown = windowInstructions;
+
+    for (uint32_t kind = 0; kind < AK_COUNT; ++kind)
+    {
+        counts[kind].assign(MEMORY_MAX, 0);
+    }
+    SetLineBytes(ACCESS_DEFAULT_LINE_BYTES);
+}
+
+
+/**
+ * @brief Attaches a cache model fed with every access; its line size becomes the working set granularity.
+ *
+ * @param cacheModel Pointer to the CacheModel object, or nullptr to count accesses only.
+ */
+void AccessProfile::SetCacheModel(CacheModel* cacheModel)
+{
+    cacheModelPtr = cacheModel;
+    SetLineBytes(cacheModel ? cacheModel->LineBytes() : ACCESS_DEFAULT_LINE_BYTES);
+}
+
+
+/**
+ * @brief Sets the line size the working set is measured in.
+ *
+ * @param lineBytes A power of two of at least one word.
+ */
+void AccessProfile::SetLineBytes(uint32_t lineBytes)
+{
+    // Lines are counted in words of two bytes
+    lineShift = 0;
+    while ((2u << lineShift) < lineBytes)
+    {
+        ++lineShift;
+    }
+    lineWindows.assign((MEMORY_MAX >> lineShift) + 1, 0);
+    window = 1;
+    windowLines = 0;
+}
+
+
+/**
+ * @brief Stores the working set of the current window and starts the next one.
+ */
+void AccessProfile::CloseWindow()
+{
+    AccessWindow closed;
+    closed.endInstruction = fetchCount;
+    closed.lines = windowLines;
+    closed.hits = cacheModelPtr ? cacheModelPtr->Hits() - windowHits : 0;
+    closed.misses = cacheModelPtr ? cacheModelPtr->Misses() - windowMisses : 0;
+    windows.push_back(closed);
+
+    if (cacheModelPtr)
+    {
+        windowHits = cacheModelPtr->Hits();
+        windowMisses = cacheModelPtr->Misses();
+    }
+    ++window;
+    windowLines = 0;
+    windowCountdown = windowInstructions;
+}
+
+
+/**
+ * @brief Closes the last, partial window once the program halted.
+ */
+void AccessProfile::Finish()
+{
+    if (windowLines)
+    {
+        CloseWindow();
+    }
+}
+
+
+/**
+ * @brief Writes the per-address counts of every address accessed as CSV.
+ *
+ * @param path Path of the file to write.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int AccessProfile::SaveHeatmap(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fprintf(file, "address,fetches,reads,writes,symbol\n");
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        uint64_t fetches = counts[AK_FETCH][address];
+        uint64_t reads = counts[AK_READ][address];
+        uint64_t writes = counts[AK_WRITE][address];
+        if (!fetches && !reads && !writes)
+        {
+            continue;
+        }
+
+        fprintf(file, "x%04X,%llu,%llu,%llu,", address,
+            (unsigned long long)fetches, (unsigned long long)reads, (unsigned long long)writes);
+
+        const std::string* name;
+        uint16_t offset;
+        if (cpuPtr->FindSymbol((uint16_t)address, &name, &offset))
+        {
+            fprintf(file, offset ? "%s+%u" : "%s", name->c_str(), offset);
+        }
+        fprintf(file, "\n");
+    }
+
+    int written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+
+/**
+ * @brief Prints totals, the hottest addresses, the cache model's hit rates and the working set over time.
+ *
+ * @param out The stream to print to.
+ */
+void AccessProfile::Report(FILE* out) const
+{
+    uint64_t totals[AK_COUNT] = {};
+    uint32_t codeWords = 0;
+    uint32_t dataWords = 0;
+    std::vector<std::pair<uint64_t, uint16_t>> hottest;
+
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        uint64_t data = counts[AK_READ][address] + counts[AK_WRITE][address];
+        uint64_t all = counts[AK_FETCH][address] + data;
+        for (uint32_t kind = 0; kind < AK_COUNT; ++kind)
+        {
+            totals[kind] += counts[kind][address];
+        }
+        codeWords += counts[AK_FETCH][address] != 0;
+        dataWords += data != 0;
+        if (all)
+        {
+            hottest.push_back(std::make_pair(all, (uint16_t)address));
+        }
+    }
+
+    fprintf(out, "access profile: %llu fetches, %llu reads, %llu writes\n", (unsigned long long)totals[AK_FETCH],
+        (unsigned long long)totals[AK_READ], (unsigned long long)totals[AK_WRITE]);
+    fprintf(out, "  touched %u code words, %u data words\n", codeWords, dataWords);
+
+    uint64_t total = totals[AK_FETCH] + totals[AK_READ] + totals[AK_WRITE];
+    size_t shown = std::min<size_t>(hottest.size(), 8);
+    std::partial_sort(hottest.begin(), hottest.begin() + shown, hottest.end(),
+        [](const std::pair<uint64_t, uint16_t>& a, const std::pair<uint64_t, uint16_t>& b) { return a.first > b.first; });
+    for (size_t i = 0; i < shown; ++i)
+    {
+        uint16_t address = hottest[i].second;
+        fprintf(out, "    x%04X %5.1f%%  fetch %llu read %llu write %llu", address, 100.0 * hottest[i].first / total,
+            (unsigned long long)counts[AK_FETCH][address], (unsigned long long)counts[AK_READ][address],
+            (unsigned long long)counts[AK_WRITE][address]);
+
+        const std::string* name;
+        uint16_t offset;
+        if (cpuPtr->FindSymbol(address, &name, &offset))
+        {
+            fprintf(out, offset ? "  %s+%u" : "  %s", name->c_str(), offset);
+        }
+        fprintf(out, "\n");
+    }
+
+    if (cacheModelPtr)
+    {
+        cacheModelPtr->Report(out);
+    }
+
+    if (windows.empty())
+    {
+        return;
+    }
+
+    // Merge consecutive windows so that long runs print a bounded series, keeping each group's peak
+    uint32_t lineBytes = 2u << lineShift;
+    size_t group = (windows.size() + ACCESS_SUMMARY_ROWS - 1) / ACCESS_SUMMARY_ROWS;
+    fprintf(out, "  working set per %llu-instruction window (%u B lines", (unsigned long long)windowInstructions, lineBytes);
+    fprintf(out, group > 1 ? ", peak of every %zu windows):\n" : "):\n", group);
+    for (size_t first = 0; first < windows.size(); first += group)
+    {
+        size_t last = std::min(first + group, windows.size());
+        uint32_t lines = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        for (size_t i = first; i < last; ++i)
+        {
+            lines = std::max(lines, windows[i].lines);
+            hits += windows[i].hits;
+            misses += windows[i].misses;
+        }
+
+        fprintf(out, "    to %12llu: %6u lines, %8u B", (unsigned long long)windows[last - 1].endInstruction, lines, lines * lineBytes);
+        if (cacheModelPtr && hits + misses)
+        {
+            fprintf(out, ", %6.2f%% hits", 100.0 * hits / (hits + misses));
+        }
+        fprintf(out, "\n");
+    }
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef ACCESS_PROFILE_H
+#define ACCESS_PROFILE_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "CPU.h"
+#include "CacheModel.h"
+
+
+enum AccessProfileLimits : uint32_t
+{
+    // Line size in bytes used for the working set when no cache model sets one.
+    ACCESS_DEFAULT_LINE_BYTES = 64,
+
+    // Rows of the working set series printed by the summary; longer runs are merged into this many.
+    ACCESS_SUMMARY_ROWS = 32
+};
+
+
+// Working set of one window of instructions.
+struct AccessWindow
+{
+    uint64_t endInstruction;
+    uint32_t lines;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+
+// Per-address counts of instruction fetches, data reads and data writes, with the working set
+// measured in host cache lines per window of instructions and an optional cache model fed with
+// every access. Word address A is taken to live at host byte address 2 * A.
+class AccessProfile
+{
+private:
+    CPU* cpuPtr;
+    CacheModel* cacheModelPtr = nullptr;
+
+    std::vector<uint64_t> counts[AK_COUNT];
+
+    // Working set: the window in which each line was last touched, numbered from 1.
+    uint32_t lineShift = 0;
+    std::vector<uint32_t> lineWindows;
+    uint32_t window = 1;
+    uint32_t windowLines = 0;
+    uint64_t windowInstructions;
+    uint64_t windowCountdown;
+    uint64_t fetchCount = 0;
+    uint64_t windowHits = 0;
+    uint64_t windowMisses = 0;
+    std::vector<AccessWindow> windows;
+
+    void SetLineBytes(uint32_t lineBytes);
+    void CloseWindow();
+
+    void Touch(uint16_t address, uint8_t kind)
+    {
+        ++counts[kind][address];
+
+        uint32_t line = address >> lineShift;
+        if (lineWindows[line] != window)
+        {
+            lineWindows[line] = window;
+            ++windowLines;
+        }
+
+        if (cacheModelPtr)
+        {
+            cacheModelPtr->Access((uint32_t)address << 1, kind);
+        }
+    }
+
+public:
+    AccessProfile(CPU* cpu, uint64_t windowInstructions);
+
+    void SetCacheModel(CacheModel* cacheModel);
+
+    /**
+     * @brief Counts an instruction fetch; called by MemoryIO. Each fetch retires one instruction.
+     */
+    void Fetch(uint16_t address)
+    {
+        Touch(address, AK_FETCH);
+        ++fetchCount;
+        if (--windowCountdown == 0)
+        {
+            CloseWindow();
+        }
+    }
+
+    /**
+     * @brief Counts a data read; called by MemoryIO.
+     */
+    void Read(uint16_t address)
+    {
+        Touch(address, AK_READ);
+    }
+
+    /**
+     * @brief Counts a data write; called by MemoryIO.
+     */
+    void Write(uint16_t address)
+    {
+        Touch(address, AK_WRITE);
+    }
+
+    void Finish();
+    int SaveHeatmap(const char* path) const;
+    void Report(FILE* out) const;
+};
+#endif
\ No newline at end of file
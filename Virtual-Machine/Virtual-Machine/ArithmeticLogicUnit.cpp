@@ -11,6 +11,7 @@ Copyright 
 #include "ArithmeticLogicUnit.h"
 #include "CPU.h"
 #include "MemoryIO.h"
+#include "DecodeCache.h"
 
 
 /**
@@ -82,261 +83,225 @@ uint16_t ArithmeticLogicUnit::Swap16(uint16_t number)
 
 
 /**
- * @brief Performs an addition operation based on the provided instruction.
- *
- * This function extracts operands from the instruction and performs addition.
- *
- * @param instruction The 16-bit instruction.
+ * @brief Performs an addition on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the sign-extended immediate.
  */
-void ArithmeticLogicUnit::ADD(uint16_t instruction)
+void ArithmeticLogicUnit::ADD(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR), Source Register 1 (SR1), and Immediate Flag (Imm)
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Source Register 1
-    uint16_t Imm = (instruction >> 5) & 0x0001; // Immediate Flag
-
-    if (Imm)
+    if (decoded.sr2 == DecodedOperands::DECODED_IMMEDIATE)
     {
-        // If Immediate Flag is set, extract immediate value and perform addition
-        uint16_t imm5 = (instruction) & 0x001F;
-        imm5 = SignExtend(imm5, 5); // Sign-extend the immediate value
-        registersPtr[DR] = registersPtr[SR1] + imm5;
+        registersPtr[decoded.dr] = registersPtr[decoded.sr1] + decoded.operand;
     }
     else
     {
-        // If Immediate Flag is not set, extract Source Register 2 (SR2) and perform addition
-        uint16_t SR2 = (instruction) & 0x0007; // Source Register 2
-        registersPtr[DR] = registersPtr[SR1] + registersPtr[SR2];
+        registersPtr[decoded.dr] = registersPtr[decoded.sr1] + registersPtr[decoded.sr2];
     }
 
     // Update condition flags based on the result in the destination register
-    cpuPtr->UpdateFlags(DR);
+    cpuPtr->UpdateFlags(decoded.dr);
 }
 
 
 /**
- * @brief Performs a bitwise AND operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a bitwise AND on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the sign-extended immediate.
  */
-void ArithmeticLogicUnit::AND(uint16_t instruction)
+void ArithmeticLogicUnit::AND(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR), Source Register 1 (SR1), and Immediate Flag (Imm)
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Source Register 1
-    uint16_t Imm = (instruction >> 5) & 0x0001; // Immediate Flag
-
-    if (Imm)
+    if (decoded.sr2 == DecodedOperands::DECODED_IMMEDIATE)
     {
-        // If Immediate Flag is set, extract immediate value and perform bitwise AND
-        uint16_t imm5 = (instruction) & 0x001F;
-        imm5 = SignExtend(imm5, 5); // Sign-extend the immediate value
-        registersPtr[DR] = registersPtr[SR1] & imm5;
+        registersPtr[decoded.dr] = registersPtr[decoded.sr1] & decoded.operand;
     }
     else
     {
-        // If Immediate Flag is not set, extract Source Register 2 (SR2) and perform bitwise AND
-        uint16_t SR2 = (instruction) & 0x0007; // Source Register 2
-        registersPtr[DR] = registersPtr[SR1] & registersPtr[SR2];
+        registersPtr[decoded.dr] = registersPtr[decoded.sr1] & registersPtr[decoded.sr2];
     }
 
     // Update condition flags based on the result in the destination register
-    cpuPtr->UpdateFlags(DR);
+    cpuPtr->UpdateFlags(decoded.dr);
 }
 
 
 /**
- * @brief Performs a bitwise NOT operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a bitwise NOT on a pre-decoded instruction.
+ * @param decoded The decoded instruction.
  */
-void ArithmeticLogicUnit::NOT(uint16_t instruction)
+void ArithmeticLogicUnit::NOT(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR) and Source Register 1 (SR1)
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Source Register 1
-
-    // Perform bitwise NOT operation on the value in source register and store it in destination register
-    registersPtr[DR] = ~registersPtr[SR1];
-
-    // Update condition flags based on the result in the destination register
-    cpuPtr->UpdateFlags(DR);
+    registersPtr[decoded.dr] = ~registersPtr[decoded.sr1];
+    cpuPtr->UpdateFlags(decoded.dr);
 }
 
 
 /**
- * @brief Performs a branch operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a branch on a pre-decoded instruction.
+ * @param decoded The decoded instruction; dr holds the condition mask and the operand the target.
  */
-void ArithmeticLogicUnit::BR(uint16_t instruction)
+void ArithmeticLogicUnit::BR(const DecodedInstruction& decoded)
 {
-    // Extract pcOffset and Condition Flag
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9);
-    uint16_t conditionFlag = (instruction >> 9) & 0x0007;
-
-    // Check if condition flag is set in the Condition Register, then update PC
-    if (conditionFlag & registersPtr[Registers::R_COND])
+    if (decoded.dr & registersPtr[Registers::R_COND])
     {
-        registersPtr[Registers::R_PC] += pcOffset;
+        registersPtr[Registers::R_PC] = decoded.operand;
     }
 }
 
 
 /**
- * @brief Performs a jump operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a jump on a pre-decoded instruction.
+ * @param decoded The decoded instruction.
  */
-void ArithmeticLogicUnit::JMP(uint16_t instruction)
+void ArithmeticLogicUnit::JMP(const DecodedInstruction& decoded)
 {
-    // Extract Source Register (SR1)
-    uint16_t SR1 = (instruction >> 6) & 0x0007;
-
-    // Set PC to the value in the source register
-    registersPtr[Registers::R_PC] = registersPtr[SR1];
+    registersPtr[Registers::R_PC] = registersPtr[decoded.sr1];
 }
 
 
 /**
- * @brief Performs a jump to subroutine operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a jump to subroutine on a pre-decoded instruction.
+ * @param decoded The decoded instruction; for JSR the operand holds the target.
  */
-void ArithmeticLogicUnit::JSR(uint16_t instruction)
+void ArithmeticLogicUnit::JSR(const DecodedInstruction& decoded)
 {
-    // Extract Long Flag to determine the type of jump
-    uint16_t longFlag = (instruction >> 11) & 0x0001;
-
     // Save the current PC value to R7 (Return Address Register)
     registersPtr[Registers::R_7] = registersPtr[Registers::R_PC];
 
-    if (longFlag)
+    if (decoded.sr2 == DecodedOperands::DECODED_IMMEDIATE)
     {
-        // If Long Flag is set, calculate the long PC offset and perform jump
-        uint16_t longPCOffset = SignExtend(instruction & 0x07FF, 11);
-        registersPtr[Registers::R_PC] += longPCOffset;  // JSR
+        registersPtr[Registers::R_PC] = decoded.operand; // JSR
     }
     else
     {
-        // If Long Flag is not set, extract the source register and perform jump
-        uint16_t SR1 = (instruction >> 6) & 0x0007;
-        registersPtr[Registers::R_PC] = registersPtr[SR1]; // JSRR
+        registersPtr[Registers::R_PC] = registersPtr[decoded.sr1]; // JSRR
     }
 }
 
 
 /**
- * @brief Performs a load operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a load on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the resolved address.
  */
-void ArithmeticLogicUnit::LD(uint16_t instruction)
+void ArithmeticLogicUnit::LD(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9);
+    registersPtr[decoded.dr] = memoryIOPtr->Read(decoded.operand);
+    cpuPtr->UpdateFlags(decoded.dr);
+}
 
-    // Load the value from memory at the calculated address into the destination register
-    registersPtr[DR] = memoryIOPtr->Read(registersPtr[Registers::R_PC] + pcOffset);
 
-    // Update the condition flags based on the value loaded into the destination register
-    cpuPtr->UpdateFlags(DR);
+/**
+ * @brief Performs a load from base register with offset on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the sign-extended offset.
+ */
+void ArithmeticLogicUnit::LDR(const DecodedInstruction& decoded)
+{
+    registersPtr[decoded.dr] = memoryIOPtr->Read(registersPtr[decoded.sr1] + decoded.operand);
+    cpuPtr->UpdateFlags(decoded.dr);
 }
 
 
 /**
- * @brief Performs a load from base register with offset operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a load effective address on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the resolved address.
  */
-void ArithmeticLogicUnit::LDR(uint16_t instruction)
+void ArithmeticLogicUnit::LEA(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR), Base Register (SR1), and Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Base Register
-    uint16_t offset = SignExtend(instruction & 0x003F, 6); // Offset
+    registersPtr[decoded.dr] = decoded.operand;
+    cpuPtr->UpdateFlags(decoded.dr);
+}
 
-    // Load the value from memory at the address calculated by adding base register value and offset
-    registersPtr[DR] = memoryIOPtr->Read(registersPtr[SR1] + offset);
 
-    // Update the condition flags based on the value loaded into the destination register
-    cpuPtr->UpdateFlags(DR);
+/**
+ * @brief Performs a store on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the resolved address.
+ */
+void ArithmeticLogicUnit::ST(const DecodedInstruction& decoded)
+{
+    memoryIOPtr->Write(decoded.operand, registersPtr[decoded.dr]);
 }
 
 
 /**
- * @brief Performs a load effective address operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs an indirect store on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the address of the pointer.
  */
-void ArithmeticLogicUnit::LEA(uint16_t instruction)
+void ArithmeticLogicUnit::STI(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    memoryIOPtr->Write(memoryIOPtr->Read(decoded.operand), registersPtr[decoded.dr]);
+}
 
-    // Calculate the effective address by adding PC value and PC offset
-    registersPtr[DR] = registersPtr[Registers::R_PC] + pcOffset;
 
-    // Update the condition flags based on the effective address value
-    cpuPtr->UpdateFlags(DR);
+/**
+ * @brief Performs a store register on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the sign-extended offset.
+ */
+void ArithmeticLogicUnit::STR(const DecodedInstruction& decoded)
+{
+    memoryIOPtr->Write(registersPtr[decoded.sr1] + decoded.operand, registersPtr[decoded.dr]);
 }
 
 
 /**
- * @brief Performs a store operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Performs a load indirect on a pre-decoded instruction.
+ * @param decoded The decoded instruction; the operand holds the address of the pointer.
  */
-void ArithmeticLogicUnit::ST(uint16_t instruction)
+void ArithmeticLogicUnit::LDI(const DecodedInstruction& decoded)
 {
-    // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9); // PC Offset
-
-    // Write the value from DR register to memory at the address calculated by adding PC value and PC offset
-    memoryIOPtr->Write(registersPtr[Registers::R_PC] + pcOffset, registersPtr[DR]);
+    registersPtr[decoded.dr] = memoryIOPtr->Read(memoryIOPtr->Read(decoded.operand));
+    cpuPtr->UpdateFlags(decoded.dr);
 }
 
 
 /**
- * @brief Performs an indirect store operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Executes an ADD followed by a BR, the step and test of a counted loop.
+ * @param first The decoded ADD instruction.
+ * @param second The decoded BR instruction.
  */
-void ArithmeticLogicUnit::STI(uint16_t instruction)
+void ArithmeticLogicUnit::ADD_BR(const DecodedInstruction& first, const DecodedInstruction& second)
 {
-    // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pcOffset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    ADD(first);
 
-    // Perform an indirect store by first reading the memory at the address calculated by adding PC value and PC offset,
-    // then storing the value from DR register to the memory location read.
-    memoryIOPtr->Write(memoryIOPtr->Read(registersPtr[Registers::R_PC] + pcOffset), registersPtr[DR]);
+    // Step over the branch word before evaluating the branch
+    ++registersPtr[Registers::R_PC];
+    BR(second);
 }
 
 
 /**
- * @brief Performs a store register operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Executes an LDR followed by an ADD, the load and advance of a pointer walk.
+ * @param first The decoded LDR instruction.
+ * @param second The decoded ADD instruction.
  */
-void ArithmeticLogicUnit::STR(uint16_t instruction)
+void ArithmeticLogicUnit::LDR_ADD(const DecodedInstruction& first, const DecodedInstruction& second)
 {
-    // Extract Destination Register (DR), Base Register (SR1), and Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t SR1 = (instruction >> 6) & 0x0007; // Base Register
-    uint16_t offset = SignExtend(instruction & 0x003F, 6); // Offset
-
-    // Write the value from DR register to memory at the address calculated by adding SR1 register value and offset
-    memoryIOPtr->Write(registersPtr[SR1] + offset, registersPtr[DR]);
+    LDR(first);
+    ++registersPtr[Registers::R_PC];
+    ADD(second);
 }
 
 
 /**
- * @brief Performs a load indirect operation based on the provided instruction.
- * @param instruction The 16-bit instruction.
+ * @brief Executes AND Rx,Ry,#0 followed by ADD Rx,Rx,#imm, which loads the constant imm into Rx.
+ * @param first The decoded AND instruction, unused as the ADD's destination and immediate give the result.
+ * @param second The decoded ADD instruction.
  */
-void ArithmeticLogicUnit::LDI(uint16_t instruction)
+void ArithmeticLogicUnit::AND_ADD(const DecodedInstruction&, const DecodedInstruction& second)
 {
-    // Extract Destination Register (DR) and PC Offset
-    uint16_t DR = (instruction >> 9) & 0x0007; // Destination Register
-    uint16_t pc_offset = SignExtend(instruction & 0x01FF, 9); // PC Offset
+    // The AND clears the register, so the result is the immediate itself
+    registersPtr[second.dr] = second.operand;
+    cpuPtr->UpdateFlags(second.dr);
+    ++registersPtr[Registers::R_PC];
+}
+
 
-    // Calculate the effective address by adding PC value and PC offset,
-    // then load the value from the memory location pointed by the calculated address into the destination register
-    registersPtr[DR] = memoryIOPtr->Read(memoryIOPtr->Read(registersPtr[Registers::R_PC] + pc_offset));
+/**
+ * @brief Executes an ST followed by a JSR or JSRR, saving a register before a call.
+ * @param first The decoded ST instruction.
+ * @param second The decoded JSR or JSRR instruction.
+ */
+void ArithmeticLogicUnit::ST_JSR(const DecodedInstruction& first, const DecodedInstruction& second)
+{
+    ST(first);
 
-    // Update the condition flags based on the value loaded into the destination register
-    cpuPtr->UpdateFlags(DR);
+    // The return address saved by JSR is the word after the pair
+    ++registersPtr[Registers::R_PC];
+    JSR(second);
 }
\ No newline at end of file
@@ -17,6 +17,7 @@ Copyright 
 
 class MemoryIO;
 class CPU;
+struct DecodedInstruction;
 
 
 enum Opcodes : uint16_t
@@ -54,22 +55,29 @@ public:
     uint16_t SignExtend(uint16_t immNumber, int immNumberLength) const;
     uint16_t Swap16(uint16_t number);
 
-    void ADD(uint16_t instruction);
-    void AND(uint16_t instruction);
-    void NOT(uint16_t instruction);
+    // Handlers for instructions pre-decoded by the DecodeCache. Raw instructions run on VmCore.
+    void ADD(const DecodedInstruction& decoded);
+    void AND(const DecodedInstruction& decoded);
+    void NOT(const DecodedInstruction& decoded);
 
-    void BR(uint16_t instruction);
-    void JMP(uint16_t instruction);
-    void JSR(uint16_t instruction);
+    void BR(const DecodedInstruction& decoded);
+    void JMP(const DecodedInstruction& decoded);
+    void JSR(const DecodedInstruction& decoded);
 
-    void LD(uint16_t instruction);
-    void LDR(uint16_t instruction);
-    void LEA(uint16_t instruction);
+    void LD(const DecodedInstruction& decoded);
+    void LDR(const DecodedInstruction& decoded);
+    void LEA(const DecodedInstruction& decoded);
 
-    void ST(uint16_t instruction);
-    void STI(uint16_t instruction);
-    void STR(uint16_t instruction);
+    void ST(const DecodedInstruction& decoded);
+    void STI(const DecodedInstruction& decoded);
+    void STR(const DecodedInstruction& decoded);
 
-    void LDI(uint16_t instruction);
+    void LDI(const DecodedInstruction& decoded);
+
+    // Superinstructions executing a pre-decoded pair of instructions.
+    void ADD_BR(const DecodedInstruction& first, const DecodedInstruction& second);
+    void LDR_ADD(const DecodedInstruction& first, const DecodedInstruction& second);
+    void AND_ADD(const DecodedInstruction& first, const DecodedInstruction& second);
+    void ST_JSR(const DecodedInstruction& first, const DecodedInstruction& second);
 };
 #endif
\ No newline at end of file
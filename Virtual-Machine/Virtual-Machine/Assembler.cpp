@@ -0,0 +1,805 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Assembler.h"
+#include "ArithmeticLogicUnit.h"
+#include "CPU.h"
+#include "Trap.h"
+
+
+// Operations taking a destination, a source and a register or 5-bit immediate.
+static const struct
+{
+    const char* name;
+    uint16_t opcode;
+} arithmetic[] = { { "ADD", OP_ADD }, { "AND", OP_AND } };
+
+
+// Operations addressing memory relative to the program counter.
+static const struct
+{
+    const char* name;
+    uint16_t opcode;
+} pcRelative[] = { { "LD", OP_LD }, { "LDI", OP_LDI }, { "LEA", OP_LEA }, { "ST", OP_ST }, { "STI", OP_STI } };
+
+
+// Trap aliases.
+static const struct
+{
+    const char* name;
+    uint16_t vector;
+} traps[] = { { "GETC", TRAP_GETC }, { "OUT", TRAP_OUT }, { "PUTS", TRAP_PUTS }, { "IN", TRAP_IN },
+              { "PUTSP", TRAP_PUTSP }, { "HALT", TRAP_HALT } };
+
+
+/**
+ * @brief Returns the condition bits of a BR mnemonic, or -1 if the name is not one.
+ */
+static int BranchConditions(const std::string& name)
+{
+    if (name.compare(0, 2, "BR") != 0)
+    {
+        return -1;
+    }
+
+    // Conditions must appear in n, z, p order; a bare BR branches always
+    int conditions = 0;
+    const char* order = "NZP";
+    size_t next = 0;
+    for (size_t i = 2; i < name.size(); ++i)
+    {
+        size_t position = std::string(order).find(name[i], next);
+        if (position == std::string::npos)
+        {
+            return -1;
+        }
+        conditions |= 4 >> position;
+        next = position + 1;
+    }
+    return conditions ? conditions : 7;
+}
+
+
+/**
+ * @brief Tells whether an upper-case name is an instruction, alias or directive.
+ */
+static bool IsOperation(const std::string& name)
+{
+    static const char* others[] = { "NOT", "JMP", "RET", "JSR", "JSRR", "LDR", "STR", "TRAP", "RTI", "NOP",
+                                    ".ORIG", ".FILL", ".BLKW", ".STRINGZ", ".END" };
+
+    for (const auto& entry : arithmetic)
+    {
+        if (name == entry.name)
+        {
+            return true;
+        }
+    }
+    for (const auto& entry : pcRelative)
+    {
+        if (name == entry.name)
+        {
+            return true;
+        }
+    }
+    for (const auto& entry : traps)
+    {
+        if (name == entry.name)
+        {
+            return true;
+        }
+    }
+    for (const char* other : others)
+    {
+        if (name == other)
+        {
+            return true;
+        }
+    }
+    return BranchConditions(name) >= 0;
+}
+
+
+/**
+ * @brief Returns a copy of text in upper case.
+ */
+static std::string Upper(const std::string& text)
+{
+    std::string upper = text;
+    for (char& c : upper)
+    {
+        c = (char)toupper((unsigned char)c);
+    }
+    return upper;
+}
+
+
+/**
+ * @brief Parses a numeric literal: #decimal, xHEX, 0xHEX, bBINARY or a plain decimal.
+ *
+ * @return True if the whole token is a number.
+ */
+static bool ParseNumber(const std::string& token, int32_t* value)
+{
+    const char* text = token.c_str();
+    int base = 10;
+    bool negative = false;
+
+    if (*text == '#')
+    {
+        ++text;
+    }
+    if (*text == '-')
+    {
+        negative = true;
+        ++text;
+    }
+    if ((*text == 'x' || *text == 'X') && text[1])
+    {
+        base = 16;
+        ++text;
+    }
+    else if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X') && text[2])
+    {
+        base = 16;
+        text += 2;
+    }
+    else if ((*text == 'b' || *text == 'B') && text[1])
+    {
+        base = 2;
+        ++text;
+    }
+    if (*text == '\0' || *text == '-' || *text == '+')
+    {
+        return false;
+    }
+
+    char* end;
+    long parsed = strtol(text, &end, base);
+    if (*end != '\0' || parsed > 0xFFFF)
+    {
+        return false;
+    }
+    *value = negative ? -(int32_t)parsed : (int32_t)parsed;
+    return true;
+}
+
+
+/**
+ * @brief Records an error for a source line.
+ *
+ * @return 0, for callers to return.
+ */
+int Assembler::Fail(uint32_t line, const std::string& message)
+{
+    error = "line " + std::to_string(line) + ": " + message;
+    return 0;
+}
+
+
+/**
+ * @brief Splits the source into lines of label, operation and operands, dropping comments.
+ *
+ * @return 1 on success, 0 with Error set on a malformed line.
+ */
+int Assembler::Parse(const std::string& source)
+{
+    lines.clear();
+
+    size_t start = 0;
+    uint32_t number = 0;
+    while (start <= source.size())
+    {
+        size_t end = source.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = source.size();
+        }
+        std::string text = source.substr(start, end - start);
+        start = end + 1;
+        ++number;
+
+        // Tokens are separated by whitespace and commas; a quoted string is one token
+        std::vector<std::string> tokens;
+        size_t i = 0;
+        while (i < text.size())
+        {
+            char c = text[i];
+            if (c == ';')
+            {
+                break;
+            }
+            if (isspace((unsigned char)c) || c == ',')
+            {
+                ++i;
+                continue;
+            }
+
+            size_t first = i;
+            if (c == '"')
+            {
+                for (++i; i < text.size() && text[i] != '"'; ++i)
+                {
+                    if (text[i] == '\\')
+                    {
+                        ++i;
+                    }
+                }
+                if (i >= text.size())
+                {
+                    return Fail(number, "unterminated string");
+                }
+                ++i;
+            }
+            else
+            {
+                while (i < text.size() && !isspace((unsigned char)text[i]) && text[i] != ',' && text[i] != ';')
+                {
+                    ++i;
+                }
+            }
+            tokens.push_back(text.substr(first, i - first));
+        }
+
+        if (tokens.empty())
+        {
+            continue;
+        }
+
+        AssemblyLine line;
+        line.number = number;
+        size_t next = 0;
+        if (!IsOperation(Upper(tokens[0])))
+        {
+            line.label = tokens[0];
+            next = 1;
+        }
+        if (next < tokens.size())
+        {
+            line.operation = Upper(tokens[next]);
+            if (!IsOperation(line.operation))
+            {
+                return Fail(number, "unknown operation " + tokens[next]);
+            }
+            line.operands.assign(tokens.begin() + next + 1, tokens.end());
+        }
+        lines.push_back(line);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Returns the number of words a line occupies.
+ *
+ * @return 1 on success, 0 with Error set if a directive's operand is invalid.
+ */
+int Assembler::Size(const AssemblyLine& line, uint32_t* size)
+{
+    *size = 1;
+    if (line.operation.empty())
+    {
+        *size = 0;
+    }
+    else if (line.operation == ".BLKW")
+    {
+        int32_t count;
+        if (line.operands.size() != 1 && line.operands.size() != 2)
+        {
+            return Fail(line.number, ".BLKW takes a count and an optional fill value");
+        }
+        if (!Number(line, 0, 1, 0xFFFF, &count))
+        {
+            return 0;
+        }
+        *size = (uint32_t)count;
+    }
+    else if (line.operation == ".STRINGZ")
+    {
+        if (!Operands(line, 1) || line.operands[0][0] != '"')
+        {
+            return Fail(line.number, ".STRINGZ needs a quoted string");
+        }
+
+        // Characters between the quotes, counting escapes once, plus the terminator
+        const std::string& text = line.operands[0];
+        *size = 1;
+        for (size_t i = 1; i + 1 < text.size(); ++i)
+        {
+            if (text[i] == '\\')
+            {
+                ++i;
+            }
+            ++*size;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Checks that a line has exactly count operands.
+ */
+int Assembler::Operands(const AssemblyLine& line, size_t count)
+{
+    if (line.operands.size() != count)
+    {
+        return Fail(line.number, line.operation + " takes " + std::to_string(count) + " operands");
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Parses a register operand R0-R7.
+ */
+int Assembler::Register(const AssemblyLine& line, size_t operand, uint16_t* value)
+{
+    const std::string& token = line.operands[operand];
+    if (token.size() != 2 || (token[0] != 'R' && token[0] != 'r') || token[1] < '0' || token[1] > '7')
+    {
+        return Fail(line.number, "expected a register, found " + token);
+    }
+    *value = (uint16_t)(token[1] - '0');
+    return 1;
+}
+
+
+/**
+ * @brief Parses a numeric operand, or a label for its address, and checks its range.
+ */
+int Assembler::Number(const AssemblyLine& line, size_t operand, int32_t low, int32_t high, int32_t* value)
+{
+    const std::string& token = line.operands[operand];
+    if (!ParseNumber(token, value))
+    {
+        auto label = labels.find(token);
+        if (label == labels.end())
+        {
+            return Fail(line.number, "undefined label " + token);
+        }
+        *value = label->second;
+    }
+
+    if (*value < low || *value > high)
+    {
+        return Fail(line.number, token + " is out of range");
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Encodes a PC-relative operand: a label, or a number taken as the offset itself.
+ *
+ * @param address The address of the instruction.
+ * @param bits Width of the offset field.
+ */
+int Assembler::Offset(const AssemblyLine& line, size_t operand, uint16_t address, int bits, uint16_t* value)
+{
+    const std::string& token = line.operands[operand];
+    int32_t offset;
+    if (!ParseNumber(token, &offset))
+    {
+        auto label = labels.find(token);
+        if (label == labels.end())
+        {
+            return Fail(line.number, "undefined label " + token);
+        }
+        offset = (int32_t)label->second - (int32_t)(uint16_t)(address + 1);
+    }
+
+    int32_t limit = 1 << (bits - 1);
+    if (offset < -limit || offset >= limit)
+    {
+        return Fail(line.number, token + " is out of reach of a " + std::to_string(bits) + "-bit offset");
+    }
+    *value = (uint16_t)(offset & ((1 << bits) - 1));
+    return 1;
+}
+
+
+/**
+ * @brief Encodes a line into words appended at the given address.
+ *
+ * @return 1 on success, 0 with Error set on an invalid operand.
+ */
+int Assembler::Encode(const AssemblyLine& line, uint16_t address)
+{
+    const std::string& op = line.operation;
+    uint16_t dr, sr1, sr2, offset;
+    int32_t value;
+
+    if (op.empty() || op == ".ORIG" || op == ".END")
+    {
+        return 1;
+    }
+
+    if (op == ".FILL")
+    {
+        if (!Operands(line, 1) || !Number(line, 0, -0x8000, 0xFFFF, &value))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)value);
+        return 1;
+    }
+    if (op == ".BLKW")
+    {
+        int32_t count;
+        int32_t fill = 0;
+        if (!Number(line, 0, 1, 0xFFFF, &count) || (line.operands.size() == 2 && !Number(line, 1, -0x8000, 0xFFFF, &fill)))
+        {
+            return 0;
+        }
+        words.insert(words.end(), (size_t)count, (uint16_t)fill);
+        return 1;
+    }
+    if (op == ".STRINGZ")
+    {
+        const std::string& text = line.operands[0];
+        for (size_t i = 1; i + 1 < text.size(); ++i)
+        {
+            char c = text[i];
+            if (c == '\\')
+            {
+                switch (text[++i])
+                {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'e': c = 27; break;
+                case '0': c = 0; break;
+                default: c = text[i]; break;
+                }
+            }
+            words.push_back((uint16_t)(uint8_t)c);
+        }
+        words.push_back(0);
+        return 1;
+    }
+
+    for (const auto& entry : arithmetic)
+    {
+        if (op == entry.name)
+        {
+            if (!Operands(line, 3) || !Register(line, 0, &dr) || !Register(line, 1, &sr1))
+            {
+                return 0;
+            }
+            uint16_t word = (uint16_t)((entry.opcode << 12) | (dr << 9) | (sr1 << 6));
+            const std::string& last = line.operands[2];
+            if ((last[0] == 'R' || last[0] == 'r') && last.size() == 2)
+            {
+                if (!Register(line, 2, &sr2))
+                {
+                    return 0;
+                }
+                word |= sr2;
+            }
+            else
+            {
+                if (!Number(line, 2, -16, 15, &value))
+                {
+                    return 0;
+                }
+                word |= 0x0020 | (value & 0x001F);
+            }
+            words.push_back(word);
+            return 1;
+        }
+    }
+
+    for (const auto& entry : pcRelative)
+    {
+        if (op == entry.name)
+        {
+            if (!Operands(line, 2) || !Register(line, 0, &dr) || !Offset(line, 1, address, 9, &offset))
+            {
+                return 0;
+            }
+            words.push_back((uint16_t)((entry.opcode << 12) | (dr << 9) | offset));
+            return 1;
+        }
+    }
+
+    for (const auto& entry : traps)
+    {
+        if (op == entry.name)
+        {
+            if (!Operands(line, 0))
+            {
+                return 0;
+            }
+            words.push_back((uint16_t)((OP_TRAP << 12) | entry.vector));
+            return 1;
+        }
+    }
+
+    int conditions = BranchConditions(op);
+    if (conditions >= 0)
+    {
+        if (!Operands(line, 1) || !Offset(line, 0, address, 9, &offset))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)((OP_BR << 12) | (conditions << 9) | offset));
+        return 1;
+    }
+
+    if (op == "NOT")
+    {
+        if (!Operands(line, 2) || !Register(line, 0, &dr) || !Register(line, 1, &sr1))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)((OP_NOT << 12) | (dr << 9) | (sr1 << 6) | 0x003F));
+    }
+    else if (op == "JMP" || op == "JSRR")
+    {
+        if (!Operands(line, 1) || !Register(line, 0, &sr1))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)(((op == "JMP" ? OP_JMP : OP_JSR) << 12) | (sr1 << 6)));
+    }
+    else if (op == "RET")
+    {
+        if (!Operands(line, 0))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)((OP_JMP << 12) | (Registers::R_7 << 6)));
+    }
+    else if (op == "JSR")
+    {
+        if (!Operands(line, 1) || !Offset(line, 0, address, 11, &offset))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)((OP_JSR << 12) | 0x0800 | offset));
+    }
+    else if (op == "LDR" || op == "STR")
+    {
+        if (!Operands(line, 3) || !Register(line, 0, &dr) || !Register(line, 1, &sr1) || !Number(line, 2, -32, 31, &value))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)(((op == "LDR" ? OP_LDR : OP_STR) << 12) | (dr << 9) | (sr1 << 6) | (value & 0x003F)));
+    }
+    else if (op == "TRAP")
+    {
+        if (!Operands(line, 1) || !Number(line, 0, 0, 0xFF, &value))
+        {
+            return 0;
+        }
+        words.push_back((uint16_t)((OP_TRAP << 12) | value));
+    }
+    else if (op == "RTI" || op == "NOP")
+    {
+        if (!Operands(line, 0))
+        {
+            return 0;
+        }
+        words.push_back(op == "RTI" ? (uint16_t)(OP_RTI << 12) : 0);
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Assembles a program from source text.
+ *
+ * The first pass assigns an address to every label, the second encodes the words.
+ *
+ * @param source The program, starting with .ORIG and ending with .END.
+ * @return 1 on success, 0 with Error describing the first problem found.
+ */
+int Assembler::Assemble(const std::string& source)
+{
+    labels.clear();
+    words.clear();
+    error.clear();
+
+    if (!Parse(source))
+    {
+        return 0;
+    }
+
+    size_t first = 0;
+    while (first < lines.size() && lines[first].operation.empty())
+    {
+        ++first;
+    }
+    if (first == lines.size() || lines[first].operation != ".ORIG" || !lines[first].label.empty())
+    {
+        return Fail(first < lines.size() ? lines[first].number : 1, "the program must start with .ORIG");
+    }
+
+    int32_t value;
+    if (!Operands(lines[first], 1) || !Number(lines[first], 0, 0, 0xFFFF, &value))
+    {
+        return 0;
+    }
+    origin = (uint16_t)value;
+
+    // First pass: addresses of labels
+    uint32_t address = origin;
+    size_t last = first + 1;
+    for (; last < lines.size() && lines[last].operation != ".END"; ++last)
+    {
+        const AssemblyLine& line = lines[last];
+        if (line.operation == ".ORIG")
+        {
+            return Fail(line.number, "only one .ORIG is supported per program");
+        }
+        if (!line.label.empty())
+        {
+            int32_t ignored;
+            if (!labels.emplace(line.label, (uint16_t)address).second || ParseNumber(line.label, &ignored))
+            {
+                return Fail(line.number, "label " + line.label + " is defined twice or looks like a number");
+            }
+        }
+
+        uint32_t size;
+        if (!Size(line, &size))
+        {
+            return 0;
+        }
+        address += size;
+        if (address > MEMORY_MAX)
+        {
+            return Fail(line.number, "the program does not fit in memory");
+        }
+    }
+
+    // Second pass: encoding
+    address = origin;
+    for (size_t i = first + 1; i < last; ++i)
+    {
+        if (!Encode(lines[i], (uint16_t)address))
+        {
+            return 0;
+        }
+        address = origin + (uint32_t)words.size();
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Assembles a program from a source file.
+ *
+ * @param path Path of the assembly source.
+ * @return 1 on success, 0 with Error set if the file cannot be read or does not assemble.
+ */
+int Assembler::AssembleFile(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        error = std::string("cannot open ") + path;
+        return 0;
+    }
+
+    std::string source;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        source.append(buffer, read);
+    }
+    fclose(file);
+
+    // Sources written on Windows end their lines with CR LF
+    std::string text;
+    text.reserve(source.size());
+    for (char c : source)
+    {
+        if (c != '\r')
+        {
+            text.push_back(c);
+        }
+    }
+
+    return Assemble(text);
+}
+
+
+/**
+ * @brief Writes the assembled program as an image: the origin, then each word, all big-endian.
+ *
+ * @param path Path of the image file to write.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int Assembler::SaveImage(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve((words.size() + 1) * 2);
+    bytes.push_back((uint8_t)(origin >> 8));
+    bytes.push_back((uint8_t)origin);
+    for (uint16_t word : words)
+    {
+        bytes.push_back((uint8_t)(word >> 8));
+        bytes.push_back((uint8_t)word);
+    }
+
+    size_t written = fwrite(bytes.data(), 1, bytes.size(), file);
+    return fclose(file) == 0 && written == bytes.size();
+}
+
+
+/**
+ * @brief Writes the labels as an lc3as symbol table, which --symbols reads back.
+ *
+ * @param path Path of the symbol file to write.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int Assembler::SaveSymbols(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fprintf(file, "// Symbol table\n// Scope level 0:\n//\tSymbol Name       Page Address\n//\t----------------  ------------\n");
+    for (const auto& label : labels)
+    {
+        fprintf(file, "//\t%-16s  %04X\n", label.first.c_str(), label.second);
+    }
+    fprintf(file, "\n");
+
+    int written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+
+/**
+ * @brief Returns the address the program is loaded at.
+ */
+uint16_t Assembler::Origin() const
+{
+    return origin;
+}
+
+
+/**
+ * @brief Returns the assembled words.
+ */
+const std::vector<uint16_t>& Assembler::Words() const
+{
+    return words;
+}
+
+
+/**
+ * @brief Returns the description of the last failure, prefixed with its source line.
+ */
+const std::string& Assembler::Error() const
+{
+    return error;
+}
\ No newline at end of file
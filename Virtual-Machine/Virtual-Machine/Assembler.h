@@ -0,0 +1,65 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// One source line split into its label, operation and operands.
+struct AssemblyLine
+{
+    uint32_t number;
+    std::string label;
+    std::string operation;
+    std::vector<std::string> operands;
+};
+
+
+// Two-pass assembler for LC-3 assembly in the syntax of lc3as: labels, the instructions with their
+// BR, RET, JSRR and trap aliases, and the .ORIG, .FILL, .BLKW, .STRINGZ and .END directives.
+// It produces the big-endian origin-plus-words image CPU::ReadImageFile loads.
+class Assembler
+{
+private:
+    std::vector<AssemblyLine> lines;
+    std::map<std::string, uint16_t> labels;
+
+    uint16_t origin = 0;
+    std::vector<uint16_t> words;
+    std::string error;
+
+    int Fail(uint32_t line, const std::string& message);
+    int Parse(const std::string& source);
+    int Size(const AssemblyLine& line, uint32_t* size);
+    int Encode(const AssemblyLine& line, uint16_t address);
+
+    int Register(const AssemblyLine& line, size_t operand, uint16_t* value);
+    int Number(const AssemblyLine& line, size_t operand, int32_t low, int32_t high, int32_t* value);
+    int Offset(const AssemblyLine& line, size_t operand, uint16_t address, int bits, uint16_t* value);
+    int Operands(const AssemblyLine& line, size_t count);
+
+public:
+    int Assemble(const std::string& source);
+    int AssembleFile(const char* path);
+
+    int SaveImage(const char* path) const;
+    int SaveSymbols(const char* path) const;
+
+    uint16_t Origin() const;
+    const std::vector<uint16_t>& Words() const;
+    const std::string& Error() const;
+};
+#endif
\ No newline at end of file
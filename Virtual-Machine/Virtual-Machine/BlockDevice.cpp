@@ -0,0 +1,210 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include "BlockDevice.h"
+#include "MemoryIO.h"
+
+#include <algorithm>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+// windows only
+#include <Windows.h>
+#endif
+
+
+/**
+ * @brief Constructs a block device without a file, which reports itself as not ready.
+ *
+ * @param memoryIO Pointer to the MemoryIO object transfers copy words through.
+ */
+BlockDevice::BlockDevice(MemoryIO* memoryIO)
+{
+    memoryIOPtr = memoryIO;
+}
+
+
+/**
+ * @brief Unmaps the file, leaving the words written to it in place.
+ */
+BlockDevice::~BlockDevice()
+{
+#if defined(__linux__)
+    if (wordsPtr)
+    {
+        munmap(wordsPtr, mappedBytes);
+    }
+#else
+    if (wordsPtr)
+    {
+        UnmapViewOfFile(wordsPtr);
+    }
+    if (mappingHandle)
+    {
+        CloseHandle((HANDLE)mappingHandle);
+    }
+    if (fileHandle)
+    {
+        CloseHandle((HANDLE)fileHandle);
+    }
+#endif
+}
+
+
+/**
+ * @brief Maps an existing file for reading and writing as the device's blocks.
+ *
+ * Bytes after the last whole block, and blocks the block register cannot address, are left out.
+ *
+ * @param path The file.
+ * @return 1 on success, 0 if the file cannot be opened or mapped or holds no whole block.
+ */
+int BlockDevice::Open(const char* path)
+{
+    const size_t blockBytes = BD_BLOCK_WORDS * sizeof(uint16_t);
+
+#if defined(__linux__)
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) == 0)
+    {
+        size_t blocks = std::min<size_t>((size_t)fileStatus.st_size / blockBytes, BD_MAX_BLOCKS);
+        if (blocks > 0)
+        {
+            void* view = mmap(nullptr, blocks * blockBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                wordsPtr = (uint16_t*)view;
+                mappedBytes = blocks * blockBytes;
+                blockCount = (uint32_t)blocks;
+            }
+        }
+    }
+    // The mapping keeps the file open
+    close(fd);
+#else
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size))
+    {
+        size_t blocks = std::min<size_t>((size_t)size.QuadPart / blockBytes, BD_MAX_BLOCKS);
+        if (blocks > 0)
+        {
+            uint64_t bytes = blocks * blockBytes;
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+            if (mapping)
+            {
+                mappingHandle = mapping;
+                void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)bytes);
+                if (view)
+                {
+                    wordsPtr = (uint16_t*)view;
+                    mappedBytes = (size_t)bytes;
+                    blockCount = (uint32_t)blocks;
+                }
+            }
+        }
+    }
+#endif
+
+    status = wordsPtr ? BD_READY : 0;
+    return wordsPtr != nullptr;
+}
+
+
+/**
+ * @brief Returns the number of blocks of the device, 0 without a file.
+ */
+uint32_t BlockDevice::BlockCount() const
+{
+    return blockCount;
+}
+
+
+/**
+ * @brief Returns the value of the status register: BD_READY once a file is mapped, and BD_ERROR after a failed command.
+ */
+uint16_t BlockDevice::Status() const
+{
+    return status;
+}
+
+
+/**
+ * @brief Runs a command written to the command register, with the other registers' values.
+ *
+ * The range of words must lie within the device, starting at the beginning of the block, and within
+ * memory below the device registers; otherwise nothing is copied and the error bit is set.
+ *
+ * @param command A BlockDeviceCommands value.
+ * @param block The first block of the transfer.
+ * @param address The first memory address of the transfer.
+ * @param count Number of words to copy.
+ */
+void BlockDevice::Execute(uint16_t command, uint16_t block, uint16_t address, uint16_t count)
+{
+    if (!wordsPtr)
+    {
+        return;
+    }
+
+    uint32_t first = block * BD_BLOCK_WORDS;
+    bool fits = first + count <= blockCount * BD_BLOCK_WORDS &&
+        (uint32_t)address + count <= MemoryMappedRegisters::MR_DEVICES;
+
+    if (fits && command == BD_READ)
+    {
+        memoryIOPtr->WriteWords(address, wordsPtr + first, count);
+        wordsRead += count;
+    }
+    else if (fits && command == BD_WRITE)
+    {
+        memoryIOPtr->ReadWords(address, wordsPtr + first, count);
+        wordsWritten += count;
+    }
+    else
+    {
+        ++errors;
+        status = BD_READY | BD_ERROR;
+        return;
+    }
+
+    ++transfers;
+    status = BD_READY;
+}
+
+
+/**
+ * @brief Prints the size of the device and the words transferred.
+ *
+ * @param out The stream to print to.
+ */
+void BlockDevice::Report(FILE* out) const
+{
+    fprintf(out, "block device: %u blocks, %llu transfers, %llu words read, %llu words written, %llu failed commands\n",
+        blockCount, (unsigned long long)transfers, (unsigned long long)wordsRead, (unsigned long long)wordsWritten,
+        (unsigned long long)errors);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+
+class MemoryIO;
+
+
+enum BlockDeviceCommands : uint16_t
+{
+    BD_READ = 1, // copy words from the device into memory
+    BD_WRITE = 2 // copy words from memory onto the device
+};
+
+
+enum BlockDeviceStatus : uint16_t
+{
+    BD_READY = (1 << 15), // a device is attached; transfers complete before the command write returns
+    BD_ERROR = (1 << 14)  // the last command was unknown or its range did not fit the device or memory
+};
+
+
+enum BlockDeviceLimits : uint32_t
+{
+    // Words per block; a block is 512 bytes of the file.
+    BD_BLOCK_WORDS = 256,
+
+    // Most blocks addressable by the 16-bit block register.
+    BD_MAX_BLOCKS = 1 << 16
+};
+
+
+// Disk backed by a host file mapped into memory, read and written in whole words by DMA-style
+// transfers: the program sets a block number, a memory address and a word count in the device
+// registers, then writes a command, and the words are copied between the mapping and memory in
+// one operation. Words are kept in host byte order, so on x86 and ARM the file is little-endian.
+// Changes reach the file through the shared mapping.
+class BlockDevice
+{
+private:
+    MemoryIO* memoryIOPtr;
+
+    uint16_t* wordsPtr = nullptr;
+    size_t mappedBytes = 0;
+    uint32_t blockCount = 0;
+    uint16_t status = 0;
+
+#if !defined(__linux__)
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+    uint64_t transfers = 0;
+    uint64_t wordsRead = 0;
+    uint64_t wordsWritten = 0;
+    uint64_t errors = 0;
+
+public:
+    BlockDevice(MemoryIO* memoryIO);
+    ~BlockDevice();
+
+    int Open(const char* path);
+    uint32_t BlockCount() const;
+    uint16_t Status() const;
+    void Execute(uint16_t command, uint16_t block, uint16_t address, uint16_t count);
+    void Report(FILE* out) const;
+};
+#endif
\ No newline at end of file
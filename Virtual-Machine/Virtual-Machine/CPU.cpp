@@ -12,6 +12,7 @@ Copyright 
 
 
 #include <iostream>
+#include <cstring>
 
 
 #include "Trap.h"
@@ -19,6 +20,7 @@ Copyright 
 #include "ArithmeticLogicUnit.h"
 #include "OS.h"
 #include "CPU.h"
+#include "ObjectFile.h"
 
 
 /**
@@ -29,6 +31,10 @@ Copyright 
  */
 CPU::CPU()
 {
+    // Start from cleared registers and memory so runs of the same image are reproducible
+    memset(registers, 0, sizeof(registers));
+    memset(memory, 0, sizeof(memory));
+
     // Set the default condition flag to zero
     registers[Registers::R_COND] = ConditionFlags::FL_ZERO;
 
@@ -105,6 +111,9 @@ void CPU::ReadImageFile(FILE* file, ArithmeticLogicUnit* alu)
     // Read the contents of the file into memory
     size_t read = fread(p, sizeof(uint16_t), maxRead, file);
 
+    // Remember which range of memory the image occupies
+    segments.push_back({ origin, (uint32_t)read });
+
     // Convert each read value to little endian format
     while (read-- > 0)
     {
@@ -118,6 +127,7 @@ void CPU::ReadImageFile(FILE* file, ArithmeticLogicUnit* alu)
  * @brief Opens the specified image file and reads its contents into memory.
  *
  * This function opens the image file specified by the provided path and reads its contents into memory.
+ * Extended object files, recognized by their magic, are handed to ObjectFile; anything else is a plain image.
  *
  * @param imagePath The path to the image file to be read.
  * @return Returns 1 if the image file was successfully read into memory, 0 otherwise.
@@ -133,6 +143,16 @@ int CPU::ReadImage(const char* imagePath, ArithmeticLogicUnit* alu)
         return 0;
     }
 
+    uint8_t prefix[4];
+    size_t prefixSize = fread(prefix, 1, sizeof(prefix), file);
+    if (ObjectFile::IsExtended(prefix, prefixSize))
+    {
+        fclose(file);
+        ObjectFile objectFile(this);
+        return objectFile.Load(imagePath);
+    }
+    rewind(file);
+
     // Call the ReadImageFile function to read the contents of the image file into memory
     ReadImageFile(file, alu);
 
@@ -141,4 +161,27 @@ int CPU::ReadImage(const char* imagePath, ArithmeticLogicUnit* alu)
 
     // Return 1 to indicate that the image file was successfully read into memory
     return 1;
+}
+
+
+/**
+ * @brief Finds the symbol at or closest below an address.
+ *
+ * @param address The address to describe.
+ * @param name Receives the symbol name.
+ * @param offset Receives the distance of the address from the symbol.
+ * @return True if a symbol was found.
+ */
+bool CPU::FindSymbol(uint16_t address, const std::string** name, uint16_t* offset) const
+{
+    auto symbol = symbols.upper_bound(address);
+    if (symbol == symbols.begin())
+    {
+        return false;
+    }
+    --symbol;
+
+    *name = &symbol->second;
+    *offset = (uint16_t)(address - symbol->first);
+    return true;
 }
\ No newline at end of file
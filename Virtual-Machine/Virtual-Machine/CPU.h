@@ -16,6 +16,10 @@ Copyright 
 // The maximum memory size is specified as 128 kilobytes (KB).
 #define MEMORY_MAX (1 << 16)
 
+// Memory is tracked in pages of 256 words where whole ranges matter, e.g. for dirty-page snapshots.
+#define PAGE_SHIFT 8
+#define PAGE_COUNT (MEMORY_MAX >> PAGE_SHIFT)
+
 // Virtual Machine includes total number of 10 registers.
 #define REGISTER_COUNT 10
 
@@ -28,6 +32,9 @@ Copyright 
 // windows only
 #include <Windows.h>
 #include <conio.h>  // _kbhit
+#include <map>
+#include <string>
+#include <vector>
 
 
 class Trap;
@@ -74,6 +81,14 @@ enum PC : uint16_t
 };
 
 
+// A contiguous range of memory filled from an image file.
+struct ImageSegment
+{
+    uint16_t origin;
+    uint32_t length;
+};
+
+
 class CPU
 {
 public:
@@ -89,6 +104,15 @@ public:
     // Boolean flag to control the execution state of the Virtual Machine.
     int running = 1;
 
+    // Number of instructions retired since start-up. Drives the virtual timer.
+    uint64_t instructionCount = 0;
+
+    // Memory ranges filled by the image files, in load order.
+    std::vector<ImageSegment> segments;
+
+    // Symbol names by address, from extended object files or symbol tables.
+    std::map<uint16_t, std::string> symbols;
+
 public:
 	CPU();
     ~CPU();
@@ -97,5 +121,6 @@ public:
 
     void ReadImageFile(FILE* file, ArithmeticLogicUnit* alu);
     int ReadImage(const char* imagePath, ArithmeticLogicUnit* alu);
+    bool FindSymbol(uint16_t address, const std::string** name, uint16_t* offset) const;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include "CacheModel.h"
+
+
+/**
+ * @brief Constructs an empty cache; the geometry must pass IsValid.
+ *
+ * @param sizeBytes Capacity in bytes.
+ * @param ways Lines per set.
+ * @param lineBytes Line size in bytes.
+ */
+CacheModel::CacheModel(uint32_t sizeBytes, uint32_t ways, uint32_t lineBytes)
+{
+    this->sizeBytes = sizeBytes;
+    this->ways = ways;
+    this->lineBytes = lineBytes;
+
+    while ((1u << lineShift) < lineBytes)
+    {
+        ++lineShift;
+    }
+    setCount = sizeBytes / (ways * lineBytes);
+
+    tags.assign((size_t)setCount * ways, 0);
+    lastUse.assign((size_t)setCount * ways, 0);
+}
+
+
+/**
+ * @brief Checks that a geometry describes a cache this model can simulate.
+ *
+ * The line size and the number of sets must be powers of two; the associativity need not be.
+ *
+ * @return True if the geometry is usable.
+ */
+bool CacheModel::IsValid(uint32_t sizeBytes, uint32_t ways, uint32_t lineBytes)
+{
+    if (ways == 0 || lineBytes < 2 || (lineBytes & (lineBytes - 1)) != 0)
+    {
+        return false;
+    }
+
+    uint64_t setBytes = (uint64_t)ways * lineBytes;
+    if (sizeBytes == 0 || sizeBytes % setBytes != 0)
+    {
+        return false;
+    }
+
+    uint64_t sets = sizeBytes / setBytes;
+    return (sets & (sets - 1)) == 0;
+}
+
+
+/**
+ * @brief Looks up a byte address, filling its line on a miss.
+ *
+ * @param byteAddress The address accessed.
+ * @param kind The AccessKinds kind of access, counted separately.
+ * @return True on a hit.
+ */
+bool CacheModel::Access(uint32_t byteAddress, uint8_t kind)
+{
+    uint32_t line = byteAddress >> lineShift;
+    uint32_t* set = &tags[(size_t)(line & (setCount - 1)) * ways];
+    uint64_t* uses = &lastUse[(size_t)(line & (setCount - 1)) * ways];
+    ++clock;
+
+    uint32_t victim = 0;
+    for (uint32_t way = 0; way < ways; ++way)
+    {
+        if (set[way] == line + 1)
+        {
+            uses[way] = clock;
+            ++hits[kind];
+            return true;
+        }
+        if (uses[way] < uses[victim])
+        {
+            victim = way;
+        }
+    }
+
+    // Empty ways were last used at 0, so they are filled before anything is evicted
+    set[victim] = line + 1;
+    uses[victim] = clock;
+    ++misses[kind];
+    return false;
+}
+
+
+/**
+ * @brief Returns the line size in bytes.
+ */
+uint32_t CacheModel::LineBytes() const
+{
+    return lineBytes;
+}
+
+
+/**
+ * @brief Returns the number of hits of every kind so far.
+ */
+uint64_t CacheModel::Hits() const
+{
+    return hits[AK_FETCH] + hits[AK_READ] + hits[AK_WRITE];
+}
+
+
+/**
+ * @brief Returns the number of misses of every kind so far.
+ */
+uint64_t CacheModel::Misses() const
+{
+    return misses[AK_FETCH] + misses[AK_READ] + misses[AK_WRITE];
+}
+
+
+/**
+ * @brief Prints the geometry and the hit rate of each kind of access.
+ *
+ * @param out The stream to print to.
+ */
+void CacheModel::Report(FILE* out) const
+{
+    static const char* kindNames[AK_COUNT] = { "fetch", "read", "write" };
+
+    fprintf(out, "  host cache %u B, %u-way, %u B lines (%u sets):\n", sizeBytes, ways, lineBytes, setCount);
+    for (uint32_t kind = 0; kind < AK_COUNT; ++kind)
+    {
+        uint64_t total = hits[kind] + misses[kind];
+        if (total)
+        {
+            fprintf(out, "    %-6s %6.2f%% hits, %llu misses\n", kindNames[kind],
+                100.0 * hits[kind] / total, (unsigned long long)misses[kind]);
+        }
+    }
+}
\ No newline at end of file
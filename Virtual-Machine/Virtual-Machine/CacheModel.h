@@ -0,0 +1,59 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef CACHE_MODEL_H
+#define CACHE_MODEL_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+enum AccessKinds : uint8_t
+{
+    AK_FETCH = 0, // instruction fetch
+    AK_READ,      // data read
+    AK_WRITE,     // data write
+    AK_COUNT
+};
+
+
+// Set-associative cache with LRU replacement that allocates on reads and writes alike.
+class CacheModel
+{
+private:
+    uint32_t sizeBytes;
+    uint32_t ways;
+    uint32_t lineBytes;
+    uint32_t lineShift = 0;
+    uint32_t setCount;
+
+    // Per set and way: the cached line number plus one, 0 when empty, and when it was last used.
+    std::vector<uint32_t> tags;
+    std::vector<uint64_t> lastUse;
+    uint64_t clock = 0;
+
+    uint64_t hits[AK_COUNT] = {};
+    uint64_t misses[AK_COUNT] = {};
+
+public:
+    CacheModel(uint32_t sizeBytes, uint32_t ways, uint32_t lineBytes);
+
+    static bool IsValid(uint32_t sizeBytes, uint32_t ways, uint32_t lineBytes);
+
+    bool Access(uint32_t byteAddress, uint8_t kind);
+
+    uint32_t LineBytes() const;
+    uint64_t Hits() const;
+    uint64_t Misses() const;
+    void Report(FILE* out) const;
+};
+#endif
\ No newline at end of file
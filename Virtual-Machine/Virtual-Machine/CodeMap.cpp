@@ -0,0 +1,231 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstring>
+
+#include "CodeMap.h"
+#include "ArithmeticLogicUnit.h"
+#include "MemoryIO.h"
+#include "Trap.h"
+
+
+enum CodeMapLimits : uint16_t
+{
+    // Trap vector table entries that may point at service routines loaded with the image.
+    CODE_MAP_TRAP_FIRST = 0x0020,
+    CODE_MAP_TRAP_LAST = 0x00FF
+};
+
+
+/**
+ * @brief Sign-extends the low bits of a value to 16 bits.
+ *
+ * @param value The value holding the field in its low bits.
+ * @param bits Width of the field.
+ * @return The sign-extended value.
+ */
+static uint16_t SignExtend(uint16_t value, int bits)
+{
+    return (uint16_t)((int16_t)(value << (16 - bits)) >> (16 - bits));
+}
+
+
+/**
+ * @brief Constructs a map that treats every page as possibly holding code until Classify runs.
+ *
+ * @param cpu Pointer to the CPU object whose memory and image segments are analyzed.
+ */
+CodeMap::CodeMap(CPU* cpu)
+{
+    cpuPtr = cpu;
+    memset(kinds, PK_UNKNOWN, sizeof(kinds));
+    memset(referenced, 0, sizeof(referenced));
+}
+
+
+/**
+ * @brief Tells whether an address lies in one of the loaded image segments.
+ */
+static bool IsLoaded(const CPU* cpu, uint16_t address)
+{
+    for (const ImageSegment& segment : cpu->segments)
+    {
+        if (address >= segment.origin && (uint32_t)(address - segment.origin) < segment.length)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Follows straight-line code from an address until it ends or joins code already reached.
+ *
+ * Branch and call targets are queued, PC-relative loads and stores mark the pages they reference,
+ * and jumps through a register end the path, as their target is not known before the program runs.
+ *
+ * @param address The first instruction of the path.
+ * @param pending Addresses still to be followed.
+ */
+void CodeMap::Follow(uint16_t address, std::vector<uint16_t>& pending)
+{
+    const uint16_t* memory = cpuPtr->memory;
+    uint16_t pc = address;
+
+    while (pc < MemoryMappedRegisters::MR_DEVICES && !reached[pc])
+    {
+        reached[pc] = 1;
+
+        uint16_t instruction = memory[pc];
+        uint16_t next = pc + 1;
+        uint16_t pcOffset = next + SignExtend(instruction & 0x01FF, 9);
+
+        switch (instruction >> 12)
+        {
+        case OP_BR:
+        {
+            uint16_t condition = (instruction >> 9) & 0x0007;
+            if (condition)
+            {
+                pending.push_back(pcOffset);
+            }
+            if (condition == 0x0007)
+            {
+                return;
+            }
+            break;
+        }
+        case OP_JSR:
+            if ((instruction >> 11) & 0x0001)
+            {
+                pending.push_back(next + SignExtend(instruction & 0x07FF, 11));
+            }
+            break;
+        case OP_LDI:
+        case OP_STI:
+            // The pointer itself is data, and so is what it points to when the image supplies it
+            referenced[pcOffset >> PAGE_SHIFT] = 1;
+            if (IsLoaded(cpuPtr, pcOffset))
+            {
+                referenced[memory[pcOffset] >> PAGE_SHIFT] = 1;
+            }
+            break;
+        case OP_LD:
+        case OP_ST:
+        case OP_LEA:
+            referenced[pcOffset >> PAGE_SHIFT] = 1;
+            break;
+        case OP_JMP:
+        case OP_RTI:
+        case OP_RES:
+            return;
+        case OP_TRAP:
+            if ((instruction & 0x00FF) == TrapCodes::TRAP_HALT)
+            {
+                return;
+            }
+            break;
+        }
+
+        // Never wrap around memory
+        if (next == 0)
+        {
+            return;
+        }
+        pc = next;
+    }
+}
+
+
+/**
+ * @brief Classifies every page of the loaded images, following the code from the entry point.
+ *
+ * Paths start at the program counter and at every trap vector the image fills in. A page holding
+ * an instruction reached this way is code. A page that reached instructions only load from or
+ * store to, or that no image loaded at all, is data. Loaded pages nothing refers to stay unknown:
+ * they may still be reached through a jump table or a computed address.
+ */
+void CodeMap::Classify()
+{
+    reached.assign(MEMORY_MAX, 0);
+    memset(referenced, 0, sizeof(referenced));
+    reclassifiedPages = 0;
+
+    std::vector<uint16_t> pending;
+    pending.push_back(cpuPtr->registers[Registers::R_PC]);
+    for (uint16_t vector = CODE_MAP_TRAP_FIRST; vector <= CODE_MAP_TRAP_LAST; ++vector)
+    {
+        if (IsLoaded(cpuPtr, vector) && cpuPtr->memory[vector] != 0)
+        {
+            pending.push_back(cpuPtr->memory[vector]);
+        }
+    }
+
+    while (!pending.empty())
+    {
+        uint16_t address = pending.back();
+        pending.pop_back();
+        Follow(address, pending);
+    }
+
+    bool loaded[PAGE_COUNT] = {};
+    for (const ImageSegment& segment : cpuPtr->segments)
+    {
+        for (uint32_t address = segment.origin; address < segment.origin + segment.length; ++address)
+        {
+            loaded[address >> PAGE_SHIFT] = true;
+        }
+    }
+
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
+    {
+        const uint8_t* first = reached.data() + (page << PAGE_SHIFT);
+        bool code = memchr(first, 1, 1 << PAGE_SHIFT) != nullptr;
+
+        kinds[page] = code ? PK_CODE : (referenced[page] || !loaded[page]) ? PK_DATA : PK_UNKNOWN;
+    }
+
+    // The analysis is only needed once
+    std::vector<uint8_t>().swap(reached);
+}
+
+
+/**
+ * @brief Turns the data page holding an address into a code page, for the rest of the run.
+ *
+ * @param address The address about to be decoded.
+ */
+void CodeMap::Reclassify(uint16_t address)
+{
+    kinds[address >> PAGE_SHIFT] = PK_CODE;
+    ++reclassifiedPages;
+}
+
+
+/**
+ * @brief Prints how many pages of each kind there are and how many data pages turned out to be code.
+ *
+ * @param out The stream to print to.
+ */
+void CodeMap::Report(FILE* out) const
+{
+    uint32_t counts[3] = {};
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
+    {
+        ++counts[kinds[page]];
+    }
+
+    fprintf(out, "code map: %u code, %u data and %u unknown pages of %u words, %u data pages reclassified as code\n",
+        counts[PK_CODE], counts[PK_DATA], counts[PK_UNKNOWN], 1u << PAGE_SHIFT, reclassifiedPages);
+}
\ No newline at end of file
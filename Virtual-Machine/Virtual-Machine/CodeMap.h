@@ -0,0 +1,76 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef CODE_MAP_H
+#define CODE_MAP_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "CPU.h"
+
+
+enum PageKinds : uint8_t
+{
+    PK_UNKNOWN = 0, // loaded, but neither reached by the analysis nor referenced as data
+    PK_CODE,        // holds instructions reached from the entry point, or decoded since
+    PK_DATA         // only referenced as data, or never loaded at all
+};
+
+
+// Kind of every memory page, worked out once the images are loaded by following the control flow
+// from the entry point. Stores into data pages skip the invalidation of decoded instructions and
+// IR regions, which is only correct as long as nothing on such a page was ever decoded: the decode
+// cache and the IR tier therefore report every address they decode or lift, and a data page seen
+// there becomes a code page for the rest of the run.
+class CodeMap
+{
+private:
+    CPU* cpuPtr;
+
+    uint8_t kinds[PAGE_COUNT];
+
+    // Analysis state: per address, set once reached; per page, set once a load or store refers to it.
+    std::vector<uint8_t> reached;
+    uint8_t referenced[PAGE_COUNT];
+
+    uint32_t reclassifiedPages = 0;
+
+    void Follow(uint16_t address, std::vector<uint16_t>& pending);
+    void Reclassify(uint16_t address);
+
+public:
+    CodeMap(CPU* cpu);
+
+    void Classify();
+    void Report(FILE* out) const;
+
+    /**
+     * @brief Tells whether a store to the address may leave decoded code stale.
+     */
+    bool MayHoldCode(uint16_t address) const
+    {
+        return kinds[address >> PAGE_SHIFT] != PK_DATA;
+    }
+
+    /**
+     * @brief Notes that the word at the address is about to be decoded or lifted as an instruction.
+     */
+    void Execute(uint16_t address)
+    {
+        if (kinds[address >> PAGE_SHIFT] == PK_DATA)
+        {
+            Reclassify(address);
+        }
+    }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,418 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "CycleModel.h"
+#include "ArithmeticLogicUnit.h"
+
+
+// Opcode names accepted by Configure, indexed by opcode.
+static const char* opcodeNames[16] =
+{
+    "br", "add", "ld", "st", "jsr", "and", "ldr", "str", "rti", "not", "ldi", "sti", "jmp", "res", "lea", "trap"
+};
+
+// Default cycles per opcode without memory accesses: the fetch and decode states plus the opcode's
+// own states of the reference LC-3 state machine.
+static const uint32_t defaultOpcodeCycles[16] =
+{
+    4, 4, 5, 5, 5, 4, 5, 5, 4, 4, 6, 6, 4, 4, 4, 5
+};
+
+// Memory accesses per opcode, the instruction fetch included.
+static const uint32_t opcodeAccesses[16] =
+{
+    1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 3, 3, 1, 1, 1, 2
+};
+
+
+/**
+ * @brief Constructs a model with the default costs that has not run anything yet.
+ *
+ * @param cpu Pointer to the CPU object whose memory holds the instructions and whose symbols name routines.
+ */
+CycleModel::CycleModel(CPU* cpu)
+{
+    cpuPtr = cpu;
+    memcpy(opcodeCycles, defaultOpcodeCycles, sizeof(opcodeCycles));
+    memoryCycles = 5;
+    takenCycles = 1;
+    blockStart = PC::PC_START;
+
+    blockIndex.assign(MEMORY_MAX, 0);
+    covered.assign(MEMORY_MAX, 0);
+    routineIndex.assign(MEMORY_MAX, 0);
+}
+
+
+/**
+ * @brief Overrides costs from a comma-separated list such as "mem=3,taken=2,ldi=8".
+ *
+ * Names are the lowercase opcode mnemonics, "mem" for the cycles of one memory access and "taken"
+ * for the extra cycles of a taken branch.
+ *
+ * @param spec The list of overrides, or nullptr to keep the defaults.
+ * @return 1 if every entry was understood, 0 otherwise.
+ */
+int CycleModel::Configure(const char* spec)
+{
+    if (!spec)
+    {
+        return 1;
+    }
+
+    const char* p = spec;
+    while (*p)
+    {
+        char name[8];
+        unsigned int value;
+        int used = 0;
+        if (sscanf(p, "%7[a-z]=%u%n", name, &value, &used) != 2 || used == 0)
+        {
+            return 0;
+        }
+
+        if (strcmp(name, "mem") == 0)
+        {
+            memoryCycles = value;
+        }
+        else if (strcmp(name, "taken") == 0)
+        {
+            takenCycles = value;
+        }
+        else
+        {
+            uint32_t opcode = 0;
+            while (opcode < 16 && strcmp(name, opcodeNames[opcode]) != 0)
+            {
+                ++opcode;
+            }
+            if (opcode == 16)
+            {
+                return 0;
+            }
+            opcodeCycles[opcode] = value;
+        }
+
+        p += used;
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Starts the first block and routine at the program counter, once the images are loaded.
+ */
+void CycleModel::Start()
+{
+    blockStart = cpuPtr->registers[Registers::R_PC];
+    stack[0] = Routine(blockStart);
+    routines[stack[0]].calls = 1;
+    depth = 1;
+    started = true;
+}
+
+
+/**
+ * @brief Charges and records the block executed since the last control transfer, e.g. up to the HALT.
+ */
+void CycleModel::Finish()
+{
+    if (!started)
+    {
+        return;
+    }
+    started = false;
+
+    // The block ends with the last instruction executed, before the program counter
+    uint16_t pc = cpuPtr->registers[Registers::R_PC];
+    if (pc == blockStart)
+    {
+        return;
+    }
+    uint16_t end = pc - 1;
+
+    uint32_t index = blockIndex[blockStart];
+    CycleBlock& block = index && blocks[index - 1].end == end ? blocks[index - 1] : Build(blockStart, end);
+    ++block.executions;
+    block.totalCycles += block.cycles;
+    totalInstructions += block.length;
+    Charge(block.cycles);
+}
+
+
+/**
+ * @brief Returns the cycles one execution of an instruction costs, before any taken branch penalty.
+ */
+uint32_t CycleModel::InstructionCycles(uint16_t instruction) const
+{
+    uint16_t opcode = instruction >> 12;
+    return opcodeCycles[opcode] + opcodeAccesses[opcode] * memoryCycles;
+}
+
+
+/**
+ * @brief Returns the index of the routine entered at an address, adding it on first use.
+ */
+uint32_t CycleModel::Routine(uint16_t entry)
+{
+    if (routineIndex[entry] == 0)
+    {
+        CycleRoutine routine = { entry, 0, 0 };
+        routines.push_back(routine);
+        routineIndex[entry] = (uint32_t)routines.size();
+    }
+    return routineIndex[entry] - 1;
+}
+
+
+/**
+ * @brief Sums the cost of the block from start to end and makes it the block entered at start.
+ *
+ * A block previously entered at start that ended elsewhere, because the code changed, is kept for
+ * the report but no longer used.
+ *
+ * @param start The first instruction of the block.
+ * @param end The control transfer that ended it.
+ * @return The new block.
+ */
+CycleBlock& CycleModel::Build(uint16_t start, uint16_t end)
+{
+    if (blockIndex[start])
+    {
+        Drop(blockIndex[start] - 1);
+    }
+
+    CycleBlock block = {};
+    block.start = start;
+    block.end = end;
+
+    uint16_t address = start;
+    while (true)
+    {
+        block.cycles += InstructionCycles(cpuPtr->memory[address]);
+        ++block.length;
+        ++covered[address];
+        if (address == end)
+        {
+            break;
+        }
+        ++address;
+    }
+
+    uint16_t instruction = cpuPtr->memory[end];
+    switch (instruction >> 12)
+    {
+    case OP_JSR:
+        block.exit = CE_CALL;
+        break;
+    case OP_JMP:
+        block.exit = ((instruction >> 6) & 0x0007) == Registers::R_7 ? CE_RETURN : CE_JUMP;
+        break;
+    default:
+        block.exit = CE_BRANCH;
+        break;
+    }
+
+    blocks.push_back(block);
+    blockIndex[start] = (uint32_t)blocks.size();
+    return blocks.back();
+}
+
+
+/**
+ * @brief Adds cycles to the total and to the routine executing now.
+ */
+void CycleModel::Charge(uint64_t cycles)
+{
+    totalCycles += cycles;
+    if (depth)
+    {
+        routines[stack[depth - 1]].selfCycles += cycles;
+    }
+}
+
+
+/**
+ * @brief Follows a call into the routine at target, or a return out of the current one.
+ */
+void CycleModel::Exit(const CycleBlock& block, uint16_t target)
+{
+    if (block.exit == CE_CALL)
+    {
+        uint32_t routine = Routine(target);
+        ++routines[routine].calls;
+        if (depth < CYCLE_MAX_DEPTH)
+        {
+            stack[depth++] = routine;
+        }
+        else
+        {
+            ++untrackedCalls;
+        }
+    }
+    else if (block.exit == CE_RETURN)
+    {
+        if (untrackedCalls)
+        {
+            --untrackedCalls;
+        }
+        else if (depth > 1)
+        {
+            --depth;
+        }
+    }
+}
+
+
+/**
+ * @brief Stops using the blocks that hold a word written since, so their cost is summed again.
+ *
+ * @param address The address that was written.
+ */
+void CycleModel::Invalidate(uint16_t address)
+{
+    if (covered[address] == 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < blocks.size(); ++i)
+    {
+        const CycleBlock& block = blocks[i];
+        if (blockIndex[block.start] == i + 1 && (uint16_t)(address - block.start) < block.length)
+        {
+            Drop(i);
+        }
+    }
+}
+
+
+/**
+ * @brief Stops entering a block at its start, keeping its counts for the report.
+ */
+void CycleModel::Drop(uint32_t index)
+{
+    const CycleBlock& block = blocks[index];
+    blockIndex[block.start] = 0;
+
+    uint16_t word = block.start;
+    for (uint32_t n = 0; n < block.length; ++n)
+    {
+        --covered[word++];
+    }
+}
+
+
+/**
+ * @brief Prints the estimated cycles, the routines that took them and the hottest blocks.
+ *
+ * @param out The stream to print to.
+ */
+void CycleModel::Report(FILE* out) const
+{
+    fprintf(out, "cycle model: %llu cycles for %llu instructions, %.2f per instruction (memory access %u, taken branch %u)\n",
+        (unsigned long long)totalCycles, (unsigned long long)totalInstructions,
+        totalInstructions ? (double)totalCycles / totalInstructions : 0.0, memoryCycles, takenCycles);
+    if (totalCycles == 0)
+    {
+        return;
+    }
+
+    std::vector<const CycleRoutine*> byRoutine;
+    for (const CycleRoutine& routine : routines)
+    {
+        byRoutine.push_back(&routine);
+    }
+    size_t shown = std::min<size_t>(byRoutine.size(), CYCLE_REPORT_ROWS);
+    std::partial_sort(byRoutine.begin(), byRoutine.begin() + shown, byRoutine.end(),
+        [](const CycleRoutine* a, const CycleRoutine* b) { return a->selfCycles > b->selfCycles; });
+
+    fprintf(out, "  routines by own cycles:\n");
+    for (size_t i = 0; i < shown; ++i)
+    {
+        const CycleRoutine& routine = *byRoutine[i];
+        fprintf(out, "    x%04X %5.1f%%  cycles %llu calls %llu", routine.entry, 100.0 * routine.selfCycles / totalCycles,
+            (unsigned long long)routine.selfCycles, (unsigned long long)routine.calls);
+
+        const std::string* name;
+        uint16_t offset;
+        if (cpuPtr->FindSymbol(routine.entry, &name, &offset))
+        {
+            fprintf(out, offset ? "  %s+%u" : "  %s", name->c_str(), offset);
+        }
+        fprintf(out, "\n");
+    }
+
+    // A block built again after its code was overwritten is listed once, with the passes of every version
+    std::map<uint32_t, CycleBlock> merged;
+    std::map<uint32_t, uint32_t> versions;
+    for (const CycleBlock& block : blocks)
+    {
+        uint32_t range = ((uint32_t)block.start << 16) | block.end;
+        auto found = merged.find(range);
+        if (found == merged.end())
+        {
+            merged[range] = block;
+        }
+        else
+        {
+            found->second.executions += block.executions;
+            found->second.totalCycles += block.totalCycles;
+        }
+        ++versions[range];
+    }
+
+    std::vector<const CycleBlock*> byBlock;
+    for (const auto& entry : merged)
+    {
+        byBlock.push_back(&entry.second);
+    }
+    shown = std::min<size_t>(byBlock.size(), CYCLE_REPORT_ROWS);
+    std::partial_sort(byBlock.begin(), byBlock.begin() + shown, byBlock.end(),
+        [](const CycleBlock* a, const CycleBlock* b) { return a->totalCycles > b->totalCycles; });
+
+    fprintf(out, "  hottest blocks:\n");
+    for (size_t i = 0; i < shown; ++i)
+    {
+        const CycleBlock& block = *byBlock[i];
+        fprintf(out, "    x%04X-x%04X %5.1f%%  cycles %llu passes %llu, %.1f per pass", block.start, block.end,
+            100.0 * block.totalCycles / totalCycles, (unsigned long long)block.totalCycles,
+            (unsigned long long)block.executions, block.executions ? (double)block.totalCycles / block.executions : 0.0);
+
+        uint32_t built = versions[((uint32_t)block.start << 16) | block.end];
+        if (built > 1)
+        {
+            fprintf(out, ", code rewritten %u times", built - 1);
+        }
+
+        const std::string* name;
+        uint16_t offset;
+        if (cpuPtr->FindSymbol(block.start, &name, &offset))
+        {
+            fprintf(out, offset ? "  %s+%u" : "  %s", name->c_str(), offset);
+        }
+        fprintf(out, "\n");
+    }
+}
\ No newline at end of file
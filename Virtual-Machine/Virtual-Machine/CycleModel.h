@@ -0,0 +1,164 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef CYCLE_MODEL_H
+#define CYCLE_MODEL_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "CPU.h"
+
+
+enum CycleExits : uint8_t
+{
+    CE_BRANCH = 0, // BR, which costs extra when taken
+    CE_JUMP,       // JMP through any register but R7
+    CE_CALL,       // JSR or JSRR, entering a routine
+    CE_RETURN      // RET, leaving the routine
+};
+
+
+enum CycleLimits : uint32_t
+{
+    // Calls tracked for attributing cycles to routines; deeper ones are charged to the deepest tracked.
+    CYCLE_MAX_DEPTH = 256,
+
+    // Routines and blocks listed in the report.
+    CYCLE_REPORT_ROWS = 10
+};
+
+
+// Straight-line code from an entry address up to and including the control transfer that ends it.
+struct CycleBlock
+{
+    uint16_t start;
+    uint16_t end;
+    uint8_t exit;         // CycleExits value of the instruction at end
+    uint32_t length;      // instructions
+    uint32_t cycles;      // cost of one pass, without the taken branch penalty
+    uint64_t executions;
+    uint64_t totalCycles;
+};
+
+
+// Routine entered by a call, or the program's entry point.
+struct CycleRoutine
+{
+    uint16_t entry;
+    uint64_t calls;
+    uint64_t selfCycles;
+};
+
+
+// Estimates how many cycles the program would take on LC-3 hardware. Every instruction costs a
+// fixed number of cycles for its opcode plus a configurable number per memory access, counting
+// the fetch, so LDI and STI pay for two data accesses. The default costs are the state counts of
+// the reference LC-3 microarchitecture, with five cycles per memory access.
+//
+// Costs are folded in a block at a time: the cost of each block of straight-line code is summed
+// once, and at every control transfer the block that just ended is charged to the routine on top
+// of a call stack kept from JSR and RET.
+class CycleModel
+{
+private:
+    CPU* cpuPtr;
+
+    // Cycles per opcode without memory accesses, per memory access, and for a taken branch.
+    uint32_t opcodeCycles[16];
+    uint32_t memoryCycles;
+    uint32_t takenCycles;
+
+    // Per address: the index plus one of the block starting there, and blocks covering the word.
+    std::vector<uint32_t> blockIndex;
+    std::vector<uint16_t> covered;
+    std::vector<CycleBlock> blocks;
+
+    std::vector<CycleRoutine> routines;
+    std::vector<uint32_t> routineIndex;
+    uint32_t stack[CYCLE_MAX_DEPTH];
+    uint32_t depth = 0;
+    uint64_t untrackedCalls = 0;
+
+    // Start of the block executing now.
+    uint16_t blockStart;
+    bool started = false;
+
+    uint64_t totalCycles = 0;
+    uint64_t totalInstructions = 0;
+
+    uint32_t InstructionCycles(uint16_t instruction) const;
+    uint32_t Routine(uint16_t entry);
+    CycleBlock& Build(uint16_t start, uint16_t end);
+    void Drop(uint32_t index);
+    void Charge(uint64_t cycles);
+    void Exit(const CycleBlock& block, uint16_t target);
+
+public:
+    CycleModel(CPU* cpu);
+
+    int Configure(const char* spec);
+    void Start();
+    void Finish();
+    void Invalidate(uint16_t address);
+    void Report(FILE* out) const;
+
+    /**
+     * @brief Charges the block ending with the control transfer at pc and starts the next at target.
+     */
+    void Transfer(uint16_t pc, uint16_t target)
+    {
+        uint32_t index = blockIndex[blockStart];
+        CycleBlock& block = index && blocks[index - 1].end == pc ? blocks[index - 1] : Build(blockStart, pc);
+
+        uint64_t cycles = block.cycles;
+        if (block.exit == CE_BRANCH && target != (uint16_t)(pc + 1))
+        {
+            cycles += takenCycles;
+        }
+        ++block.executions;
+        block.totalCycles += cycles;
+        totalInstructions += block.length;
+        Charge(cycles);
+
+        if (block.exit != CE_BRANCH)
+        {
+            Exit(block, target);
+        }
+        blockStart = target;
+    }
+};
+
+
+// VmCore instrumentation policy handing every control transfer to a cycle model.
+class CycleAccounting
+{
+private:
+    CycleModel* cycleModelPtr;
+
+public:
+    CycleAccounting(CycleModel* cycleModel)
+    {
+        cycleModelPtr = cycleModel;
+    }
+
+    void OnControl(uint16_t pc, uint16_t target)
+    {
+        cycleModelPtr->Transfer(pc, target);
+    }
+
+    bool StopsAt(uint16_t) const
+    {
+        return false;
+    }
+};
+#endif
\ No newline at end of file
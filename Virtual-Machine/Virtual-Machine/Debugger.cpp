@@ -0,0 +1,513 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+#include "Debugger.h"
+#include "OS.h"
+#include "Recorder.h"
+#include "VirtualMachine.h"
+
+
+// Spelling of every ConditionOperators value, in enum order.
+static const char* operatorNames[] = { "", "==", "!=", "<", ">", "<=", ">=" };
+
+
+/**
+ * @brief Parses an address or value written as x3000, 0x3000 or 12288.
+ *
+ * @param text The text to parse.
+ * @param value Receives the parsed value.
+ * @return True if the whole text is a number.
+ */
+static bool ParseNumber(const char* text, long* value)
+{
+    char* end = nullptr;
+    if (text[0] == 'x' || text[0] == 'X')
+    {
+        *value = strtol(text + 1, &end, 16);
+    }
+    else
+    {
+        *value = strtol(text, &end, 0);
+    }
+    return end != text && *end == '\0';
+}
+
+
+/**
+ * @brief Constructs a Debugger over an already wired virtual machine.
+ *
+ * @param cpu Pointer to the CPU object.
+ * @param os Pointer to the OS object owning the console.
+ * @param virtualMachine Pointer to the VirtualMachine object used for stepping.
+ * @param recorder Pointer to the Recorder object, used for seeking when a recording is loaded.
+ */
+Debugger::Debugger(CPU* cpu, OS* os, VirtualMachine* virtualMachine, Recorder* recorder)
+{
+    cpuPtr = cpu;
+    osPtr = os;
+    virtualMachinePtr = virtualMachine;
+    recorderPtr = recorder;
+
+    attributes.assign(MEMORY_MAX, 0);
+    memset(pageFlags, 0, sizeof(pageFlags));
+}
+
+
+/**
+ * @brief Sets or clears an attribute of an address and refreshes the flags of its page.
+ *
+ * @param address The address.
+ * @param attribute The DebugAttributes bits to change.
+ * @param set True to set the bits, false to clear them.
+ */
+void Debugger::SetAttribute(uint16_t address, uint8_t attribute, bool set)
+{
+    if (set)
+    {
+        attributes[address] |= attribute;
+    }
+    else
+    {
+        attributes[address] &= (uint8_t)~attribute;
+    }
+
+    uint32_t first = (uint32_t)(address >> PAGE_SHIFT) << PAGE_SHIFT;
+    uint8_t flags = 0;
+    for (uint32_t i = first; i < first + (1 << PAGE_SHIFT); ++i)
+    {
+        flags |= attributes[i];
+    }
+    pageFlags[address >> PAGE_SHIFT] = flags;
+
+    watching = false;
+    for (uint8_t pageFlag : pageFlags)
+    {
+        watching |= (pageFlag & (DA_WATCH_READ | DA_WATCH_WRITE)) != 0;
+    }
+}
+
+
+/**
+ * @brief Sets an execution breakpoint, replacing any previous one at the address.
+ *
+ * @param address The address of the instruction to stop at.
+ * @param condition The condition under which to stop; CO_ALWAYS for an unconditional breakpoint.
+ */
+void Debugger::SetBreakpoint(uint16_t address, const BreakCondition& condition)
+{
+    SetAttribute(address, DA_BREAK, true);
+
+    if (condition.op != CO_ALWAYS)
+    {
+        conditions[address] = condition;
+    }
+    else
+    {
+        conditions.erase(address);
+    }
+}
+
+
+/**
+ * @brief Sets a watchpoint on an address.
+ *
+ * @param address The address to watch.
+ * @param kind DA_WATCH_READ, DA_WATCH_WRITE or both.
+ */
+void Debugger::SetWatchpoint(uint16_t address, uint8_t kind)
+{
+    SetAttribute(address, kind & (DA_WATCH_READ | DA_WATCH_WRITE), true);
+}
+
+
+/**
+ * @brief Removes some of the breakpoint and watchpoint kinds at an address.
+ *
+ * @param address The address.
+ * @param attribute The DebugAttributes bits to remove.
+ */
+void Debugger::Remove(uint16_t address, uint8_t attribute)
+{
+    SetAttribute(address, attribute, false);
+    if (attribute & DA_BREAK)
+    {
+        conditions.erase(address);
+    }
+}
+
+
+/**
+ * @brief Removes the breakpoint and watchpoints at an address.
+ *
+ * @param address The address.
+ */
+void Debugger::Delete(uint16_t address)
+{
+    Remove(address, DA_BREAK | DA_WATCH_READ | DA_WATCH_WRITE);
+}
+
+
+/**
+ * @brief Prepares to resume execution from the current program counter without stopping there again.
+ */
+void Debugger::Resume()
+{
+    watchHit = false;
+    resumeAddress = cpuPtr->registers[Registers::R_PC];
+}
+
+
+/**
+ * @brief Returns and clears the watchpoint hit by the last instruction, if any.
+ *
+ * @param address Receives the watched address.
+ * @param kind Receives DA_WATCH_READ or DA_WATCH_WRITE.
+ * @return True if a watchpoint was hit.
+ */
+bool Debugger::TakeWatchHit(uint16_t* address, uint8_t* kind)
+{
+    if (!watchHit)
+    {
+        return false;
+    }
+
+    *address = watchAddress;
+    *kind = watchKind;
+    watchHit = false;
+    return true;
+}
+
+
+/**
+ * @brief Checks the breakpoint at an address of a flagged page.
+ *
+ * @param pc The address of the next instruction.
+ * @return True if a breakpoint is set there and its condition holds.
+ */
+bool Debugger::CheckBreakpoint(uint16_t pc)
+{
+    if (resumeAddress == pc)
+    {
+        resumeAddress = -1;
+        return false;
+    }
+    resumeAddress = -1;
+
+    if (!(attributes[pc] & DA_BREAK))
+    {
+        return false;
+    }
+
+    auto found = conditions.find(pc);
+    if (found == conditions.end())
+    {
+        return true;
+    }
+
+    const BreakCondition& condition = found->second;
+    int16_t value = (int16_t)cpuPtr->registers[condition.reg];
+    switch (condition.op)
+    {
+    case CO_EQUAL:
+        return value == condition.value;
+    case CO_NOT_EQUAL:
+        return value != condition.value;
+    case CO_LESS:
+        return value < condition.value;
+    case CO_GREATER:
+        return value > condition.value;
+    case CO_LESS_EQUAL:
+        return value <= condition.value;
+    case CO_GREATER_EQUAL:
+        return value >= condition.value;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Prints the instruction count, the registers and the instruction at the program counter.
+ */
+void Debugger::PrintState() const
+{
+    const uint16_t* registers = cpuPtr->registers;
+    uint16_t cond = registers[Registers::R_COND];
+
+    printf("instruction %llu", (unsigned long long)cpuPtr->instructionCount);
+    if (recorderPtr->HasRecording())
+    {
+        printf(" of %llu", (unsigned long long)recorderPtr->EndInstruction());
+    }
+    printf("%s\n", cpuPtr->running ? "" : " (halted)");
+
+    printf("PC x%04X [x%04X]  COND %c%c%c\n", registers[Registers::R_PC], cpuPtr->memory[registers[Registers::R_PC]],
+        (cond & FL_NEGATIVE) ? 'n' : '-', (cond & FL_ZERO) ? 'z' : '-', (cond & FL_POSITIVE) ? 'p' : '-');
+    const std::string* symbol;
+    uint16_t offset;
+    if (cpuPtr->FindSymbol(registers[Registers::R_PC], &symbol, &offset))
+    {
+        printf("at %s+%u\n", symbol->c_str(), offset);
+    }
+    for (int r = Registers::R_0; r <= Registers::R_7; ++r)
+    {
+        printf("R%d x%04X%s", r, registers[r], r == Registers::R_3 || r == Registers::R_7 ? "\n" : "  ");
+    }
+}
+
+
+/**
+ * @brief Lists every breakpoint and watchpoint.
+ */
+void Debugger::PrintBreakpoints() const
+{
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
+    {
+        if (!pageFlags[page])
+        {
+            continue;
+        }
+
+        for (uint32_t address = page << PAGE_SHIFT; address < (page + 1) << PAGE_SHIFT; ++address)
+        {
+            uint8_t attribute = attributes[address];
+            if (attribute & DA_BREAK)
+            {
+                auto found = conditions.find((uint16_t)address);
+                if (found != conditions.end())
+                {
+                    printf("break x%04X if R%d %s %d\n", address, found->second.reg,
+                        operatorNames[found->second.op], found->second.value);
+                }
+                else
+                {
+                    printf("break x%04X\n", address);
+                }
+            }
+            if (attribute & (DA_WATCH_READ | DA_WATCH_WRITE))
+            {
+                printf("watch x%04X %s%s\n", address,
+                    (attribute & DA_WATCH_READ) ? "r" : "", (attribute & DA_WATCH_WRITE) ? "w" : "");
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Prints memory words, eight per line.
+ *
+ * @param address The first address.
+ * @param count Number of words.
+ */
+void Debugger::PrintMemory(uint16_t address, uint32_t count) const
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint16_t current = (uint16_t)(address + i);
+        if (i % 8 == 0)
+        {
+            printf("x%04X:", current);
+        }
+        printf(" x%04X", cpuPtr->memory[current]);
+        if (i % 8 == 7 || i + 1 == count)
+        {
+            printf("\n");
+        }
+    }
+}
+
+
+/**
+ * @brief Prints the console commands.
+ */
+void Debugger::PrintHelp() const
+{
+    printf("break ADDR [if Rn OP VALUE]  stop before executing ADDR, optionally only when the condition holds\n");
+    printf("watch ADDR [r|w|rw]          stop after ADDR is read or written (default w)\n");
+    printf("delete ADDR                  remove the breakpoint and watchpoints at ADDR\n");
+    printf("info                         list breakpoints and watchpoints\n");
+    printf("mem ADDR [N]                 print N memory words (default 8)\n");
+    printf("step [N]                     execute N instructions (default 1)\n");
+    printf("regs                         print the registers\n");
+    printf("seek N                       with a recording, move to the state after N instructions\n");
+    printf("rstep [N]                    with a recording, move N instructions back (default 1)\n");
+    printf("continue                     resume the program\n");
+    printf("quit                         exit without resuming\n");
+}
+
+
+/**
+ * @brief Reports why execution stopped, then reads and executes console commands from standard input.
+ *
+ * @return Returns 1 to resume the program, 0 to exit.
+ */
+int Debugger::RunConsole()
+{
+    // Commands are typed as whole lines
+    osPtr->RestoreInputBuffering();
+
+    uint16_t pc = cpuPtr->registers[Registers::R_PC];
+    if (watchHit)
+    {
+        printf("watchpoint x%04X %s: x%04X\n", watchAddress, watchKind == DA_WATCH_READ ? "read" : "written",
+            cpuPtr->memory[watchAddress]);
+        watchHit = false;
+    }
+    else if (attributes[pc] & DA_BREAK)
+    {
+        printf("breakpoint x%04X\n", pc);
+    }
+    PrintState();
+
+    char line[128];
+    int resume = 0;
+    while (printf("(lc3) "), fflush(stdout), fgets(line, sizeof(line), stdin))
+    {
+        char command[16] = "";
+        char first[32] = "";
+        char second[32] = "";
+        char reg[8] = "";
+        char op[4] = "";
+        char value[32] = "";
+        int fields = sscanf(line, "%15s %31s %31s", command, first, second);
+
+        long number = 0;
+        bool hasNumber = fields >= 2 && ParseNumber(first, &number);
+        uint64_t count = hasNumber ? (uint64_t)number : 1;
+
+        if (fields < 1)
+        {
+            continue;
+        }
+        else if (strcmp(command, "break") == 0 && hasNumber)
+        {
+            BreakCondition condition = { 0, CO_ALWAYS, 0 };
+            long threshold = 0;
+            if (sscanf(line, "%*s %*s if %7s %3[=!<>] %31s", reg, op, value) == 3)
+            {
+                int index = 1;
+                while (index < CO_GREATER_EQUAL + 1 && strcmp(op, operatorNames[index]) != 0)
+                {
+                    ++index;
+                }
+                if ((reg[0] != 'R' && reg[0] != 'r') || reg[1] < '0' || reg[1] > '7' || reg[2] != '\0'
+                    || index > CO_GREATER_EQUAL || !ParseNumber(value, &threshold))
+                {
+                    printf("invalid condition\n");
+                    continue;
+                }
+                condition.reg = (uint8_t)(reg[1] - '0');
+                condition.op = (uint8_t)index;
+                condition.value = (int16_t)threshold;
+            }
+            SetBreakpoint((uint16_t)number, condition);
+        }
+        else if (strcmp(command, "watch") == 0 && hasNumber)
+        {
+            uint8_t kind = DA_WATCH_WRITE;
+            if (fields == 3)
+            {
+                kind = (strchr(second, 'r') ? DA_WATCH_READ : 0) | (strchr(second, 'w') ? DA_WATCH_WRITE : 0);
+            }
+            SetWatchpoint((uint16_t)number, kind ? kind : (uint8_t)DA_WATCH_WRITE);
+        }
+        else if (strcmp(command, "delete") == 0 && hasNumber)
+        {
+            Delete((uint16_t)number);
+        }
+        else if (strcmp(command, "info") == 0)
+        {
+            PrintBreakpoints();
+        }
+        else if (strcmp(command, "mem") == 0 && hasNumber)
+        {
+            long words = 8;
+            if (fields == 3 && !ParseNumber(second, &words))
+            {
+                words = 8;
+            }
+            PrintMemory((uint16_t)number, (uint32_t)words);
+        }
+        else if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0)
+        {
+            for (uint64_t i = 0; i < count && cpuPtr->running; ++i)
+            {
+                virtualMachinePtr->Step();
+            }
+            watchHit = false;
+            PrintState();
+        }
+        else if (strcmp(command, "regs") == 0)
+        {
+            PrintState();
+        }
+        else if (strcmp(command, "seek") == 0 && hasNumber && recorderPtr->HasRecording())
+        {
+            recorderPtr->Seek(count);
+            watchHit = false;
+            PrintState();
+        }
+        else if ((strcmp(command, "rstep") == 0 || strcmp(command, "rs") == 0) && recorderPtr->HasRecording())
+        {
+            recorderPtr->ReverseStep(count);
+            watchHit = false;
+            PrintState();
+        }
+        else if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0)
+        {
+            resume = 1;
+            break;
+        }
+        else if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0)
+        {
+            break;
+        }
+        else
+        {
+            PrintHelp();
+        }
+    }
+
+    // Do not stop again at the breakpoint the program resumes from
+    resumeAddress = cpuPtr->registers[Registers::R_PC];
+
+    osPtr->DisableInputBuffering();
+    return resume;
+}
+
+
+/**
+ * @brief Executes instructions until the program halts, opening the console at breakpoints and watchpoints.
+ *
+ * The program runs freely on the core up to an instruction on a page that holds a breakpoint, or
+ * up to a watchpoint hit; only there is each instruction checked and stepped on its own.
+ */
+void Debugger::Run()
+{
+    while (cpuPtr->running)
+    {
+        if (ShouldBreak() && !RunConsole())
+        {
+            return;
+        }
+
+        // The instruction at the program counter may be a breakpoint the program resumes from
+        virtualMachinePtr->Step();
+        virtualMachinePtr->RunDebugged(this, UINT64_MAX);
+    }
+}
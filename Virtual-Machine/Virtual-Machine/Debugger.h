@@ -0,0 +1,169 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "CPU.h"
+
+
+class OS;
+class VirtualMachine;
+class Recorder;
+
+
+enum DebugAttributes : uint8_t
+{
+    DA_BREAK = (1 << 0),       // execution breakpoint
+    DA_WATCH_READ = (1 << 1),  // stop after the address is read
+    DA_WATCH_WRITE = (1 << 2)  // stop after the address is written
+};
+
+
+enum ConditionOperators : uint8_t
+{
+    CO_ALWAYS = 0,
+    CO_EQUAL,
+    CO_NOT_EQUAL,
+    CO_LESS,
+    CO_GREATER,
+    CO_LESS_EQUAL,
+    CO_GREATER_EQUAL
+};
+
+
+// Condition of a conditional breakpoint, comparing a register against a signed value.
+struct BreakCondition
+{
+    uint8_t reg;
+    uint8_t op;
+    int16_t value;
+};
+
+
+class Debugger
+{
+private:
+    CPU* cpuPtr;
+    OS* osPtr;
+    VirtualMachine* virtualMachinePtr;
+    Recorder* recorderPtr;
+
+    // DebugAttributes of every address, and the union of them for every page.
+    // Only pages with a flag set pay for a per-address lookup.
+    std::vector<uint8_t> attributes;
+    uint8_t pageFlags[PAGE_COUNT];
+
+    // True while a watchpoint is set anywhere, so memory accesses must go through MemoryIO.
+    bool watching = false;
+
+    std::map<uint16_t, BreakCondition> conditions;
+
+    // Watchpoint hit by the last instruction, reported before the next one executes.
+    bool watchHit = false;
+    uint16_t watchAddress = 0;
+    uint8_t watchKind = 0;
+
+    // Address of a breakpoint the program was resumed from, which must not stop it again right away.
+    int32_t resumeAddress = -1;
+
+    bool CheckBreakpoint(uint16_t pc);
+    void SetAttribute(uint16_t address, uint8_t attribute, bool set);
+    void PrintState() const;
+    void PrintBreakpoints() const;
+    void PrintMemory(uint16_t address, uint32_t count) const;
+    void PrintHelp() const;
+
+public:
+    Debugger(CPU* cpu, OS* os, VirtualMachine* virtualMachine, Recorder* recorder);
+
+    void SetBreakpoint(uint16_t address, const BreakCondition& condition);
+    void SetWatchpoint(uint16_t address, uint8_t kind);
+    void Remove(uint16_t address, uint8_t attribute);
+    void Delete(uint16_t address);
+
+    void Resume();
+    bool TakeWatchHit(uint16_t* address, uint8_t* kind);
+
+    int RunConsole();
+    void Run();
+
+    /**
+     * @brief Tells whether a watchpoint is set, so that accesses to plain memory must be observed.
+     */
+    bool Watching() const
+    {
+        return watching;
+    }
+
+    /**
+     * @brief Tells whether a free run must hand over before an instruction: it lies on a page
+     * holding a breakpoint, or the last instruction hit a watchpoint.
+     */
+    bool StopsAt(uint16_t pc) const
+    {
+        return watchHit || (pageFlags[pc >> PAGE_SHIFT] & DA_BREAK);
+    }
+
+    /**
+     * @brief Tells whether execution must stop before the instruction at the program counter.
+     */
+    bool ShouldBreak()
+    {
+        uint16_t pc = cpuPtr->registers[Registers::R_PC];
+        return watchHit || ((pageFlags[pc >> PAGE_SHIFT] & DA_BREAK) && CheckBreakpoint(pc));
+    }
+
+    /**
+     * @brief Notes a memory access for the watchpoints; called by MemoryIO, which leaves out instruction fetches.
+     *
+     * @param address The accessed address.
+     * @param kind DA_WATCH_READ or DA_WATCH_WRITE.
+     */
+    void OnAccess(uint16_t address, uint8_t kind)
+    {
+        if ((pageFlags[address >> PAGE_SHIFT] & kind) && (attributes[address] & kind))
+        {
+            watchHit = true;
+            watchAddress = address;
+            watchKind = kind;
+        }
+    }
+};
+
+
+// VmCore instrumentation policy stopping a free run wherever the debugger needs to look at a single
+// instruction; everywhere else the core runs on with one flag test per instruction.
+class DebugStops
+{
+private:
+    Debugger* debuggerPtr;
+
+public:
+    DebugStops(Debugger* debugger)
+    {
+        debuggerPtr = debugger;
+    }
+
+    void OnControl(uint16_t, uint16_t)
+    {
+    }
+
+    bool StopsAt(uint16_t pc) const
+    {
+        return debuggerPtr->StopsAt(pc);
+    }
+};
+#endif
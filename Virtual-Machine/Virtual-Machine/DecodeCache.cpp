@@ -0,0 +1,415 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "DecodeCache.h"
+#include "ArithmeticLogicUnit.h"
+#include "CPU.h"
+#include "MemoryIO.h"
+#include "CodeMap.h"
+
+
+// Bump whenever the layout or meaning of DecodedInstruction changes.
+static const uint32_t DECODE_CACHE_VERSION = 2;
+
+static const uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+
+/**
+ * @brief Folds a block of bytes into a 64-bit FNV-1a hash.
+ *
+ * @param data Pointer to the bytes to hash.
+ * @param size Number of bytes.
+ * @param hash The running hash value.
+ * @return The updated hash value.
+ */
+static uint64_t Fnv1a(const void* data, size_t size, uint64_t hash)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/**
+ * @brief Constructs an empty decode cache over the given memory.
+ *
+ * @param memory Pointer to the memory array.
+ * @param cpu Pointer to the CPU object holding the loaded image segments.
+ * @param alu Pointer to the ArithmeticLogicUnit object used for sign extension.
+ */
+DecodeCache::DecodeCache(uint16_t* memory, CPU* cpu, ArithmeticLogicUnit* alu)
+{
+    memoryPtr = memory;
+    cpuPtr = cpu;
+    aluPtr = alu;
+
+    DecodedInstruction undecoded = { DH_UNDECODED, 0, 0, 0, 0, 0 };
+    entries.assign(MEMORY_MAX, undecoded);
+}
+
+
+/**
+ * @brief Attaches the code map told about every address decoded, and every one loaded from a persisted cache.
+ *
+ * @param codeMap Pointer to the CodeMap object, or nullptr to detach it.
+ */
+void DecodeCache::SetCodeMap(CodeMap* codeMap)
+{
+    codeMapPtr = codeMap;
+}
+
+
+/**
+ * @brief Decodes the instruction word at the given address into its cache entry, without fusion.
+ *
+ * @param address The address of the instruction.
+ */
+void DecodeCache::DecodePlain(uint16_t address)
+{
+    if (codeMapPtr)
+    {
+        codeMapPtr->Execute(address);
+    }
+
+    uint16_t instruction = memoryPtr[address];
+    uint16_t next = address + 1;
+    DecodedInstruction& decoded = entries[address];
+
+    decoded.handler = (uint8_t)(instruction >> 12);
+    decoded.dr = (instruction >> 9) & 0x0007;
+    decoded.sr1 = (instruction >> 6) & 0x0007;
+    decoded.sr2 = instruction & 0x0007;
+    decoded.operand = 0;
+    decoded.instruction = instruction;
+
+    switch (decoded.handler)
+    {
+    case OP_ADD:
+    case OP_AND:
+        if ((instruction >> 5) & 0x0001)
+        {
+            decoded.sr2 = DECODED_IMMEDIATE;
+            decoded.operand = aluPtr->SignExtend(instruction & 0x001F, 5);
+        }
+        break;
+    case OP_BR:
+    case OP_LD:
+    case OP_LDI:
+    case OP_LEA:
+    case OP_ST:
+    case OP_STI:
+        // PC-relative forms: resolve the absolute address once
+        decoded.operand = next + aluPtr->SignExtend(instruction & 0x01FF, 9);
+        break;
+    case OP_LDR:
+    case OP_STR:
+        decoded.operand = aluPtr->SignExtend(instruction & 0x003F, 6);
+        break;
+    case OP_JSR:
+        if ((instruction >> 11) & 0x0001)
+        {
+            decoded.sr2 = DECODED_IMMEDIATE;
+            decoded.operand = next + aluPtr->SignExtend(instruction & 0x07FF, 11);
+        }
+        break;
+    }
+
+    dirty = true;
+}
+
+
+/**
+ * @brief Turns a decoded entry into a superinstruction when it forms a known pair with its successor.
+ *
+ * The fields of both entries stay those of the plain instructions, so the successor can still be
+ * executed on its own when it is a branch target.
+ *
+ * @param address The address of the first instruction of the pair.
+ */
+void DecodeCache::Fuse(uint16_t address)
+{
+    uint16_t nextAddress = address + 1;
+
+    // Never look ahead into the device registers, and never wrap around memory
+    if (nextAddress == 0 || nextAddress >= MemoryMappedRegisters::MR_DEVICES)
+    {
+        return;
+    }
+
+    if (entries[nextAddress].handler == DH_UNDECODED)
+    {
+        DecodePlain(nextAddress);
+    }
+
+    DecodedInstruction& first = entries[address];
+    const DecodedInstruction& second = entries[nextAddress];
+    uint16_t secondOpcode = second.instruction >> 12;
+
+    switch (first.handler)
+    {
+    case OP_ADD:
+        if (secondOpcode == OP_BR && second.dr)
+        {
+            first.handler = DH_ADD_BR;
+        }
+        break;
+    case OP_LDR:
+        if (secondOpcode == OP_ADD)
+        {
+            first.handler = DH_LDR_ADD;
+        }
+        break;
+    case OP_AND:
+        if (first.sr2 == DecodedOperands::DECODED_IMMEDIATE && first.operand == 0
+            && secondOpcode == OP_ADD && second.sr2 == DecodedOperands::DECODED_IMMEDIATE
+            && second.dr == first.dr && second.sr1 == first.dr)
+        {
+            first.handler = DH_AND_ADD;
+        }
+        break;
+    case OP_ST:
+        // The store must not overwrite the pair itself
+        if (secondOpcode == OP_JSR && first.operand != address && first.operand != nextAddress)
+        {
+            first.handler = DH_ST_JSR;
+        }
+        break;
+    }
+}
+
+
+/**
+ * @brief Decodes the instruction at the given address and fuses it with its successor when possible.
+ *
+ * @param address The address of the instruction.
+ */
+void DecodeCache::Decode(uint16_t address)
+{
+    DecodePlain(address);
+    Fuse(address);
+}
+
+
+/**
+ * @brief Returns the decoded form of the instruction at the given address, decoding it on first use.
+ *
+ * @param address The address of the instruction.
+ * @return The decoded instruction.
+ */
+const DecodedInstruction& DecodeCache::Fetch(uint16_t address)
+{
+    if (entries[address].handler == DH_UNDECODED)
+    {
+        Decode(address);
+    }
+    return entries[address];
+}
+
+
+/**
+ * @brief Drops the decoded entry for an address whose memory word was written.
+ *
+ * @param address The address that was written.
+ */
+void DecodeCache::Invalidate(uint16_t address)
+{
+    entries[address].handler = DH_UNDECODED;
+
+    // A superinstruction ending at this address is stale as well
+    DecodedInstruction& previous = entries[(uint16_t)(address - 1)];
+    if (previous.handler > DH_UNDECODED)
+    {
+        previous.handler = DH_UNDECODED;
+    }
+}
+
+
+/**
+ * @brief Computes the content hash of the loaded image segments.
+ *
+ * The hash is the key of the persisted cache, so it must be taken before the program runs
+ * and changes its memory.
+ *
+ * @return The 64-bit hash of every segment's origin, length and words.
+ */
+uint64_t DecodeCache::HashImage()
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (const ImageSegment& segment : cpuPtr->segments)
+    {
+        hash = Fnv1a(&segment.origin, sizeof(segment.origin), hash);
+        hash = Fnv1a(&segment.length, sizeof(segment.length), hash);
+        hash = Fnv1a(memoryPtr + segment.origin, segment.length * sizeof(uint16_t), hash);
+    }
+
+    imageHash = hash;
+    return imageHash;
+}
+
+
+/**
+ * @brief Builds the path of the cache file for the current image.
+ *
+ * @param directory The cache directory.
+ * @param path Buffer receiving the path.
+ * @param size Size of the buffer.
+ */
+void DecodeCache::CachePath(const char* directory, char* path, size_t size) const
+{
+    snprintf(path, size, "%s/%016llx.lc3d", directory, (unsigned long long)imageHash);
+}
+
+
+/**
+ * @brief Loads a previously persisted decode cache for the current image.
+ *
+ * Files with a wrong magic, version, image hash or checksum are deleted. Individual records whose
+ * instruction word no longer matches memory are skipped.
+ *
+ * @param directory The cache directory.
+ * @return Returns 1 if a valid cache was loaded, 0 otherwise.
+ */
+int DecodeCache::Load(const char* directory)
+{
+    char path[MAX_PATH];
+    CachePath(directory, path, sizeof(path));
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    DecodeCacheHeader header;
+    std::vector<DecodeCacheRecord> records;
+
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, "LC3D", 4) == 0
+        && header.version == DECODE_CACHE_VERSION
+        && header.imageHash == imageHash
+        && header.recordCount <= MEMORY_MAX;
+
+    if (valid)
+    {
+        records.resize(header.recordCount);
+        valid = fread(records.data(), sizeof(DecodeCacheRecord), records.size(), file) == records.size()
+            && Fnv1a(records.data(), records.size() * sizeof(DecodeCacheRecord), FNV_OFFSET_BASIS) == header.checksum;
+    }
+
+    fclose(file);
+
+    if (!valid)
+    {
+        // Stale or corrupt, discard it so the next run writes a fresh one
+        remove(path);
+        return 0;
+    }
+
+    for (const DecodeCacheRecord& record : records)
+    {
+        if (record.decoded.handler != DH_UNDECODED && record.decoded.handler < DH_COUNT
+            && record.decoded.instruction == memoryPtr[record.address])
+        {
+            entries[record.address] = record.decoded;
+            if (codeMapPtr)
+            {
+                codeMapPtr->Execute(record.address);
+            }
+        }
+    }
+
+    // A superinstruction is only usable if its second half was loaded as well
+    for (const DecodeCacheRecord& record : records)
+    {
+        if (entries[record.address].handler > DH_UNDECODED
+            && entries[(uint16_t)(record.address + 1)].handler == DH_UNDECODED)
+        {
+            entries[record.address].handler = DH_UNDECODED;
+        }
+    }
+
+    dirty = false;
+    return 1;
+}
+
+
+/**
+ * @brief Persists the decoded entries that belong to the loaded image segments.
+ *
+ * The file is written under a temporary name and moved into place, so concurrent runs of the
+ * same image never observe a partially written cache.
+ *
+ * @param directory The cache directory, created if missing.
+ * @return Returns 1 if the cache is up to date on disk, 0 otherwise.
+ */
+int DecodeCache::Save(const char* directory)
+{
+    if (!dirty)
+    {
+        return 1;
+    }
+
+    std::vector<DecodeCacheRecord> records;
+    for (const ImageSegment& segment : cpuPtr->segments)
+    {
+        for (uint32_t i = 0; i < segment.length; ++i)
+        {
+            uint16_t address = (uint16_t)(segment.origin + i);
+            if (entries[address].handler != DH_UNDECODED && entries[address].instruction == memoryPtr[address])
+            {
+                records.push_back({ address, entries[address] });
+            }
+        }
+    }
+
+    DecodeCacheHeader header = {};
+    memcpy(header.magic, "LC3D", 4);
+    header.version = DECODE_CACHE_VERSION;
+    header.imageHash = imageHash;
+    header.recordCount = (uint32_t)records.size();
+    header.checksum = Fnv1a(records.data(), records.size() * sizeof(DecodeCacheRecord), FNV_OFFSET_BASIS);
+
+    char path[MAX_PATH];
+    char tempPath[MAX_PATH + 16];
+    CachePath(directory, path, sizeof(path));
+    snprintf(tempPath, sizeof(tempPath), "%s.%lu.tmp", path, (unsigned long)GetCurrentProcessId());
+
+    CreateDirectoryA(directory, NULL);
+
+    FILE* file = fopen(tempPath, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(records.data(), sizeof(DecodeCacheRecord), records.size(), file) == records.size();
+
+    if (fclose(file) != 0 || !written || !MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        remove(tempPath);
+        return 0;
+    }
+
+    dirty = false;
+    return 1;
+}
\ No newline at end of file
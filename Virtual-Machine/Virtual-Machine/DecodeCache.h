@@ -0,0 +1,111 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+
+#include <cstdint>
+#include <vector>
+
+
+class CPU;
+class ArithmeticLogicUnit;
+class CodeMap;
+
+
+enum DecodedHandlers : uint8_t
+{
+    // Handlers 0-15 are the plain opcodes, see Opcodes.
+    DH_UNDECODED = 16,
+
+    // Superinstructions, executing an instruction together with the one that follows it.
+    DH_ADD_BR,  // ADD followed by BR (counted loops)
+    DH_LDR_ADD, // LDR followed by ADD (pointer walks)
+    DH_AND_ADD, // AND Rx,Ry,#0 followed by ADD Rx,Rx,#imm (load constant)
+    DH_ST_JSR,  // ST followed by JSR or JSRR (save a register around a call)
+
+    DH_COUNT
+};
+
+
+enum DecodedOperands : uint8_t
+{
+    // Stored in sr2 when the operand field holds an immediate value instead of a register.
+    DECODED_IMMEDIATE = 0xFF
+};
+
+
+// An instruction with its fields extracted, immediates sign-extended and PC-relative addresses resolved.
+struct DecodedInstruction
+{
+    uint8_t handler;      // DecodedHandlers value
+    uint8_t dr;           // destination register, stored register, or BR condition mask
+    uint8_t sr1;          // first source or base register
+    uint8_t sr2;          // second source register, or DECODED_IMMEDIATE
+    uint16_t operand;     // immediate, base offset, or resolved absolute address
+    uint16_t instruction; // original instruction word
+};
+
+
+// On-disk header of a persisted decode cache.
+struct DecodeCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t imageHash;
+    uint32_t recordCount;
+    uint32_t reserved;
+    uint64_t checksum;
+};
+
+
+// One persisted entry of a decode cache.
+struct DecodeCacheRecord
+{
+    uint16_t address;
+    DecodedInstruction decoded;
+};
+
+
+class DecodeCache
+{
+private:
+    uint16_t* memoryPtr;
+    CPU* cpuPtr;
+    ArithmeticLogicUnit* aluPtr;
+    CodeMap* codeMapPtr = nullptr;
+
+    std::vector<DecodedInstruction> entries;
+
+    // Content hash of the loaded image segments, taken before execution starts.
+    uint64_t imageHash = 0;
+
+    // Set when entries were decoded that the persisted cache did not contain.
+    bool dirty = false;
+
+    void DecodePlain(uint16_t address);
+    void Fuse(uint16_t address);
+    void Decode(uint16_t address);
+    void CachePath(const char* directory, char* path, size_t size) const;
+
+public:
+    DecodeCache(uint16_t* memory, CPU* cpu, ArithmeticLogicUnit* alu);
+
+    void SetCodeMap(CodeMap* codeMap);
+
+    const DecodedInstruction& Fetch(uint16_t address);
+    void Invalidate(uint16_t address);
+
+    uint64_t HashImage();
+    int Load(const char* directory);
+    int Save(const char* directory);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,370 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstdio>
+#include <cstring>
+
+
+#include "Fuzzer.h"
+#include "ArithmeticLogicUnit.h"
+#include "MemoryIO.h"
+#include "OS.h"
+#include "Options.h"
+#include "VmCore.h"
+
+
+// Executions between two checks of the wall clock for the progress line.
+static const uint64_t FUZZ_STATUS_INTERVAL = 4096;
+
+// Milliseconds between two progress lines.
+static const uint64_t FUZZ_STATUS_MILLISECONDS = 1000;
+
+
+/**
+ * @brief Maps an edge hit count to its coverage bucket, so loops differing only slightly in trip count
+ * are not treated as new behaviour.
+ *
+ * @param count The number of times the edge was taken, at least one.
+ * @return A single bit identifying the bucket.
+ */
+static uint8_t HitBucket(uint8_t count)
+{
+    if (count <= 3)
+    {
+        return count == 3 ? 4 : count;
+    }
+    if (count <= 7)
+    {
+        return 8;
+    }
+    if (count <= 15)
+    {
+        return 16;
+    }
+    if (count <= 31)
+    {
+        return 32;
+    }
+    return count <= 127 ? 64 : 128;
+}
+
+
+/**
+ * @brief Constructs a Fuzzer over an already wired virtual machine.
+ *
+ * @param cpu Pointer to the CPU object.
+ * @param os Pointer to the OS object providing program input and output.
+ * @param timer Pointer to the Timer object.
+ * @param memoryIO Pointer to the MemoryIO object.
+ * @param trap Pointer to the Trap object serving the test cases' traps.
+ */
+Fuzzer::Fuzzer(CPU* cpu, OS* os, Timer* timer, MemoryIO* memoryIO, Trap* trap)
+    : timerSnapshot(*timer)
+{
+    cpuPtr = cpu;
+    osPtr = os;
+    timerPtr = timer;
+    memoryIOPtr = memoryIO;
+    trapPtr = trap;
+
+    memset(registersSnapshot, 0, sizeof(registersSnapshot));
+    memset(dirtyPages, 0, sizeof(dirtyPages));
+
+    trace.assign(FUZZ_MAP_SIZE, 0);
+    virgin.assign(FUZZ_MAP_SIZE, 0xFF);
+}
+
+
+/**
+ * @brief Returns the next value of the xorshift64* generator.
+ */
+uint32_t Fuzzer::Random()
+{
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (uint32_t)((randomState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+/**
+ * @brief Captures the loaded machine state that every test case starts from.
+ */
+void Fuzzer::Snapshot()
+{
+    memorySnapshot.assign(cpuPtr->memory, cpuPtr->memory + MEMORY_MAX);
+    memcpy(registersSnapshot, cpuPtr->registers, sizeof(registersSnapshot));
+    instructionCountSnapshot = cpuPtr->instructionCount;
+    timerSnapshot = *timerPtr;
+}
+
+
+/**
+ * @brief Returns the machine to the snapshot, copying back only the pages the test case wrote.
+ */
+void Fuzzer::Restore()
+{
+    // Device registers are updated on reads as well, so their page is always restored
+    dirtyPages[MemoryMappedRegisters::MR_DEVICES >> PAGE_SHIFT] = 1;
+
+    for (int page = 0; page < PAGE_COUNT; ++page)
+    {
+        if (dirtyPages[page])
+        {
+            uint32_t offset = (uint32_t)page << PAGE_SHIFT;
+            memcpy(cpuPtr->memory + offset, memorySnapshot.data() + offset, (1 << PAGE_SHIFT) * sizeof(uint16_t));
+            dirtyPages[page] = 0;
+        }
+    }
+
+    memcpy(cpuPtr->registers, registersSnapshot, sizeof(registersSnapshot));
+    cpuPtr->instructionCount = instructionCountSnapshot;
+    cpuPtr->running = 1;
+    *timerPtr = timerSnapshot;
+}
+
+
+/**
+ * @brief Runs one test case from the snapshot, recording the control-flow edges it takes.
+ *
+ * The test case ends when the program halts, when it waits for more input than was given,
+ * or when it exceeds its instruction budget.
+ *
+ * @param input The bytes fed to the program as keyboard input.
+ * @param budget Maximum number of instructions to execute.
+ * @return The FuzzResults outcome of the test case.
+ */
+int Fuzzer::Execute(const std::vector<uint8_t>& input, uint64_t budget)
+{
+    osPtr->SetScriptedInput(input.data(), input.size());
+
+    // Memory goes through MemoryIO so that the pages to restore are tracked
+    VmCore<ObservedMemory, ScriptedIo, EdgeCoverage> core(cpuPtr, ObservedMemory(memoryIOPtr),
+        ScriptedIo(memoryIOPtr, trapPtr, osPtr), EdgeCoverage(trace.data(), &touched));
+
+    switch (core.Run(cpuPtr->instructionCount + budget))
+    {
+    case VC_LIMIT:
+        return FR_HANG;
+    case VC_ILLEGAL:
+        // The interpreter aborts on these, so they are reported before they are executed
+        return FR_CRASH;
+    default:
+        return FR_OK;
+    }
+}
+
+
+/**
+ * @brief Merges the trace of the last test case into the global coverage and clears it.
+ *
+ * @return True if the test case hit an edge, or an edge hit-count bucket, never seen before.
+ */
+bool Fuzzer::HasNewCoverage()
+{
+    bool found = false;
+
+    for (uint16_t edge : touched)
+    {
+        uint8_t bucket = HitBucket(trace[edge]);
+        if (virgin[edge] & bucket)
+        {
+            if (virgin[edge] == 0xFF)
+            {
+                ++edgeCount;
+            }
+            virgin[edge] &= (uint8_t)~bucket;
+            found = true;
+        }
+        trace[edge] = 0;
+    }
+
+    touched.clear();
+    return found;
+}
+
+
+/**
+ * @brief Applies a few random mutations to an input.
+ *
+ * Generated bytes lean towards printable characters, which is what LC-3 programs usually compare against.
+ *
+ * @param input The input to mutate in place.
+ * @param maxLength Maximum length of the mutated input.
+ */
+void Fuzzer::Mutate(std::vector<uint8_t>& input, uint32_t maxLength)
+{
+    uint32_t mutations = 1 + Random() % 4;
+
+    for (uint32_t i = 0; i < mutations; ++i)
+    {
+        uint32_t r = Random();
+        uint8_t byte = (r & 0x100) ? (uint8_t)(0x20 + (r >> 16) % 0x5F) : (uint8_t)(r >> 16);
+
+        switch (r % 5)
+        {
+        case 0:
+            // Flip a bit
+            if (!input.empty())
+            {
+                input[Random() % input.size()] ^= (uint8_t)(1 << (r >> 24) % 8);
+            }
+            break;
+        case 1:
+            // Overwrite a byte
+            if (!input.empty())
+            {
+                input[Random() % input.size()] = byte;
+            }
+            break;
+        case 2:
+            // Insert a byte
+            if (input.size() < maxLength)
+            {
+                input.insert(input.begin() + Random() % (input.size() + 1), byte);
+            }
+            break;
+        case 3:
+            // Delete a byte
+            if (!input.empty())
+            {
+                input.erase(input.begin() + Random() % input.size());
+            }
+            break;
+        case 4:
+        {
+            // Splice in a chunk of another corpus entry
+            const std::vector<uint8_t>& other = corpus[Random() % corpus.size()];
+            if (other.empty() || input.size() >= maxLength)
+            {
+                break;
+            }
+            size_t start = Random() % other.size();
+            size_t length = 1 + Random() % (other.size() - start);
+            length = length < maxLength - input.size() ? length : maxLength - input.size();
+            input.insert(input.begin() + Random() % (input.size() + 1), other.begin() + start, other.begin() + start + length);
+            break;
+        }
+        }
+    }
+}
+
+
+/**
+ * @brief Writes an input that crashed or hung the program to the findings directory.
+ *
+ * @param directory The findings directory, created if missing.
+ * @param kind "crash" or "hang", used as the file name prefix.
+ * @param id Sequence number of the finding.
+ * @param input The input bytes.
+ */
+void Fuzzer::SaveInput(const char* directory, const char* kind, uint64_t id, const std::vector<uint8_t>& input) const
+{
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s-%06llu.bin", directory, kind, (unsigned long long)id);
+
+    CreateDirectoryA(directory, NULL);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return;
+    }
+    fwrite(input.data(), 1, input.size(), file);
+    fclose(file);
+}
+
+
+/**
+ * @brief Fuzzes the keyboard input of the loaded images.
+ *
+ * Every test case starts from a snapshot taken after loading, and only the pages it wrote are copied
+ * back afterwards, so resetting costs far less than reloading the images. Inputs reaching new edge
+ * coverage join the corpus, hanging ones included: a program that computes longer than the budget
+ * between two reads would otherwise never get a corpus to mutate. Inputs that crash or hang the
+ * program in a new way are also saved.
+ *
+ * @param options Options holding the fuzzing limits and findings directory.
+ */
+void Fuzzer::Run(const Options* options)
+{
+    Snapshot();
+    memoryIOPtr->SetDirtyPages(dirtyPages);
+    osPtr->SetOutputMuted(true);
+
+    // Start from the empty input; everything else is discovered by mutation
+    corpus.push_back(std::vector<uint8_t>());
+
+    uint64_t executions = 0;
+    uint64_t crashes = 0;
+    uint64_t hangs = 0;
+    uint64_t startTime = GetTickCount64();
+    uint64_t statusTime = startTime;
+    std::vector<uint8_t> input;
+
+    while (options->fuzzExecutions == 0 || executions < options->fuzzExecutions)
+    {
+        input = corpus[Random() % corpus.size()];
+        if (executions > 0)
+        {
+            Mutate(input, options->fuzzMaxLength);
+        }
+
+        int result = Execute(input, options->fuzzBudget);
+        bool fresh = HasNewCoverage();
+        Restore();
+        ++executions;
+
+        if (result == FR_CRASH)
+        {
+            if (fresh && options->fuzzDirectory)
+            {
+                SaveInput(options->fuzzDirectory, "crash", crashes, input);
+            }
+            ++crashes;
+        }
+        else if (result == FR_HANG)
+        {
+            if (fresh)
+            {
+                corpus.push_back(input);
+                if (options->fuzzDirectory)
+                {
+                    SaveInput(options->fuzzDirectory, "hang", hangs, input);
+                }
+            }
+            ++hangs;
+        }
+        else if (fresh)
+        {
+            corpus.push_back(input);
+        }
+
+        if (executions % FUZZ_STATUS_INTERVAL == 0 && GetTickCount64() - statusTime >= FUZZ_STATUS_MILLISECONDS)
+        {
+            statusTime = GetTickCount64();
+            double seconds = (statusTime - startTime) / 1000.0;
+            fprintf(stderr, "fuzz: %llu execs (%.0f/s), %u edges, corpus %zu, %llu crashes, %llu hangs\n",
+                (unsigned long long)executions, executions / seconds, edgeCount, corpus.size(),
+                (unsigned long long)crashes, (unsigned long long)hangs);
+        }
+    }
+
+    osPtr->SetOutputMuted(false);
+    memoryIOPtr->SetDirtyPages(nullptr);
+
+    double seconds = (GetTickCount64() - startTime) / 1000.0;
+    printf("fuzz: %llu execs in %.1f s (%.0f/s), %u edges, corpus %zu, %llu crashes, %llu hangs\n",
+        (unsigned long long)executions, seconds, seconds > 0 ? executions / seconds : 0.0, edgeCount, corpus.size(),
+        (unsigned long long)crashes, (unsigned long long)hangs);
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef FUZZER_H
+#define FUZZER_H
+
+
+#include <cstdint>
+#include <vector>
+
+#include "CPU.h"
+#include "Timer.h"
+
+
+class OS;
+class MemoryIO;
+class Trap;
+class Options;
+
+
+enum FuzzerLimits : uint32_t
+{
+    // Number of entries in the edge coverage bitmap.
+    FUZZ_MAP_SIZE = 1 << 16
+};
+
+
+enum FuzzResults : uint8_t
+{
+    FR_OK = 0, // halted, or ran out of input
+    FR_CRASH,  // reached an RTI or reserved opcode, which aborts the interpreter
+    FR_HANG    // exceeded the instruction budget
+};
+
+
+// VmCore instrumentation policy counting the control-flow edges a test case takes.
+class EdgeCoverage
+{
+private:
+    uint8_t* tracePtr;
+    std::vector<uint16_t>* touchedPtr;
+
+public:
+    EdgeCoverage(uint8_t* trace, std::vector<uint16_t>* touched)
+    {
+        tracePtr = trace;
+        touchedPtr = touched;
+    }
+
+    void OnControl(uint16_t pc, uint16_t target)
+    {
+        uint16_t edge = (uint16_t)((pc * 0x9E37u) ^ target);
+        if (tracePtr[edge] == 0)
+        {
+            touchedPtr->push_back(edge);
+        }
+        if (tracePtr[edge] != 0xFF)
+        {
+            ++tracePtr[edge];
+        }
+    }
+
+    bool StopsAt(uint16_t) const
+    {
+        return false;
+    }
+};
+
+
+class Fuzzer
+{
+private:
+    CPU* cpuPtr;
+    OS* osPtr;
+    Timer* timerPtr;
+    MemoryIO* memoryIOPtr;
+    Trap* trapPtr;
+
+    // Post-load machine state every test case starts from.
+    std::vector<uint16_t> memorySnapshot;
+    uint16_t registersSnapshot[REGISTER_COUNT];
+    uint64_t instructionCountSnapshot = 0;
+    Timer timerSnapshot;
+
+    // Pages written by the current test case, the only ones restored afterwards.
+    uint8_t dirtyPages[PAGE_COUNT];
+
+    // Edge hit counts of the current test case, and the entries it touched.
+    std::vector<uint8_t> trace;
+    std::vector<uint16_t> touched;
+
+    // Hit-count buckets not yet seen for each edge, shared by all test cases.
+    std::vector<uint8_t> virgin;
+    uint32_t edgeCount = 0;
+
+    // Inputs that reached new coverage, mutated to produce further test cases.
+    std::vector<std::vector<uint8_t>> corpus;
+
+    uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+
+    uint32_t Random();
+    void Snapshot();
+    void Restore();
+    int Execute(const std::vector<uint8_t>& input, uint64_t budget);
+    bool HasNewCoverage();
+    void Mutate(std::vector<uint8_t>& input, uint32_t maxLength);
+    void SaveInput(const char* directory, const char* kind, uint64_t id, const std::vector<uint8_t>& input) const;
+
+public:
+    Fuzzer(CPU* cpu, OS* os, Timer* timer, MemoryIO* memoryIO, Trap* trap);
+
+    void Run(const Options* options);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,690 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CloseSocket close
+#else
+// windows only, must come before Windows.h
+#include <winsock2.h>
+#pragma comment(lib, "Ws2_32.lib")
+#define CloseSocket closesocket
+#endif
+
+
+#include "GdbStub.h"
+#include "CPU.h"
+#include "Debugger.h"
+#include "MemoryIO.h"
+#include "VirtualMachine.h"
+
+
+// Value of a socket handle that is not open, matching both -1 and INVALID_SOCKET.
+static const uintptr_t NO_SOCKET = (uintptr_t)-1;
+
+// Instructions executed between two checks for an interrupt request from the debugger.
+static const uint32_t INTERRUPT_POLL_INTERVAL = 1 << 16;
+
+static const char* hexDigits = "0123456789abcdef";
+
+// Register layout reported to the debugger: R0-R7, PC and COND in Registers order. The PC is a byte
+// address like every other address the debugger sees, twice the word address, so it needs 32 bits.
+static const char* targetXml =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<feature name=\"org.lc3.core\">"
+    "<reg name=\"r0\" bitsize=\"16\" type=\"int\" regnum=\"0\"/>"
+    "<reg name=\"r1\" bitsize=\"16\" type=\"int\"/>"
+    "<reg name=\"r2\" bitsize=\"16\" type=\"int\"/>"
+    "<reg name=\"r3\" bitsize=\"16\" type=\"int\"/>"
+    "<reg name=\"r4\" bitsize=\"16\" type=\"int\"/>"
+    "<reg name=\"r5\" bitsize=\"16\" type=\"int\"/>"
+    "<reg name=\"r6\" bitsize=\"16\" type=\"data_ptr\"/>"
+    "<reg name=\"r7\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "<reg name=\"cond\" bitsize=\"16\" type=\"int\"/>"
+    "</feature>"
+    "</target>";
+
+
+/**
+ * @brief Returns the value of a hexadecimal digit, or -1 if the character is not one.
+ */
+static int HexValue(int c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/**
+ * @brief Appends a value as a number of hexadecimal digits, most significant byte first.
+ */
+static void AppendHex(std::string& text, uint32_t value, int digits)
+{
+    for (int shift = 4 * (digits - 1); shift >= 0; shift -= 4)
+    {
+        text += hexDigits[(value >> shift) & 0xF];
+    }
+}
+
+
+/**
+ * @brief Parses up to a number of hexadecimal digits into a value.
+ *
+ * @param text The digits, most significant first.
+ * @param digits Most digits to parse.
+ */
+static uint32_t ParseHex(const char* text, int digits)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < digits && HexValue(text[i]) >= 0; ++i)
+    {
+        value = (value << 4) | (uint32_t)HexValue(text[i]);
+    }
+    return value;
+}
+
+
+/**
+ * @brief Returns the number of hexadecimal digits of a register in 'g' and 'G' packets.
+ */
+static int RegisterDigits(int reg)
+{
+    return reg == Registers::R_PC ? 8 : 4;
+}
+
+
+/**
+ * @brief Returns the value of a register as the debugger sees it: the PC as a byte address.
+ */
+static uint32_t ExposeRegister(const uint16_t* registers, int reg)
+{
+    return reg == Registers::R_PC ? (uint32_t)registers[reg] * 2 : registers[reg];
+}
+
+
+/**
+ * @brief Sets a register from a value the debugger sent, converting the PC back to a word address.
+ */
+static void AcceptRegister(uint16_t* registers, int reg, uint32_t value)
+{
+    registers[reg] = (uint16_t)(reg == Registers::R_PC ? value >> 1 : value);
+}
+
+
+/**
+ * @brief Constructs a GdbStub serving an already wired virtual machine.
+ *
+ * @param cpu Pointer to the CPU object whose registers and memory are exposed.
+ * @param memoryIO Pointer to the MemoryIO object memory is written through.
+ * @param virtualMachine Pointer to the VirtualMachine object used for stepping.
+ * @param debugger Pointer to the Debugger object holding breakpoints and watchpoints.
+ */
+GdbStub::GdbStub(CPU* cpu, MemoryIO* memoryIO, VirtualMachine* virtualMachine, Debugger* debugger)
+{
+    cpuPtr = cpu;
+    memoryIOPtr = memoryIO;
+    virtualMachinePtr = virtualMachine;
+    debuggerPtr = debugger;
+    listener = NO_SOCKET;
+    client = NO_SOCKET;
+}
+
+
+/**
+ * @brief Closes the sockets.
+ */
+GdbStub::~GdbStub()
+{
+    if (client != NO_SOCKET)
+    {
+        CloseSocket(client);
+    }
+    if (listener != NO_SOCKET)
+    {
+        CloseSocket(listener);
+    }
+#if !defined(__linux__)
+    if (listening)
+    {
+        WSACleanup();
+    }
+#endif
+}
+
+
+/**
+ * @brief Starts listening for a debugger on the loopback interface.
+ *
+ * @param port The TCP port.
+ * @return Returns 1 on success, 0 if the port cannot be bound.
+ */
+int GdbStub::Listen(uint16_t port)
+{
+#if !defined(__linux__)
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    {
+        return 0;
+    }
+#endif
+    listening = true;
+
+    listener = (uintptr_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == NO_SOCKET)
+    {
+        return 0;
+    }
+
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 1) != 0)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Reads one byte from the debugger connection.
+ *
+ * @return The byte, or -1 if the connection is closed.
+ */
+int GdbStub::ReadByte()
+{
+    unsigned char c;
+    if (recv(client, (char*)&c, 1, 0) != 1)
+    {
+        return -1;
+    }
+    return c;
+}
+
+
+/**
+ * @brief Tells whether the debugger asked to stop the running program, without blocking.
+ *
+ * @return True on an interrupt request (Ctrl+C in gdb) or when the connection is closed.
+ */
+bool GdbStub::InterruptPending()
+{
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(client, &readable);
+    timeval timeout = { 0, 0 };
+
+    if (select((int)client + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+    {
+        return false;
+    }
+
+    int c = ReadByte();
+    return c == 0x03 || c < 0;
+}
+
+
+/**
+ * @brief Reads the next packet, acknowledging it, and skips anything outside of packets.
+ *
+ * @param packet Receives the packet data without framing.
+ * @return False if the connection is closed.
+ */
+bool GdbStub::ReadPacket(std::string& packet)
+{
+    for (;;)
+    {
+        int c = ReadByte();
+        if (c < 0)
+        {
+            return false;
+        }
+        if (c != '$')
+        {
+            // Acknowledgements and stray interrupt requests
+            continue;
+        }
+
+        packet.clear();
+        uint8_t sum = 0;
+        while ((c = ReadByte()) >= 0 && c != '#')
+        {
+            packet += (char)c;
+            sum += (uint8_t)c;
+        }
+
+        int high = ReadByte();
+        int low = ReadByte();
+        if (c < 0 || low < 0)
+        {
+            return false;
+        }
+
+        bool valid = HexValue(high) * 16 + HexValue(low) == sum;
+        send(client, valid ? "+" : "-", 1, 0);
+        if (valid)
+        {
+            return true;
+        }
+    }
+}
+
+
+/**
+ * @brief Sends a packet with its framing and checksum.
+ *
+ * @param data The packet data.
+ */
+void GdbStub::SendPacket(const std::string& data)
+{
+    uint8_t sum = 0;
+    for (char c : data)
+    {
+        sum += (uint8_t)c;
+    }
+
+    std::string framed = "$" + data + "#";
+    framed += hexDigits[sum >> 4];
+    framed += hexDigits[sum & 0xF];
+    send(client, framed.data(), (int)framed.size(), 0);
+}
+
+
+/**
+ * @brief Builds the stop reply for the current state, reporting a hit watchpoint if there is one.
+ *
+ * Addresses seen by the debugger are byte addresses: word N of memory is bytes 2N and 2N+1.
+ */
+std::string GdbStub::StopReply()
+{
+    if (!cpuPtr->running)
+    {
+        return "W00";
+    }
+
+    uint16_t address;
+    uint8_t kind;
+    if (debuggerPtr->TakeWatchHit(&address, &kind))
+    {
+        char reply[32];
+        snprintf(reply, sizeof(reply), "T05%s:%x;", kind == DA_WATCH_READ ? "rwatch" : "watch", address * 2);
+        return reply;
+    }
+    return "S05";
+}
+
+
+/**
+ * @brief Encodes R0-R7, PC and COND for a 'g' reply.
+ */
+std::string GdbStub::ReadRegisters() const
+{
+    std::string reply;
+    for (int r = Registers::R_0; r <= Registers::R_COND; ++r)
+    {
+        AppendHex(reply, ExposeRegister(cpuPtr->registers, r), RegisterDigits(r));
+    }
+    return reply;
+}
+
+
+/**
+ * @brief Applies a 'G' packet, setting the registers its data covers.
+ *
+ * @param hex The register values as hexadecimal digits, in 'g' reply order.
+ */
+void GdbStub::WriteRegisters(const char* hex)
+{
+    size_t length = strlen(hex);
+    size_t offset = 0;
+    for (int r = Registers::R_0; r <= Registers::R_COND && offset + RegisterDigits(r) <= length; ++r)
+    {
+        AcceptRegister(cpuPtr->registers, r, ParseHex(hex + offset, RegisterDigits(r)));
+        offset += RegisterDigits(r);
+    }
+}
+
+
+/**
+ * @brief Encodes a range of memory for an 'm' reply, words in big-endian byte order.
+ *
+ * Memory is read directly, so device registers are not updated by the debugger looking at them.
+ *
+ * @param address The first byte address.
+ * @param length Number of bytes.
+ */
+std::string GdbStub::ReadMemory(uint32_t address, uint32_t length) const
+{
+    std::string reply;
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        uint32_t byte = address + i;
+        uint16_t word = cpuPtr->memory[(byte >> 1) & 0xFFFF];
+        uint8_t value = (byte & 1) ? (uint8_t)word : (uint8_t)(word >> 8);
+        reply += hexDigits[value >> 4];
+        reply += hexDigits[value & 0xF];
+    }
+    return reply;
+}
+
+
+/**
+ * @brief Applies an 'M' packet to memory.
+ *
+ * Each changed word is stored through MemoryIO like a program store, so the state hash, the decoded
+ * and translated code and the dirty pages see it; the debugger's own watchpoints do not report it.
+ *
+ * @param address The first byte address.
+ * @param length Number of bytes.
+ * @param hex The bytes as hexadecimal digits.
+ */
+void GdbStub::WriteMemory(uint32_t address, uint32_t length, const char* hex)
+{
+    for (uint32_t i = 0; i < length && HexValue(hex[2 * i]) >= 0 && HexValue(hex[2 * i + 1]) >= 0; ++i)
+    {
+        uint32_t byte = address + i;
+        uint16_t wordAddress = (uint16_t)(byte >> 1);
+        uint16_t word = cpuPtr->memory[wordAddress];
+        uint8_t value = (uint8_t)(HexValue(hex[2 * i]) * 16 + HexValue(hex[2 * i + 1]));
+        word = (byte & 1) ? (uint16_t)((word & 0xFF00) | value) : (uint16_t)((word & 0x00FF) | (value << 8));
+        memoryIOPtr->Write(wordAddress, word);
+    }
+
+    uint16_t watched;
+    uint8_t kind;
+    debuggerPtr->TakeWatchHit(&watched, &kind);
+}
+
+
+/**
+ * @brief Answers a qXfer:features:read request for the register layout.
+ *
+ * @param query The request, "qXfer:features:read:target.xml:offset,length".
+ */
+std::string GdbStub::TargetDescription(const std::string& query) const
+{
+    unsigned int offset = 0;
+    unsigned int length = 0;
+    if (sscanf(query.c_str(), "qXfer:features:read:target.xml:%x,%x", &offset, &length) != 2)
+    {
+        return "E00";
+    }
+
+    size_t size = strlen(targetXml);
+    if (offset >= size)
+    {
+        return "l";
+    }
+
+    std::string chunk(targetXml + offset, std::min<size_t>(length, size - offset));
+    return (offset + chunk.size() < size ? "m" : "l") + chunk;
+}
+
+
+/**
+ * @brief Runs the program until a breakpoint, a watchpoint, an interrupt request or a halt.
+ *
+ * The program runs freely on the core between pages holding a breakpoint, as under the debugger
+ * console, in chunks of INTERRUPT_POLL_INTERVAL instructions between which the connection is
+ * checked for an interrupt request.
+ */
+std::string GdbStub::Continue()
+{
+    debuggerPtr->Resume();
+
+    uint64_t nextPoll = cpuPtr->instructionCount + INTERRUPT_POLL_INTERVAL;
+    while (cpuPtr->running)
+    {
+        if (debuggerPtr->ShouldBreak())
+        {
+            return StopReply();
+        }
+
+        // The instruction at the program counter may be a breakpoint the program resumes from
+        virtualMachinePtr->Step();
+        virtualMachinePtr->RunDebugged(debuggerPtr, nextPoll);
+
+        if (cpuPtr->instructionCount >= nextPoll)
+        {
+            nextPoll = cpuPtr->instructionCount + INTERRUPT_POLL_INTERVAL;
+            if (InterruptPending())
+            {
+                return "S02";
+            }
+        }
+    }
+
+    return "W00";
+}
+
+
+/**
+ * @brief Executes a single instruction.
+ */
+std::string GdbStub::Step()
+{
+    if (cpuPtr->running)
+    {
+        virtualMachinePtr->Step();
+    }
+    return StopReply();
+}
+
+
+/**
+ * @brief Inserts or removes a breakpoint or watchpoint from a 'Z' or 'z' packet.
+ *
+ * Types 0 and 1 are execution breakpoints, 2 write, 3 read and 4 access watchpoints.
+ *
+ * @param packet The packet, "Ztype,address,kind".
+ * @param insert True for 'Z', false for 'z'.
+ */
+std::string GdbStub::Breakpoint(const std::string& packet, bool insert)
+{
+    unsigned int type = 0;
+    unsigned int address = 0;
+    if (sscanf(packet.c_str() + 1, "%u,%x", &type, &address) != 2 || type > 4)
+    {
+        return "";
+    }
+
+    static const uint8_t attributes[] = { DA_BREAK, DA_BREAK, DA_WATCH_WRITE, DA_WATCH_READ, DA_WATCH_READ | DA_WATCH_WRITE };
+    uint16_t word = (uint16_t)(address >> 1);
+
+    if (!insert)
+    {
+        debuggerPtr->Remove(word, attributes[type]);
+    }
+    else if (type <= 1)
+    {
+        BreakCondition always = { 0, CO_ALWAYS, 0 };
+        debuggerPtr->SetBreakpoint(word, always);
+    }
+    else
+    {
+        debuggerPtr->SetWatchpoint(word, attributes[type]);
+    }
+    return "OK";
+}
+
+
+/**
+ * @brief Waits for a debugger to connect and serves its requests.
+ *
+ * The program starts stopped before its first instruction.
+ *
+ * @return Returns 1 to let the program run on (detach or lost connection), 0 to exit (kill).
+ */
+int GdbStub::Serve()
+{
+    fprintf(stderr, "gdb: waiting for a connection\n");
+
+    client = (uintptr_t)accept(listener, nullptr, nullptr);
+    if (client == NO_SOCKET)
+    {
+        return 1;
+    }
+
+    int noDelay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+    std::string packet;
+    while (ReadPacket(packet))
+    {
+        std::string reply;
+        const char* arguments = packet.c_str() + 1;
+        unsigned int address = 0;
+        unsigned int length = 0;
+        unsigned int reg = 0;
+
+        switch (packet.empty() ? 0 : packet[0])
+        {
+        case '?':
+            reply = cpuPtr->running ? "S05" : "W00";
+            break;
+        case 'g':
+            reply = ReadRegisters();
+            break;
+        case 'G':
+            WriteRegisters(arguments);
+            reply = "OK";
+            break;
+        case 'p':
+            if (sscanf(arguments, "%x", &reg) == 1 && reg <= Registers::R_COND)
+            {
+                AppendHex(reply, ExposeRegister(cpuPtr->registers, reg), RegisterDigits(reg));
+            }
+            else
+            {
+                reply = "E01";
+            }
+            break;
+        case 'P':
+        {
+            const char* value = strchr(arguments, '=');
+            if (sscanf(arguments, "%x=", &reg) == 1 && value && reg <= Registers::R_COND)
+            {
+                AcceptRegister(cpuPtr->registers, reg, ParseHex(value + 1, RegisterDigits(reg)));
+                reply = "OK";
+            }
+            else
+            {
+                reply = "E01";
+            }
+            break;
+        }
+        case 'm':
+            reply = sscanf(arguments, "%x,%x", &address, &length) == 2 ? ReadMemory(address, length) : "E01";
+            break;
+        case 'M':
+        {
+            const char* data = strchr(arguments, ':');
+            if (sscanf(arguments, "%x,%x:", &address, &length) == 2 && data)
+            {
+                WriteMemory(address, length, data + 1);
+                reply = "OK";
+            }
+            else
+            {
+                reply = "E01";
+            }
+            break;
+        }
+        case 'c':
+        case 's':
+            // Optional resume address, a byte address like the PC in 'g' replies
+            if (sscanf(arguments, "%x", &address) == 1)
+            {
+                AcceptRegister(cpuPtr->registers, Registers::R_PC, address);
+            }
+            reply = packet[0] == 'c' ? Continue() : Step();
+            break;
+        case 'Z':
+            reply = Breakpoint(packet, true);
+            break;
+        case 'z':
+            reply = Breakpoint(packet, false);
+            break;
+        case 'H':
+        case 'T':
+            reply = "OK";
+            break;
+        case 'q':
+            if (packet.rfind("qSupported", 0) == 0)
+            {
+                reply = "PacketSize=1000;qXfer:features:read+";
+            }
+            else if (packet.rfind("qXfer:features:read:target.xml:", 0) == 0)
+            {
+                reply = TargetDescription(packet);
+            }
+            else if (packet == "qAttached")
+            {
+                reply = "1";
+            }
+            else if (packet == "qC")
+            {
+                reply = "QC1";
+            }
+            else if (packet == "qfThreadInfo")
+            {
+                reply = "m1";
+            }
+            else if (packet == "qsThreadInfo")
+            {
+                reply = "l";
+            }
+            break;
+        case 'D':
+            SendPacket("OK");
+            return 1;
+        case 'k':
+            return 0;
+        }
+
+        SendPacket(reply);
+    }
+
+    // Connection lost, let the program run on
+    return 1;
+}
\ No newline at end of file
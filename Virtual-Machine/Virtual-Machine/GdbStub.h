@@ -0,0 +1,60 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef GDB_STUB_H
+#define GDB_STUB_H
+
+
+#include <cstdint>
+#include <string>
+
+
+class CPU;
+class MemoryIO;
+class VirtualMachine;
+class Debugger;
+
+
+class GdbStub
+{
+private:
+    CPU* cpuPtr;
+    MemoryIO* memoryIOPtr;
+    VirtualMachine* virtualMachinePtr;
+    Debugger* debuggerPtr;
+
+    // Listening and connected sockets (SOCKET on Windows, file descriptors elsewhere).
+    uintptr_t listener;
+    uintptr_t client;
+    bool listening = false;
+
+    int ReadByte();
+    bool InterruptPending();
+    bool ReadPacket(std::string& packet);
+    void SendPacket(const std::string& data);
+
+    std::string StopReply();
+    std::string ReadRegisters() const;
+    void WriteRegisters(const char* hex);
+    std::string ReadMemory(uint32_t address, uint32_t length) const;
+    void WriteMemory(uint32_t address, uint32_t length, const char* hex);
+    std::string TargetDescription(const std::string& query) const;
+    std::string Continue();
+    std::string Step();
+    std::string Breakpoint(const std::string& packet, bool insert);
+
+public:
+    GdbStub(CPU* cpu, MemoryIO* memoryIO, VirtualMachine* virtualMachine, Debugger* debugger);
+    ~GdbStub();
+
+    int Listen(uint16_t port);
+    int Serve();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,1018 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <algorithm>
+
+#include "IrTier.h"
+#include "ArithmeticLogicUnit.h"
+#include "MemoryIO.h"
+#include "CodeMap.h"
+
+
+enum IrLimits : uint16_t
+{
+    // Longest trace lifted into one region, in LC-3 instructions.
+    IR_MAX_INSTRUCTIONS = 1024,
+
+    // Regions entered at one address that self-modifying code may invalidate before it stays interpreted.
+    IR_MAX_INVALIDATIONS = 4,
+
+    // Heat of an address that is never compiled again.
+    IR_COLD = 0xFFFF
+};
+
+
+/**
+ * @brief Sign-extends the low bits of a value to 16 bits.
+ *
+ * @param value The value holding the field in its low bits.
+ * @param bits Width of the field.
+ * @return The sign-extended value.
+ */
+static uint16_t SignExtend(uint16_t value, int bits)
+{
+    return (uint16_t)((int16_t)(value << (16 - bits)) >> (16 - bits));
+}
+
+
+/**
+ * @brief Returns the condition flags a register holding the given value sets.
+ */
+static uint16_t FlagsOf(uint16_t value)
+{
+    return value == 0 ? ConditionFlags::FL_ZERO : (value >> 15) ? ConditionFlags::FL_NEGATIVE : ConditionFlags::FL_POSITIVE;
+}
+
+
+/**
+ * @brief Constructs an IR tier with no regions.
+ *
+ * @param cpu Pointer to the CPU object whose memory and registers regions work on.
+ * @param memoryIO Pointer to the MemoryIO object stores go through, so its observers see them.
+ * @param threshold Control transfers to an address after which the code there is compiled, below 65535.
+ */
+IrTier::IrTier(CPU* cpu, MemoryIO* memoryIO, uint32_t threshold)
+{
+    cpuPtr = cpu;
+    memoryIOPtr = memoryIO;
+    this->threshold = threshold;
+
+    heat.assign(MEMORY_MAX, 0);
+    regionIndex.assign(MEMORY_MAX, 0);
+    invalidations.assign(MEMORY_MAX, 0);
+    covered.assign(MEMORY_MAX, 0);
+    visiting.assign(MEMORY_MAX, 0);
+}
+
+
+/**
+ * @brief Attaches the code map told about every address lifted into a region.
+ *
+ * @param codeMap Pointer to the CodeMap object, or nullptr to detach it.
+ */
+void IrTier::SetCodeMap(CodeMap* codeMap)
+{
+    codeMapPtr = codeMap;
+}
+
+
+/**
+ * @brief Appends an operation to the region being lifted.
+ *
+ * @return The number of the operation, which is also that of its result.
+ */
+uint16_t IrTier::Emit(uint8_t opcode, uint16_t a, uint16_t b)
+{
+    IrOp op = { opcode, a, b, IR_NONE, IR_NONE };
+    building->ops.push_back(op);
+    return (uint16_t)(building->ops.size() - 1);
+}
+
+
+/**
+ * @brief Returns the value of an operation without side effects, reusing an equal one emitted before.
+ */
+uint16_t IrTier::Pure(uint8_t opcode, uint16_t a, uint16_t b)
+{
+    uint64_t key = ((uint64_t)opcode << 32) | ((uint64_t)a << 16) | b;
+    std::map<uint64_t, uint16_t>::const_iterator found = numbering.find(key);
+    if (found != numbering.end())
+    {
+        return found->second;
+    }
+
+    uint16_t value = Emit(opcode, a, b);
+    numbering[key] = value;
+    return value;
+}
+
+
+/**
+ * @brief Returns the value of a constant.
+ */
+uint16_t IrTier::Constant(uint16_t value)
+{
+    return Pure(IR_CONST, value, 0);
+}
+
+
+/**
+ * @brief Tells whether a value is a constant.
+ *
+ * @param value The value.
+ * @param constant Receives the constant if it is one.
+ */
+bool IrTier::IsConstant(uint16_t value, uint16_t* constant) const
+{
+    const IrOp& op = building->ops[value];
+    if (op.opcode != IR_CONST)
+    {
+        return false;
+    }
+
+    *constant = op.a;
+    return true;
+}
+
+
+/**
+ * @brief Returns a + b, folding constants and chains of constant additions.
+ */
+uint16_t IrTier::Add(uint16_t a, uint16_t b)
+{
+    uint16_t x, y;
+    if (IsConstant(a, &x))
+    {
+        if (IsConstant(b, &y))
+        {
+            return Constant(x + y);
+        }
+        std::swap(a, b);
+    }
+    else if (!IsConstant(b, &y) && b < a)
+    {
+        std::swap(a, b);
+    }
+
+    if (IsConstant(b, &y))
+    {
+        if (y == 0)
+        {
+            return a;
+        }
+
+        // (v + x) + y is v + (x + y)
+        IrOp inner = building->ops[a];
+        if (inner.opcode == IR_ADD && IsConstant(inner.b, &x))
+        {
+            return Add(inner.a, Constant(x + y));
+        }
+    }
+    return Pure(IR_ADD, a, b);
+}
+
+
+/**
+ * @brief Returns a & b, folding constants, masks that keep or clear every bit, and chains of masks.
+ */
+uint16_t IrTier::And(uint16_t a, uint16_t b)
+{
+    uint16_t x, y;
+    if (IsConstant(a, &x))
+    {
+        if (IsConstant(b, &y))
+        {
+            return Constant(x & y);
+        }
+        std::swap(a, b);
+    }
+    else if (!IsConstant(b, &y) && b < a)
+    {
+        std::swap(a, b);
+    }
+
+    if (a == b)
+    {
+        return a;
+    }
+
+    if (IsConstant(b, &y))
+    {
+        if (y == 0)
+        {
+            return b;
+        }
+        if (y == 0xFFFF)
+        {
+            return a;
+        }
+
+        IrOp inner = building->ops[a];
+        if (inner.opcode == IR_AND && IsConstant(inner.b, &x))
+        {
+            return And(inner.a, Constant(x & y));
+        }
+    }
+    return Pure(IR_AND, a, b);
+}
+
+
+/**
+ * @brief Returns ~a, folding constants and double negation.
+ */
+uint16_t IrTier::Not(uint16_t a)
+{
+    uint16_t x;
+    if (IsConstant(a, &x))
+    {
+        return Constant(~x);
+    }
+
+    const IrOp& inner = building->ops[a];
+    if (inner.opcode == IR_NOT)
+    {
+        return inner.a;
+    }
+    return Pure(IR_NOT, a, 0);
+}
+
+
+/**
+ * @brief Returns the condition flags of a, folded when a is a constant.
+ */
+uint16_t IrTier::Flags(uint16_t a)
+{
+    uint16_t x;
+    if (IsConstant(a, &x))
+    {
+        return Constant(FlagsOf(x));
+    }
+    return Pure(IR_FLAGS, a, 0);
+}
+
+
+/**
+ * @brief Returns the value of a register at this point of the trace.
+ */
+uint16_t IrTier::Reg(uint16_t r)
+{
+    if (current[r] == IR_NONE)
+    {
+        current[r] = Pure(IR_GET, r, 0);
+    }
+    return current[r];
+}
+
+
+/**
+ * @brief Gives a register a new value and sets the condition flags from it.
+ *
+ * Flags no branch or exit reads before they are set again are removed by Eliminate.
+ */
+void IrTier::SetResult(uint16_t r, uint16_t value)
+{
+    current[r] = value;
+    current[Registers::R_COND] = Flags(value);
+}
+
+
+/**
+ * @brief Returns the word at an address, reusing a load or store of the same address since the last store that may alias it.
+ *
+ * @param address Value of the address.
+ * @param pc Address of the instruction, which is left to the interpreter if the load reaches the device registers.
+ * @param count Instructions lifted before it.
+ */
+uint16_t IrTier::Load(uint16_t address, uint16_t pc, uint32_t count)
+{
+    for (size_t i = 0; i < loadAddresses.size(); ++i)
+    {
+        if (loadAddresses[i] == address)
+        {
+            return loadValues[i];
+        }
+    }
+
+    uint16_t constant;
+    bool below = IsConstant(address, &constant) && constant < MemoryMappedRegisters::MR_DEVICES;
+    uint16_t exit = below ? (uint16_t)IR_NONE : Exit(pc, IR_NONE, count);
+
+    uint16_t value = Emit(IR_LOAD, address, 0);
+    building->ops[value].exit = exit;
+
+    loadAddresses.push_back(address);
+    loadValues.push_back(value);
+    return value;
+}
+
+
+/**
+ * @brief Stores a word, forgetting the loads it may overwrite and forwarding it to later loads of the same address.
+ *
+ * @param address Value of the address.
+ * @param value Value stored.
+ * @param pc Address of the instruction, which is left to the interpreter if the store reaches the device registers.
+ * @param count Instructions lifted before it.
+ */
+void IrTier::Store(uint16_t address, uint16_t value, uint16_t pc, uint32_t count)
+{
+    uint16_t constant, other;
+    bool isConstant = IsConstant(address, &constant);
+
+    uint16_t exit = isConstant ? (uint16_t)IR_NONE : Exit(pc, IR_NONE, count);
+    uint16_t guard = Exit(pc + 1, IR_NONE, count + 1);
+
+    uint16_t op = Emit(IR_STORE, address, value);
+    building->ops[op].exit = exit;
+    building->ops[op].guard = guard;
+
+    // Only two different constant addresses are known not to alias
+    size_t kept = 0;
+    for (size_t i = 0; i < loadAddresses.size(); ++i)
+    {
+        if (loadAddresses[i] != address && isConstant && IsConstant(loadAddresses[i], &other) && other != constant)
+        {
+            loadAddresses[kept] = loadAddresses[i];
+            loadValues[kept] = loadValues[i];
+            ++kept;
+        }
+    }
+    loadAddresses.resize(kept);
+    loadValues.resize(kept);
+
+    loadAddresses.push_back(address);
+    loadValues.push_back(value);
+
+    if (isConstant)
+    {
+        storedAddresses.push_back(constant);
+    }
+}
+
+
+/**
+ * @brief Adds an exit leaving the registers as they are at this point of the trace.
+ *
+ * @param target Program counter to continue at.
+ * @param targetValue Value holding the program counter instead, or IR_NONE.
+ * @param instructions LC-3 instructions retired on leaving.
+ * @return The number of the exit.
+ */
+uint16_t IrTier::Exit(uint16_t target, uint16_t targetValue, uint32_t instructions)
+{
+    IrExit exit = {};
+    exit.target = target;
+    exit.targetValue = targetValue;
+    exit.instructions = (uint16_t)instructions;
+    exit.flagsValue = IR_NONE;
+
+    for (uint8_t r = 0; r < REGISTER_COUNT; ++r)
+    {
+        uint16_t value = current[r];
+        if (value == IR_NONE)
+        {
+            continue;
+        }
+
+        // A register still holding its value from the start of the pass needs no write
+        const IrOp& op = building->ops[value];
+        if (op.opcode == IR_GET && op.a == r)
+        {
+            continue;
+        }
+
+        // Flags are only computed when leaving, from the value that set them
+        if (r == Registers::R_COND && op.opcode == IR_FLAGS)
+        {
+            exit.flagsValue = op.a;
+            continue;
+        }
+
+        exit.writes[exit.writeCount].reg = r;
+        exit.writes[exit.writeCount].value = value;
+        ++exit.writeCount;
+    }
+
+    building->exits.push_back(exit);
+    return (uint16_t)(building->exits.size() - 1);
+}
+
+
+/**
+ * @brief Ends the trace with an unconditional exit.
+ */
+void IrTier::Jump(uint16_t target, uint16_t targetValue, uint32_t instructions)
+{
+    uint16_t exit = Exit(target, targetValue, instructions);
+    uint16_t op = Emit(IR_JUMP, 0, 0);
+    building->ops[op].exit = exit;
+}
+
+
+/**
+ * @brief Lifts the trace starting at an address into the region being built.
+ *
+ * The trace follows the fall-through path, unconditional branches, calls and returns to known
+ * addresses; conditional branches become exits. It ends before a trap, an RTI, a reserved opcode,
+ * a constant access to the device registers or code an earlier store of the trace overwrites, at a
+ * jump to an unknown address, and on coming back to its head or to another word it already holds.
+ * Constants are folded and registers copied as values while lifting, so that a register or flag
+ * overwritten before it is read never becomes an operation of its own.
+ *
+ * @param head The address the region is entered at.
+ * @return True if at least one instruction was lifted.
+ */
+bool IrTier::Lift(uint16_t head)
+{
+    IrRegion& region = *building;
+    const uint16_t* memory = cpuPtr->memory;
+
+    for (uint16_t& value : current)
+    {
+        value = IR_NONE;
+    }
+    numbering.clear();
+    loadAddresses.clear();
+    loadValues.clear();
+    storedAddresses.clear();
+
+    uint16_t pc = head;
+    uint32_t count = 0;
+
+    while (true)
+    {
+        if (count >= IR_MAX_INSTRUCTIONS || pc >= MemoryMappedRegisters::MR_DEVICES
+            || std::find(storedAddresses.begin(), storedAddresses.end(), pc) != storedAddresses.end())
+        {
+            Jump(pc, IR_NONE, count);
+            break;
+        }
+
+        if (codeMapPtr)
+        {
+            codeMapPtr->Execute(pc);
+        }
+
+        uint16_t instruction = memory[pc];
+        uint16_t next = pc + 1;
+        uint16_t dr = (instruction >> 9) & 0x0007;
+        uint16_t sr1 = (instruction >> 6) & 0x0007;
+        uint16_t pcOffset = next + SignExtend(instruction & 0x01FF, 9);
+        uint16_t target = next;
+        uint16_t address, constant;
+
+        // The instruction is left to the interpreter, or it ended the trace itself
+        bool before = false;
+        bool ended = false;
+
+        switch (instruction >> 12)
+        {
+        case OP_ADD:
+        case OP_AND:
+        {
+            uint16_t operand = (instruction & 0x0020) ? Constant(SignExtend(instruction & 0x001F, 5)) : Reg(instruction & 0x0007);
+            uint16_t source = Reg(sr1);
+            SetResult(dr, (instruction >> 12) == OP_ADD ? Add(source, operand) : And(source, operand));
+            break;
+        }
+        case OP_NOT:
+            SetResult(dr, Not(Reg(sr1)));
+            break;
+        case OP_LEA:
+            SetResult(dr, Constant(pcOffset));
+            break;
+        case OP_LD:
+        case OP_LDI:
+        case OP_ST:
+        case OP_STI:
+            if (pcOffset >= MemoryMappedRegisters::MR_DEVICES)
+            {
+                before = true;
+                break;
+            }
+
+            address = Constant(pcOffset);
+            if ((instruction >> 12) == OP_LDI || (instruction >> 12) == OP_STI)
+            {
+                address = Load(address, pc, count);
+            }
+
+            if ((instruction >> 12) == OP_LD || (instruction >> 12) == OP_LDI)
+            {
+                SetResult(dr, Load(address, pc, count));
+            }
+            else
+            {
+                Store(address, Reg(dr), pc, count);
+            }
+            break;
+        case OP_LDR:
+        case OP_STR:
+            address = Add(Reg(sr1), Constant(SignExtend(instruction & 0x003F, 6)));
+            if (IsConstant(address, &constant) && constant >= MemoryMappedRegisters::MR_DEVICES)
+            {
+                before = true;
+            }
+            else if ((instruction >> 12) == OP_LDR)
+            {
+                SetResult(dr, Load(address, pc, count));
+            }
+            else
+            {
+                Store(address, Reg(dr), pc, count);
+            }
+            break;
+        case OP_BR:
+        {
+            // dr holds the nzp mask; BR with none of them set is a no-op
+            if (dr == 0)
+            {
+                break;
+            }
+
+            // Flags set by an instruction of the trace always hold one of n, z and p
+            uint16_t flags = Reg(Registers::R_COND);
+            bool isConstant = IsConstant(flags, &constant);
+            const IrOp& setter = region.ops[flags];
+            if ((isConstant && (constant & dr)) || (dr == 0x0007 && setter.opcode == IR_FLAGS))
+            {
+                target = pcOffset;
+            }
+            else if (!isConstant)
+            {
+                // Test the value that set the flags rather than the flags themselves
+                uint16_t opcode = setter.opcode == IR_FLAGS ? IR_TEST : IR_BRANCH;
+                uint16_t tested = setter.opcode == IR_FLAGS ? setter.a : flags;
+                uint16_t exit = Exit(pcOffset, IR_NONE, count + 1);
+                uint16_t op = Emit((uint8_t)opcode, tested, dr);
+                region.ops[op].exit = exit;
+            }
+            break;
+        }
+        case OP_JMP:
+            address = Reg(sr1);
+            if (IsConstant(address, &constant))
+            {
+                target = constant;
+            }
+            else
+            {
+                Jump(0, address, count + 1);
+                ended = true;
+            }
+            break;
+        case OP_JSR:
+            // JSRR R7 jumps to the return address just written, as in ArithmeticLogicUnit::JSR
+            current[Registers::R_7] = Constant(next);
+            if (instruction & 0x0800)
+            {
+                target = next + SignExtend(instruction & 0x07FF, 11);
+                break;
+            }
+
+            address = Reg(sr1);
+            if (IsConstant(address, &constant))
+            {
+                target = constant;
+            }
+            else
+            {
+                Jump(0, address, count + 1);
+                ended = true;
+            }
+            break;
+        default:
+            // Traps, RTI and reserved opcodes
+            before = true;
+            break;
+        }
+
+        if (before)
+        {
+            Jump(pc, IR_NONE, count);
+            break;
+        }
+
+        ++count;
+        region.addresses.push_back(pc);
+        visiting[pc] = 1;
+
+        if (ended)
+        {
+            break;
+        }
+
+        if (target == head || visiting[target])
+        {
+            Jump(target, IR_NONE, count);
+            break;
+        }
+        pc = target;
+    }
+
+    for (uint16_t address : region.addresses)
+    {
+        visiting[address] = 0;
+    }
+    std::sort(region.addresses.begin(), region.addresses.end());
+
+    return count > 0;
+}
+
+
+/**
+ * @brief Removes operations whose values nothing uses and renumbers the rest.
+ *
+ * Stores, branches, jumps and loads that may reach the device registers are kept, and so are the
+ * values exits write back. Everything else, such as flags set and overwritten without a branch in
+ * between, is only kept if a kept operation reads it.
+ */
+void IrTier::Eliminate()
+{
+    std::vector<IrOp>& ops = building->ops;
+    std::vector<uint8_t> live(ops.size(), 0);
+
+    for (const IrExit& exit : building->exits)
+    {
+        for (uint8_t i = 0; i < exit.writeCount; ++i)
+        {
+            live[exit.writes[i].value] = 1;
+        }
+        if (exit.targetValue != IR_NONE)
+        {
+            live[exit.targetValue] = 1;
+        }
+        if (exit.flagsValue != IR_NONE)
+        {
+            live[exit.flagsValue] = 1;
+        }
+    }
+
+    // Operands always come before their users, so one backward pass reaches them all
+    for (size_t i = ops.size(); i-- > 0;)
+    {
+        const IrOp& op = ops[i];
+        switch (op.opcode)
+        {
+        case IR_LOAD:
+            live[i] |= op.exit != IR_NONE;
+            break;
+        case IR_STORE:
+        case IR_BRANCH:
+        case IR_TEST:
+        case IR_JUMP:
+            live[i] = 1;
+            break;
+        }
+
+        if (!live[i])
+        {
+            continue;
+        }
+
+        switch (op.opcode)
+        {
+        case IR_ADD:
+        case IR_AND:
+        case IR_STORE:
+            live[op.a] = 1;
+            live[op.b] = 1;
+            break;
+        case IR_NOT:
+        case IR_FLAGS:
+        case IR_LOAD:
+        case IR_BRANCH:
+        case IR_TEST:
+            live[op.a] = 1;
+            break;
+        }
+    }
+
+    // Constants move to the front, where Execute sets them once per entry
+    std::vector<IrOp> compacted;
+    std::vector<uint16_t> renumbered(ops.size(), IR_NONE);
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        if (live[i] && ops[i].opcode == IR_CONST)
+        {
+            renumbered[i] = (uint16_t)compacted.size();
+            compacted.push_back(ops[i]);
+        }
+    }
+    building->constantCount = (uint16_t)compacted.size();
+
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        if (!live[i] || ops[i].opcode == IR_CONST)
+        {
+            continue;
+        }
+
+        IrOp op = ops[i];
+        switch (op.opcode)
+        {
+        case IR_ADD:
+        case IR_AND:
+        case IR_STORE:
+            op.a = renumbered[op.a];
+            op.b = renumbered[op.b];
+            break;
+        case IR_NOT:
+        case IR_FLAGS:
+        case IR_LOAD:
+        case IR_BRANCH:
+        case IR_TEST:
+            op.a = renumbered[op.a];
+            break;
+        }
+
+        renumbered[i] = (uint16_t)compacted.size();
+        compacted.push_back(op);
+    }
+
+    liftedOps += ops.size();
+    optimizedOps += compacted.size();
+    ops.swap(compacted);
+
+    for (IrExit& exit : building->exits)
+    {
+        for (uint8_t i = 0; i < exit.writeCount; ++i)
+        {
+            exit.writes[i].value = renumbered[exit.writes[i].value];
+        }
+        if (exit.targetValue != IR_NONE)
+        {
+            exit.targetValue = renumbered[exit.targetValue];
+        }
+        if (exit.flagsValue != IR_NONE)
+        {
+            exit.flagsValue = renumbered[exit.flagsValue];
+        }
+    }
+}
+
+
+/**
+ * @brief Lifts, optimizes and registers the region entered at an address.
+ *
+ * @param head The address the region is entered at.
+ * @return True if a region was compiled.
+ */
+bool IrTier::Compile(uint16_t head)
+{
+    regions.emplace_back();
+    building = &regions.back();
+    building->head = head;
+    building->valid = true;
+
+    if (!Lift(head))
+    {
+        regions.pop_back();
+        building = nullptr;
+        return false;
+    }
+
+    Eliminate();
+
+    for (uint16_t address : building->addresses)
+    {
+        ++covered[address];
+    }
+    liftedInstructions += building->addresses.size();
+
+    regionIndex[head] = (uint32_t)regions.size();
+    building = nullptr;
+    return true;
+}
+
+
+/**
+ * @brief Stops entering a region, for its code was overwritten or it cannot make progress.
+ *
+ * @param region The region.
+ * @param cold True to never compile at its head again.
+ */
+void IrTier::Discard(IrRegion& region, bool cold)
+{
+    region.valid = false;
+    for (uint16_t address : region.addresses)
+    {
+        --covered[address];
+    }
+    regionIndex[region.head] = 0;
+    ++invalidatedRegions;
+
+    if (++invalidations[region.head] >= IR_MAX_INVALIDATIONS)
+    {
+        cold = true;
+    }
+    heat[region.head] = cold ? (uint16_t)IR_COLD : 0;
+}
+
+
+/**
+ * @brief Executes a region until it leaves through an exit to anywhere but its head, or one that
+ * retired no instruction, continuing in the region entered at the exit's target if there is one.
+ *
+ * Each pass reads the registers it needs when it starts and writes back the ones it changed when
+ * it leaves; loads read memory directly, stores go through MemoryIO.
+ *
+ * @param region The region.
+ */
+void IrTier::Execute(IrRegion* region)
+{
+    uint16_t* registers = cpuPtr->registers;
+    const uint16_t* memory = cpuPtr->memory;
+
+    while (true)
+    {
+        const IrOp* ops = region->ops.data();
+        const IrExit* exits = region->exits.data();
+        if (values.size() < region->ops.size())
+        {
+            values.resize(region->ops.size());
+        }
+        uint16_t* v = values.data();
+
+        for (uint16_t i = 0; i < region->constantCount; ++i)
+        {
+            v[i] = ops[i].a;
+        }
+
+        const IrExit* exit;
+        uint16_t pc;
+        do
+        {
+            exit = nullptr;
+            for (size_t i = region->constantCount; !exit; ++i)
+            {
+                const IrOp& op = ops[i];
+                switch (op.opcode)
+                {
+                case IR_GET:
+                    v[i] = registers[op.a];
+                    break;
+                case IR_ADD:
+                    v[i] = v[op.a] + v[op.b];
+                    break;
+                case IR_AND:
+                    v[i] = v[op.a] & v[op.b];
+                    break;
+                case IR_NOT:
+                    v[i] = ~v[op.a];
+                    break;
+                case IR_FLAGS:
+                    v[i] = FlagsOf(v[op.a]);
+                    break;
+                case IR_LOAD:
+                    if (v[op.a] >= MemoryMappedRegisters::MR_DEVICES)
+                    {
+                        exit = &exits[op.exit];
+                        break;
+                    }
+                    v[i] = memory[v[op.a]];
+                    break;
+                case IR_STORE:
+                    if (v[op.a] >= MemoryMappedRegisters::MR_DEVICES)
+                    {
+                        exit = &exits[op.exit];
+                        break;
+                    }
+                    memoryIOPtr->Write(v[op.a], v[op.b]);
+
+                    // Guard: the store overwrote code of this region, which must not run stale
+                    if (!region->valid)
+                    {
+                        exit = &exits[op.guard];
+                    }
+                    break;
+                case IR_BRANCH:
+                    if (v[op.a] & op.b)
+                    {
+                        exit = &exits[op.exit];
+                    }
+                    break;
+                case IR_TEST:
+                    if (FlagsOf(v[op.a]) & op.b)
+                    {
+                        exit = &exits[op.exit];
+                    }
+                    break;
+                case IR_JUMP:
+                    exit = &exits[op.exit];
+                    break;
+                }
+            }
+
+            for (uint8_t i = 0; i < exit->writeCount; ++i)
+            {
+                registers[exit->writes[i].reg] = v[exit->writes[i].value];
+            }
+            if (exit->flagsValue != IR_NONE)
+            {
+                registers[Registers::R_COND] = FlagsOf(v[exit->flagsValue]);
+            }
+            pc = exit->targetValue == IR_NONE ? exit->target : v[exit->targetValue];
+            registers[Registers::R_PC] = pc;
+            cpuPtr->instructionCount += exit->instructions;
+            regionInstructions += exit->instructions;
+
+            // An exit back to the head that retired nothing, e.g. at an LDI of the keyboard status
+            // register, would be taken again forever; the interpreter must execute that instruction
+        } while (pc == region->head && region->valid && exit->instructions != 0);
+
+        // A region that cannot get past its first instruction only costs time
+        if (exit->instructions == 0)
+        {
+            if (region->valid)
+            {
+                Discard(*region, true);
+            }
+            return;
+        }
+
+        uint32_t index = regionIndex[pc];
+        if (index == 0)
+        {
+            return;
+        }
+        region = &regions[index - 1];
+    }
+}
+
+
+/**
+ * @brief Counts a control transfer to an address and executes the region entered there, compiling it once hot.
+ *
+ * @param address The address control was transferred to, below the device registers.
+ * @return True if a region was executed; the CPU then holds the state it left.
+ */
+bool IrTier::Enter(uint16_t address)
+{
+    uint32_t index = regionIndex[address];
+    if (index == 0)
+    {
+        if (heat[address] == IR_COLD || ++heat[address] < threshold)
+        {
+            return false;
+        }
+        if (!Compile(address))
+        {
+            heat[address] = IR_COLD;
+            return false;
+        }
+        index = regionIndex[address];
+    }
+
+    Execute(&regions[index - 1]);
+    return true;
+}
+
+
+/**
+ * @brief Drops every region lifted from an address whose memory word was written.
+ *
+ * @param address The address that was written.
+ */
+void IrTier::Invalidate(uint16_t address)
+{
+    if (covered[address] == 0)
+    {
+        return;
+    }
+
+    for (IrRegion& region : regions)
+    {
+        if (region.valid && std::binary_search(region.addresses.begin(), region.addresses.end(), address))
+        {
+            Discard(region, false);
+        }
+    }
+}
+
+
+/**
+ * @brief Prints how many regions were compiled, how much the IR shrank and how much of the run they took.
+ *
+ * @param out The stream to print to.
+ */
+void IrTier::Report(FILE* out) const
+{
+    fprintf(out, "ir tier: %zu regions compiled, %llu discarded\n", regions.size(), (unsigned long long)invalidatedRegions);
+    fprintf(out, "ir tier: %llu instructions lifted into %llu operations, %llu after dead code elimination\n",
+        (unsigned long long)liftedInstructions, (unsigned long long)liftedOps, (unsigned long long)optimizedOps);
+
+    uint64_t total = cpuPtr->instructionCount;
+    fprintf(out, "ir tier: %llu of %llu instructions retired in regions (%.1f%%)\n",
+        (unsigned long long)regionInstructions, (unsigned long long)total, total ? 100.0 * regionInstructions / total : 0.0);
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef IR_TIER_H
+#define IR_TIER_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "CPU.h"
+
+
+class MemoryIO;
+class CodeMap;
+
+
+enum IrOpcodes : uint8_t
+{
+    IR_GET = 0, // the value register a held when the pass started
+    IR_CONST,   // the constant a
+    IR_ADD,     // a + b
+    IR_AND,     // a & b
+    IR_NOT,     // ~a
+    IR_FLAGS,   // the condition flags of a, as R_COND holds them
+    IR_LOAD,    // memory[a]; leaves through exit instead of reading a device register
+    IR_STORE,   // memory[a] = b; leaves through exit instead of writing a device register, and through guard when it overwrote the region
+    IR_BRANCH,  // leaves through exit if a & b, the mask of a BR
+    IR_TEST,    // leaves through exit if the condition flags of a match the mask b
+    IR_JUMP     // leaves through exit
+};
+
+
+enum IrValues : uint16_t
+{
+    // No value: a register left unchanged, or an exit to a fixed address.
+    IR_NONE = 0xFFFF
+};
+
+
+// One operation of a region. Its result, if any, is the value numbered like the operation.
+struct IrOp
+{
+    uint8_t opcode; // IrOpcodes value
+    uint16_t a;     // first operand value, register number or constant
+    uint16_t b;     // second operand value or branch mask
+    uint16_t exit;  // exit taken by a branch, a jump, or a load or store reaching the device registers
+    uint16_t guard; // exit taken by a store that overwrote the region's code
+};
+
+
+// Register written on leaving a region.
+struct IrWrite
+{
+    uint8_t reg;
+    uint16_t value;
+};
+
+
+// A way out of a region: the machine state the interpreter continues from.
+struct IrExit
+{
+    uint16_t target;        // program counter, unless targetValue holds it
+    uint16_t targetValue;   // value holding the program counter, or IR_NONE
+    uint16_t instructions;  // LC-3 instructions retired by leaving here
+    uint16_t flagsValue;    // value whose condition flags R_COND receives, or IR_NONE
+    uint8_t writeCount;
+    IrWrite writes[REGISTER_COUNT];
+};
+
+
+// A trace of LC-3 code entered at its head, lifted into IR and optimized. An exit back to the head
+// starts the next pass without returning to the interpreter.
+struct IrRegion
+{
+    uint16_t head;
+    bool valid;
+
+    // Operations, starting with the constants, which are only evaluated on entering the region.
+    std::vector<IrOp> ops;
+    uint16_t constantCount;
+
+    std::vector<IrExit> exits;
+
+    // Words the region was lifted from, each once.
+    std::vector<uint16_t> addresses;
+};
+
+
+// Second execution tier on top of the decode cache. Counts how often each address is reached by a
+// control transfer; once one passes the threshold, the code from there is lifted into a region of
+// value-numbered IR, optimized and from then on executed by a small interpreter over the IR.
+class IrTier
+{
+private:
+    CPU* cpuPtr;
+    MemoryIO* memoryIOPtr;
+    CodeMap* codeMapPtr = nullptr;
+    uint32_t threshold;
+
+    // Per address: transfers counted so far, the index plus one of its region, and how often
+    // regions entered there were invalidated by self-modifying code.
+    std::vector<uint16_t> heat;
+    std::vector<uint32_t> regionIndex;
+    std::vector<uint8_t> invalidations;
+
+    // Per address: number of valid regions lifted from that word.
+    std::vector<uint16_t> covered;
+
+    // Per address: set while the word is part of the trace being lifted.
+    std::vector<uint8_t> visiting;
+
+    std::vector<IrRegion> regions;
+    std::vector<uint16_t> values;
+
+    // Lifting state: the region being built, its value numbering and the value of every register.
+    IrRegion* building = nullptr;
+    std::map<uint64_t, uint16_t> numbering;
+    uint16_t current[REGISTER_COUNT];
+    std::vector<uint16_t> loadAddresses;
+    std::vector<uint16_t> loadValues;
+    std::vector<uint16_t> storedAddresses;
+
+    uint64_t liftedInstructions = 0;
+    uint64_t liftedOps = 0;
+    uint64_t optimizedOps = 0;
+    uint64_t invalidatedRegions = 0;
+    uint64_t regionInstructions = 0;
+
+    uint16_t Emit(uint8_t opcode, uint16_t a, uint16_t b);
+    uint16_t Constant(uint16_t value);
+    bool IsConstant(uint16_t value, uint16_t* constant) const;
+    uint16_t Pure(uint8_t opcode, uint16_t a, uint16_t b);
+    uint16_t Add(uint16_t a, uint16_t b);
+    uint16_t And(uint16_t a, uint16_t b);
+    uint16_t Not(uint16_t a);
+    uint16_t Flags(uint16_t a);
+    uint16_t Reg(uint16_t r);
+    void SetResult(uint16_t r, uint16_t value);
+    uint16_t Load(uint16_t address, uint16_t pc, uint32_t count);
+    void Store(uint16_t address, uint16_t value, uint16_t pc, uint32_t count);
+    uint16_t Exit(uint16_t target, uint16_t targetValue, uint32_t instructions);
+    void Jump(uint16_t target, uint16_t targetValue, uint32_t instructions);
+    bool Lift(uint16_t head);
+    void Eliminate();
+    bool Compile(uint16_t head);
+    void Discard(IrRegion& region, bool cold);
+    void Execute(IrRegion* region);
+
+public:
+    IrTier(CPU* cpu, MemoryIO* memoryIO, uint32_t threshold);
+
+    void SetCodeMap(CodeMap* codeMap);
+
+    bool Enter(uint16_t address);
+    void Invalidate(uint16_t address);
+    void Report(FILE* out) const;
+};
+#endif
\ No newline at end of file
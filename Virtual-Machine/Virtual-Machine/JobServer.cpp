@@ -0,0 +1,650 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CloseSocket close
+#else
+// windows only, must come before Windows.h
+#include <winsock2.h>
+#pragma comment(lib, "Ws2_32.lib")
+#define CloseSocket closesocket
+#endif
+
+
+#include "JobServer.h"
+#include "ArithmeticLogicUnit.h"
+#include "MemoryIO.h"
+#include "Metrics.h"
+#include "OS.h"
+#include "StateHash.h"
+#include "Options.h"
+#include "Timer.h"
+#include "Trap.h"
+#include "VirtualMachine.h"
+#include "VmCore.h"
+
+
+// Value of a socket handle that is not open, matching both -1 and INVALID_SOCKET.
+static const uintptr_t NO_SOCKET = (uintptr_t)-1;
+
+// Longest request line accepted from a client.
+static const size_t MAX_LINE = 256;
+
+static const char* resultNames[] = { "halted", "budget", "input", "crash", "loop" };
+
+
+// A complete virtual machine owned by one worker thread.
+struct JobMachine
+{
+    CPU cpu;
+    OS os;
+    Timer timer;
+    Trap trap;
+    MemoryIO memoryIO;
+    ArithmeticLogicUnit alu;
+    VirtualMachine virtualMachine;
+    StateHash stateHash;
+
+    // Timer state of a freshly started machine.
+    TimerState timerState;
+
+    // Pages written by the last job; only these are restored when the next job runs the same image.
+    uint8_t dirtyPages[PAGE_COUNT];
+    int32_t loadedImage = -1;
+
+    // Number of the machine in the scheduler.
+    uint32_t index = 0;
+
+    std::string output;
+
+    JobMachine(uint32_t instructionsPerTick)
+        : timer(&cpu, instructionsPerTick, false),
+          trap(cpu.memory, cpu.registers, &cpu, &os),
+          memoryIO(cpu.memory, &os, &timer),
+          alu(cpu.memory, cpu.registers, &memoryIO, &cpu),
+          virtualMachine(&cpu, &os, &trap, &memoryIO, &alu),
+          stateHash(&cpu)
+    {
+        timerState = timer.SaveState();
+        memset(dirtyPages, 0, sizeof(dirtyPages));
+        memset(cpu.memory, 0, sizeof(cpu.memory));
+        memoryIO.SetDirtyPages(dirtyPages);
+        memoryIO.SetStateHash(&stateHash);
+        os.SetOutputCapture(&output);
+    }
+};
+
+
+/**
+ * @brief Sends a whole buffer to a client.
+ *
+ * @return False if the connection is closed.
+ */
+static bool SendAll(uintptr_t client, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        int sent = send(client, data, (int)length, 0);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Receives exactly length bytes from a client.
+ *
+ * @return False if the connection is closed first.
+ */
+static bool ReceiveAll(uintptr_t client, char* data, size_t length)
+{
+    while (length > 0)
+    {
+        int received = recv(client, data, (int)length, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        data += received;
+        length -= received;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Receives one newline-terminated request line, without the newline.
+ *
+ * @return False if the connection is closed or the line is too long.
+ */
+static bool ReceiveLine(uintptr_t client, std::string& line)
+{
+    line.clear();
+    char c;
+    while (recv(client, &c, 1, 0) == 1)
+    {
+        if (c == '\n')
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            return true;
+        }
+        if (line.size() >= MAX_LINE)
+        {
+            return false;
+        }
+        line += c;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Sends captured program output as an OUT frame and clears it.
+ *
+ * @return False if the connection is closed.
+ */
+static bool SendOutput(uintptr_t client, std::string& output)
+{
+    char header[32];
+    int length = snprintf(header, sizeof(header), "OUT %zu\n", output.size());
+    bool sent = SendAll(client, header, length) && SendAll(client, output.data(), output.size());
+    output.clear();
+    return sent;
+}
+
+
+/**
+ * @brief Returns the number of CPUs jobs share: the one requested, or one per hardware thread.
+ */
+static uint32_t ServerCpus(uint32_t requested)
+{
+    uint32_t cpus = requested ? requested : std::thread::hardware_concurrency();
+    return cpus ? cpus : 1;
+}
+
+
+/**
+ * @brief Constructs a JobServer for the images given on the command line.
+ *
+ * @param options Parsed command-line options holding the image paths, timer and scheduler settings.
+ */
+JobServer::JobServer(const Options* options)
+    : scheduler(ServerCpus(options->serveCpus), options->serveSlice)
+{
+    optionsPtr = options;
+    listener = NO_SOCKET;
+}
+
+
+/**
+ * @brief Stops the workers and closes the listening socket.
+ */
+JobServer::~JobServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        stopping = true;
+    }
+    pendingReady.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    if (listener != NO_SOCKET)
+    {
+        CloseSocket(listener);
+    }
+#if !defined(__linux__)
+    if (listening)
+    {
+        WSACleanup();
+    }
+#endif
+}
+
+
+/**
+ * @brief Loads every image once and keeps its post-load memory as the starting point of jobs.
+ *
+ * Images are identified by their position on the command line, starting at 0.
+ *
+ * @return Returns 1 on success, 0 if an image cannot be read.
+ */
+int JobServer::Preload()
+{
+    std::unique_ptr<JobMachine> loader(new JobMachine(optionsPtr->timerInstructionsPerTick));
+
+    for (const char* imagePath : optionsPtr->imagePaths)
+    {
+        memset(loader->cpu.memory, 0, sizeof(loader->cpu.memory));
+        loader->cpu.segments.clear();
+        loader->cpu.registers[Registers::R_PC] = PC::PC_START;
+
+        if (!loader->cpu.ReadImage(imagePath, &loader->alu))
+        {
+            printf("failed to load image: %s\n", imagePath);
+            return 0;
+        }
+
+        PreloadedImage image;
+        image.path = imagePath;
+        image.memory.assign(loader->cpu.memory, loader->cpu.memory + MEMORY_MAX);
+        image.segments = loader->cpu.segments;
+        image.entry = loader->cpu.registers[Registers::R_PC];
+        loader->stateHash.Recompute();
+        image.memoryHash = loader->stateHash.MemoryHash();
+        images.push_back(image);
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Starts listening for clients on the loopback interface.
+ *
+ * @param port The TCP port.
+ * @return Returns 1 on success, 0 if the port cannot be bound.
+ */
+int JobServer::Listen(uint16_t port)
+{
+#if !defined(__linux__)
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    {
+        return 0;
+    }
+#endif
+    listening = true;
+
+    listener = (uintptr_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == NO_SOCKET)
+    {
+        return 0;
+    }
+
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Accepts clients and hands each to the next free worker until accepting fails.
+ *
+ * There may be more workers than CPUs: the scheduler lets only as many jobs run at a time as
+ * there are CPUs and time-slices them.
+ *
+ * @param workerCount Number of worker threads, each with its own machine; 0 for four per CPU.
+ */
+void JobServer::Serve(uint32_t workerCount)
+{
+    uint32_t cpus = ServerCpus(optionsPtr->serveCpus);
+    if (workerCount == 0)
+    {
+        workerCount = 4 * cpus;
+    }
+    scheduler.AddMachines(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        workers.emplace_back(&JobServer::Work, this, i);
+    }
+
+    fprintf(stderr, "serve: %zu images, %u workers, %u cpus\n", images.size(), workerCount, cpus);
+
+    for (;;)
+    {
+        uintptr_t client = (uintptr_t)accept(listener, nullptr, nullptr);
+        if (client == NO_SOCKET)
+        {
+            break;
+        }
+
+        int noDelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.push_back(client);
+        }
+        pendingReady.notify_one();
+    }
+}
+
+
+/**
+ * @brief Worker thread: serves one client connection at a time on a machine of its own.
+ *
+ * @param index Number of the worker's machine in the scheduler.
+ */
+void JobServer::Work(uint32_t index)
+{
+    std::unique_ptr<JobMachine> machine(new JobMachine(optionsPtr->timerInstructionsPerTick));
+    machine->index = index;
+
+    for (;;)
+    {
+        uintptr_t client;
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            pendingReady.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty())
+            {
+                return;
+            }
+            client = pending.front();
+            pending.pop_front();
+        }
+
+        ServeClient(client, machine.get());
+        CloseSocket(client);
+    }
+}
+
+
+/**
+ * @brief Answers the requests of one client until it quits or disconnects.
+ *
+ * Requests are lines: "LIST" returns the preloaded images, "RUN image budget length [deadline]"
+ * followed by length bytes of keyboard input runs a job, due deadline milliseconds later if given,
+ * "TENANT name weight mips" sets the share and cap of a tenant and bills the connection's later
+ * jobs to it, "STATS" returns the CPU usage per tenant and machine, and "QUIT" closes the connection.
+ *
+ * @param client The connected socket.
+ * @param machine The worker's machine.
+ */
+void JobServer::ServeClient(uintptr_t client, JobMachine* machine)
+{
+    std::string line;
+    std::vector<uint8_t> input;
+    std::string tenant = "default";
+
+    while (ReceiveLine(client, line))
+    {
+        unsigned int image = 0;
+        unsigned long long budget = 0;
+        unsigned int length = 0;
+        unsigned long long deadline = 0;
+        char name[SCHEDULER_MAX_NAME + 1];
+        unsigned int weight = 0;
+        unsigned int mips = 0;
+
+        if (line == "QUIT")
+        {
+            return;
+        }
+        else if (line == "LIST")
+        {
+            std::string reply = "IMAGES " + std::to_string(images.size()) + "\n";
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                reply += std::to_string(i) + " " + images[i].path + "\n";
+            }
+            if (!SendAll(client, reply.data(), reply.size()))
+            {
+                return;
+            }
+        }
+        else if (line == "STATS")
+        {
+            std::string reply = scheduler.Report();
+            if (!SendAll(client, reply.data(), reply.size()))
+            {
+                return;
+            }
+        }
+        else if (sscanf(line.c_str(), "TENANT %31s %u %u", name, &weight, &mips) == 3)
+        {
+            const char* reply = "OK\n";
+            if (scheduler.SetTenant(name, weight, mips))
+            {
+                tenant = name;
+            }
+            else
+            {
+                reply = "ERR weight must be from 1 to 10000\n";
+            }
+            if (!SendAll(client, reply, strlen(reply)))
+            {
+                return;
+            }
+        }
+        else if (sscanf(line.c_str(), "RUN %u %llu %u %llu", &image, &budget, &length, &deadline) >= 3)
+        {
+            if (length > JOB_MAX_INPUT)
+            {
+                // The input cannot be skipped safely, so the connection is dropped
+                const char* reply = "ERR input too long\n";
+                SendAll(client, reply, strlen(reply));
+                return;
+            }
+
+            input.resize(length);
+            if (length > 0 && !ReceiveAll(client, (char*)input.data(), length))
+            {
+                return;
+            }
+
+            if (image >= images.size() || budget == 0)
+            {
+                const char* reply = image >= images.size() ? "ERR unknown image\n" : "ERR budget must be positive\n";
+                if (!SendAll(client, reply, strlen(reply)))
+                {
+                    return;
+                }
+                continue;
+            }
+
+            RunJob(client, machine, image, budget, input, tenant, deadline);
+        }
+        else
+        {
+            const char* reply = "ERR unknown request\n";
+            if (!SendAll(client, reply, strlen(reply)))
+            {
+                return;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Runs one job from the pristine state of its image, streaming its output to the client.
+ *
+ * Memory is restored from the preloaded image: in full when the machine last ran a different image,
+ * otherwise only the pages the last job wrote. Output is sent in OUT frames while the job runs, and
+ * the job ends with an END line holding the outcome, the instruction count and R0-R7, PC and COND.
+ * The job runs a scheduler slice at a time and streams its output between slices, without a CPU.
+ *
+ * @param client The connected socket.
+ * @param machine The worker's machine.
+ * @param image Index of the preloaded image.
+ * @param budget Maximum number of instructions to execute.
+ * @param input The bytes fed to the program as keyboard input.
+ * @param tenant The tenant the job is billed to.
+ * @param deadline Milliseconds from now the job should be done in, 0 for none.
+ */
+void JobServer::RunJob(uintptr_t client, JobMachine* machine, uint32_t image, uint64_t budget, const std::vector<uint8_t>& input,
+    const std::string& tenant, uint64_t deadline)
+{
+    CPU& cpu = machine->cpu;
+    const PreloadedImage& preloaded = images[image];
+
+    if (machine->loadedImage != (int32_t)image)
+    {
+        memcpy(cpu.memory, preloaded.memory.data(), MEMORY_MAX * sizeof(uint16_t));
+        cpu.segments = preloaded.segments;
+        machine->loadedImage = image;
+    }
+    else
+    {
+        // Device registers are updated on reads as well, so their page is always restored
+        machine->dirtyPages[MemoryMappedRegisters::MR_DEVICES >> PAGE_SHIFT] = 1;
+
+        for (int page = 0; page < PAGE_COUNT; ++page)
+        {
+            if (machine->dirtyPages[page])
+            {
+                uint32_t offset = (uint32_t)page << PAGE_SHIFT;
+                memcpy(cpu.memory + offset, preloaded.memory.data() + offset, (1 << PAGE_SHIFT) * sizeof(uint16_t));
+            }
+        }
+    }
+    memset(machine->dirtyPages, 0, sizeof(machine->dirtyPages));
+    machine->stateHash.SetMemoryHash(preloaded.memoryHash);
+    machine->stateHash.ClearSamples();
+
+    memset(cpu.registers, 0, sizeof(cpu.registers));
+    cpu.registers[Registers::R_PC] = preloaded.entry;
+    cpu.registers[Registers::R_COND] = ConditionFlags::FL_ZERO;
+    cpu.instructionCount = 0;
+    cpu.running = 1;
+    machine->timer.RestoreState(machine->timerState);
+
+    machine->os.SetScriptedInput(input.data(), input.size());
+    machine->output.clear();
+
+    // Memory goes through MemoryIO for the dirty page table and the state hash
+    VmCore<ObservedMemory, ScriptedIo, NoInstrumentation> core(&cpu, ObservedMemory(&machine->memoryIO),
+        ScriptedIo(&machine->memoryIO, &machine->trap, &machine->os), NoInstrumentation());
+
+    int result = JR_HALTED;
+    bool done = false;
+    uint64_t nextStream = JOB_STREAM_INTERVAL;
+
+    scheduler.Begin(machine->index, tenant, deadline ? Metrics::Now() + deadline * 1000000 : 0);
+
+    // Run a scheduler slice at a time, in steps of the loop detection interval sampling the state between them
+    uint64_t slice = scheduler.Acquire(machine->index);
+    while (!done)
+    {
+        uint64_t sliceEnd = cpu.instructionCount + slice;
+        uint64_t sliceStart = cpu.instructionCount;
+        uint64_t started = Metrics::Now();
+
+        while (!done && cpu.instructionCount < sliceEnd)
+        {
+            uint64_t limit = std::min(cpu.instructionCount + JOB_LOOP_INTERVAL, std::min(sliceEnd, budget));
+            int stop = core.Run(limit);
+            done = true;
+
+            if (stop == VC_HALTED)
+            {
+                break;
+            }
+            if (stop == VC_INTERRUPTED)
+            {
+                result = JR_INPUT;
+                break;
+            }
+            if (stop == VC_ILLEGAL)
+            {
+                result = JR_CRASH;
+                break;
+            }
+            if (cpu.instructionCount >= budget)
+            {
+                result = JR_BUDGET;
+                break;
+            }
+
+            if (machine->stateHash.Repeats(machine->os.InputPosition()))
+            {
+                result = JR_LOOP;
+                break;
+            }
+            done = false;
+
+            // Output is due: give the CPU back early rather than send it while holding one
+            if (cpu.instructionCount >= nextStream && !machine->output.empty())
+            {
+                break;
+            }
+        }
+
+        uint64_t executed = cpu.instructionCount - sliceStart;
+        uint64_t elapsed = Metrics::Now() - started;
+        if (done)
+        {
+            scheduler.Release(machine->index, executed, elapsed);
+            break;
+        }
+
+        if (cpu.instructionCount < nextStream)
+        {
+            slice = scheduler.Yield(machine->index, executed, elapsed);
+            continue;
+        }
+
+        nextStream = cpu.instructionCount + JOB_STREAM_INTERVAL;
+        if (machine->output.empty())
+        {
+            slice = scheduler.Yield(machine->index, executed, elapsed);
+            continue;
+        }
+
+        scheduler.Release(machine->index, executed, elapsed);
+        if (!SendOutput(client, machine->output))
+        {
+            scheduler.End(machine->index);
+            return;
+        }
+        slice = scheduler.Acquire(machine->index);
+    }
+
+    scheduler.End(machine->index);
+
+    if (!machine->output.empty() && !SendOutput(client, machine->output))
+    {
+        return;
+    }
+
+    char end[160];
+    int length = snprintf(end, sizeof(end), "END %s %llu", resultNames[result], (unsigned long long)cpu.instructionCount);
+    for (int reg = 0; reg < REGISTER_COUNT; ++reg)
+    {
+        length += snprintf(end + length, sizeof(end) - length, " %04x", cpu.registers[reg]);
+    }
+    length += snprintf(end + length, sizeof(end) - length, " %016llx\n", (unsigned long long)machine->stateHash.Value());
+    SendAll(client, end, length);
+}
\ No newline at end of file
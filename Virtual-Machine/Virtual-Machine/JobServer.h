@@ -0,0 +1,100 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef JOB_SERVER_H
+#define JOB_SERVER_H
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CPU.h"
+#include "Scheduler.h"
+
+
+class Options;
+struct JobMachine;
+
+
+enum JobLimits : uint32_t
+{
+    // Instructions executed between two flushes of captured output to the client.
+    JOB_STREAM_INTERVAL = 1 << 16,
+
+    // Instructions executed between two samples of the state for loop detection.
+    JOB_LOOP_INTERVAL = 1 << 12,
+
+    // Largest input script a job may carry.
+    JOB_MAX_INPUT = 1 << 20
+};
+
+
+enum JobResults : uint8_t
+{
+    JR_HALTED = 0, // the program executed HALT
+    JR_BUDGET,     // the instruction budget ran out
+    JR_INPUT,      // the program waited for more input than the script held
+    JR_CRASH,      // the program reached an RTI or reserved opcode
+    JR_LOOP        // the program returned to an earlier state without taking input, so it cannot halt
+};
+
+
+// Post-load machine state of one image, which every job on it starts from.
+struct PreloadedImage
+{
+    std::string path;
+    std::vector<uint16_t> memory;
+    std::vector<ImageSegment> segments;
+    uint16_t entry;
+    uint64_t memoryHash;
+};
+
+
+class JobServer
+{
+private:
+    const Options* optionsPtr;
+    std::vector<PreloadedImage> images;
+
+    // Listening socket (SOCKET on Windows, file descriptor elsewhere).
+    uintptr_t listener;
+    bool listening = false;
+
+    // Accepted connections waiting for a free worker.
+    std::deque<uintptr_t> pending;
+    std::mutex pendingMutex;
+    std::condition_variable pendingReady;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+
+    // Shares the CPUs among the jobs of all workers.
+    Scheduler scheduler;
+
+    void Work(uint32_t index);
+    void ServeClient(uintptr_t client, JobMachine* machine);
+    void RunJob(uintptr_t client, JobMachine* machine, uint32_t image, uint64_t budget, const std::vector<uint8_t>& input,
+        const std::string& tenant, uint64_t deadline);
+
+public:
+    JobServer(const Options* options);
+    ~JobServer();
+
+    int Preload();
+    int Listen(uint16_t port);
+    void Serve(uint32_t workerCount);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,418 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#if defined(__linux__)
+#include <signal.h>
+#endif
+
+#include "LatencyTrace.h"
+#include "Metrics.h"
+
+
+// Stage names, as the report prints them.
+static const char* stageNames[LS_COUNT] =
+{
+    "queue (read to consumed)",
+    "vm (consumed to output)",
+    "terminal (output to flushed)",
+    "total (read to flushed)"
+};
+
+
+// Trace to save if the process exits before the program halts, e.g. from the Ctrl+C handler.
+static LatencyTrace* exitLatencyTrace = nullptr;
+
+// Set by the dump signal, acted on at the next input or output event or when it interrupts a read.
+static volatile sig_atomic_t saveRequested = 0;
+
+
+/**
+ * @brief Saves the trace when the process exits before the program halts.
+ */
+static void SaveLatencyTraceAtExit()
+{
+    if (exitLatencyTrace)
+    {
+        exitLatencyTrace->Save();
+    }
+}
+
+
+/**
+ * @brief Requests a save of the trace; files cannot be written safely from a signal handler.
+ */
+static void RequestLatencySave(int signal)
+{
+    saveRequested = 1;
+
+#if !defined(__linux__)
+    // Windows resets the handler before calling it
+    std::signal(signal, RequestLatencySave);
+#else
+    (void)signal;
+#endif
+}
+
+
+/**
+ * @brief Constructs an empty histogram.
+ */
+LatencyHistogram::LatencyHistogram()
+{
+    // Shifts up to LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1 reach bucket groups one above them
+    counts.assign((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 3) << (LATENCY_SUB_BUCKET_BITS - 1), 0);
+}
+
+
+/**
+ * @brief Returns the bucket a value falls into.
+ *
+ * Values below 2^LATENCY_SUB_BUCKET_BITS have a bucket each. Above, every power of two has
+ * 2^(LATENCY_SUB_BUCKET_BITS - 1) buckets, found by shifting the value down until it fits.
+ */
+uint32_t LatencyHistogram::Index(uint64_t value)
+{
+    uint32_t shift = 0;
+    while ((value >> shift) >= (1ULL << LATENCY_SUB_BUCKET_BITS))
+    {
+        ++shift;
+    }
+    return (shift << (LATENCY_SUB_BUCKET_BITS - 1)) + (uint32_t)(value >> shift);
+}
+
+
+/**
+ * @brief Returns the largest value that falls into a bucket.
+ */
+uint64_t LatencyHistogram::HighestEquivalent(uint32_t index)
+{
+    uint32_t half = 1 << (LATENCY_SUB_BUCKET_BITS - 1);
+    if (index < 2 * half)
+    {
+        return index;
+    }
+
+    uint32_t shift = index / half - 1;
+    uint64_t lowest = (uint64_t)(index - shift * half) << shift;
+    return lowest + (1ULL << shift) - 1;
+}
+
+
+/**
+ * @brief Counts one value.
+ *
+ * @param value The value in nanoseconds, clamped to 2^LATENCY_MAX_BITS.
+ */
+void LatencyHistogram::Record(uint64_t value)
+{
+    if (value > (1ULL << LATENCY_MAX_BITS))
+    {
+        value = 1ULL << LATENCY_MAX_BITS;
+    }
+
+    ++counts[Index(value)];
+    ++total;
+    minimum = value < minimum ? value : minimum;
+    maximum = value > maximum ? value : maximum;
+    sum += (double)value;
+    sumSquares += (double)value * (double)value;
+}
+
+
+/**
+ * @brief Returns the number of values counted.
+ */
+uint64_t LatencyHistogram::Count() const
+{
+    return total;
+}
+
+
+/**
+ * @brief Returns the value at or below which the given share of values falls.
+ *
+ * @param percentile Share of values, from 0 to 100.
+ * @return The largest value equivalent to the bucket that share reaches, never above the maximum; 0 if empty.
+ */
+uint64_t LatencyHistogram::ValueAtPercentile(double percentile) const
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t wanted = (uint64_t)ceil(percentile / 100.0 * (double)total);
+    wanted = wanted < 1 ? 1 : wanted;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < counts.size(); ++i)
+    {
+        seen += counts[i];
+        if (seen >= wanted)
+        {
+            uint64_t value = HighestEquivalent(i);
+            return value < maximum ? value : maximum;
+        }
+    }
+    return maximum;
+}
+
+
+/**
+ * @brief Prints the percentile distribution in HdrHistogram's text format, in microseconds.
+ *
+ * Percentiles are listed in five steps per halving of the distance to 100%, until the steps are
+ * finer than one value, so the tail is shown in as much detail as the count allows.
+ *
+ * @param out The stream to print to.
+ * @param title Heading of the distribution.
+ */
+void LatencyHistogram::Print(FILE* out, const char* title) const
+{
+    fprintf(out, "# %s, microseconds\n", title);
+    fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    if (total > 0)
+    {
+        for (uint32_t level = 0; (1ULL << level) <= 2 * total; ++level)
+        {
+            double start = 100.0 - 100.0 / (double)(1ULL << level);
+            for (uint32_t tick = 0; tick < 5; ++tick)
+            {
+                double percentile = start + 100.0 / (double)(1ULL << (level + 1)) * tick / 5.0;
+                uint64_t value = ValueAtPercentile(percentile);
+
+                uint64_t below = 0;
+                for (uint32_t i = 0; i <= Index(value); ++i)
+                {
+                    below += counts[i];
+                }
+
+                fprintf(out, "%12.3f %14.12f %10llu %14.2f\n", value / 1000.0, percentile / 100.0,
+                    (unsigned long long)below, 1.0 / (1.0 - percentile / 100.0));
+            }
+        }
+        fprintf(out, "%12.3f %14.12f %10llu\n", maximum / 1000.0, 1.0, (unsigned long long)total);
+    }
+
+    double mean = total ? sum / (double)total : 0.0;
+    double variance = total ? sumSquares / (double)total - mean * mean : 0.0;
+    fprintf(out, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean / 1000.0, sqrt(variance > 0 ? variance : 0) / 1000.0);
+    fprintf(out, "#[Max     = %12.3f, Total count    = %12llu]\n", maximum / 1000.0, (unsigned long long)total);
+    fprintf(out, "#[Buckets = %12u, SubBuckets     = %12u]\n\n",
+        LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 3, 1u << LATENCY_SUB_BUCKET_BITS);
+}
+
+
+/**
+ * @brief Constructs a trace that has seen no input yet.
+ *
+ * @param path File the histograms are written to.
+ */
+LatencyTrace::LatencyTrace(const char* path)
+{
+    this->path = path;
+}
+
+
+/**
+ * @brief Creates the output file and arranges for the trace to be saved on exit and on the dump signal.
+ *
+ * @return 1 if the file could be created, 0 otherwise.
+ */
+int LatencyTrace::Start()
+{
+    if (!Save())
+    {
+        return 0;
+    }
+
+    exitLatencyTrace = this;
+    atexit(SaveLatencyTraceAtExit);
+
+#if defined(__linux__)
+    // Without SA_RESTART the signal interrupts a blocking read of the console, so the trace is
+    // saved while the program waits for input
+    struct sigaction action = {};
+    action.sa_handler = RequestLatencySave;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+#else
+    std::signal(SIGBREAK, RequestLatencySave);
+#endif
+    return 1;
+}
+
+
+/**
+ * @brief Saves the trace a last time once the program halted.
+ */
+void LatencyTrace::Stop()
+{
+    Save();
+    exitLatencyTrace = nullptr;
+}
+
+
+/**
+ * @brief Writes a summary of every stage followed by their percentile distributions, replacing the file.
+ *
+ * @return 1 if the file was written, 0 otherwise.
+ */
+int LatencyTrace::Save()
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+    {
+        return 0;
+    }
+
+    fprintf(out, "# input latency, milliseconds\n");
+    fprintf(out, "# %-30s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (uint32_t stage = 0; stage < LS_COUNT; ++stage)
+    {
+        const LatencyHistogram& histogram = histograms[stage];
+        fprintf(out, "# %-30s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n", stageNames[stage],
+            (unsigned long long)histogram.Count(),
+            histogram.ValueAtPercentile(50.0) / 1e6, histogram.ValueAtPercentile(90.0) / 1e6,
+            histogram.ValueAtPercentile(99.0) / 1e6, histogram.ValueAtPercentile(99.9) / 1e6,
+            histogram.ValueAtPercentile(100.0) / 1e6);
+    }
+    fprintf(out, "# %llu bytes dropped before the program consumed them, %zu in flight\n\n",
+        (unsigned long long)dropped, (latched ? 1 : 0) + awaitingOutput.size() + awaitingFlush.size());
+
+    for (uint32_t stage = 0; stage < LS_COUNT; ++stage)
+    {
+        histograms[stage].Print(out, stageNames[stage]);
+    }
+
+    fclose(out);
+    return 1;
+}
+
+
+/**
+ * @brief Saves the trace if the dump signal arrived since the last event, e.g. after it interrupted a read.
+ */
+void LatencyTrace::Pending()
+{
+    if (saveRequested)
+    {
+        saveRequested = 0;
+        Save();
+    }
+}
+
+
+/**
+ * @brief Gives up the oldest samples of a list that grew past LATENCY_MAX_PENDING, e.g. for input that never produces output.
+ */
+void LatencyTrace::Trim(std::vector<LatencySample>& samples)
+{
+    if (samples.size() > LATENCY_MAX_PENDING)
+    {
+        size_t excess = samples.size() - LATENCY_MAX_PENDING;
+        samples.erase(samples.begin(), samples.begin() + excess);
+        dropped += excess;
+    }
+}
+
+
+/**
+ * @brief Notes a byte read from the host, by a keyboard status poll or a trap.
+ *
+ * A byte still unconsumed is lost, as the keyboard data register only holds one.
+ */
+void LatencyTrace::Read()
+{
+    Pending();
+
+    if (latched)
+    {
+        ++dropped;
+    }
+    latched = true;
+    latchedSample = {};
+    latchedSample.read = Metrics::Now();
+}
+
+
+/**
+ * @brief Notes the program consuming the last byte read, from the keyboard data register or a trap.
+ *
+ * Reading the data register again without a new byte consumes nothing.
+ */
+void LatencyTrace::Consume()
+{
+    Pending();
+
+    if (!latched)
+    {
+        return;
+    }
+    latched = false;
+
+    latchedSample.consumed = Metrics::Now();
+    histograms[LS_QUEUE].Record(latchedSample.consumed - latchedSample.read);
+    awaitingOutput.push_back(latchedSample);
+    Trim(awaitingOutput);
+}
+
+
+/**
+ * @brief Notes the program writing output, the response to every byte consumed since the last output.
+ */
+void LatencyTrace::Output()
+{
+    Pending();
+
+    if (awaitingOutput.empty())
+    {
+        return;
+    }
+
+    uint64_t now = Metrics::Now();
+    for (LatencySample& sample : awaitingOutput)
+    {
+        sample.output = now;
+        histograms[LS_VM].Record(now - sample.consumed);
+        awaitingFlush.push_back(sample);
+    }
+    awaitingOutput.clear();
+    Trim(awaitingFlush);
+}
+
+
+/**
+ * @brief Notes all output written so far reaching the host terminal.
+ */
+void LatencyTrace::Flushed()
+{
+    Pending();
+
+    if (awaitingFlush.empty())
+    {
+        return;
+    }
+
+    uint64_t now = Metrics::Now();
+    for (const LatencySample& sample : awaitingFlush)
+    {
+        histograms[LS_TERMINAL].Record(now - sample.output);
+        histograms[LS_TOTAL].Record(now - sample.read);
+    }
+    awaitingFlush.clear();
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+enum LatencyStages : uint8_t
+{
+    LS_QUEUE = 0, // byte read from the host until the program consumes it
+    LS_VM,        // byte consumed until the program writes its next output
+    LS_TERMINAL,  // that output written until it is flushed to the host terminal
+    LS_TOTAL,     // byte read until the output that followed it is flushed
+    LS_COUNT
+};
+
+
+enum LatencyLimits : uint32_t
+{
+    // Each power of two is split into 2^(LATENCY_SUB_BUCKET_BITS - 1) linear buckets, which keeps
+    // every recorded value within 1/64 of its bucket's bounds.
+    LATENCY_SUB_BUCKET_BITS = 7,
+
+    // Largest recorded value is 2^LATENCY_MAX_BITS nanoseconds, about 18 minutes; longer ones are clamped.
+    LATENCY_MAX_BITS = 40,
+
+    // Bytes that may wait for their consumption, output or flush before the oldest is given up.
+    LATENCY_MAX_PENDING = 4096
+};
+
+
+// Histogram of nanosecond values with logarithmic buckets split linearly, in the manner of HdrHistogram.
+class LatencyHistogram
+{
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t minimum = UINT64_MAX;
+    uint64_t maximum = 0;
+    double sum = 0;
+    double sumSquares = 0;
+
+    static uint32_t Index(uint64_t value);
+    static uint64_t HighestEquivalent(uint32_t index);
+
+public:
+    LatencyHistogram();
+
+    void Record(uint64_t value);
+    uint64_t Count() const;
+    uint64_t ValueAtPercentile(double percentile) const;
+    void Print(FILE* out, const char* title) const;
+};
+
+
+// Times of one input byte on its way through the program, in Metrics::Now nanoseconds.
+struct LatencySample
+{
+    uint64_t read;
+    uint64_t consumed;
+    uint64_t output;
+};
+
+
+// Follows every input byte from the moment it is read from the host, through the program consuming
+// it and writing its next output, to that output reaching the host terminal. The time spent in each
+// stage goes into a histogram; all of them are written to a file when the process exits, and on
+// SIGUSR1 (Ctrl+Break on Windows) at the next input or output, or at once on Linux if the signal
+// interrupts a read of the console.
+class LatencyTrace
+{
+private:
+    const char* path;
+    LatencyHistogram histograms[LS_COUNT];
+
+    // The byte read and not yet consumed, bytes consumed with no output since, and bytes whose
+    // output is written but not yet flushed.
+    bool latched = false;
+    LatencySample latchedSample = {};
+    std::vector<LatencySample> awaitingOutput;
+    std::vector<LatencySample> awaitingFlush;
+
+    // Bytes read but overwritten by the next before the program consumed them, or given up.
+    uint64_t dropped = 0;
+
+    void Trim(std::vector<LatencySample>& samples);
+
+public:
+    LatencyTrace(const char* path);
+
+    int Start();
+    int Save();
+    void Stop();
+
+    void Pending();
+    void Read();
+    void Consume();
+    void Output();
+    void Flushed();
+};
+#endif
\ No newline at end of file
@@ -11,50 +11,320 @@ Copyright 
 #include "MemoryIO.h"
 #include "CPU.h"
 #include "OS.h"
+#include "Timer.h"
+#include "DecodeCache.h"
+#include "Debugger.h"
+#include "StateHash.h"
+#include "AccessProfile.h"
+#include "IrTier.h"
+#include "LatencyTrace.h"
+#include "CodeMap.h"
+#include "CycleModel.h"
+#include "BlockDevice.h"
+#include "Mmu.h"
+
+#include <cstring>
 
 
 /**
  * @brief Constructs a MemoryIO object.
  *
- * This constructor initializes a MemoryIO object with the provided memory array and OS pointer.
+ * This constructor initializes a MemoryIO object with the provided memory array, OS and Timer pointers.
  *
  * @param memory Pointer to the memory array.
  * @param os Pointer to the OS object.
+ * @param timer Pointer to the Timer object backing the timer registers.
  */
-MemoryIO::MemoryIO(uint16_t* memory, OS* os)
+MemoryIO::MemoryIO(uint16_t* memory, OS* os, Timer* timer)
 {
     memoryPtr = memory;
     osPtr = os;
+    timerPtr = timer;
 }
 
 
 /**
- * @brief Reads the 16-bit value from memory at the specified address.
+ * @brief Attaches a decode cache whose entries are invalidated by writes.
  *
- * This function reads a 16-bit value from memory at the specified address.
- * If the address corresponds to the keyboard status register, it checks if a key is pressed
- * and updates the keyboard status register accordingly.
+ * @param decodeCache Pointer to the DecodeCache object, or nullptr to detach it.
+ */
+void MemoryIO::SetDecodeCache(DecodeCache* decodeCache)
+{
+    decodeCachePtr = decodeCache;
+}
+
+
+/**
+ * @brief Attaches an IR tier whose regions are invalidated by writes to their code.
  *
- * @param memoryAddress The address to read from.
- * @return The 16-bit value read from memory.
+ * @param irTier Pointer to the IrTier object, or nullptr to detach it.
  */
-uint16_t MemoryIO::Read(uint16_t memoryAddress)
+void MemoryIO::SetIrTier(IrTier* irTier)
+{
+    irTierPtr = irTier;
+}
+
+
+/**
+ * @brief Attaches the code map whose data pages need no invalidation of decoded code on writes.
+ *
+ * @param codeMap Pointer to the CodeMap object, or nullptr to invalidate on every write.
+ */
+void MemoryIO::SetCodeMap(CodeMap* codeMap)
+{
+    codeMapPtr = codeMap;
+}
+
+
+/**
+ * @brief Attaches a per-page table in which writes mark their page as dirty.
+ *
+ * @param dirtyPages Pointer to PAGE_COUNT flags, or nullptr to stop tracking.
+ */
+void MemoryIO::SetDirtyPages(uint8_t* dirtyPages)
+{
+    dirtyPagesPtr = dirtyPages;
+}
+
+
+/**
+ * @brief Attaches the debugger whose watchpoints observe memory accesses.
+ *
+ * @param debugger Pointer to the Debugger object, or nullptr to stop watching.
+ */
+void MemoryIO::SetDebugger(Debugger* debugger)
+{
+    debuggerPtr = debugger;
+}
+
+
+/**
+ * @brief Attaches the state hash kept up to date on every write.
+ *
+ * @param stateHash Pointer to the StateHash object, or nullptr to stop hashing.
+ */
+void MemoryIO::SetStateHash(StateHash* stateHash)
+{
+    stateHashPtr = stateHash;
+}
+
+
+/**
+ * @brief Rehashes memory after it was replaced without going through Write, e.g. from a checkpoint.
+ */
+void MemoryIO::Rehash()
+{
+    if (stateHashPtr)
+    {
+        stateHashPtr->Recompute();
+    }
+}
+
+
+/**
+ * @brief Attaches the access profile counting every fetch, read and write.
+ *
+ * @param accessProfile Pointer to the AccessProfile object, or nullptr to stop counting.
+ */
+void MemoryIO::SetAccessProfile(AccessProfile* accessProfile)
+{
+    accessProfilePtr = accessProfile;
+}
+
+
+/**
+ * @brief Attaches the cycle model whose block costs are summed again when their code is written.
+ *
+ * @param cycleModel Pointer to the CycleModel object, or nullptr to detach it.
+ */
+void MemoryIO::SetCycleModel(CycleModel* cycleModel)
 {
-    // Check if the memory address corresponds to the keyboard status register
-    if (memoryAddress == MemoryMappedRegisters::MR_KBSR)
+    cycleModelPtr = cycleModel;
+}
+
+
+/**
+ * @brief Attaches the latency trace told when the program reads the keyboard data register.
+ *
+ * @param latencyTrace Pointer to the LatencyTrace object, or nullptr to stop tracing.
+ */
+void MemoryIO::SetLatencyTrace(LatencyTrace* latencyTrace)
+{
+    latencyTracePtr = latencyTrace;
+}
+
+
+/**
+ * @brief Attaches the block device behind the block device registers.
+ *
+ * @param blockDevice Pointer to the BlockDevice object, or nullptr to leave the registers unconnected.
+ */
+void MemoryIO::SetBlockDevice(BlockDevice* blockDevice)
+{
+    blockDevicePtr = blockDevice;
+}
+
+
+/**
+ * @brief Attaches the MMU whose running process device transfers copy words to and from.
+ *
+ * @param mmu Pointer to the Mmu object, or nullptr to transfer to and from CPU::memory.
+ */
+void MemoryIO::SetMmu(Mmu* mmu)
+{
+    mmuPtr = mmu;
+}
+
+
+/**
+ * @brief Tells whether anything attached needs to see accesses to plain memory.
+ *
+ * @return True if a decode cache, IR tier, dirty page table, debugger with a watchpoint set, state hash, access profile or cycle model is attached.
+ */
+bool MemoryIO::Observed() const
+{
+    return decodeCachePtr || irTierPtr || dirtyPagesPtr || (debuggerPtr && debuggerPtr->Watching()) || stateHashPtr ||
+        accessProfilePtr || cycleModelPtr;
+}
+
+
+/**
+ * @brief Updates a device register before it is read.
+ *
+ * The keyboard status register checks whether a key is pressed and latches the character into the
+ * keyboard data register. The timer registers are refreshed from the virtual clock.
+ *
+ * @param memoryAddress The device register address being read.
+ */
+void MemoryIO::ReadDevice(uint16_t memoryAddress)
+{
+    switch (memoryAddress)
     {
+    case MemoryMappedRegisters::MR_KBSR:
         // If a key is pressed, set the keyboard status register's most significant bit (bit 15) to indicate input
         if (osPtr->CheckKey())
         {
             memoryPtr[MemoryMappedRegisters::MR_KBSR] = (1 << 15);
             // Read the character from the keyboard and store it in the keyboard data register
-            memoryPtr[MemoryMappedRegisters::MR_KBDR] = getchar();
+            memoryPtr[MemoryMappedRegisters::MR_KBDR] = osPtr->GetChar();
         }
         else
         {
             // If no key is pressed, clear the keyboard status register
             memoryPtr[MemoryMappedRegisters::MR_KBSR] = 0;
         }
+        break;
+    case MemoryMappedRegisters::MR_KBDR:
+        if (latencyTracePtr)
+        {
+            latencyTracePtr->Consume();
+        }
+        break;
+    case MemoryMappedRegisters::MR_TMSR:
+        memoryPtr[MemoryMappedRegisters::MR_TMSR] = timerPtr->ReadStatus();
+        break;
+    case MemoryMappedRegisters::MR_TMDR:
+        memoryPtr[MemoryMappedRegisters::MR_TMDR] = timerPtr->ReadCount();
+        break;
+    case MemoryMappedRegisters::MR_BKSR:
+        memoryPtr[MemoryMappedRegisters::MR_BKSR] = blockDevicePtr ? blockDevicePtr->Status() : 0;
+        break;
+    case MemoryMappedRegisters::MR_BKNR:
+        // A full 65536-block device reads as 0, like one that is absent; the status register tells them apart
+        memoryPtr[MemoryMappedRegisters::MR_BKNR] = blockDevicePtr ? (uint16_t)blockDevicePtr->BlockCount() : 0;
+        break;
+    }
+}
+
+
+/**
+ * @brief Applies a write to a device register.
+ *
+ * @param address The device register address written to.
+ * @param value The 16-bit value written.
+ */
+void MemoryIO::WriteDevice(uint16_t address, uint16_t value)
+{
+    switch (address)
+    {
+    case MemoryMappedRegisters::MR_TMIR:
+        timerPtr->WriteInterval(value);
+        break;
+    case MemoryMappedRegisters::MR_BKCR:
+        if (blockDevicePtr)
+        {
+            blockDevicePtr->Execute(value, memoryPtr[MemoryMappedRegisters::MR_BKBR],
+                memoryPtr[MemoryMappedRegisters::MR_BKAR], memoryPtr[MemoryMappedRegisters::MR_BKWC]);
+        }
+        break;
+    }
+}
+
+
+/**
+ * @brief Reads the instruction at the specified address.
+ *
+ * Behaves like Read, but is counted as an instruction fetch rather than a data read, and does not
+ * trigger read watchpoints.
+ *
+ * @param memoryAddress The address of the instruction.
+ * @return The 16-bit instruction.
+ */
+uint16_t MemoryIO::Fetch(uint16_t memoryAddress)
+{
+    if (accessProfilePtr)
+    {
+        accessProfilePtr->Fetch(memoryAddress);
+    }
+
+    return Access(memoryAddress, false);
+}
+
+
+/**
+ * @brief Reads the 16-bit value from memory at the specified address.
+ *
+ * This function reads a 16-bit value from memory at the specified address.
+ * If the address lies in the device register space, the device is given a chance
+ * to update its register first.
+ *
+ * @param memoryAddress The address to read from.
+ * @return The 16-bit value read from memory.
+ */
+uint16_t MemoryIO::Read(uint16_t memoryAddress)
+{
+    if (accessProfilePtr)
+    {
+        accessProfilePtr->Read(memoryAddress);
+    }
+
+    return Access(memoryAddress, true);
+}
+
+
+/**
+ * @brief Reads memory for Fetch and Read, updating device registers and notifying watchpoints.
+ *
+ * @param memoryAddress The address to read from.
+ * @param data True for a data read, which read watchpoints see, false for an instruction fetch.
+ * @return The 16-bit value read from memory.
+ */
+uint16_t MemoryIO::Access(uint16_t memoryAddress, bool data)
+{
+    // Only addresses in the device register space need special handling
+    if (memoryAddress >= MemoryMappedRegisters::MR_DEVICES)
+    {
+        ReadDevice(memoryAddress);
+
+        if (stateHashPtr)
+        {
+            stateHashPtr->DeviceRead();
+        }
+    }
+
+    if (debuggerPtr && data)
+    {
+        debuggerPtr->OnAccess(memoryAddress, DA_WATCH_READ);
     }
 
     // Return the value stored in memory at the specified address
@@ -66,11 +336,115 @@ uint16_t MemoryIO::Read(uint16_t memoryAddress)
  * @brief Writes the 16-bit value to memory at the specified address.
  *
  * This function writes a 16-bit value to memory at the specified address.
+ * Writes into the device register space are also forwarded to the device.
  *
  * @param address The address to write to.
  * @param value The 16-bit value to write.
  */
 void MemoryIO::Write(uint16_t address, uint16_t value)
 {
+    if (accessProfilePtr)
+    {
+        accessProfilePtr->Write(address);
+    }
+
+    if (stateHashPtr)
+    {
+        stateHashPtr->Store(address, memoryPtr[address], value);
+    }
+
     memoryPtr[address] = value;
+
+    // Self-modifying code: a decoded copy of the old word must not be executed again. Nothing on
+    // a data page was ever decoded, so stores there have nothing to invalidate.
+    if (!codeMapPtr || codeMapPtr->MayHoldCode(address))
+    {
+        if (decodeCachePtr)
+        {
+            decodeCachePtr->Invalidate(address);
+        }
+
+        if (irTierPtr)
+        {
+            irTierPtr->Invalidate(address);
+        }
+    }
+
+    if (cycleModelPtr)
+    {
+        cycleModelPtr->Invalidate(address);
+    }
+
+    if (dirtyPagesPtr)
+    {
+        dirtyPagesPtr[address >> PAGE_SHIFT] = 1;
+    }
+
+    if (debuggerPtr)
+    {
+        debuggerPtr->OnAccess(address, DA_WATCH_WRITE);
+    }
+
+    if (address >= MemoryMappedRegisters::MR_DEVICES)
+    {
+        WriteDevice(address, value);
+    }
+}
+
+
+/**
+ * @brief Copies words out of memory for a device transfer, e.g. onto the block device.
+ *
+ * Reads by a device are not program accesses, so nothing attached is told about them.
+ *
+ * @param address The first address, below the device registers; the range must not reach them.
+ * @param words Receives count words.
+ * @param count Number of words.
+ */
+void MemoryIO::ReadWords(uint16_t address, uint16_t* words, uint32_t count)
+{
+    if (mmuPtr)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            words[i] = mmuPtr->Load((uint16_t)(address + i));
+        }
+        return;
+    }
+
+    memcpy(words, memoryPtr + address, count * sizeof(uint16_t));
+}
+
+
+/**
+ * @brief Copies words into memory for a device transfer, e.g. from the block device.
+ *
+ * Without observers this is a single copy. Otherwise every word goes through Write, so decoded
+ * code, dirty pages and the state hash stay as if the program had stored it.
+ *
+ * @param address The first address, below the device registers; the range must not reach them.
+ * @param words The words to copy.
+ * @param count Number of words.
+ */
+void MemoryIO::WriteWords(uint16_t address, const uint16_t* words, uint32_t count)
+{
+    if (mmuPtr)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            mmuPtr->Store((uint16_t)(address + i), words[i]);
+        }
+        return;
+    }
+
+    if (!Observed())
+    {
+        memcpy(memoryPtr + address, words, count * sizeof(uint16_t));
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Write((uint16_t)(address + i), words[i]);
+    }
 }
\ No newline at end of file
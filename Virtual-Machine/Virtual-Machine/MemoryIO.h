@@ -16,12 +16,33 @@ Copyright 
 
 
 class OS;
+class Timer;
+class DecodeCache;
+class Debugger;
+class StateHash;
+class AccessProfile;
+class IrTier;
+class LatencyTrace;
+class CodeMap;
+class CycleModel;
+class BlockDevice;
+class Mmu;
 
 
 enum MemoryMappedRegisters : uint16_t
 {
+	MR_DEVICES = 0xFE00, // start of the device register space
 	MR_KBSR = 0xFE00, // keyboard status
-	MR_KBDR = 0xFE02  // keyboard data
+	MR_KBDR = 0xFE02, // keyboard data
+	MR_TMSR = 0xFE08, // timer status
+	MR_TMDR = 0xFE0A, // timer data (tick count)
+	MR_TMIR = 0xFE0C, // timer interval (ticks)
+	MR_BKSR = 0xFE10, // block device status
+	MR_BKCR = 0xFE12, // block device command, started when written
+	MR_BKBR = 0xFE14, // block device block number
+	MR_BKAR = 0xFE16, // block device memory address
+	MR_BKWC = 0xFE18, // block device word count
+	MR_BKNR = 0xFE1A  // block device number of blocks
 };
 
 
@@ -30,11 +51,44 @@ class MemoryIO
 private:
 	uint16_t* memoryPtr;
 	OS* osPtr;
+	Timer* timerPtr;
+	DecodeCache* decodeCachePtr = nullptr;
+	uint8_t* dirtyPagesPtr = nullptr;
+	Debugger* debuggerPtr = nullptr;
+	StateHash* stateHashPtr = nullptr;
+	AccessProfile* accessProfilePtr = nullptr;
+	IrTier* irTierPtr = nullptr;
+	CodeMap* codeMapPtr = nullptr;
+	CycleModel* cycleModelPtr = nullptr;
+	LatencyTrace* latencyTracePtr = nullptr;
+	BlockDevice* blockDevicePtr = nullptr;
+	Mmu* mmuPtr = nullptr;
+
+	void ReadDevice(uint16_t memoryAddress);
+	uint16_t Access(uint16_t memoryAddress, bool data);
+	void WriteDevice(uint16_t address, uint16_t value);
 
 public:
-	MemoryIO(uint16_t* memory, OS* os);
+	MemoryIO(uint16_t* memory, OS* os, Timer* timer);
+
+	void SetDecodeCache(DecodeCache* decodeCache);
+	void SetIrTier(IrTier* irTier);
+	void SetCodeMap(CodeMap* codeMap);
+	void SetDirtyPages(uint8_t* dirtyPages);
+	void SetDebugger(Debugger* debugger);
+	void SetStateHash(StateHash* stateHash);
+	void Rehash();
+	void SetAccessProfile(AccessProfile* accessProfile);
+	void SetCycleModel(CycleModel* cycleModel);
+	void SetLatencyTrace(LatencyTrace* latencyTrace);
+	void SetBlockDevice(BlockDevice* blockDevice);
+	void SetMmu(Mmu* mmu);
+	bool Observed() const;
 
+	uint16_t Fetch(uint16_t memoryAddress);
 	uint16_t Read(uint16_t memoryAddress);
 	void Write(uint16_t address, uint16_t value);
+	void ReadWords(uint16_t address, uint16_t* words, uint32_t count);
+	void WriteWords(uint16_t address, const uint16_t* words, uint32_t count);
 };
 #endif
\ No newline at end of file
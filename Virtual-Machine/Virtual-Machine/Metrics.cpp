@@ -0,0 +1,399 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include "Metrics.h"
+#include "Trap.h"
+#include "CPU.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#else
+// windows only
+#include <Windows.h>
+#endif
+
+
+// Bump whenever the layout of MetricsSegment changes.
+static const uint32_t METRICS_VERSION = 1;
+
+// Shortest window over which the instruction rate is measured.
+static const uint64_t RATE_WINDOW_NANOSECONDS = 250000000ULL;
+
+#if defined(__linux__)
+// Name of the published segment, removed at exit since POSIX shared memory outlives the process,
+// e.g. when the Ctrl+C handler exits without running destructors.
+static char exitSegmentName[64];
+
+static void UnlinkSegmentAtExit()
+{
+    shm_unlink(exitSegmentName);
+}
+#endif
+
+
+/**
+ * @brief Builds the name of the shared-memory segment of a process.
+ *
+ * @param processId The process publishing the segment.
+ * @param name Buffer receiving the name.
+ * @param size Size of the buffer.
+ */
+void Metrics::SegmentName(uint32_t processId, char* name, size_t size)
+{
+#if defined(__linux__)
+    snprintf(name, size, "/lc3-metrics-%lu", (unsigned long)processId);
+#else
+    snprintf(name, size, "Local\\lc3-metrics-%lu", (unsigned long)processId);
+#endif
+}
+
+
+/**
+ * @brief Returns a monotonic, system-wide timestamp in nanoseconds, comparable across processes.
+ */
+uint64_t Metrics::Now()
+{
+#if defined(__linux__)
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#endif
+}
+
+
+/**
+ * @brief Constructs a Metrics object. Nothing is published until Open succeeds.
+ *
+ * @param cpu Pointer to the CPU object whose instruction count is published.
+ */
+Metrics::Metrics(CPU* cpu)
+{
+    cpuPtr = cpu;
+    startNanoseconds = Now();
+    rateNanoseconds = startNanoseconds;
+}
+
+
+/**
+ * @brief Unmaps and removes the shared-memory segment.
+ */
+Metrics::~Metrics()
+{
+    if (!segment)
+    {
+        return;
+    }
+
+#if defined(__linux__)
+    char name[64];
+    SegmentName(segment->processId, name, sizeof(name));
+    munmap(segment, sizeof(MetricsSegment));
+    shm_unlink(name);
+#else
+    UnmapViewOfFile(segment);
+    CloseHandle((HANDLE)mappingHandle);
+#endif
+}
+
+
+/**
+ * @brief Creates the shared-memory segment named after the current process.
+ *
+ * @return Returns 1 on success, 0 if the segment cannot be created.
+ */
+int Metrics::Open()
+{
+    char name[64];
+    uint32_t processId;
+    void* view = nullptr;
+
+#if defined(__linux__)
+    processId = (uint32_t)getpid();
+    SegmentName(processId, name, sizeof(name));
+
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    if (ftruncate(fd, sizeof(MetricsSegment)) == 0)
+    {
+        view = mmap(nullptr, sizeof(MetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (view == MAP_FAILED || !view)
+    {
+        shm_unlink(name);
+        return 0;
+    }
+
+    strcpy(exitSegmentName, name);
+    atexit(UnlinkSegmentAtExit);
+#else
+    processId = (uint32_t)GetCurrentProcessId();
+    SegmentName(processId, name, sizeof(name));
+
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(MetricsSegment), name);
+    if (!mapping)
+    {
+        return 0;
+    }
+    view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(MetricsSegment));
+    if (!view)
+    {
+        CloseHandle(mapping);
+        return 0;
+    }
+    mappingHandle = mapping;
+#endif
+
+    segment = new (view) MetricsSegment();
+    memcpy(segment->magic, "LC3M", 4);
+    segment->version = METRICS_VERSION;
+    segment->processId = processId;
+    Publish(true);
+
+    fprintf(stderr, "metrics: publishing for process %lu\n", (unsigned long)processId);
+    return 1;
+}
+
+
+/**
+ * @brief Copies the accumulated counters into the shared segment.
+ *
+ * Uses a sequence lock: the sequence is odd while the fields are being written, so a reader that
+ * sees an odd or changed sequence retries instead of blocking the VM.
+ *
+ * @param running False once the program has halted.
+ */
+void Metrics::Publish(bool running)
+{
+    if (!segment)
+    {
+        return;
+    }
+
+    uint64_t instructions = cpuPtr->instructionCount;
+    uint64_t now = Now();
+    if (now - rateNanoseconds >= RATE_WINDOW_NANOSECONDS)
+    {
+        local.instructionsPerSecond = (uint64_t)((instructions - rateInstructions) * 1e9 / (now - rateNanoseconds));
+        rateNanoseconds = now;
+        rateInstructions = instructions;
+    }
+    local.running = running ? 1 : 0;
+    local.uptimeNanoseconds = now - startNanoseconds;
+    local.instructions = instructions;
+
+    uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    segment->running.store(local.running, std::memory_order_relaxed);
+    segment->uptimeNanoseconds.store(local.uptimeNanoseconds, std::memory_order_relaxed);
+    segment->instructions.store(local.instructions, std::memory_order_relaxed);
+    segment->instructionsPerSecond.store(local.instructionsPerSecond, std::memory_order_relaxed);
+    segment->keyboardPolls.store(local.keyboardPolls, std::memory_order_relaxed);
+    segment->outputBytes.store(local.outputBytes, std::memory_order_relaxed);
+    segment->inputBlockedNanoseconds.store(local.inputBlockedNanoseconds, std::memory_order_relaxed);
+    segment->inputWaitingSince.store(local.inputWaitingSince, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < METRICS_TRAP_VECTORS; ++i)
+    {
+        segment->traps[i].store(local.traps[i], std::memory_order_relaxed);
+    }
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+/**
+ * @brief Marks the start of a blocking wait for keyboard input, visible to readers right away.
+ */
+void Metrics::BeginInputWait()
+{
+    local.inputWaitingSince = Now();
+    Publish(true);
+}
+
+
+/**
+ * @brief Marks the end of a blocking wait for keyboard input and accounts its duration.
+ */
+void Metrics::EndInputWait()
+{
+    local.inputBlockedNanoseconds += Now() - local.inputWaitingSince;
+    local.inputWaitingSince = 0;
+    Publish(true);
+}
+
+
+/**
+ * @brief Takes a consistent copy of a segment without ever blocking its writer.
+ */
+static void ReadSegment(const MetricsSegment* segment, MetricsSnapshot* snapshot)
+{
+    for (;;)
+    {
+        uint32_t before = segment->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+
+        snapshot->running = segment->running.load(std::memory_order_relaxed);
+        snapshot->uptimeNanoseconds = segment->uptimeNanoseconds.load(std::memory_order_relaxed);
+        snapshot->instructions = segment->instructions.load(std::memory_order_relaxed);
+        snapshot->instructionsPerSecond = segment->instructionsPerSecond.load(std::memory_order_relaxed);
+        snapshot->keyboardPolls = segment->keyboardPolls.load(std::memory_order_relaxed);
+        snapshot->outputBytes = segment->outputBytes.load(std::memory_order_relaxed);
+        snapshot->inputBlockedNanoseconds = segment->inputBlockedNanoseconds.load(std::memory_order_relaxed);
+        snapshot->inputWaitingSince = segment->inputWaitingSince.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < METRICS_TRAP_VECTORS; ++i)
+        {
+            snapshot->traps[i] = segment->traps[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment->sequence.load(std::memory_order_relaxed) == before)
+        {
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief Tells whether a process still exists.
+ *
+ * @param processId The process.
+ * @return False once it has exited, e.g. after Ctrl+C or being killed before it could publish the halt.
+ */
+static bool ProcessAlive(uint32_t processId)
+{
+#if defined(__linux__)
+    return kill((pid_t)processId, 0) == 0 || errno == EPERM;
+#else
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, processId);
+    if (!process)
+    {
+        return false;
+    }
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#endif
+}
+
+
+/**
+ * @brief Prints the metrics of another VM process once per second until it halts or exits.
+ *
+ * @param processId The process to watch.
+ * @param out The output stream.
+ * @return Returns 0 when the program halted or the process exited, 1 if its segment cannot be opened.
+ */
+int Metrics::Watch(uint32_t processId, FILE* out)
+{
+    char name[64];
+    SegmentName(processId, name, sizeof(name));
+    const MetricsSegment* segment = nullptr;
+
+#if defined(__linux__)
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd >= 0)
+    {
+        void* view = mmap(nullptr, sizeof(MetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+        segment = view == MAP_FAILED ? nullptr : (const MetricsSegment*)view;
+        close(fd);
+    }
+#else
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (mapping)
+    {
+        segment = (const MetricsSegment*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(MetricsSegment));
+    }
+#endif
+
+    if (!segment || memcmp(segment->magic, "LC3M", 4) != 0 || segment->version != METRICS_VERSION)
+    {
+        fprintf(out, "metrics: no VM publishing for process %lu\n", (unsigned long)processId);
+        return 1;
+    }
+
+    static const char* trapNames[] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT" };
+    MetricsSnapshot snapshot;
+    bool alive = true;
+
+    do
+    {
+        ReadSegment(segment, &snapshot);
+
+        double waiting = snapshot.inputWaitingSince ? (Now() - snapshot.inputWaitingSince) / 1e9 : 0.0;
+        fprintf(out, "%8.1f s  %14llu instr  %8.2f MIPS  %10llu KBSR polls  %10llu bytes out  %8.3f s blocked",
+            snapshot.uptimeNanoseconds / 1e9, (unsigned long long)snapshot.instructions,
+            snapshot.instructionsPerSecond / 1e6, (unsigned long long)snapshot.keyboardPolls,
+            (unsigned long long)snapshot.outputBytes, snapshot.inputBlockedNanoseconds / 1e9 + waiting);
+        if (snapshot.inputWaitingSince)
+        {
+            fprintf(out, " (waiting for input)");
+        }
+        fprintf(out, "\n         ");
+        for (uint32_t vector = 0; vector < METRICS_TRAP_VECTORS; ++vector)
+        {
+            if (!snapshot.traps[vector])
+            {
+                continue;
+            }
+            if (vector >= TRAP_GETC && vector <= TRAP_HALT)
+            {
+                fprintf(out, " %s %llu", trapNames[vector - TRAP_GETC], (unsigned long long)snapshot.traps[vector]);
+            }
+            else
+            {
+                fprintf(out, " x%02X %llu", vector, (unsigned long long)snapshot.traps[vector]);
+            }
+        }
+        fprintf(out, "\n");
+        fflush(out);
+
+        if (snapshot.running)
+        {
+#if defined(__linux__)
+            usleep(1000000);
+#else
+            Sleep(1000);
+#endif
+            // The segment stays mapped after its writer is gone, still saying it runs
+            alive = ProcessAlive(processId);
+        }
+    } while (snapshot.running && alive);
+
+    if (!alive)
+    {
+        fprintf(out, "metrics: process %lu exited before its program halted\n", (unsigned long)processId);
+    }
+    return 0;
+}
\ No newline at end of file
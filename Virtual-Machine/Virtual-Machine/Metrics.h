@@ -0,0 +1,102 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+
+class CPU;
+
+
+enum MetricsLimits : uint32_t
+{
+    // Trap vectors are eight bits wide.
+    METRICS_TRAP_VECTORS = 256,
+
+    // Instructions executed between two publications from the run loop.
+    METRICS_PUBLISH_INTERVAL = 1 << 20
+};
+
+
+// Layout of the shared-memory segment a running VM publishes into.
+// Written by the VM thread only; readers retry while the sequence is odd or changed during their copy.
+struct MetricsSegment
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t processId;
+    std::atomic<uint32_t> sequence;
+
+    std::atomic<uint64_t> running;
+    std::atomic<uint64_t> uptimeNanoseconds;
+    std::atomic<uint64_t> instructions;
+    std::atomic<uint64_t> instructionsPerSecond;
+    std::atomic<uint64_t> keyboardPolls;
+    std::atomic<uint64_t> outputBytes;
+    std::atomic<uint64_t> inputBlockedNanoseconds;
+    std::atomic<uint64_t> inputWaitingSince; // Now() when the current wait for input began, 0 if not waiting
+    std::atomic<uint64_t> traps[METRICS_TRAP_VECTORS];
+};
+
+
+// A consistent copy of a MetricsSegment.
+struct MetricsSnapshot
+{
+    uint64_t running;
+    uint64_t uptimeNanoseconds;
+    uint64_t instructions;
+    uint64_t instructionsPerSecond;
+    uint64_t keyboardPolls;
+    uint64_t outputBytes;
+    uint64_t inputBlockedNanoseconds;
+    uint64_t inputWaitingSince;
+    uint64_t traps[METRICS_TRAP_VECTORS];
+};
+
+
+class Metrics
+{
+private:
+    CPU* cpuPtr;
+    MetricsSegment* segment = nullptr;
+    void* mappingHandle = nullptr;
+
+    // Counters accumulated by the VM thread between publications.
+    MetricsSnapshot local = {};
+
+    uint64_t startNanoseconds = 0;
+    uint64_t rateNanoseconds = 0;
+    uint64_t rateInstructions = 0;
+
+    static void SegmentName(uint32_t processId, char* name, size_t size);
+
+public:
+    Metrics(CPU* cpu);
+    ~Metrics();
+
+    static uint64_t Now();
+
+    int Open();
+    void Publish(bool running);
+
+    void CountTrap(uint8_t vector) { ++local.traps[vector]; }
+    void CountKeyboardPoll() { ++local.keyboardPolls; }
+    void CountOutput(uint64_t bytes) { local.outputBytes += bytes; }
+    void BeginInputWait();
+    void EndInputWait();
+
+    static int Watch(uint32_t processId, FILE* out);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,286 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "Mmu.h"
+
+
+/**
+ * @brief Constructs an MMU without processes, holding only the zero frame.
+ *
+ * @param cpu Pointer to the CPU object whose registers hold the running process's.
+ */
+Mmu::Mmu(CPU* cpu)
+{
+    cpuPtr = cpu;
+
+    MmuFrame zero = {};
+    frames.push_back(zero);
+    memset(tlb, 0, sizeof(tlb));
+}
+
+
+/**
+ * @brief Takes a free frame, or adds one, with a single reference.
+ *
+ * @return The frame number.
+ */
+uint32_t Mmu::Allocate()
+{
+    uint32_t frame;
+    if (!freeFrames.empty())
+    {
+        frame = freeFrames.back();
+        freeFrames.pop_back();
+    }
+    else
+    {
+        frame = (uint32_t)frames.size();
+        frames.emplace_back();
+    }
+
+    frames[frame].references = 1;
+    peakFrames = std::max(peakFrames, ++framesInUse);
+    return frame;
+}
+
+
+/**
+ * @brief Drops a reference to a frame, freeing it with the last one. The zero frame is never freed.
+ */
+void Mmu::Release(uint32_t frame)
+{
+    if (frame != 0 && --frames[frame].references == 0)
+    {
+        freeFrames.push_back(frame);
+        --framesInUse;
+    }
+}
+
+
+/**
+ * @brief Fills the TLB entry of an address of the current process from its page table.
+ *
+ * A store to a page that maps the zero frame or a frame shared with another process first gives
+ * the page a private copy.
+ *
+ * @param address The address accessed.
+ * @param write True for a store.
+ * @return The words of the frame the page maps.
+ */
+uint16_t* Mmu::Miss(uint16_t address, bool write)
+{
+    ++tlbMisses;
+
+    uint32_t page = address >> PAGE_SHIFT;
+    uint32_t& mapped = processes[current].pageTable[page];
+    if (write && (mapped == 0 || frames[mapped].references > 1))
+    {
+        uint32_t copy = Allocate();
+        memcpy(frames[copy].words, frames[mapped].words, sizeof(frames[copy].words));
+        if (mapped == 0)
+        {
+            ++zeroFills;
+        }
+        else
+        {
+            ++copies;
+        }
+        Release(mapped);
+        mapped = copy;
+    }
+
+    MmuTlbEntry& entry = tlb[(page ^ tlbSpread) % MMU_TLB_ENTRIES];
+    entry.readTag = tagBase | page;
+    entry.writeTag = (mapped != 0 && frames[mapped].references == 1) ? tagBase | page : 0;
+    entry.words = frames[mapped].words;
+    return entry.words;
+}
+
+
+/**
+ * @brief Creates a process from the image loaded into CPU::memory, starting at the CPU's registers.
+ *
+ * Every page an image segment touched gets a frame of its own; the rest map the zero frame.
+ *
+ * @param name The image the process runs.
+ * @return The process number.
+ */
+uint32_t Mmu::CreateProcess(const char* name)
+{
+    processes.emplace_back();
+    MmuProcess& process = processes.back();
+    process.name = name;
+    memcpy(process.registers, cpuPtr->registers, sizeof(process.registers));
+    process.running = true;
+    process.instructions = 0;
+    process.switches = 0;
+    process.pages = 0;
+    process.privatePages = 0;
+    memset(process.pageTable, 0, sizeof(process.pageTable));
+
+    for (const ImageSegment& segment : cpuPtr->segments)
+    {
+        uint32_t end = std::min<uint32_t>(segment.origin + segment.length, MemoryMappedRegisters::MR_DEVICES);
+        for (uint32_t address = segment.origin; address < end; address += MMU_PAGE_WORDS - address % MMU_PAGE_WORDS)
+        {
+            uint32_t page = address >> PAGE_SHIFT;
+            if (process.pageTable[page] == 0)
+            {
+                uint32_t frame = Allocate();
+                memcpy(frames[frame].words, cpuPtr->memory + (page << PAGE_SHIFT), sizeof(frames[frame].words));
+                process.pageTable[page] = frame;
+            }
+        }
+    }
+    return (uint32_t)processes.size() - 1;
+}
+
+
+/**
+ * @brief Creates a copy of a process that has not run yet, sharing its frames until either writes.
+ *
+ * @param source The process to copy.
+ * @return The number of the copy.
+ */
+uint32_t Mmu::Clone(uint32_t source)
+{
+    processes.push_back(processes[source]);
+    for (uint32_t frame : processes.back().pageTable)
+    {
+        if (frame != 0)
+        {
+            ++frames[frame].references;
+        }
+    }
+
+    // Pages of the source that were private are shared now, so their stores must fault
+    memset(tlb, 0, sizeof(tlb));
+    return (uint32_t)processes.size() - 1;
+}
+
+
+/**
+ * @brief Returns the number of processes created, halted ones included.
+ */
+uint32_t Mmu::ProcessCount() const
+{
+    return (uint32_t)processes.size();
+}
+
+
+/**
+ * @brief Saves the registers of the current process and loads those of another.
+ *
+ * @param index The process to run next.
+ * @return 1 if it was switched in, 0 if it has halted.
+ */
+int Mmu::Switch(uint32_t index)
+{
+    if (!processes[index].running)
+    {
+        return 0;
+    }
+
+    if (current != UINT32_MAX && processes[current].running)
+    {
+        memcpy(processes[current].registers, cpuPtr->registers, sizeof(cpuPtr->registers));
+        processes[current].instructions += cpuPtr->instructionCount - switchedAt;
+    }
+    if (index != current)
+    {
+        ++switches;
+    }
+
+    MmuProcess& process = processes[index];
+    memcpy(cpuPtr->registers, process.registers, sizeof(cpuPtr->registers));
+    cpuPtr->running = 1;
+    ++process.switches;
+
+    current = index;
+    tagBase = (index + 1) * PAGE_COUNT;
+    tlbSpread = index * MMU_TLB_SPREAD;
+    switchedAt = cpuPtr->instructionCount;
+    switchRequested = false;
+    return 1;
+}
+
+
+/**
+ * @brief Ends the current process once it halted, freeing the frames no other process maps.
+ */
+void Mmu::Exit()
+{
+    MmuProcess& process = processes[current];
+    process.running = false;
+    process.instructions += cpuPtr->instructionCount - switchedAt;
+
+    for (uint32_t& frame : process.pageTable)
+    {
+        if (frame != 0)
+        {
+            ++process.pages;
+            process.privatePages += frames[frame].references == 1;
+            Release(frame);
+            frame = 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Copies a null-terminated string of the current process, for the trap routines.
+ *
+ * @param address Address of the first word.
+ * @param out Room for MEMORY_MAX words.
+ * @return Length of the string, which stops at the device registers if it is not terminated before.
+ */
+uint32_t Mmu::ReadString(uint16_t address, uint16_t* out)
+{
+    uint32_t length = 0;
+    for (uint32_t word = address; word < MemoryMappedRegisters::MR_DEVICES; ++word)
+    {
+        uint16_t value = Load((uint16_t)word);
+        if (value == 0)
+        {
+            break;
+        }
+        out[length++] = value;
+    }
+    return length;
+}
+
+
+/**
+ * @brief Prints the frames the processes used against separate machines, the TLB misses and each process.
+ *
+ * @param out The stream to print to.
+ */
+void Mmu::Report(FILE* out) const
+{
+    uint32_t count = (uint32_t)processes.size();
+    fprintf(out, "mmu: %u processes, peak %u frames (%u KB, %u KB as separate machines), %llu pages zero-filled, %llu copied on write\n",
+        count, peakFrames, peakFrames * MMU_PAGE_WORDS * 2 / 1024, count * MEMORY_MAX * 2 / 1024,
+        (unsigned long long)zeroFills, (unsigned long long)copies);
+    fprintf(out, "  %llu TLB misses, %llu context switches\n", (unsigned long long)tlbMisses, (unsigned long long)switches);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const MmuProcess& process = processes[i];
+        fprintf(out, "  process %u %s: %llu instructions, %llu times switched in, %u pages (%u private)%s\n",
+            i, process.name.c_str(), (unsigned long long)process.instructions, (unsigned long long)process.switches,
+            process.pages, process.privatePages, process.running ? ", still running" : "");
+    }
+}
\ No newline at end of file
@@ -0,0 +1,217 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef MMU_H
+#define MMU_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "CPU.h"
+#include "VmCore.h"
+
+
+enum MmuLimits : uint32_t
+{
+    // Words per page and frame.
+    MMU_PAGE_WORDS = 1 << PAGE_SHIFT,
+
+    // Pages a process maps: all below the device registers, which every process shares.
+    MMU_PAGES = MemoryMappedRegisters::MR_DEVICES >> PAGE_SHIFT,
+
+    // Entries of the software TLB, indexed by the low bits of the virtual page number XORed with
+    // the process's spread.
+    MMU_TLB_ENTRIES = 64,
+
+    // Spread per process number, so that processes running the same image, whose pages are the
+    // same, use different entries and keep them across context switches. Odd, so the first 64
+    // processes all have different spreads.
+    MMU_TLB_SPREAD = 13
+};
+
+
+// Physical page, shared copy-on-write by every process mapping it.
+struct MmuFrame
+{
+    uint16_t words[MMU_PAGE_WORDS];
+    uint32_t references;
+};
+
+
+// Translation of one virtual page of the current process. A tag is the process number plus one times
+// PAGE_COUNT plus the page; writeTag is 0 while the frame is shared, so stores fault and copy it.
+struct MmuTlbEntry
+{
+    uint32_t readTag;
+    uint32_t writeTag;
+    uint16_t* words;
+};
+
+
+// LC-3 program with its own registers and address space.
+struct MmuProcess
+{
+    std::string name;
+    uint16_t registers[REGISTER_COUNT];
+    bool running;
+    uint64_t instructions;
+    uint64_t switches;
+
+    // Pages mapped and pages not shared with another process, counted when it halts.
+    uint32_t pages;
+    uint32_t privatePages;
+
+    // Frame per virtual page; frame 0 is the zero frame every unwritten page maps.
+    uint32_t pageTable[MMU_PAGES];
+};
+
+
+// Paged memory for many isolated LC-3 processes in one machine. Each process maps its pages to
+// frames of 256 words. Pages it never wrote map a shared zero frame, and copies of a process share
+// its frames until one of them writes. Loads and stores go through a direct-mapped software TLB
+// tagged and indexed with the process, so a context switch needs no flush and processes at the
+// same addresses keep their entries across switches. The CPU holds the registers of the
+// process running now; the device registers stay in CPU::memory.
+class Mmu
+{
+private:
+    CPU* cpuPtr;
+
+    std::deque<MmuFrame> frames;
+    std::vector<uint32_t> freeFrames;
+    uint32_t framesInUse = 0;
+    uint32_t peakFrames = 0;
+
+    std::vector<MmuProcess> processes;
+    uint32_t current = UINT32_MAX;
+    uint64_t switchedAt = 0;
+    bool switchRequested = false;
+
+    MmuTlbEntry tlb[MMU_TLB_ENTRIES];
+    uint32_t tagBase = 0;
+    uint32_t tlbSpread = 0;
+
+    uint64_t tlbMisses = 0;
+    uint64_t zeroFills = 0;
+    uint64_t copies = 0;
+    uint64_t switches = 0;
+
+    uint32_t Allocate();
+    void Release(uint32_t frame);
+    uint16_t* Miss(uint16_t address, bool write);
+
+public:
+    Mmu(CPU* cpu);
+
+    uint32_t CreateProcess(const char* name);
+    uint32_t Clone(uint32_t source);
+    uint32_t ProcessCount() const;
+    int Switch(uint32_t index);
+    void Exit();
+    uint32_t ReadString(uint16_t address, uint16_t* out);
+    void Report(FILE* out) const;
+
+    /**
+     * @brief Asks for another process to be switched in once the core stops, e.g. after a trap.
+     */
+    void RequestSwitch()
+    {
+        switchRequested = true;
+    }
+
+    /**
+     * @brief Tells whether the core should stop for a context switch.
+     */
+    bool SwitchRequested() const
+    {
+        return switchRequested;
+    }
+
+    /**
+     * @brief Reads a word of the current process below the device registers.
+     */
+    uint16_t Load(uint16_t address)
+    {
+        uint32_t page = address >> PAGE_SHIFT;
+        const MmuTlbEntry& entry = tlb[(page ^ tlbSpread) % MMU_TLB_ENTRIES];
+        uint16_t* words = entry.readTag == (tagBase | page) ? entry.words : Miss(address, false);
+        return words[address % MMU_PAGE_WORDS];
+    }
+
+    /**
+     * @brief Writes a word of the current process below the device registers.
+     */
+    void Store(uint16_t address, uint16_t value)
+    {
+        uint32_t page = address >> PAGE_SHIFT;
+        const MmuTlbEntry& entry = tlb[(page ^ tlbSpread) % MMU_TLB_ENTRIES];
+        uint16_t* words = entry.writeTag == (tagBase | page) ? entry.words : Miss(address, true);
+        words[address % MMU_PAGE_WORDS] = value;
+    }
+};
+
+
+// Memory policy translating every access of the current process through the MMU.
+class MappedMemory
+{
+private:
+    Mmu* mmuPtr;
+
+public:
+    MappedMemory(Mmu* mmu)
+    {
+        mmuPtr = mmu;
+    }
+
+    uint16_t Fetch(uint16_t address) const
+    {
+        return mmuPtr->Load(address);
+    }
+
+    uint16_t Load(uint16_t address) const
+    {
+        return mmuPtr->Load(address);
+    }
+
+    void Store(uint16_t address, uint16_t value)
+    {
+        mmuPtr->Store(address, value);
+    }
+};
+
+
+// I/O policy stopping the core after every trap, so the next process is switched in at the system call.
+class ProcessIo : public MachineIo
+{
+private:
+    Mmu* mmuPtr;
+
+public:
+    ProcessIo(MemoryIO* memoryIO, Trap* trap, Mmu* mmu) : MachineIo(memoryIO, trap)
+    {
+        mmuPtr = mmu;
+    }
+
+    void Execute(uint16_t instruction)
+    {
+        trapPtr->Proxy(instruction);
+        mmuPtr->RequestSwitch();
+    }
+
+    bool Interrupted() const
+    {
+        return mmuPtr->SwitchRequested();
+    }
+};
+#endif
\ No newline at end of file
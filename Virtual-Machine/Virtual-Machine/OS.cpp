@@ -9,10 +9,16 @@ Copyright 
 
 
 #include "OS.h"
+#include "Recorder.h"
+#include "Metrics.h"
+#include "Terminal.h"
+#include "LatencyTrace.h"
 
+#include <cerrno>
 #include <cstdint>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <signal.h>
 // windows only
 #include <Windows.h>
@@ -78,13 +84,388 @@ void OS::RestoreInputBuffering()
 /**
  * @brief Checks if a key is pressed within a specified timeout.
  *
- * This function checks if a key is pressed within a specified timeout.
+ * This function checks if a key is pressed within a specified timeout. The result is taken from,
+ * or written to, the attached recording.
  *
  * @return True if a key is pressed within the timeout, false otherwise.
  */
 uint16_t OS::CheckKey()
 {
-    return WaitForSingleObject(hStdin, 1000) == WAIT_OBJECT_0 && _kbhit();
+    if (metricsPtr)
+    {
+        metricsPtr->CountKeyboardPoll();
+    }
+
+    int value;
+    if (recorderPtr && recorderPtr->Replay(RE_KEY_POLL, &value))
+    {
+        return (uint16_t)value;
+    }
+
+    uint16_t pressed = PollKey();
+    if (recorderPtr)
+    {
+        recorderPtr->Record(RE_KEY_POLL, pressed);
+    }
+    return pressed;
+}
+
+
+/**
+ * @brief Checks the scripted input or the console for a pending key.
+ *
+ * @return True if a key is available, false otherwise.
+ */
+uint16_t OS::PollKey()
+{
+    if (inputScripted)
+    {
+        // A program polling for input that will never come has nothing left to do
+        if (inputPosition >= inputSize)
+        {
+            inputExhausted = true;
+            return 0;
+        }
+        return 1;
+    }
+
+    if (terminalPtr)
+    {
+        // The screen must be up to date while the program waits for the user
+        terminalPtr->Present();
+        if (latencyTracePtr)
+        {
+            latencyTracePtr->Flushed();
+        }
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->BeginInputWait();
+    }
+    uint16_t pressed = WaitForSingleObject(hStdin, 1000) == WAIT_OBJECT_0 && _kbhit();
+    if (metricsPtr)
+    {
+        metricsPtr->EndInputWait();
+    }
+
+    // A program polling without output never reaches another trace event, so save a requested trace here
+    if (latencyTracePtr)
+    {
+        latencyTracePtr->Pending();
+    }
+    return pressed;
+}
+
+
+/**
+ * @brief Reads one character of program input.
+ *
+ * The character is taken from, or written to, the attached recording.
+ *
+ * @return The character read, or EOF when no more input is available.
+ */
+int OS::GetChar()
+{
+    int c;
+    if (recorderPtr && recorderPtr->Replay(RE_CHAR, &c))
+    {
+        return c;
+    }
+
+    c = ReadChar();
+    if (recorderPtr)
+    {
+        recorderPtr->Record(RE_CHAR, c);
+    }
+    if (latencyTracePtr && c != EOF)
+    {
+        latencyTracePtr->Read();
+    }
+    return c;
+}
+
+
+/**
+ * @brief Reads one character from the scripted input when one is set, otherwise from the console.
+ *
+ * @return The character read, or EOF when no more input is available.
+ */
+int OS::ReadChar()
+{
+    if (inputScripted)
+    {
+        if (inputPosition >= inputSize)
+        {
+            inputExhausted = true;
+            return EOF;
+        }
+        return inputData[inputPosition++];
+    }
+
+    if (terminalPtr)
+    {
+        terminalPtr->Present();
+        if (latencyTracePtr)
+        {
+            latencyTracePtr->Flushed();
+        }
+    }
+    if (metricsPtr)
+    {
+        metricsPtr->BeginInputWait();
+    }
+    int c;
+    bool interrupted;
+    do
+    {
+        errno = 0;
+        c = getchar();
+
+        // A signal without SA_RESTART, like the latency dump signal, interrupts the wait; act on it and keep waiting
+        interrupted = c == EOF && errno == EINTR;
+        if (interrupted)
+        {
+            clearerr(stdin);
+            if (latencyTracePtr)
+            {
+                latencyTracePtr->Pending();
+            }
+        }
+    } while (interrupted);
+    if (metricsPtr)
+    {
+        metricsPtr->EndInputWait();
+    }
+    return c;
+}
+
+
+/**
+ * @brief Writes one character of program output.
+ *
+ * @param c The character to write.
+ */
+void OS::PutChar(char c)
+{
+    if (metricsPtr)
+    {
+        metricsPtr->CountOutput(1);
+    }
+    if (latencyTracePtr)
+    {
+        latencyTracePtr->Output();
+    }
+    if (outputCapture)
+    {
+        outputCapture->push_back(c);
+    }
+    else if (outputMuted)
+    {
+        return;
+    }
+    else if (terminalPtr)
+    {
+        terminalPtr->Write(&c, 1);
+    }
+    else
+    {
+        putc(c, stdout);
+    }
+}
+
+
+/**
+ * @brief Writes a null-terminated string of program output.
+ *
+ * @param text The string to write.
+ */
+void OS::PutString(const char* text)
+{
+    if (metricsPtr)
+    {
+        metricsPtr->CountOutput(strlen(text));
+    }
+    if (latencyTracePtr && *text)
+    {
+        latencyTracePtr->Output();
+    }
+    if (outputCapture)
+    {
+        outputCapture->append(text);
+    }
+    else if (outputMuted)
+    {
+        return;
+    }
+    else if (terminalPtr)
+    {
+        terminalPtr->Write(text, strlen(text));
+    }
+    else
+    {
+        fputs(text, stdout);
+    }
+}
+
+
+/**
+ * @brief Writes a run of program output bytes in one call.
+ *
+ * @param data The bytes to write, which may include nulls.
+ * @param length Number of bytes.
+ */
+void OS::PutBytes(const char* data, size_t length)
+{
+    if (metricsPtr)
+    {
+        metricsPtr->CountOutput(length);
+    }
+    if (latencyTracePtr && length)
+    {
+        latencyTracePtr->Output();
+    }
+    if (outputCapture)
+    {
+        outputCapture->append(data, length);
+    }
+    else if (outputMuted)
+    {
+        return;
+    }
+    else if (terminalPtr)
+    {
+        terminalPtr->Write(data, length);
+    }
+    else
+    {
+        fwrite(data, 1, length, stdout);
+    }
+}
+
+
+/**
+ * @brief Flushes program output to ensure immediate display.
+ */
+void OS::FlushOutput()
+{
+    if (terminalPtr && !outputCapture && !outputMuted)
+    {
+        terminalPtr->Flush();
+    }
+    else if (!outputCapture && !outputMuted)
+    {
+        fflush(stdout);
+    }
+
+    // The emulated screen may hold the output back until its next frame
+    if (latencyTracePtr && !(terminalPtr && !outputCapture && terminalPtr->Pending()))
+    {
+        latencyTracePtr->Flushed();
+    }
+}
+
+
+/**
+ * @brief Replaces console input with the given bytes.
+ *
+ * Once the bytes are used up, reads return EOF and InputExhausted reports true.
+ *
+ * @param data Pointer to the input bytes; must stay valid while in use.
+ * @param size Number of input bytes.
+ */
+void OS::SetScriptedInput(const uint8_t* data, size_t size)
+{
+    inputData = data;
+    inputSize = size;
+    inputPosition = 0;
+    inputScripted = true;
+    inputExhausted = false;
+}
+
+
+/**
+ * @brief Tells whether the program asked for more scripted input than was provided.
+ *
+ * @return True if the scripted input ran out.
+ */
+bool OS::InputExhausted() const
+{
+    return inputExhausted;
+}
+
+
+/**
+ * @brief Returns how many bytes of the scripted input were consumed.
+ */
+size_t OS::InputPosition() const
+{
+    return inputPosition;
+}
+
+
+/**
+ * @brief Enables or disables discarding of program output.
+ *
+ * @param muted True to discard output.
+ */
+void OS::SetOutputMuted(bool muted)
+{
+    outputMuted = muted;
+}
+
+
+/**
+ * @brief Redirects program output into a string, e.g. for jobs run by the job server.
+ *
+ * @param capture Pointer to the string receiving the output, or nullptr to write to the console again.
+ */
+void OS::SetOutputCapture(std::string* capture)
+{
+    outputCapture = capture;
+}
+
+
+/**
+ * @brief Routes program output through an emulated screen that draws only what changed.
+ *
+ * @param terminal Pointer to the Terminal object, or nullptr to write output as it comes.
+ */
+void OS::SetTerminal(Terminal* terminal)
+{
+    terminalPtr = terminal;
+}
+
+
+/**
+ * @brief Attaches the recorder that records or replays keyboard input.
+ *
+ * @param recorder Pointer to the Recorder object, or nullptr to use live input only.
+ */
+void OS::SetRecorder(Recorder* recorder)
+{
+    recorderPtr = recorder;
+}
+
+
+/**
+ * @brief Attaches the live metrics that count keyboard polls, output and time blocked on input.
+ *
+ * @param metrics Pointer to the Metrics object, or nullptr to skip counting.
+ */
+void OS::SetMetrics(Metrics* metrics)
+{
+    metricsPtr = metrics;
+}
+
+
+/**
+ * @brief Attaches the latency trace told about every byte read, every output and every flush.
+ *
+ * @param latencyTrace Pointer to the LatencyTrace object, or nullptr to stop tracing.
+ */
+void OS::SetLatencyTrace(LatencyTrace* latencyTrace)
+{
+    latencyTracePtr = latencyTrace;
 }
 
 
@@ -13,7 +13,15 @@ Copyright 
 
 
 #include <Windows.h>
+#include <cstddef>
 #include <cstdint>
+#include <string>
+
+
+class Recorder;
+class Metrics;
+class Terminal;
+class LatencyTrace;
 
 
 class OS
@@ -24,11 +32,53 @@ private:
     // Variables to store the input mode flags.
     DWORD fdwMode, fdwOldMode;
 
+    // Scripted input replacing the console, e.g. test cases generated by the fuzzer.
+    const uint8_t* inputData = nullptr;
+    size_t inputSize = 0;
+    size_t inputPosition = 0;
+    bool inputScripted = false;
+    bool inputExhausted = false;
+
+    // Discard program output instead of writing it to the console.
+    bool outputMuted = false;
+
+    // Collect program output here instead of writing it to the console, if set.
+    std::string* outputCapture = nullptr;
+
+    // Emulated screen that redraws only what changed, if attached.
+    Terminal* terminalPtr = nullptr;
+
+    // Records or replays nondeterministic inputs, if attached.
+    Recorder* recorderPtr = nullptr;
+
+    // Counts polls, output and time spent waiting for input, if attached.
+    Metrics* metricsPtr = nullptr;
+
+    // Follows input bytes to the output that answers them, if attached.
+    LatencyTrace* latencyTracePtr = nullptr;
+
+    uint16_t PollKey();
+    int ReadChar();
+
 public:
     OS();
     void DisableInputBuffering();
     void RestoreInputBuffering();
     uint16_t CheckKey();
+    int GetChar();
+    void PutChar(char c);
+    void PutString(const char* text);
+    void PutBytes(const char* data, size_t length);
+    void FlushOutput();
+    void SetScriptedInput(const uint8_t* data, size_t size);
+    bool InputExhausted() const;
+    size_t InputPosition() const;
+    void SetOutputMuted(bool muted);
+    void SetOutputCapture(std::string* capture);
+    void SetTerminal(Terminal* terminal);
+    void SetRecorder(Recorder* recorder);
+    void SetMetrics(Metrics* metrics);
+    void SetLatencyTrace(LatencyTrace* latencyTrace);
     void HandleInterrupt(int signal);
     static void HandleInterruptWrapper(int signal);
 };
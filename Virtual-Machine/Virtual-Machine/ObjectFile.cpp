@@ -0,0 +1,514 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include "ObjectFile.h"
+#include "CPU.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+// windows only
+#include <Windows.h>
+#endif
+
+
+static const uint16_t OBJECT_VERSION = 1;
+
+// Shortest match worth a back-reference, and the widest distance one can reach.
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_DISTANCE = 0xFFFF;
+
+// Entries of the compressor's match-finder hash table.
+static const uint32_t HASH_BITS = 12;
+
+
+/**
+ * @brief Computes the 32-bit FNV-1a hash of a byte range.
+ */
+static uint32_t Checksum(const uint8_t* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * @brief Appends a length that did not fit its 4-bit field, in bytes of 255 ended by a smaller one.
+ */
+static void AppendLength(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((uint8_t)length);
+}
+
+
+/**
+ * @brief Appends one LZ sequence: a run of literals, then a back-reference unless distance is 0.
+ *
+ * The token byte holds the literal count in its high and the match length minus MIN_MATCH in its low nibble,
+ * 15 meaning more length bytes follow. The distance is stored as two bytes after the literals.
+ */
+static void AppendSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t distance, size_t matchLength)
+{
+    size_t matchCode = distance ? matchLength - MIN_MATCH : 0;
+    out.push_back((uint8_t)(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+    if (literalCount >= 15)
+    {
+        AppendLength(out, literalCount - 15);
+    }
+    out.insert(out.end(), literals, literals + literalCount);
+
+    if (distance)
+    {
+        out.push_back((uint8_t)distance);
+        out.push_back((uint8_t)(distance >> 8));
+        if (matchCode >= 15)
+        {
+            AppendLength(out, matchCode - 15);
+        }
+    }
+}
+
+
+/**
+ * @brief Compresses a byte range with a greedy LZ77 match finder.
+ */
+static void Compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out)
+{
+    std::vector<int32_t> table((size_t)1 << HASH_BITS, -1);
+    size_t anchor = 0;
+    size_t position = 0;
+
+    while (position + MIN_MATCH <= size)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, in + position, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        int32_t candidate = table[hash];
+        table[hash] = (int32_t)position;
+
+        if (candidate >= 0 && position - candidate <= MAX_DISTANCE && memcmp(in + candidate, in + position, MIN_MATCH) == 0)
+        {
+            size_t length = MIN_MATCH;
+            while (position + length < size && in[candidate + length] == in[position + length])
+            {
+                ++length;
+            }
+
+            AppendSequence(out, in + anchor, position - anchor, position - candidate, length);
+            position += length;
+            anchor = position;
+        }
+        else
+        {
+            ++position;
+        }
+    }
+
+    if (anchor < size)
+    {
+        AppendSequence(out, in + anchor, size - anchor, 0, 0);
+    }
+}
+
+
+/**
+ * @brief Reads a length continued in extra bytes.
+ *
+ * @return False if the input ends first.
+ */
+static bool ReadLength(const uint8_t*& in, const uint8_t* inEnd, size_t& length)
+{
+    uint8_t extra;
+    do
+    {
+        if (in >= inEnd)
+        {
+            return false;
+        }
+        extra = *in++;
+        length += extra;
+    } while (extra == 255);
+    return true;
+}
+
+
+/**
+ * @brief Decompresses an LZ byte stream, refusing anything that would read or write out of bounds.
+ *
+ * @return True if exactly outSize bytes were produced.
+ */
+static bool Decompress(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize)
+{
+    const uint8_t* inEnd = in + inSize;
+    uint8_t* const outStart = out;
+    uint8_t* const outEnd = out + outSize;
+
+    while (out < outEnd)
+    {
+        if (in >= inEnd)
+        {
+            return false;
+        }
+        uint8_t token = *in++;
+
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(in, inEnd, literalCount))
+        {
+            return false;
+        }
+        if (literalCount > (size_t)(inEnd - in) || literalCount > (size_t)(outEnd - out))
+        {
+            return false;
+        }
+        memcpy(out, in, literalCount);
+        in += literalCount;
+        out += literalCount;
+
+        if (out == outEnd)
+        {
+            break;
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+        size_t distance = in[0] | (in[1] << 8);
+        in += 2;
+
+        size_t matchLength = token & 0xF;
+        if (matchLength == 15 && !ReadLength(in, inEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+
+        if (distance == 0 || distance > (size_t)(out - outStart) || matchLength > (size_t)(outEnd - out))
+        {
+            return false;
+        }
+
+        // Byte by byte, since a match may overlap the bytes it produces
+        const uint8_t* match = out - distance;
+        while (matchLength-- > 0)
+        {
+            *out++ = *match++;
+        }
+    }
+
+    return out == outEnd;
+}
+
+
+/**
+ * @brief Constructs an ObjectFile that loads into, and saves from, the given CPU.
+ *
+ * @param cpu Pointer to the CPU object holding memory, segments, symbols and the program counter.
+ */
+ObjectFile::ObjectFile(CPU* cpu)
+{
+    cpuPtr = cpu;
+}
+
+
+/**
+ * @brief Tells whether the first bytes of a file are those of an extended object file.
+ *
+ * A plain image would need an origin of x4C43 followed by the word x3358 to be mistaken for one.
+ *
+ * @param prefix The first bytes of the file.
+ * @param size Number of bytes available.
+ */
+bool ObjectFile::IsExtended(const uint8_t* prefix, size_t size)
+{
+    return size >= 4 && memcmp(prefix, "LC3X", 4) == 0;
+}
+
+
+/**
+ * @brief Maps an extended object file into memory and loads it.
+ *
+ * The file is verified against its checksum first, then segments are copied, or decompressed,
+ * straight from the mapping into machine memory.
+ *
+ * @param path The file to load.
+ * @return Returns 1 on success, 0 if the file cannot be read or is malformed.
+ */
+int ObjectFile::Load(const char* path)
+{
+    int loaded = 0;
+
+#if defined(__linux__)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        size_t size = (size_t)status.st_size;
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED)
+        {
+            loaded = LoadMapped((const uint8_t*)view, size);
+            munmap(view, size);
+        }
+    }
+    close(fd);
+#else
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+        {
+            const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (view)
+            {
+                loaded = LoadMapped((const uint8_t*)view, (size_t)size.QuadPart);
+                UnmapViewOfFile(view);
+            }
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#endif
+
+    return loaded;
+}
+
+
+/**
+ * @brief Validates and loads an extended object file held in memory.
+ *
+ * Nothing is written to the machine unless the whole file is well formed.
+ *
+ * @param data The file contents.
+ * @param size Size of the file in bytes.
+ * @return Returns 1 on success, 0 if the file is malformed.
+ */
+int ObjectFile::LoadMapped(const uint8_t* data, size_t size)
+{
+    ObjectHeader header;
+    if (size < sizeof(header) || !IsExtended(data, size))
+    {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.version != OBJECT_VERSION || Checksum(data + sizeof(header), size - sizeof(header)) != header.checksum)
+    {
+        return 0;
+    }
+
+    size_t tables = sizeof(header) + (size_t)header.segmentCount * sizeof(ObjectSegment) + (size_t)header.symbolCount * sizeof(ObjectSymbol);
+    if (tables > size)
+    {
+        return 0;
+    }
+
+    std::vector<ObjectSegment> segments(header.segmentCount);
+    std::vector<ObjectSymbol> symbols(header.symbolCount);
+    if (header.segmentCount)
+    {
+        memcpy(segments.data(), data + sizeof(header), segments.size() * sizeof(ObjectSegment));
+    }
+    if (header.symbolCount)
+    {
+        memcpy(symbols.data(), data + sizeof(header) + segments.size() * sizeof(ObjectSegment), symbols.size() * sizeof(ObjectSymbol));
+    }
+
+    for (const ObjectSegment& segment : segments)
+    {
+        bool compressed = (segment.flags & OS_COMPRESSED) != 0;
+        if (segment.origin + (size_t)segment.length > MEMORY_MAX || segment.offset > size || segment.storedSize > size - segment.offset
+            || (!compressed && segment.storedSize != segment.length * sizeof(uint16_t)))
+        {
+            return 0;
+        }
+    }
+    for (const ObjectSymbol& symbol : symbols)
+    {
+        if (symbol.nameOffset > size || symbol.nameLength > size - symbol.nameOffset)
+        {
+            return 0;
+        }
+    }
+
+    // Decompress into a scratch copy so a corrupt stream leaves memory untouched
+    std::vector<uint16_t> memory(cpuPtr->memory, cpuPtr->memory + MEMORY_MAX);
+    for (const ObjectSegment& segment : segments)
+    {
+        uint8_t* target = (uint8_t*)(memory.data() + segment.origin);
+        size_t length = segment.length * sizeof(uint16_t);
+
+        if (segment.flags & OS_COMPRESSED)
+        {
+            if (!Decompress(data + segment.offset, segment.storedSize, target, length))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            memcpy(target, data + segment.offset, length);
+        }
+    }
+
+    memcpy(cpuPtr->memory, memory.data(), MEMORY_MAX * sizeof(uint16_t));
+    for (const ObjectSegment& segment : segments)
+    {
+        cpuPtr->segments.push_back({ segment.origin, segment.length });
+    }
+    for (const ObjectSymbol& symbol : symbols)
+    {
+        cpuPtr->symbols[symbol.address] = std::string((const char*)data + symbol.nameOffset, symbol.nameLength);
+    }
+    if (header.flags & OH_ENTRY)
+    {
+        cpuPtr->registers[Registers::R_PC] = header.entry;
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Writes the loaded segments, the symbols and the program counter as an extended object file.
+ *
+ * Each segment is stored compressed when that makes it smaller.
+ *
+ * @param path The file to write.
+ * @return Returns 1 on success, 0 if the file cannot be written.
+ */
+int ObjectFile::Save(const char* path) const
+{
+    ObjectHeader header;
+    memcpy(header.magic, "LC3X", 4);
+    header.version = OBJECT_VERSION;
+    header.flags = OH_ENTRY;
+    header.entry = cpuPtr->registers[Registers::R_PC];
+    header.segmentCount = (uint16_t)cpuPtr->segments.size();
+    header.symbolCount = (uint32_t)cpuPtr->symbols.size();
+
+    std::vector<ObjectSegment> segments;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<uint8_t> body;
+
+    uint32_t offset = (uint32_t)(sizeof(header) + header.segmentCount * sizeof(ObjectSegment) + header.symbolCount * sizeof(ObjectSymbol));
+
+    for (const auto& symbol : cpuPtr->symbols)
+    {
+        symbols.push_back({ symbol.first, (uint16_t)symbol.second.size(), offset + (uint32_t)body.size() });
+        body.insert(body.end(), symbol.second.begin(), symbol.second.end());
+    }
+
+    for (const ImageSegment& segment : cpuPtr->segments)
+    {
+        const uint8_t* raw = (const uint8_t*)(cpuPtr->memory + segment.origin);
+        size_t rawSize = segment.length * sizeof(uint16_t);
+
+        std::vector<uint8_t> packed;
+        Compress(raw, rawSize, packed);
+        bool compressed = packed.size() < rawSize;
+
+        segments.push_back({ segment.origin, (uint16_t)(compressed ? OS_COMPRESSED : 0), segment.length,
+            offset + (uint32_t)body.size(), (uint32_t)(compressed ? packed.size() : rawSize) });
+        if (compressed)
+        {
+            body.insert(body.end(), packed.begin(), packed.end());
+        }
+        else
+        {
+            body.insert(body.end(), raw, raw + rawSize);
+        }
+    }
+
+    std::vector<uint8_t> file((const uint8_t*)segments.data(), (const uint8_t*)(segments.data() + segments.size()));
+    file.insert(file.end(), (const uint8_t*)symbols.data(), (const uint8_t*)(symbols.data() + symbols.size()));
+    file.insert(file.end(), body.begin(), body.end());
+    header.checksum = Checksum(file.data(), file.size());
+
+    FILE* out = fopen(path, "wb");
+    if (!out)
+    {
+        return 0;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(file.data(), 1, file.size(), out) == file.size();
+    return fclose(out) == 0 && written;
+}
+
+
+/**
+ * @brief Reads a symbol table in the format written by lc3as (.sym files).
+ *
+ * Every line holding a name followed by a hexadecimal address defines a symbol; the leading "//"
+ * of lc3as output, headings and rulers are skipped.
+ *
+ * @param path The symbol file.
+ * @return Returns 1 on success, 0 if the file cannot be read.
+ */
+int ObjectFile::ReadSymbols(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        const char* text = line;
+        while (*text == '/' || *text == ' ' || *text == '\t')
+        {
+            ++text;
+        }
+
+        char name[128];
+        char address[16];
+        char* end;
+        if (sscanf(text, "%127s %15s", name, address) != 2)
+        {
+            continue;
+        }
+        unsigned long value = strtoul(address[0] == 'x' || address[0] == 'X' ? address + 1 : address, &end, 16);
+        if (*end == '\0' && value <= 0xFFFF && name[0] != '-')
+        {
+            cpuPtr->symbols[(uint16_t)value] = name;
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
\ No newline at end of file
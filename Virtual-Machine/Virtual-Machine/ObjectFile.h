@@ -0,0 +1,84 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+class CPU;
+
+
+enum ObjectHeaderFlags : uint16_t
+{
+    OH_ENTRY = (1 << 0)       // the entry field holds the initial program counter
+};
+
+
+enum ObjectSegmentFlags : uint16_t
+{
+    OS_COMPRESSED = (1 << 0)  // the data is LZ-compressed
+};
+
+
+// Extended object file layout, all fields little-endian:
+// header, segment table, symbol table, symbol names, then the data of every segment.
+// The checksum is the FNV-1a hash of everything after the header.
+struct ObjectHeader
+{
+    char magic[4];            // "LC3X"
+    uint16_t version;
+    uint16_t flags;           // ObjectHeaderFlags
+    uint16_t entry;
+    uint16_t segmentCount;
+    uint32_t symbolCount;
+    uint32_t checksum;
+};
+
+
+struct ObjectSegment
+{
+    uint16_t origin;
+    uint16_t flags;           // ObjectSegmentFlags
+    uint32_t length;          // words once loaded
+    uint32_t offset;          // file offset of the data
+    uint32_t storedSize;      // bytes of data in the file
+};
+
+
+struct ObjectSymbol
+{
+    uint16_t address;
+    uint16_t nameLength;
+    uint32_t nameOffset;      // file offset of the name, not null-terminated
+};
+
+
+class ObjectFile
+{
+private:
+    CPU* cpuPtr;
+
+    int LoadMapped(const uint8_t* data, size_t size);
+
+public:
+    ObjectFile(CPU* cpu);
+
+    static bool IsExtended(const uint8_t* prefix, size_t size);
+
+    int Load(const char* path);
+    int Save(const char* path) const;
+    int ReadSymbols(const char* path);
+};
+#endif
\ No newline at end of file
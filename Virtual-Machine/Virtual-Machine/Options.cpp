@@ -0,0 +1,392 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include "Options.h"
+#include "CacheModel.h"
+#include "Workload.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+/**
+ * @brief Parses the command-line arguments into option values and image paths.
+ *
+ * Arguments starting with "--" are treated as options; every other argument is an image file.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments.
+ * @return Returns 1 if the arguments are valid and at least one image was given, 0 otherwise.
+ */
+int Options::Parse(int argc, const char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+
+        if (strcmp(arg, "--timer-ipt") == 0 && i + 1 < argc)
+        {
+            // Instructions per timer tick, must be at least one
+            timerInstructionsPerTick = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            if (timerInstructionsPerTick == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--timer-realtime") == 0)
+        {
+            timerRealTime = true;
+        }
+        else if (strcmp(arg, "--translate") == 0 && i + 1 < argc)
+        {
+            translateOutput = argv[++i];
+        }
+        else if (strcmp(arg, "--pack") == 0 && i + 1 < argc)
+        {
+            packOutput = argv[++i];
+        }
+        else if (strcmp(arg, "--symbols") == 0 && i + 1 < argc)
+        {
+            symbolsPath = argv[++i];
+        }
+        else if (strcmp(arg, "--decode") == 0)
+        {
+            decode = true;
+        }
+        else if (strcmp(arg, "--cache-dir") == 0 && i + 1 < argc)
+        {
+            decode = true;
+            cacheDirectory = argv[++i];
+        }
+        else if (strcmp(arg, "--tier") == 0)
+        {
+            decode = true;
+            tier = true;
+        }
+        else if (strcmp(arg, "--tier-threshold") == 0 && i + 1 < argc)
+        {
+            decode = true;
+            tier = true;
+            tierThreshold = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            if (tierThreshold == 0 || tierThreshold >= 0xFFFF)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--perf") == 0)
+        {
+            perf = true;
+        }
+        else if (strcmp(arg, "--fuzz") == 0 && i + 1 < argc)
+        {
+            fuzz = true;
+            fuzzExecutions = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(arg, "--fuzz-budget") == 0 && i + 1 < argc)
+        {
+            fuzzBudget = strtoull(argv[++i], nullptr, 10);
+            if (fuzzBudget == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--fuzz-max-len") == 0 && i + 1 < argc)
+        {
+            fuzzMaxLength = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            if (fuzzMaxLength == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--fuzz-dir") == 0 && i + 1 < argc)
+        {
+            fuzzDirectory = argv[++i];
+        }
+        else if (strcmp(arg, "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(arg, "--replay") == 0 && i + 1 < argc)
+        {
+            replayPath = argv[++i];
+        }
+        else if (strcmp(arg, "--checkpoint-interval") == 0 && i + 1 < argc)
+        {
+            // Given in millions of instructions
+            checkpointInterval = strtoull(argv[++i], nullptr, 10) * 1000000ULL;
+            if (checkpointInterval == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--debug") == 0)
+        {
+            debug = true;
+        }
+        else if (strcmp(arg, "--gdb") == 0 && i + 1 < argc)
+        {
+            gdbPort = (uint16_t)strtoul(argv[++i], nullptr, 10);
+            if (gdbPort == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--metrics") == 0)
+        {
+            metrics = true;
+        }
+        else if (strcmp(arg, "--metrics-watch") == 0 && i + 1 < argc)
+        {
+            metricsWatch = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            if (metricsWatch == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--serve") == 0 && i + 1 < argc)
+        {
+            servePort = (uint16_t)strtoul(argv[++i], nullptr, 10);
+            if (servePort == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--cpus") == 0 && i + 1 < argc)
+        {
+            serveCpus = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(arg, "--slice") == 0 && i + 1 < argc)
+        {
+            serveSlice = strtoull(argv[++i], nullptr, 10);
+            if (serveSlice == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--workers") == 0 && i + 1 < argc)
+        {
+            serveWorkers = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(arg, "--terminal") == 0)
+        {
+            terminal = true;
+        }
+        else if (strcmp(arg, "--terminal-size") == 0 && i + 1 < argc)
+        {
+            terminal = true;
+            if (sscanf(argv[++i], "%ux%u", &terminalColumns, &terminalRows) != 2 || terminalColumns == 0 || terminalRows == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--terminal-fps") == 0 && i + 1 < argc)
+        {
+            terminal = true;
+            terminalFramesPerSecond = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            if (terminalFramesPerSecond == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--headless") == 0)
+        {
+            terminal = true;
+            headless = true;
+        }
+        else if (strcmp(arg, "--screenshot") == 0 && i + 1 < argc)
+        {
+            terminal = true;
+            screenshotPath = argv[++i];
+        }
+        else if (strcmp(arg, "--state-hash") == 0)
+        {
+            stateHash = true;
+        }
+        else if (strcmp(arg, "--heatmap") == 0 && i + 1 < argc)
+        {
+            accessProfile = true;
+            heatmapPath = argv[++i];
+        }
+        else if (strcmp(arg, "--heatmap-window") == 0 && i + 1 < argc)
+        {
+            accessProfile = true;
+            heatmapWindow = strtoull(argv[++i], nullptr, 10);
+            if (heatmapWindow == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--host-cache") == 0 && i + 1 < argc)
+        {
+            accessProfile = true;
+            hostCache = true;
+            if (sscanf(argv[++i], "%u,%u,%u", &hostCacheSize, &hostCacheWays, &hostCacheLine) != 3 ||
+                !CacheModel::IsValid(hostCacheSize, hostCacheWays, hostCacheLine))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--cycles") == 0)
+        {
+            cycles = true;
+        }
+        else if (strcmp(arg, "--cycle-costs") == 0 && i + 1 < argc)
+        {
+            cycles = true;
+            cycleCosts = argv[++i];
+        }
+        else if (strcmp(arg, "--mmu") == 0)
+        {
+            mmu = true;
+        }
+        else if (strcmp(arg, "--processes") == 0 && i + 1 < argc)
+        {
+            mmu = true;
+            mmuProcesses = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            if (mmuProcesses == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--quantum") == 0 && i + 1 < argc)
+        {
+            mmuQuantum = strtoull(argv[++i], nullptr, 10);
+            if (mmuQuantum == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--disk") == 0 && i + 1 < argc)
+        {
+            diskPath = argv[++i];
+        }
+        else if (strcmp(arg, "--latency") == 0 && i + 1 < argc)
+        {
+            latencyPath = argv[++i];
+        }
+        else if (strcmp(arg, "--assemble") == 0 && i + 1 < argc)
+        {
+            assembleOutput = argv[++i];
+        }
+        else if (strcmp(arg, "--generate") == 0 && i + 1 < argc)
+        {
+            generate = true;
+            if (!Workload::ParseKind(argv[++i], &generateKind))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--generate-size") == 0 && i + 1 < argc)
+        {
+            generateSize = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(arg, "--generate-iterations") == 0 && i + 1 < argc)
+        {
+            generateIterations = strtoull(argv[++i], nullptr, 10);
+            if (generateIterations == 0 || generateIterations > (1ULL << 31))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--generate-seed") == 0 && i + 1 < argc)
+        {
+            generateSeed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(arg, "--generate-mix") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%u,%u,%u", &generateAlu, &generateMemory, &generateBranch) != 3 ||
+                generateAlu + generateMemory + generateBranch == 0)
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(arg, "--seek") == 0 && i + 1 < argc)
+        {
+            seek = true;
+            seekInstruction = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strncmp(arg, "--", 2) == 0)
+        {
+            // Unknown option or option missing its value
+            return 0;
+        }
+        else
+        {
+            imagePaths.push_back(arg);
+        }
+    }
+
+    // Recording and replaying at once is not supported, and seeking needs a recording
+    if ((recordPath && replayPath) || (seek && !replayPath))
+    {
+        return 0;
+    }
+
+    // Watching another process or generating a workload needs no image
+    return metricsWatch || generate || !imagePaths.empty();
+}
+
+
+/**
+ * @brief Prints the command-line usage of the virtual machine.
+ */
+void Options::PrintUsage() const
+{
+    printf("lc3 [options] [image-file1] ...\n");
+    printf("  --timer-ipt N       instructions per virtual timer tick (default 10000)\n");
+    printf("  --timer-realtime    pace timer ticks to one millisecond of wall-clock time\n");
+    printf("  --translate FILE    translate the images into a C++ file instead of running them\n");
+    printf("  --pack FILE         pack the images, symbols and entry point into one extended object file\n");
+    printf("  --symbols FILE      read symbol names from an lc3as symbol table\n");
+    printf("  --decode            execute from a cache of pre-decoded instructions\n");
+    printf("  --cache-dir DIR     persist the decode cache in DIR, keyed by image hash (implies --decode)\n");
+    printf("  --tier              run hot regions as optimized IR (implies --decode)\n");
+    printf("  --tier-threshold N  branches to an address before its region is compiled (default 50, implies --tier)\n");
+    printf("  --perf              report host performance counters per LC-3 instruction on halt\n");
+    printf("  --fuzz N            fuzz keyboard input for N test cases (0 = until interrupted)\n");
+    printf("  --fuzz-budget N     instructions per test case before it counts as a hang (default 100000)\n");
+    printf("  --fuzz-max-len N    maximum generated input length in bytes (default 64)\n");
+    printf("  --fuzz-dir DIR      save inputs that crash or hang the program to DIR\n");
+    printf("  --record FILE       record keyboard input and checkpoints into FILE\n");
+    printf("  --replay FILE       replay a recording, then continue with live input\n");
+    printf("  --checkpoint-interval N  millions of instructions between checkpoints (default 10)\n");
+    printf("  --debug             open the debugger console before the first instruction\n");
+    printf("  --gdb PORT          wait for gdb on 127.0.0.1:PORT and let it control the program\n");
+    printf("  --seek N            with --replay, move to instruction N and open the debugger console\n");
+    printf("  --metrics           publish live counters in shared memory named after the process ID\n");
+    printf("  --metrics-watch PID print the live counters of the VM with process ID PID until it halts\n");
+    printf("  --serve PORT        keep the images loaded and run jobs sent to 127.0.0.1:PORT\n");
+    printf("  --workers N         job server worker threads, i.e. clients served at once (default four per CPU)\n");
+    printf("  --cpus N            jobs the server runs at the same time (default one per hardware thread)\n");
+    printf("  --slice N           instructions a job runs before the scheduler picks again (default 1000000)\n");
+    printf("  --terminal          draw output through an emulated screen, sending only changed cells\n");
+    printf("  --terminal-size CxR size of the emulated screen (default 80x24, implies --terminal)\n");
+    printf("  --terminal-fps N    highest frame rate drawn to the real terminal (default 30)\n");
+    printf("  --headless          keep the emulated screen in memory only (implies --terminal)\n");
+    printf("  --screenshot FILE   write the emulated screen as text to FILE on halt (implies --terminal)\n");
+    printf("  --state-hash        print a hash of memory and registers on halt, for comparing runs\n");
+    printf("  --heatmap FILE      count fetches, reads and writes per address, write them to FILE as CSV\n");
+    printf("  --heatmap-window N  instructions per working set window of the access summary (default 1000000)\n");
+    printf("  --host-cache S,W,L  simulate a host cache of S bytes, W ways and L-byte lines (e.g. 32768,8,64)\n");
+    printf("  --cycles            estimate LC-3 hardware cycles per routine and block, printed on halt\n");
+    printf("  --cycle-costs LIST  override cycle costs, e.g. mem=3,taken=2,ldi=8 (implies --cycles)\n");
+    printf("  --mmu               run every image as an isolated process with its own paged address space\n");
+    printf("  --processes N       run N copies of every image, sharing pages until written (implies --mmu)\n");
+    printf("  --quantum N         instructions a process runs before the next is switched in (default 100000)\n");
+    printf("  --disk FILE         attach FILE, in 512-byte blocks, as the block device at xFE10-xFE1A\n");
+    printf("  --latency FILE      write keystroke to output latency histograms to FILE on exit and on SIGUSR1\n");
+    printf("  --assemble FILE     assemble the one source file given (or --generate's kernel) into image FILE\n");
+    printf("  --generate KIND     print a benchmark kernel: mix, branchy, straight, chase, io, smc, poll or patch\n");
+    printf("  --generate-size N   loop body size, or node count for chase (default depends on the kernel)\n");
+    printf("  --generate-iterations N  loop iterations of the kernel (default 10000)\n");
+    printf("  --generate-seed N   seed of the kernel's random choices (default 1)\n");
+    printf("  --generate-mix A,M,B  weights of ALU, memory and branch instructions for mix (default 50,30,20)\n");
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+
+#include <cstdint>
+#include <vector>
+
+
+class Options
+{
+public:
+    // Image files to load, in the order they were given on the command line.
+    std::vector<const char*> imagePaths;
+
+    // Number of executed instructions that make up one tick of the virtual timer.
+    uint32_t timerInstructionsPerTick = 10000;
+
+    // When set, one timer tick is additionally paced to one millisecond of wall-clock time.
+    bool timerRealTime = false;
+
+    // When set, the images are translated into this C++ file instead of being run.
+    const char* translateOutput = nullptr;
+
+    // When set, the images are packed into this extended object file instead of being run.
+    const char* packOutput = nullptr;
+
+    // Symbol table in lc3as format naming addresses of the loaded program.
+    const char* symbolsPath = nullptr;
+
+    // Execute from pre-decoded instructions instead of decoding every fetch.
+    bool decode = false;
+
+    // Directory holding persisted decode caches, keyed by image hash. Implies decode.
+    const char* cacheDirectory = nullptr;
+
+    // Compile code reached by this many control transfers into optimized IR regions. Implies decode.
+    bool tier = false;
+    uint32_t tierThreshold = 50;
+
+    // Measure host performance counters around the run and report them on halt.
+    bool perf = false;
+
+    // Fuzz the program's keyboard input instead of running it interactively.
+    bool fuzz = false;
+
+    // Number of test cases to execute when fuzzing, 0 to run until interrupted.
+    uint64_t fuzzExecutions = 0;
+
+    // Instructions a test case may execute before it is reported as a hang.
+    uint64_t fuzzBudget = 100000;
+
+    // Maximum length in bytes of a generated input.
+    uint32_t fuzzMaxLength = 64;
+
+    // Directory receiving inputs that crash or hang the program, none if not set.
+    const char* fuzzDirectory = nullptr;
+
+    // Record all keyboard input and periodic checkpoints into this file.
+    const char* recordPath = nullptr;
+
+    // Replay a recording made with recordPath, continuing with live input once it is used up.
+    const char* replayPath = nullptr;
+
+    // Number of instructions between two checkpoints of a recording.
+    uint64_t checkpointInterval = 10000000;
+
+    // Open the debugger console before the first instruction.
+    bool debug = false;
+
+    // Serve the GDB remote serial protocol on this loopback TCP port, 0 for none.
+    uint16_t gdbPort = 0;
+
+    // When replaying, move to this instruction count first and open the debugger console.
+    bool seek = false;
+    uint64_t seekInstruction = 0;
+
+    // Publish live counters in a shared-memory segment named after the process ID.
+    bool metrics = false;
+
+    // Print the live counters published by this process ID instead of running an image, 0 for none.
+    uint32_t metricsWatch = 0;
+
+    // Keep the images loaded and run jobs for clients on this loopback TCP port instead, 0 for none.
+    uint16_t servePort = 0;
+
+    // Number of worker threads of the job server, 0 for four per CPU.
+    uint32_t serveWorkers = 0;
+
+    // Jobs the job server runs at the same time, 0 for one per hardware thread, and the instructions
+    // each runs before the scheduler picks again.
+    uint32_t serveCpus = 0;
+    uint64_t serveSlice = 1000000;
+
+    // Interpret output into an emulated screen and draw only the cells that changed.
+    bool terminal = false;
+    uint32_t terminalColumns = 80;
+    uint32_t terminalRows = 24;
+
+    // Highest number of frames per second drawn to the real terminal.
+    uint32_t terminalFramesPerSecond = 30;
+
+    // Keep the emulated screen in memory only. Implies terminal.
+    bool headless = false;
+
+    // Write the characters of the emulated screen to this file on halt. Implies terminal.
+    const char* screenshotPath = nullptr;
+
+    // Keep a hash of memory and registers up to date and print it on halt.
+    bool stateHash = false;
+
+    // Count fetches, reads and writes per address and print a summary on halt.
+    bool accessProfile = false;
+
+    // Write the per-address counts to this CSV file on halt. Implies accessProfile.
+    const char* heatmapPath = nullptr;
+
+    // Instructions per window of the working set series.
+    uint64_t heatmapWindow = 1000000;
+
+    // Feed every access through a set-associative cache of this geometry, in bytes. Implies accessProfile.
+    bool hostCache = false;
+    uint32_t hostCacheSize = 32768;
+    uint32_t hostCacheWays = 8;
+    uint32_t hostCacheLine = 64;
+
+    // Estimate LC-3 hardware cycles per routine and block, with costs overridden by cycleCosts.
+    bool cycles = false;
+    const char* cycleCosts = nullptr;
+
+    // Run every image as its own process of a paged MMU, mmuProcesses copies of each, switching
+    // processes after mmuQuantum instructions and at every trap.
+    bool mmu = false;
+    uint32_t mmuProcesses = 1;
+    uint64_t mmuQuantum = 100000;
+
+    // Map this existing file as the block device behind the MR_BK* registers, none if not set.
+    const char* diskPath = nullptr;
+
+    // Write histograms of the time from each key read to the output it caused to this file.
+    const char* latencyPath = nullptr;
+
+    // Assemble the one image path given, or the generated workload, into this image file instead of running.
+    const char* assembleOutput = nullptr;
+
+    // Generate a WorkloadKinds benchmark kernel, printed as assembly unless assembleOutput is set.
+    bool generate = false;
+    uint32_t generateKind = 0;
+
+    // Loop body or data size of the kernel, 0 for its default, and the number of loop iterations.
+    uint32_t generateSize = 0;
+    uint64_t generateIterations = 10000;
+    uint64_t generateSeed = 1;
+
+    // Relative weights of ALU, memory and branch instructions in the mix kernel.
+    uint32_t generateAlu = 50;
+    uint32_t generateMemory = 30;
+    uint32_t generateBranch = 20;
+
+public:
+    int Parse(int argc, const char* argv[]);
+    void PrintUsage() const;
+};
+#endif
\ No newline at end of file
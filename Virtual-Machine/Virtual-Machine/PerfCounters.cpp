@@ -0,0 +1,237 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include "PerfCounters.h"
+
+#include <cstring>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+// windows only
+#include <Windows.h>
+#endif
+
+
+static const char* counterNames[PC_COUNT] =
+{
+    "cycles",
+    "instructions",
+    "branch-misses",
+    "L1d-misses",
+    "L1i-misses",
+    "iTLB-misses"
+};
+
+
+#if defined(__linux__)
+// perf_event_open type and config for every counter, in PerfCounterIds order.
+static const uint32_t counterTypes[PC_COUNT] =
+{
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HW_CACHE
+};
+
+static const uint64_t counterConfigs[PC_COUNT] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_L1I | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_ITLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+};
+#endif
+
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ */
+static uint64_t MonotonicNanoseconds()
+{
+#if defined(__linux__)
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#else
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#endif
+}
+
+
+/**
+ * @brief Constructs a PerfCounters object. Counters are only opened when measuring starts.
+ */
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        handles[i] = -1;
+        values[i] = 0;
+        available[i] = false;
+    }
+}
+
+
+/**
+ * @brief Releases any open counters.
+ */
+PerfCounters::~PerfCounters()
+{
+    Close();
+}
+
+
+/**
+ * @brief Opens every counter the host permits.
+ *
+ * Each counter is opened on its own rather than as a group, so one unsupported or forbidden
+ * counter (for example under a restrictive perf_event_paranoid setting) does not disable the others.
+ */
+void PerfCounters::Open()
+{
+#if defined(__linux__)
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counterTypes[i];
+        attr.config = counterConfigs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        handles[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+
+/**
+ * @brief Closes every open counter.
+ */
+void PerfCounters::Close()
+{
+#if defined(__linux__)
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        if (handles[i] >= 0)
+        {
+            close(handles[i]);
+            handles[i] = -1;
+        }
+    }
+#endif
+}
+
+
+/**
+ * @brief Resets and starts all available counters.
+ */
+void PerfCounters::Start()
+{
+    Open();
+
+#if defined(__linux__)
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        if (handles[i] >= 0)
+        {
+            ioctl(handles[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(handles[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    ULONG64 cycles = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &cycles);
+    startCycles = cycles;
+#endif
+
+    startNanoseconds = MonotonicNanoseconds();
+}
+
+
+/**
+ * @brief Stops all counters and records their values.
+ *
+ * Counters the kernel had to multiplex are scaled up to the full measuring interval.
+ */
+void PerfCounters::Stop()
+{
+    elapsedNanoseconds = MonotonicNanoseconds() - startNanoseconds;
+
+#if defined(__linux__)
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        if (handles[i] < 0)
+        {
+            continue;
+        }
+
+        ioctl(handles[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (read(handles[i], data, sizeof(data)) == (ssize_t)sizeof(data) && data[2] > 0)
+        {
+            values[i] = (data[2] < data[1]) ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+            available[i] = true;
+        }
+    }
+    Close();
+#else
+    // Only the thread's cycle time is accessible without a kernel driver
+    ULONG64 cycles = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &cycles);
+    values[PC_CYCLES] = cycles - startCycles;
+    available[PC_CYCLES] = true;
+#endif
+}
+
+
+/**
+ * @brief Prints the measured counters, normalized per emulated LC-3 instruction.
+ *
+ * @param out The output stream.
+ * @param emulatedInstructions Number of LC-3 instructions retired while measuring.
+ */
+void PerfCounters::Report(FILE* out, uint64_t emulatedInstructions) const
+{
+    double seconds = elapsedNanoseconds / 1e9;
+    double perInstruction = emulatedInstructions ? 1.0 / emulatedInstructions : 0.0;
+
+    fprintf(out, "perf: %llu LC-3 instructions in %.3f s (%.2f MIPS)\n",
+        (unsigned long long)emulatedInstructions, seconds, seconds > 0 ? emulatedInstructions / seconds / 1e6 : 0.0);
+
+    for (int i = 0; i < PC_COUNT; ++i)
+    {
+        if (available[i])
+        {
+            fprintf(out, "perf: %-14s %16llu  %10.3f per LC-3 instruction\n",
+                counterNames[i], (unsigned long long)values[i], values[i] * perInstruction);
+        }
+        else
+        {
+            fprintf(out, "perf: %-14s %16s\n", counterNames[i], "not available");
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+
+#include <cstdint>
+#include <cstdio>
+
+
+enum PerfCounterIds : uint8_t
+{
+    PC_CYCLES = 0,
+    PC_INSTRUCTIONS,
+    PC_BRANCH_MISSES,
+    PC_L1D_MISSES,
+    PC_L1I_MISSES,
+    PC_ITLB_MISSES,
+    PC_COUNT
+};
+
+
+class PerfCounters
+{
+private:
+    // Per-counter handles (perf_event_open file descriptors on Linux), -1 if not permitted or unsupported.
+    int handles[PC_COUNT];
+
+    // Counter values measured between Start and Stop.
+    uint64_t values[PC_COUNT];
+    bool available[PC_COUNT];
+
+    // Wall-clock time between Start and Stop, in nanoseconds.
+    uint64_t startNanoseconds = 0;
+    uint64_t elapsedNanoseconds = 0;
+
+    // Thread cycle time at Start, used where hardware counters are not accessible.
+    uint64_t startCycles = 0;
+
+    void Open();
+    void Close();
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    void Start();
+    void Stop();
+    void Report(FILE* out, uint64_t emulatedInstructions) const;
+};
+#endif
\ No newline at end of file
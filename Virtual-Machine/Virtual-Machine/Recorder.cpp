@@ -0,0 +1,512 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <algorithm>
+#include <cstring>
+
+
+#include "Recorder.h"
+#include "MemoryIO.h"
+#include "OS.h"
+#include "VirtualMachine.h"
+
+
+// Bump whenever the layout of the recording changes.
+static const uint32_t RECORDING_VERSION = 1;
+
+// Every this many checkpoints one holds every page again, so a seek reads at most this many checkpoints.
+static const uint64_t FULL_CHECKPOINT_INTERVAL = 16;
+
+// Record tags preceding every entry of a recording.
+static const int RECORD_EVENT = 'E';
+static const int RECORD_CHECKPOINT = 'C';
+static const int RECORD_END = 'X';
+
+
+// Recording still to be finished if the process exits early, e.g. from the Ctrl+C handler.
+static Recorder* exitRecorder = nullptr;
+
+
+/**
+ * @brief Finishes the pending recording when the process exits before the program halts.
+ */
+static void StopRecordingAtExit()
+{
+    if (exitRecorder)
+    {
+        exitRecorder->StopRecording(true);
+    }
+}
+
+
+/**
+ * @brief Constructs a Recorder over an already wired virtual machine.
+ *
+ * @param cpu Pointer to the CPU object.
+ * @param os Pointer to the OS object, muted while seeking.
+ * @param timer Pointer to the Timer object.
+ * @param memoryIO Pointer to the MemoryIO object reporting written pages.
+ * @param virtualMachine Pointer to the VirtualMachine object used to replay forward.
+ */
+Recorder::Recorder(CPU* cpu, OS* os, Timer* timer, MemoryIO* memoryIO, VirtualMachine* virtualMachine)
+{
+    cpuPtr = cpu;
+    osPtr = os;
+    timerPtr = timer;
+    memoryIOPtr = memoryIO;
+    virtualMachinePtr = virtualMachine;
+
+    memset(dirtyPages, 0, sizeof(dirtyPages));
+}
+
+
+/**
+ * @brief Closes the recording file.
+ */
+Recorder::~Recorder()
+{
+    if (exitRecorder == this)
+    {
+        exitRecorder = nullptr;
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+
+/**
+ * @brief Creates a recording file and starts tracking inputs and written pages.
+ *
+ * @param path The recording file to create.
+ * @param interval Number of instructions between two checkpoints.
+ * @return Returns 1 on success, 0 if the file cannot be created.
+ */
+int Recorder::StartRecording(const char* path, uint64_t interval)
+{
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    RecordingHeader header = {};
+    memcpy(header.magic, "LC3R", 4);
+    header.version = RECORDING_VERSION;
+    header.checkpointInterval = interval;
+    fwrite(&header, sizeof(header), 1, file);
+
+    checkpointInterval = interval;
+    nextCheckpoint = 0;
+    fullCheckpoint = true;
+    checkpointCount = 0;
+    recording = true;
+    memoryIOPtr->SetDirtyPages(dirtyPages);
+
+    exitRecorder = this;
+    atexit(StopRecordingAtExit);
+    return 1;
+}
+
+
+/**
+ * @brief Appends one event to the recording file.
+ *
+ * @param event The event to write.
+ */
+void Recorder::WriteEvent(const RecordedEvent& event)
+{
+    fputc(RECORD_EVENT, file);
+    fwrite(&event, sizeof(event), 1, file);
+    ++eventCount;
+}
+
+
+/**
+ * @brief Writes a checkpoint of the current machine state.
+ *
+ * The first checkpoint holds every page, so a recording replays without the original images;
+ * later ones hold only the pages written since the previous checkpoint, except that every
+ * FULL_CHECKPOINT_INTERVAL-th one holds every page again.
+ */
+void Recorder::Checkpoint()
+{
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.instruction = cpuPtr->instructionCount;
+    header.eventIndex = eventCount;
+    header.eventUsed = hasPending ? pending.count : 0;
+    memcpy(header.registers, cpuPtr->registers, sizeof(header.registers));
+    header.running = cpuPtr->running;
+    header.timer = timerPtr->SaveState();
+
+    // Device registers are updated on reads without going through MemoryIO::Write
+    dirtyPages[MemoryMappedRegisters::MR_DEVICES >> PAGE_SHIFT] = 1;
+
+    for (int page = 0; page < PAGE_COUNT; ++page)
+    {
+        header.pageCount += (fullCheckpoint || dirtyPages[page]) ? 1 : 0;
+    }
+
+    fputc(RECORD_CHECKPOINT, file);
+    fwrite(&header, sizeof(header), 1, file);
+
+    CheckpointPage page;
+    for (int i = 0; i < PAGE_COUNT; ++i)
+    {
+        if (fullCheckpoint || dirtyPages[i])
+        {
+            page.page = (uint16_t)i;
+            memcpy(page.words, cpuPtr->memory + (i << PAGE_SHIFT), sizeof(page.words));
+            fwrite(&page, sizeof(page), 1, file);
+            dirtyPages[i] = 0;
+        }
+    }
+
+    fflush(file);
+    fullCheckpoint = ++checkpointCount % FULL_CHECKPOINT_INTERVAL == 0;
+    nextCheckpoint = cpuPtr->instructionCount + checkpointInterval;
+}
+
+
+/**
+ * @brief Finishes the recording and closes the file.
+ *
+ * @param interrupted True if the program did not halt, in which case the instruction in flight is not
+ * part of the recording, as it may be waiting for input that was never recorded.
+ */
+void Recorder::StopRecording(bool interrupted)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    if (hasPending)
+    {
+        WriteEvent(pending);
+        hasPending = false;
+    }
+
+    uint64_t end = cpuPtr->instructionCount;
+    if (interrupted && end > 0)
+    {
+        --end;
+    }
+    fputc(RECORD_END, file);
+    fwrite(&end, sizeof(end), 1, file);
+
+    fclose(file);
+    file = nullptr;
+    recording = false;
+    nextCheckpoint = UINT64_MAX;
+    memoryIOPtr->SetDirtyPages(nullptr);
+}
+
+
+/**
+ * @brief Returns the instruction count at which the next checkpoint is due, UINT64_MAX if none is.
+ */
+uint64_t Recorder::NextCheckpoint() const
+{
+    return nextCheckpoint;
+}
+
+
+/**
+ * @brief Opens a recording for replay and indexes its events and checkpoints.
+ *
+ * A recording cut short, for example by a crash, is usable up to its last complete entry.
+ *
+ * @param path The recording file.
+ * @return Returns 1 if the recording holds at least one checkpoint, 0 otherwise.
+ */
+int Recorder::LoadRecording(const char* path)
+{
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    RecordingHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, "LC3R", 4) != 0
+        || header.version != RECORDING_VERSION)
+    {
+        return 0;
+    }
+
+    bool ended = false;
+    for (int tag = fgetc(file); tag != EOF && !ended; tag = fgetc(file))
+    {
+        if (tag == RECORD_EVENT)
+        {
+            RecordedEvent event;
+            if (fread(&event, sizeof(event), 1, file) != 1)
+            {
+                break;
+            }
+            events.push_back(event);
+            endInstruction = std::max(endInstruction, event.instruction);
+        }
+        else if (tag == RECORD_CHECKPOINT)
+        {
+            CheckpointIndex index = { 0, ftell(file) };
+            CheckpointHeader checkpoint;
+            if (fread(&checkpoint, sizeof(checkpoint), 1, file) != 1)
+            {
+                break;
+            }
+
+            long pagesEnd = ftell(file) + (long)(checkpoint.pageCount * sizeof(CheckpointPage));
+            if (pagesEnd > size)
+            {
+                break;
+            }
+            fseek(file, pagesEnd, SEEK_SET);
+
+            index.instruction = checkpoint.instruction;
+            checkpoints.push_back(index);
+            endInstruction = std::max(endInstruction, checkpoint.instruction);
+        }
+        else if (tag == RECORD_END)
+        {
+            ended = fread(&endInstruction, sizeof(endInstruction), 1, file) == 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (checkpoints.empty())
+    {
+        return 0;
+    }
+
+    replaying = true;
+    return 1;
+}
+
+
+/**
+ * @brief Restores the machine to a checkpoint of the loaded recording.
+ *
+ * Walks back from the checkpoint towards the first one, taking every page from the most recent
+ * checkpoint that holds it, and stops as soon as all pages are known, at the latest at the last
+ * checkpoint that holds every page.
+ *
+ * @param index Index of the checkpoint.
+ */
+void Recorder::RestoreCheckpoint(size_t index)
+{
+    uint8_t restored[PAGE_COUNT] = {};
+    uint32_t remaining = PAGE_COUNT;
+    CheckpointHeader target;
+    memset(&target, 0, sizeof(target));
+
+    for (size_t i = index + 1; i-- > 0 && remaining > 0; )
+    {
+        CheckpointHeader header;
+        fseek(file, checkpoints[i].offset, SEEK_SET);
+        if (fread(&header, sizeof(header), 1, file) != 1)
+        {
+            continue;
+        }
+        if (i == index)
+        {
+            target = header;
+        }
+
+        CheckpointPage page;
+        for (uint32_t p = 0; p < header.pageCount && fread(&page, sizeof(page), 1, file) == 1; ++p)
+        {
+            if (!restored[page.page])
+            {
+                memcpy(cpuPtr->memory + (page.page << PAGE_SHIFT), page.words, sizeof(page.words));
+                restored[page.page] = 1;
+                --remaining;
+            }
+        }
+    }
+
+    memoryIOPtr->Rehash();
+
+    memcpy(cpuPtr->registers, target.registers, sizeof(target.registers));
+    cpuPtr->running = target.running;
+    cpuPtr->instructionCount = target.instruction;
+    timerPtr->RestoreState(target.timer);
+
+    eventIndex = (size_t)target.eventIndex;
+    eventUsed = target.eventUsed;
+    replaying = true;
+}
+
+
+/**
+ * @brief Supplies the next recorded input while replaying.
+ *
+ * Replay ends, and live input takes over, when the recording is used up or the program asks
+ * for a different kind of input than was recorded.
+ *
+ * @param kind The RecordedEventKinds value of the requested input.
+ * @param value Receives the recorded value.
+ * @return True if a recorded value was supplied.
+ */
+bool Recorder::Replay(uint8_t kind, int* value)
+{
+    if (!replaying)
+    {
+        return false;
+    }
+
+    while (eventIndex < events.size() && eventUsed >= events[eventIndex].count)
+    {
+        ++eventIndex;
+        eventUsed = 0;
+    }
+
+    if (eventIndex >= events.size())
+    {
+        replaying = false;
+        return false;
+    }
+
+    const RecordedEvent& event = events[eventIndex];
+    if (event.kind != kind)
+    {
+        fprintf(stderr, "replay: diverged at instruction %llu, continuing with live input\n",
+            (unsigned long long)cpuPtr->instructionCount);
+        replaying = false;
+        return false;
+    }
+
+    *value = event.value;
+    ++eventUsed;
+    return true;
+}
+
+
+/**
+ * @brief Records an input while recording; identical consecutive inputs of the same kind share one event.
+ *
+ * Repeated polls are the common case, but a program reading at end of input gets the same
+ * character on every read, which would otherwise write an event per read.
+ *
+ * @param kind The RecordedEventKinds value of the input.
+ * @param value The value returned to the program.
+ */
+void Recorder::Record(uint8_t kind, int value)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    if (hasPending && pending.kind == kind && pending.value == (int16_t)value && pending.count < UINT32_MAX)
+    {
+        ++pending.count;
+        return;
+    }
+
+    if (hasPending)
+    {
+        WriteEvent(pending);
+    }
+
+    pending.instruction = cpuPtr->instructionCount;
+    pending.count = 1;
+    pending.kind = kind;
+    pending.reserved = 0;
+    pending.value = (int16_t)value;
+    hasPending = true;
+}
+
+
+/**
+ * @brief Tells whether a recording is loaded for replay and seeking.
+ */
+bool Recorder::HasRecording() const
+{
+    return !checkpoints.empty();
+}
+
+
+/**
+ * @brief Returns the last instruction count covered by the loaded recording.
+ */
+uint64_t Recorder::EndInstruction() const
+{
+    return endInstruction;
+}
+
+
+/**
+ * @brief Restores the machine to the start of the loaded recording.
+ */
+void Recorder::Rewind()
+{
+    RestoreCheckpoint(0);
+}
+
+
+/**
+ * @brief Moves the machine to the state it had after the given number of instructions.
+ *
+ * Restores the latest checkpoint at or before the target and replays forward with output muted.
+ * When the target lies ahead with no checkpoint in between, replay continues from the current state.
+ *
+ * @param instruction The target instruction count, clamped to the end of the recording.
+ * @return The instruction count reached.
+ */
+uint64_t Recorder::Seek(uint64_t instruction)
+{
+    instruction = std::min(instruction, endInstruction);
+
+    // Latest checkpoint at or before the target
+    size_t index = std::upper_bound(checkpoints.begin(), checkpoints.end(), instruction,
+        [](uint64_t value, const CheckpointIndex& checkpoint) { return value < checkpoint.instruction; })
+        - checkpoints.begin();
+    index = index > 0 ? index - 1 : 0;
+
+    uint64_t current = cpuPtr->instructionCount;
+    if (!replaying || current > instruction || checkpoints[index].instruction > current)
+    {
+        RestoreCheckpoint(index);
+    }
+
+    osPtr->SetOutputMuted(true);
+    virtualMachinePtr->RunCore(instruction);
+    osPtr->SetOutputMuted(false);
+
+    return cpuPtr->instructionCount;
+}
+
+
+/**
+ * @brief Moves the machine back by the given number of instructions.
+ *
+ * @param count Number of instructions to undo.
+ * @return The instruction count reached.
+ */
+uint64_t Recorder::ReverseStep(uint64_t count)
+{
+    uint64_t current = cpuPtr->instructionCount;
+    return Seek(current > count ? current - count : 0);
+}
\ No newline at end of file
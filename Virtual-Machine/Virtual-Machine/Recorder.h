@@ -0,0 +1,138 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "CPU.h"
+#include "Timer.h"
+
+
+class MemoryIO;
+class OS;
+class VirtualMachine;
+
+
+enum RecordedEventKinds : uint8_t
+{
+    RE_KEY_POLL = 0, // result of a keyboard status check
+    RE_CHAR          // character returned by a keyboard read
+};
+
+
+// A nondeterministic input, or a run of identical inputs, with the instruction count the first happened at.
+struct RecordedEvent
+{
+    uint64_t instruction;
+    uint32_t count;
+    uint8_t kind;
+    uint8_t reserved;
+    int16_t value;
+};
+
+
+// On-disk header of a recording.
+struct RecordingHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t checkpointInterval;
+};
+
+
+// Machine state at a checkpoint, followed on disk by the pages written since the previous checkpoint.
+struct CheckpointHeader
+{
+    uint64_t instruction;
+    uint64_t eventIndex; // event the input cursor points at
+    uint32_t eventUsed;  // polls of that event already consumed
+    uint32_t pageCount;
+    uint16_t registers[REGISTER_COUNT];
+    int32_t running;
+    TimerState timer;
+};
+
+
+// One memory page stored in a checkpoint.
+struct CheckpointPage
+{
+    uint16_t page;
+    uint16_t words[1 << PAGE_SHIFT];
+};
+
+
+// Location of a checkpoint inside a loaded recording.
+struct CheckpointIndex
+{
+    uint64_t instruction;
+    long offset;
+};
+
+
+class Recorder
+{
+private:
+    CPU* cpuPtr;
+    OS* osPtr;
+    Timer* timerPtr;
+    MemoryIO* memoryIOPtr;
+    VirtualMachine* virtualMachinePtr;
+
+    FILE* file = nullptr;
+    bool recording = false;
+    bool replaying = false;
+
+    // Recording: instruction count at which the next checkpoint is due, and the pages written since the last one.
+    uint64_t checkpointInterval = 0;
+    uint64_t nextCheckpoint = UINT64_MAX;
+    uint8_t dirtyPages[PAGE_COUNT];
+    bool fullCheckpoint = true;
+    uint64_t checkpointCount = 0;
+
+    // Recording: the event still being extended by identical inputs, and the number of events written.
+    RecordedEvent pending = {};
+    bool hasPending = false;
+    uint64_t eventCount = 0;
+
+    // Replay: the recorded events, the input cursor, the checkpoints and the last recorded instruction.
+    std::vector<RecordedEvent> events;
+    size_t eventIndex = 0;
+    uint32_t eventUsed = 0;
+    std::vector<CheckpointIndex> checkpoints;
+    uint64_t endInstruction = 0;
+
+    void WriteEvent(const RecordedEvent& event);
+    void RestoreCheckpoint(size_t index);
+
+public:
+    Recorder(CPU* cpu, OS* os, Timer* timer, MemoryIO* memoryIO, VirtualMachine* virtualMachine);
+    ~Recorder();
+
+    int StartRecording(const char* path, uint64_t interval);
+    void Checkpoint();
+    void StopRecording(bool interrupted);
+    uint64_t NextCheckpoint() const;
+
+    int LoadRecording(const char* path);
+    bool Replay(uint8_t kind, int* value);
+    void Record(uint8_t kind, int value);
+
+    bool HasRecording() const;
+    uint64_t EndInstruction() const;
+    void Rewind();
+    uint64_t Seek(uint64_t instruction);
+    uint64_t ReverseStep(uint64_t count);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,363 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "Scheduler.h"
+#include "Metrics.h"
+
+
+static const char* stateNames[] = { "idle", "ready", "running", "blocked" };
+
+
+/**
+ * @brief Constructs a scheduler without machines.
+ *
+ * @param cpus Number of jobs that may run a slice at the same time.
+ * @param sliceInstructions Instructions a job runs before it gives its CPU back.
+ */
+Scheduler::Scheduler(uint32_t cpus, uint64_t sliceInstructions)
+{
+    this->cpus = cpus;
+    this->sliceInstructions = sliceInstructions;
+}
+
+
+/**
+ * @brief Adds idle machines, numbered after the existing ones. Must be called before jobs begin.
+ */
+void Scheduler::AddMachines(uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    SchedulerMachine idle = {};
+    idle.state = SS_IDLE;
+    machines.resize(machines.size() + count, idle);
+}
+
+
+/**
+ * @brief Returns a tenant, created with weight 1 and no cap on first use. The mutex must be held.
+ */
+SchedulerTenant& Scheduler::Tenant(const std::string& name)
+{
+    auto found = tenants.find(name);
+    if (found != tenants.end())
+    {
+        return found->second;
+    }
+
+    SchedulerTenant tenant = {};
+    tenant.weight = 1;
+    return tenants.emplace(name, tenant).first->second;
+}
+
+
+/**
+ * @brief Sets the share and the speed cap of a tenant, creating it if needed.
+ *
+ * @param name The tenant.
+ * @param weight Share of the CPUs relative to the other tenants, from 1 to SCHEDULER_MAX_WEIGHT.
+ * @param maxMips Most millions of instructions per second its jobs may execute together, 0 for no cap.
+ * @return 1 on success, 0 if the weight is out of range.
+ */
+int Scheduler::SetTenant(const std::string& name, uint32_t weight, uint32_t maxMips)
+{
+    if (weight == 0 || weight > SCHEDULER_MAX_WEIGHT)
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    SchedulerTenant& tenant = Tenant(name);
+    tenant.weight = weight;
+    tenant.maxMips = maxMips;
+    return 1;
+}
+
+
+/**
+ * @brief Starts a job on a machine, which then holds no CPU until it calls Acquire.
+ *
+ * A tenant that was idle starts from the lowest pass among the others, so it neither catches up on
+ * the time it did not use nor waits for the others to catch up with it.
+ *
+ * @param machine The machine.
+ * @param tenant The tenant the job belongs to.
+ * @param deadline Metrics::Now time the job should be done by, 0 for none.
+ */
+void Scheduler::Begin(uint32_t machine, const std::string& tenant, uint64_t deadline)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint64_t lowest = UINT64_MAX;
+    for (const SchedulerMachine& other : machines)
+    {
+        if (other.state != SS_IDLE)
+        {
+            lowest = std::min(lowest, tenants[other.tenant].pass);
+        }
+    }
+
+    SchedulerTenant& owner = Tenant(tenant);
+    bool active = false;
+    for (const SchedulerMachine& other : machines)
+    {
+        active = active || (other.state != SS_IDLE && other.tenant == tenant);
+    }
+    if (!active && lowest != UINT64_MAX && owner.pass < lowest)
+    {
+        owner.pass = lowest;
+    }
+    ++owner.jobs;
+
+    SchedulerMachine& current = machines[machine];
+    current.state = SS_BLOCKED;
+    current.tenant = tenant;
+    current.deadline = deadline;
+    ++current.jobs;
+}
+
+
+/**
+ * @brief Returns the ready machine that runs next, or -1. The mutex must be held.
+ *
+ * @param now The current Metrics::Now time.
+ * @param wakeAt Lowered to the time a capped tenant's instructions are due, when it is waiting for that.
+ */
+int32_t Scheduler::Pick(uint64_t now, uint64_t* wakeAt)
+{
+    int32_t best = -1;
+    for (uint32_t i = 0; i < machines.size(); ++i)
+    {
+        const SchedulerMachine& machine = machines[i];
+        if (machine.state != SS_READY)
+        {
+            continue;
+        }
+
+        const SchedulerTenant& tenant = tenants[machine.tenant];
+        if (tenant.maxMips && tenant.pacedUntil > now)
+        {
+            *wakeAt = std::min(*wakeAt, tenant.pacedUntil);
+            continue;
+        }
+
+        if (best < 0)
+        {
+            best = i;
+            continue;
+        }
+
+        // Deadlines first, earliest first; then the lowest pass; then first come first served
+        const SchedulerMachine& other = machines[best];
+        uint64_t deadline = machine.deadline ? machine.deadline : UINT64_MAX;
+        uint64_t otherDeadline = other.deadline ? other.deadline : UINT64_MAX;
+        uint64_t pass = tenant.pass;
+        uint64_t otherPass = tenants[other.tenant].pass;
+        if (deadline != otherDeadline ? deadline < otherDeadline
+            : pass != otherPass ? pass < otherPass : machine.waitingSince < other.waitingSince)
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * @brief Queues the machine's job and waits until it is picked and a CPU is free. The mutex must be held.
+ *
+ * @param lock The held mutex, released while waiting.
+ * @param machine The machine.
+ * @return Instructions the job may execute before it must give the CPU back.
+ */
+uint64_t Scheduler::Wait(std::unique_lock<std::mutex>& lock, uint32_t machine)
+{
+    SchedulerMachine& current = machines[machine];
+    current.state = SS_READY;
+    current.waitingSince = ++arrivals;
+    uint64_t waitStart = Metrics::Now();
+
+    for (;;)
+    {
+        uint64_t now = Metrics::Now();
+        uint64_t wakeAt = UINT64_MAX;
+        if (runningCount < cpus)
+        {
+            int32_t next = Pick(now, &wakeAt);
+            if (next == (int32_t)machine)
+            {
+                break;
+            }
+            if (next >= 0)
+            {
+                // Another job's turn; it may be asleep after an earlier pick went elsewhere
+                released.notify_all();
+            }
+        }
+
+        if (wakeAt != UINT64_MAX)
+        {
+            released.wait_for(lock, std::chrono::nanoseconds(wakeAt - now));
+        }
+        else
+        {
+            released.wait(lock);
+        }
+    }
+
+    ++runningCount;
+    current.state = SS_RUNNING;
+    current.waitNanoseconds += Metrics::Now() - waitStart;
+    return sliceInstructions;
+}
+
+
+/**
+ * @brief Gives the machine's CPU back and charges the slice to it and its tenant. The mutex must be held.
+ */
+void Scheduler::Charge(uint32_t machine, uint64_t instructions, uint64_t nanoseconds)
+{
+    SchedulerMachine& current = machines[machine];
+    current.state = SS_BLOCKED;
+    ++current.slices;
+    current.instructions += instructions;
+    current.cpuNanoseconds += nanoseconds;
+
+    SchedulerTenant& tenant = tenants[current.tenant];
+    tenant.pass += instructions * SCHEDULER_STRIDE / tenant.weight;
+    tenant.instructions += instructions;
+    tenant.cpuNanoseconds += nanoseconds;
+    if (tenant.maxMips)
+    {
+        // The slice started nanoseconds ago; its instructions are due that long after the cap allows them
+        uint64_t now = Metrics::Now();
+        uint64_t start = std::max(tenant.pacedUntil, now - nanoseconds);
+        tenant.pacedUntil = start + instructions * 1000 / tenant.maxMips;
+    }
+
+    --runningCount;
+}
+
+
+/**
+ * @brief Waits until the machine's job may run, and takes a CPU for it.
+ *
+ * @param machine The machine.
+ * @return Instructions the job may execute before it must call Yield or Release.
+ */
+uint64_t Scheduler::Acquire(uint32_t machine)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return Wait(lock, machine);
+}
+
+
+/**
+ * @brief Ends the machine's slice and queues its job again in the same step, so the pick that
+ * follows weighs it against the other waiting jobs.
+ *
+ * @param machine The machine.
+ * @param instructions Instructions the job executed during the slice.
+ * @param nanoseconds Time the slice took.
+ * @return Instructions the job may execute in its next slice.
+ */
+uint64_t Scheduler::Yield(uint32_t machine, uint64_t instructions, uint64_t nanoseconds)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    Charge(machine, instructions, nanoseconds);
+    return Wait(lock, machine);
+}
+
+
+/**
+ * @brief Gives the machine's CPU back after a slice, for a job that ends or has to wait for something else.
+ *
+ * @param machine The machine.
+ * @param instructions Instructions the job executed during the slice.
+ * @param nanoseconds Time the slice took.
+ */
+void Scheduler::Release(uint32_t machine, uint64_t instructions, uint64_t nanoseconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Charge(machine, instructions, nanoseconds);
+    }
+    released.notify_all();
+}
+
+
+/**
+ * @brief Ends the machine's job.
+ *
+ * @param machine The machine.
+ * @return True if the job had no deadline or met it.
+ */
+bool Scheduler::End(uint32_t machine)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    SchedulerMachine& current = machines[machine];
+    bool met = current.deadline == 0 || Metrics::Now() <= current.deadline;
+    if (!met)
+    {
+        ++tenants[current.tenant].missedDeadlines;
+    }
+    current.state = SS_IDLE;
+    return met;
+}
+
+
+/**
+ * @brief Describes the CPU usage of every tenant and machine, as the job server's STATS reply.
+ *
+ * @return A STATS line with the counts, a TENANT line per tenant and a MACHINE line per machine.
+ */
+std::string Scheduler::Report()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint64_t total = 0;
+    for (const auto& entry : tenants)
+    {
+        total += entry.second.instructions;
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "STATS %u cpus %llu slice %zu tenants %zu machines\n", cpus,
+        (unsigned long long)sliceInstructions, tenants.size(), machines.size());
+    std::string report = line;
+
+    for (const auto& entry : tenants)
+    {
+        const SchedulerTenant& tenant = entry.second;
+        snprintf(line, sizeof(line), "TENANT %s weight %u mips %u jobs %llu instructions %llu cpu_ms %.3f share %.1f missed %llu\n",
+            entry.first.c_str(), tenant.weight, tenant.maxMips, (unsigned long long)tenant.jobs,
+            (unsigned long long)tenant.instructions, tenant.cpuNanoseconds / 1e6,
+            total ? 100.0 * tenant.instructions / total : 0.0, (unsigned long long)tenant.missedDeadlines);
+        report += line;
+    }
+
+    for (size_t i = 0; i < machines.size(); ++i)
+    {
+        const SchedulerMachine& machine = machines[i];
+        snprintf(line, sizeof(line), "MACHINE %zu %s tenant %s jobs %llu slices %llu instructions %llu cpu_ms %.3f wait_ms %.3f\n",
+            i, stateNames[machine.state], machine.tenant.empty() ? "-" : machine.tenant.c_str(),
+            (unsigned long long)machine.jobs, (unsigned long long)machine.slices, (unsigned long long)machine.instructions,
+            machine.cpuNanoseconds / 1e6, machine.waitNanoseconds / 1e6);
+        report += line;
+    }
+    return report;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+enum SchedulerStates : uint8_t
+{
+    SS_IDLE = 0, // no job
+    SS_READY,    // the job waits for a CPU
+    SS_RUNNING,  // the job runs a slice
+    SS_BLOCKED   // the job holds no CPU and does not want one, e.g. while its output is sent
+};
+
+
+enum SchedulerLimits : uint32_t
+{
+    // Largest weight of a tenant; shares are proportional to weights.
+    SCHEDULER_MAX_WEIGHT = 10000,
+
+    // Pass added per executed instruction at weight 1; at weight w it is SCHEDULER_STRIDE / w.
+    SCHEDULER_STRIDE = SCHEDULER_MAX_WEIGHT,
+
+    // Longest tenant name.
+    SCHEDULER_MAX_NAME = 31
+};
+
+
+// Owner of jobs, sharing the CPUs with the other tenants in proportion to its weight.
+struct SchedulerTenant
+{
+    uint32_t weight;
+    uint32_t maxMips;       // instructions per second cap in millions, 0 for none
+    uint64_t pass;          // instructions executed times SCHEDULER_STRIDE / weight; the lowest runs next
+    uint64_t pacedUntil;    // with a cap, the time the instructions executed so far are due; the tenant waits until then
+    uint64_t instructions;
+    uint64_t cpuNanoseconds;
+    uint64_t jobs;
+    uint64_t missedDeadlines;
+};
+
+
+// One job server machine and the job it runs.
+struct SchedulerMachine
+{
+    uint8_t state;          // SchedulerStates value
+    std::string tenant;
+    uint64_t deadline;      // Metrics::Now time the job should be done by, 0 for none
+    uint64_t waitingSince;  // arrival in the wait queue, which breaks ties first come first served
+    uint64_t jobs;
+    uint64_t slices;
+    uint64_t instructions;
+    uint64_t cpuNanoseconds;
+    uint64_t waitNanoseconds;
+};
+
+
+// Fair-share scheduler of the job server. Jobs run on their machine's own thread, but only while
+// holding one of a fixed number of CPUs, which they give back after every slice of instructions.
+// A waiting job with a deadline goes first, earliest deadline first. Otherwise the tenant with the
+// lowest pass runs next, so tenants share the CPUs in proportion to their weights whatever the
+// number of jobs each has waiting. A tenant with a MIPS cap waits until its instructions are due.
+class Scheduler
+{
+private:
+    uint32_t cpus;
+    uint64_t sliceInstructions;
+    uint32_t runningCount = 0;
+    uint64_t arrivals = 0;
+
+    std::map<std::string, SchedulerTenant> tenants;
+    std::vector<SchedulerMachine> machines;
+
+    std::mutex mutex;
+    std::condition_variable released;
+
+    SchedulerTenant& Tenant(const std::string& name);
+    int32_t Pick(uint64_t now, uint64_t* wakeAt);
+    uint64_t Wait(std::unique_lock<std::mutex>& lock, uint32_t machine);
+    void Charge(uint32_t machine, uint64_t instructions, uint64_t nanoseconds);
+
+public:
+    Scheduler(uint32_t cpus, uint64_t sliceInstructions);
+
+    void AddMachines(uint32_t count);
+    int SetTenant(const std::string& name, uint32_t weight, uint32_t maxMips);
+
+    void Begin(uint32_t machine, const std::string& tenant, uint64_t deadline);
+    uint64_t Acquire(uint32_t machine);
+    uint64_t Yield(uint32_t machine, uint64_t instructions, uint64_t nanoseconds);
+    void Release(uint32_t machine, uint64_t instructions, uint64_t nanoseconds);
+    bool End(uint32_t machine);
+
+    std::string Report();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include "StateHash.h"
+
+
+/**
+ * @brief Constructs a StateHash over the memory and registers of a CPU.
+ *
+ * Recompute must be called once memory is loaded.
+ *
+ * @param cpu Pointer to the CPU object whose state is hashed.
+ */
+StateHash::StateHash(CPU* cpu)
+{
+    cpuPtr = cpu;
+}
+
+
+/**
+ * @brief Hashes all of memory from scratch, e.g. after images are loaded or memory is restored in bulk.
+ */
+void StateHash::Recompute()
+{
+    memoryHash = 0;
+    for (uint32_t address = 0; address < MemoryMappedRegisters::MR_DEVICES; ++address)
+    {
+        memoryHash += Mix(((uint64_t)address << 16) | cpuPtr->memory[address]);
+    }
+}
+
+
+/**
+ * @brief Returns the part of the hash covering memory, e.g. to restore it with SetMemoryHash.
+ */
+uint64_t StateHash::MemoryHash() const
+{
+    return memoryHash;
+}
+
+
+/**
+ * @brief Sets the memory part of the hash after memory was restored to a state whose hash is known.
+ *
+ * @param hash A value previously returned by MemoryHash for the same memory contents.
+ */
+void StateHash::SetMemoryHash(uint64_t hash)
+{
+    memoryHash = hash;
+}
+
+
+/**
+ * @brief Returns the hash of memory and registers.
+ *
+ * Two machines with equal memory, registers and program counter hash equally, whatever
+ * instruction count they reached it at.
+ */
+uint64_t StateHash::Value() const
+{
+    uint64_t hash = memoryHash;
+    for (uint32_t r = 0; r < REGISTER_COUNT; ++r)
+    {
+        // Registers are keyed above every memory address
+        hash += Mix(((uint64_t)(MEMORY_MAX + r) << 16) | cpuPtr->registers[r]);
+    }
+    return hash;
+}
+
+
+/**
+ * @brief Forgets the states sampled for loop detection, e.g. before an unrelated run starts.
+ */
+void StateHash::ClearSamples()
+{
+    samples.clear();
+    sampledInputs = UINT64_MAX;
+}
+
+
+/**
+ * @brief Samples the state for loop detection.
+ *
+ * A machine that returns to a state it was in before, without reading a device register or taking
+ * other outside input in between, will repeat that cycle forever.
+ *
+ * @param inputs Count of outside inputs taken by means other than device registers, e.g. characters read by traps.
+ * @return True if the state was already sampled since outside input was last seen.
+ */
+bool StateHash::Repeats(uint64_t inputs)
+{
+    inputs += deviceReads;
+    if (inputs != sampledInputs || samples.size() >= STATE_HASH_SAMPLES)
+    {
+        samples.clear();
+        sampledInputs = inputs;
+    }
+
+    return !samples.insert(Value()).second;
+}
\ No newline at end of file
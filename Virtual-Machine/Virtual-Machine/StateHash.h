@@ -0,0 +1,87 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+
+#include <cstdint>
+#include <unordered_set>
+
+#include "CPU.h"
+#include "MemoryIO.h"
+
+
+enum StateHashLimits : uint32_t
+{
+    // Samples remembered by loop detection before the oldest ones are forgotten.
+    STATE_HASH_SAMPLES = 4096
+};
+
+
+// Hash of the machine state kept up to date on every memory write, so reading it costs O(1).
+//
+// The hash is the sum of a mixed value per (address, word) pair, so a write subtracts the old word's
+// term and adds the new one. Registers are folded in when the hash is read. The device register
+// page is left out, since devices update it on reads from state that lives outside memory.
+class StateHash
+{
+private:
+    CPU* cpuPtr;
+
+    uint64_t memoryHash = 0;
+
+    // Device register reads, each of which may bring in outside input.
+    uint64_t deviceReads = 0;
+
+    // Loop detection: states sampled since outside input was last seen.
+    std::unordered_set<uint64_t> samples;
+    uint64_t sampledInputs = UINT64_MAX;
+
+    /**
+     * @brief Mixes a 64-bit key into a well-distributed hash (splitmix64 finalizer).
+     */
+    static uint64_t Mix(uint64_t key)
+    {
+        key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+        return key ^ (key >> 31);
+    }
+
+public:
+    StateHash(CPU* cpu);
+
+    void Recompute();
+    uint64_t MemoryHash() const;
+    void SetMemoryHash(uint64_t hash);
+    uint64_t Value() const;
+    bool Repeats(uint64_t inputs);
+    void ClearSamples();
+
+    /**
+     * @brief Accounts a write of value over oldValue; called by MemoryIO before the word changes.
+     */
+    void Store(uint16_t address, uint16_t oldValue, uint16_t value)
+    {
+        if (address < MemoryMappedRegisters::MR_DEVICES)
+        {
+            memoryHash += Mix(((uint64_t)address << 16) | value) - Mix(((uint64_t)address << 16) | oldValue);
+        }
+    }
+
+    /**
+     * @brief Notes a device register read; called by MemoryIO.
+     */
+    void DeviceRead()
+    {
+        ++deviceReads;
+    }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,569 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include "Terminal.h"
+
+#include <cstdio>
+#include <cstdlib>
+// windows only
+#include <Windows.h>
+
+
+static const uint32_t BLANK = ' ';
+static const uint32_t TAB_WIDTH = 8;
+
+// Longest parameter list kept from a control sequence; anything longer is malformed.
+static const size_t MAX_PARAMETERS = 32;
+
+
+/**
+ * @brief Constructs a Terminal with a blank screen.
+ *
+ * @param columns Width of the emulated screen.
+ * @param rows Height of the emulated screen.
+ * @param framesPerSecond Highest rate at which frames are sent to the real terminal.
+ * @param headless True to keep the screen in memory only, e.g. for screenshots.
+ */
+Terminal::Terminal(uint32_t columns, uint32_t rows, uint32_t framesPerSecond, bool headless)
+{
+    this->columns = columns;
+    this->rows = rows;
+    this->headless = headless;
+    frameMilliseconds = 1000 / (framesPerSecond ? framesPerSecond : 1);
+
+    screen.assign((size_t)columns * rows, BLANK);
+    shown.assign((size_t)columns * rows, BLANK);
+    dirtyRows.assign(rows, 0);
+
+    if (!headless)
+    {
+        // Frames are drawn with escape sequences, which the console only interprets when asked to
+        HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode;
+        if (GetConsoleMode(hStdout, &mode))
+        {
+            SetConsoleMode(hStdout, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        }
+    }
+}
+
+
+/**
+ * @brief Interprets program output, updating the emulated screen without drawing anything.
+ *
+ * Understands printable characters, CR, LF, BS, TAB, and the ESC [ sequences for cursor movement
+ * (A B C D G H d f), erasing (J K) and colors and styles (m). Other sequences are ignored.
+ *
+ * @param data The output bytes.
+ * @param length Number of bytes.
+ */
+void Terminal::Write(const char* data, size_t length)
+{
+    bytesWritten += length;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        uint8_t c = (uint8_t)data[i];
+
+        switch (escapeState)
+        {
+        case ES_TEXT:
+            if (c == 0x1B)
+            {
+                escapeState = ES_ESCAPE;
+            }
+            else if (c == '\n')
+            {
+                // Consoles translate LF into CR LF on output
+                cursorColumn = 0;
+                LineFeed();
+            }
+            else if (c == '\r')
+            {
+                cursorColumn = 0;
+            }
+            else if (c == '\b')
+            {
+                cursorColumn = cursorColumn ? cursorColumn - 1 : 0;
+            }
+            else if (c == '\t')
+            {
+                cursorColumn = (cursorColumn / TAB_WIDTH + 1) * TAB_WIDTH;
+                cursorColumn = cursorColumn < columns ? cursorColumn : columns - 1;
+            }
+            else if (c >= 0x20)
+            {
+                Print(c);
+            }
+            changed = true;
+            break;
+
+        case ES_ESCAPE:
+            if (c == '[')
+            {
+                parameters.clear();
+                escapeState = ES_CONTROL;
+            }
+            else
+            {
+                if (c == 'c')
+                {
+                    // Full reset
+                    rendition = 0;
+                    cursorRow = cursorColumn = 0;
+                    Erase(0, (uint32_t)screen.size());
+                }
+                escapeState = ES_TEXT;
+            }
+            break;
+
+        case ES_CONTROL:
+            if (c >= 0x40 && c <= 0x7E)
+            {
+                Control((char)c);
+                escapeState = ES_TEXT;
+            }
+            else if (parameters.size() < MAX_PARAMETERS)
+            {
+                parameters += (char)c;
+            }
+            else
+            {
+                escapeState = ES_TEXT;
+            }
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Writes a printable character at the cursor, wrapping to the next line at the right edge.
+ */
+void Terminal::Print(uint8_t c)
+{
+    if (cursorColumn >= columns)
+    {
+        cursorColumn = 0;
+        LineFeed();
+    }
+
+    screen[(size_t)cursorRow * columns + cursorColumn] = rendition | c;
+    dirtyRows[cursorRow] = 1;
+    ++cursorColumn;
+}
+
+
+/**
+ * @brief Moves the cursor down a line, scrolling the screen up at the bottom.
+ */
+void Terminal::LineFeed()
+{
+    if (cursorRow + 1 < rows)
+    {
+        ++cursorRow;
+        return;
+    }
+
+    screen.erase(screen.begin(), screen.begin() + columns);
+    screen.insert(screen.end(), columns, BLANK);
+    dirtyRows.assign(rows, 1);
+}
+
+
+/**
+ * @brief Blanks the cells in [begin, end), counted from the top-left corner.
+ */
+void Terminal::Erase(uint32_t begin, uint32_t end)
+{
+    // Erased cells keep the current background, as real terminals do
+    uint32_t blank = BLANK | (rendition & (0xFFu << CELL_BACKGROUND_SHIFT));
+
+    for (uint32_t cell = begin; cell < end; ++cell)
+    {
+        screen[cell] = blank;
+    }
+    for (uint32_t row = begin / columns; row < rows && row * columns < end; ++row)
+    {
+        dirtyRows[row] = 1;
+    }
+    changed = true;
+}
+
+
+/**
+ * @brief Splits the parameters of a control sequence, ignoring a private-mode '?' prefix.
+ *
+ * Missing parameters are returned as 0.
+ */
+std::vector<uint32_t> Terminal::ParseParameters() const
+{
+    std::vector<uint32_t> values(1, 0);
+    for (char c : parameters)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            values.back() = values.back() * 10 + (c - '0');
+        }
+        else if (c == ';')
+        {
+            values.push_back(0);
+        }
+    }
+    return values;
+}
+
+
+/**
+ * @brief Executes a complete ESC [ control sequence.
+ *
+ * @param final The final character naming the sequence.
+ */
+void Terminal::Control(char final)
+{
+    if (!parameters.empty() && parameters[0] == '?')
+    {
+        // Private modes such as cursor visibility do not change the screen
+        return;
+    }
+
+    std::vector<uint32_t> values = ParseParameters();
+    uint32_t count = values[0] ? values[0] : 1;
+    uint32_t cursor = cursorRow * columns + (cursorColumn < columns ? cursorColumn : columns - 1);
+
+    switch (final)
+    {
+    case 'A':
+        cursorRow = cursorRow > count ? cursorRow - count : 0;
+        break;
+    case 'B':
+        cursorRow = cursorRow + count < rows ? cursorRow + count : rows - 1;
+        break;
+    case 'C':
+        cursorColumn = cursorColumn + count < columns ? cursorColumn + count : columns - 1;
+        break;
+    case 'D':
+        cursorColumn = cursorColumn > count ? cursorColumn - count : 0;
+        break;
+    case 'G':
+        cursorColumn = (count < columns ? count : columns) - 1;
+        break;
+    case 'd':
+        cursorRow = (count < rows ? count : rows) - 1;
+        break;
+    case 'H':
+    case 'f':
+    {
+        uint32_t row = values[0] ? values[0] : 1;
+        uint32_t column = values.size() > 1 && values[1] ? values[1] : 1;
+        cursorRow = (row < rows ? row : rows) - 1;
+        cursorColumn = (column < columns ? column : columns) - 1;
+        break;
+    }
+    case 'J':
+        if (values[0] == 0)
+        {
+            Erase(cursor, (uint32_t)screen.size());
+        }
+        else if (values[0] == 1)
+        {
+            Erase(0, cursor + 1);
+        }
+        else
+        {
+            // 2 erases the screen, 3 the scrollback, which the emulated screen does not have
+            Erase(0, (uint32_t)screen.size());
+        }
+        break;
+    case 'K':
+    {
+        uint32_t lineStart = cursorRow * columns;
+        if (values[0] == 0)
+        {
+            Erase(cursor, lineStart + columns);
+        }
+        else if (values[0] == 1)
+        {
+            Erase(lineStart, cursor + 1);
+        }
+        else
+        {
+            Erase(lineStart, lineStart + columns);
+        }
+        break;
+    }
+    case 'm':
+        SelectRendition();
+        break;
+    default:
+        break;
+    }
+    changed = true;
+}
+
+
+/**
+ * @brief Applies an SGR (ESC [ ... m) sequence to the current rendition.
+ */
+void Terminal::SelectRendition()
+{
+    uint32_t foreground = (rendition >> CELL_FOREGROUND_SHIFT) & 0xFF;
+    uint32_t background = (rendition >> CELL_BACKGROUND_SHIFT) & 0xFF;
+    uint32_t style = rendition >> CELL_STYLE_SHIFT;
+
+    for (uint32_t value : ParseParameters())
+    {
+        if (value == 0)
+        {
+            foreground = background = style = 0;
+        }
+        else if (value == 1)
+        {
+            style |= CS_BOLD;
+        }
+        else if (value == 4)
+        {
+            style |= CS_UNDERLINE;
+        }
+        else if (value == 7)
+        {
+            style |= CS_REVERSE;
+        }
+        else if (value == 22)
+        {
+            style &= ~CS_BOLD;
+        }
+        else if (value == 24)
+        {
+            style &= ~CS_UNDERLINE;
+        }
+        else if (value == 27)
+        {
+            style &= ~CS_REVERSE;
+        }
+        else if ((value >= 30 && value <= 37) || (value >= 90 && value <= 97))
+        {
+            foreground = value;
+        }
+        else if (value == 39)
+        {
+            foreground = 0;
+        }
+        else if ((value >= 40 && value <= 47) || (value >= 100 && value <= 107))
+        {
+            background = value;
+        }
+        else if (value == 49)
+        {
+            background = 0;
+        }
+    }
+
+    rendition = (foreground << CELL_FOREGROUND_SHIFT) | (background << CELL_BACKGROUND_SHIFT) | (style << CELL_STYLE_SHIFT);
+}
+
+
+/**
+ * @brief Appends the SGR sequence that sets a rendition from scratch.
+ */
+void Terminal::AppendRendition(std::string& out, uint32_t rendition)
+{
+    char sequence[32];
+    uint32_t style = rendition >> CELL_STYLE_SHIFT;
+    uint32_t foreground = (rendition >> CELL_FOREGROUND_SHIFT) & 0xFF;
+    uint32_t background = (rendition >> CELL_BACKGROUND_SHIFT) & 0xFF;
+
+    out += "\x1b[0";
+    if (style & CS_BOLD)
+    {
+        out += ";1";
+    }
+    if (style & CS_UNDERLINE)
+    {
+        out += ";4";
+    }
+    if (style & CS_REVERSE)
+    {
+        out += ";7";
+    }
+    if (foreground)
+    {
+        snprintf(sequence, sizeof(sequence), ";%u", foreground);
+        out += sequence;
+    }
+    if (background)
+    {
+        snprintf(sequence, sizeof(sequence), ";%u", background);
+        out += sequence;
+    }
+    out += 'm';
+}
+
+
+/**
+ * @brief Draws a frame if the frame interval has passed since the last one; called when the program flushes.
+ */
+void Terminal::Flush()
+{
+    if (changed && GetTickCount64() - lastFrame >= frameMilliseconds)
+    {
+        Present();
+    }
+}
+
+
+/**
+ * @brief Tells whether the screen changed since the last frame was drawn.
+ */
+bool Terminal::Pending() const
+{
+    return changed;
+}
+
+
+/**
+ * @brief Sends the cells that differ from the last frame to the real terminal.
+ *
+ * Only dirty rows are compared. Each run of changed cells costs one cursor move, omitted when the
+ * cursor is already there, plus an SGR sequence whenever the rendition changes. The frame is
+ * written in a single call and leaves the real cursor where the program's cursor is.
+ */
+void Terminal::Present()
+{
+    if (!changed)
+    {
+        return;
+    }
+    changed = false;
+    lastFrame = GetTickCount64();
+
+    std::string out;
+    char sequence[32];
+
+    if (!started)
+    {
+        // The real screen must match the blank shown screen before differences mean anything
+        out += "\x1b[0m\x1b[2J";
+        started = true;
+        shownRendition = 0;
+        shownRow = -1;
+    }
+
+    for (uint32_t row = 0; row < rows; ++row)
+    {
+        if (!dirtyRows[row])
+        {
+            continue;
+        }
+        dirtyRows[row] = 0;
+
+        for (uint32_t column = 0; column < columns; ++column)
+        {
+            size_t cell = (size_t)row * columns + column;
+            if (screen[cell] == shown[cell])
+            {
+                continue;
+            }
+
+            if (shownRow != (int32_t)row || shownColumn != (int32_t)column)
+            {
+                snprintf(sequence, sizeof(sequence), "\x1b[%u;%uH", row + 1, column + 1);
+                out += sequence;
+            }
+
+            uint32_t cellRendition = screen[cell] & ~CELL_CHARACTER;
+            if (cellRendition != shownRendition)
+            {
+                AppendRendition(out, cellRendition);
+                shownRendition = cellRendition;
+            }
+
+            out += (char)(screen[cell] & CELL_CHARACTER);
+            shown[cell] = screen[cell];
+
+            // Writing the last column leaves the cursor in a pending-wrap state that differs between terminals
+            shownRow = column + 1 < columns ? (int32_t)row : -1;
+            shownColumn = column + 1;
+        }
+    }
+
+    uint32_t column = cursorColumn < columns ? cursorColumn : columns - 1;
+    if (shownRow != (int32_t)cursorRow || shownColumn != (int32_t)column)
+    {
+        snprintf(sequence, sizeof(sequence), "\x1b[%u;%uH", cursorRow + 1, column + 1);
+        out += sequence;
+        shownRow = (int32_t)cursorRow;
+        shownColumn = (int32_t)column;
+    }
+
+    bytesPresented += out.size();
+    if (!headless)
+    {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * @brief Returns the characters of the emulated screen, one line per row without trailing blanks.
+ */
+std::string Terminal::Screenshot() const
+{
+    std::string text;
+    for (uint32_t row = 0; row < rows; ++row)
+    {
+        std::string line;
+        for (uint32_t column = 0; column < columns; ++column)
+        {
+            line += (char)(screen[(size_t)row * columns + column] & CELL_CHARACTER);
+        }
+        line.erase(line.find_last_not_of(' ') + 1);
+        text += line;
+        text += '\n';
+    }
+    return text;
+}
+
+
+/**
+ * @brief Writes the screenshot of the emulated screen to a text file.
+ *
+ * @param path The file to write.
+ * @return Returns 1 on success, 0 if the file cannot be written.
+ */
+int Terminal::SaveScreenshot(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    std::string text = Screenshot();
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && written;
+}
+
+
+/**
+ * @brief Prints how many bytes the program wrote and how many were sent to the real terminal.
+ *
+ * @param out The output stream.
+ */
+void Terminal::Report(FILE* out) const
+{
+    fprintf(out, "terminal: %llu bytes of program output, %llu bytes drawn (%.1f%%)\n",
+        (unsigned long long)bytesWritten, (unsigned long long)bytesPresented,
+        bytesWritten ? 100.0 * bytesPresented / bytesWritten : 0.0);
+}
\ No newline at end of file
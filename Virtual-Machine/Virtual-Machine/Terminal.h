@@ -0,0 +1,102 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+// A cell packs its character into the low byte and its rendition above it.
+enum CellFields : uint32_t
+{
+    CELL_CHARACTER = 0x000000FF,
+    CELL_FOREGROUND_SHIFT = 8,   // SGR code 30-37 or 90-97, 0 for the default color
+    CELL_BACKGROUND_SHIFT = 16,  // SGR code 40-47 or 100-107, 0 for the default color
+    CELL_STYLE_SHIFT = 24        // CellStyles
+};
+
+
+enum CellStyles : uint32_t
+{
+    CS_BOLD = (1 << 0),
+    CS_UNDERLINE = (1 << 1),
+    CS_REVERSE = (1 << 2)
+};
+
+
+enum EscapeStates : uint8_t
+{
+    ES_TEXT = 0,
+    ES_ESCAPE,    // after ESC
+    ES_CONTROL    // inside an ESC [ control sequence
+};
+
+
+class Terminal
+{
+private:
+    uint32_t columns;
+    uint32_t rows;
+
+    // Emulated screen, the screen last sent to the real terminal, and the rows that may differ.
+    std::vector<uint32_t> screen;
+    std::vector<uint32_t> shown;
+    std::vector<uint8_t> dirtyRows;
+    bool changed = false;
+
+    uint32_t cursorRow = 0;
+    uint32_t cursorColumn = 0;
+
+    // Rendition applied to written characters, in cell layout with an empty character.
+    uint32_t rendition = 0;
+
+    EscapeStates escapeState = ES_TEXT;
+    std::string parameters;
+
+    // Real terminal state as left by the last frame; a row of -1 means the cursor position is unknown.
+    bool started = false;
+    int32_t shownRow = -1;
+    int32_t shownColumn = -1;
+    uint32_t shownRendition = 0;
+
+    bool headless;
+    uint64_t frameMilliseconds;
+    uint64_t lastFrame = 0;
+
+    uint64_t bytesWritten = 0;
+    uint64_t bytesPresented = 0;
+
+    void Print(uint8_t c);
+    void LineFeed();
+    void Erase(uint32_t begin, uint32_t end);
+    void Control(char final);
+    void SelectRendition();
+    std::vector<uint32_t> ParseParameters() const;
+    static void AppendRendition(std::string& out, uint32_t rendition);
+
+public:
+    Terminal(uint32_t columns, uint32_t rows, uint32_t framesPerSecond, bool headless);
+
+    void Write(const char* data, size_t length);
+    void Flush();
+    void Present();
+    bool Pending() const;
+
+    std::string Screenshot() const;
+    int SaveScreenshot(const char* path) const;
+    void Report(FILE* out) const;
+};
+#endif
\ No newline at end of file
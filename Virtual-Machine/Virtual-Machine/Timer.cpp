@@ -0,0 +1,169 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#include "Timer.h"
+#include "CPU.h"
+
+// windows only
+#include <Windows.h>
+
+
+/**
+ * @brief Constructs a Timer object driven by the CPU's instruction counter.
+ *
+ * @param cpu Pointer to the CPU object whose retired instruction count drives the clock.
+ * @param instructionsPerTick Number of instructions that make up one timer tick.
+ * @param realTime If true, ticks are never reported before the matching wall-clock millisecond.
+ */
+Timer::Timer(CPU* cpu, uint32_t instructionsPerTick, bool realTime)
+{
+    cpuPtr = cpu;
+    this->instructionsPerTick = instructionsPerTick;
+    this->realTime = realTime;
+    startMilliseconds = GetTickCount64();
+}
+
+
+/**
+ * @brief Returns the virtual clock in instructions.
+ *
+ * The virtual clock is the number of retired instructions plus any time skipped while idle.
+ *
+ * @return The current virtual time.
+ */
+uint64_t Timer::Now() const
+{
+    return cpuPtr->instructionCount + skippedInstructions;
+}
+
+
+/**
+ * @brief Returns the number of whole ticks elapsed on the virtual clock.
+ *
+ * @return The current tick count.
+ */
+uint64_t Timer::Ticks() const
+{
+    return Now() / instructionsPerTick;
+}
+
+
+/**
+ * @brief Blocks until the wall clock has reached the given tick.
+ *
+ * Only used in real-time mode, where one tick corresponds to one millisecond.
+ *
+ * @param tick The tick to wait for.
+ */
+void Timer::WaitForWallClock(uint64_t tick) const
+{
+    uint64_t elapsed = GetTickCount64() - startMilliseconds;
+    if (elapsed < tick)
+    {
+        Sleep((DWORD)(tick - elapsed));
+    }
+}
+
+
+/**
+ * @brief Reads the timer status register.
+ *
+ * Bit 15 is set when at least one programmed interval has elapsed since the last acknowledged tick;
+ * reading a set status acknowledges it. When the program keeps polling an unset status in a tight loop,
+ * the virtual clock jumps straight to the next deadline instead of retiring the spin-wait instructions.
+ *
+ * @return The status register value.
+ */
+uint16_t Timer::ReadStatus()
+{
+    uint64_t now = Now();
+    uint64_t deadline = acknowledgedTick + interval;
+
+    if (now / instructionsPerTick < deadline)
+    {
+        // Reads that follow each other closely are a spin-wait; anything else restarts detection
+        idlePolls = (now - lastPollClock <= TIMER_POLL_WINDOW) ? idlePolls + 1 : 1;
+        lastPollClock = now;
+
+        if (idlePolls < TIMER_IDLE_POLLS)
+        {
+            return 0;
+        }
+
+        // Fast-forward the virtual clock to the deadline
+        skippedInstructions += deadline * instructionsPerTick - now;
+    }
+
+    if (realTime)
+    {
+        WaitForWallClock(deadline);
+    }
+
+    idlePolls = 0;
+    acknowledgedTick = Ticks();
+    return (1 << 15);
+}
+
+
+/**
+ * @brief Reads the timer data register, holding the low 16 bits of the tick count.
+ *
+ * @return The tick count modulo 65536.
+ */
+uint16_t Timer::ReadCount() const
+{
+    return (uint16_t)Ticks();
+}
+
+
+/**
+ * @brief Writes the timer interval register.
+ *
+ * Sets the number of ticks between status events; zero is treated as one.
+ *
+ * @param value The new interval in ticks.
+ */
+void Timer::WriteInterval(uint16_t value)
+{
+    interval = value ? value : 1;
+    acknowledgedTick = Ticks();
+}
+
+
+/**
+ * @brief Captures the virtual clock state.
+ *
+ * @return The state, restorable with RestoreState.
+ */
+TimerState Timer::SaveState() const
+{
+    TimerState state = {};
+    state.skippedInstructions = skippedInstructions;
+    state.acknowledgedTick = acknowledgedTick;
+    state.lastPollClock = lastPollClock;
+    state.interval = interval;
+    state.idlePolls = idlePolls;
+    return state;
+}
+
+
+/**
+ * @brief Restores a virtual clock state captured by SaveState.
+ *
+ * @param state The state to restore.
+ */
+void Timer::RestoreState(const TimerState& state)
+{
+    skippedInstructions = state.skippedInstructions;
+    acknowledgedTick = state.acknowledgedTick;
+    lastPollClock = state.lastPollClock;
+    interval = state.interval;
+    idlePolls = state.idlePolls;
+}
\ No newline at end of file
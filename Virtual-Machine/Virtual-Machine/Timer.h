@@ -0,0 +1,82 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef TIMER_H
+#define TIMER_H
+
+
+#include <cstdint>
+
+
+class CPU;
+
+
+enum TimerPolling : uint16_t
+{
+    // Two status reads closer together than this many instructions are treated as a spin-wait loop.
+    TIMER_POLL_WINDOW = 16,
+
+    // Number of back-to-back unsatisfied status reads after which the clock is fast-forwarded.
+    TIMER_IDLE_POLLS = 2
+};
+
+
+// Virtual clock state captured by checkpoints. The wall-clock origin of real-time mode is not part of it.
+struct TimerState
+{
+    uint64_t skippedInstructions;
+    uint64_t acknowledgedTick;
+    uint64_t lastPollClock;
+    uint16_t interval;
+    uint16_t idlePolls;
+};
+
+
+class Timer
+{
+private:
+    CPU* cpuPtr;
+
+    // Number of instructions that make up one tick.
+    uint64_t instructionsPerTick;
+
+    // Pace ticks to wall-clock milliseconds instead of running as fast as possible.
+    bool realTime;
+
+    // Virtual time skipped by idle fast-forwarding, in instructions.
+    uint64_t skippedInstructions = 0;
+
+    // Tick at which the status register was last acknowledged and the programmed interval in ticks.
+    uint64_t acknowledgedTick = 0;
+    uint16_t interval = 1;
+
+    // Spin-wait detection state.
+    uint64_t lastPollClock = 0;
+    uint16_t idlePolls = 0;
+
+    // Wall-clock origin used in real-time mode, in milliseconds.
+    uint64_t startMilliseconds;
+
+    void WaitForWallClock(uint64_t tick) const;
+
+public:
+    Timer(CPU* cpu, uint32_t instructionsPerTick, bool realTime);
+
+    uint64_t Now() const;
+    uint64_t Ticks() const;
+
+    uint16_t ReadStatus();
+    uint16_t ReadCount() const;
+    void WriteInterval(uint16_t value);
+
+    TimerState SaveState() const;
+    void RestoreState(const TimerState& state);
+};
+#endif
\ No newline at end of file
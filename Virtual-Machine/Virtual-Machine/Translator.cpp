@@ -0,0 +1,656 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstring>
+#include <vector>
+
+
+#include "Translator.h"
+#include "ArithmeticLogicUnit.h"
+#include "Trap.h"
+
+
+/**
+ * @brief Tells whether execution can continue with the next word after the given instruction.
+ *
+ * @param instruction The 16-bit instruction.
+ * @return True unless the instruction always transfers control or stops the machine.
+ */
+static bool FallsThrough(uint16_t instruction)
+{
+    switch (instruction >> 12)
+    {
+    case OP_BR:
+        // BRnzp is an unconditional branch
+        return ((instruction >> 9) & 0x0007) != 0x0007;
+    case OP_JMP:
+    case OP_RTI:
+    case OP_RES:
+        return false;
+    case OP_TRAP:
+        return (instruction & 0x00FF) != TRAP_HALT;
+    default:
+        return true;
+    }
+}
+
+
+/**
+ * @brief Tells whether an instruction can see the instruction count or leave its block midway.
+ *
+ * Loads may read the timer, stores may hand over to the interpreter and traps run host code,
+ * so the count must include every instruction up to this one before it runs.
+ *
+ * @param instruction The 16-bit instruction.
+ */
+static bool ObservesCount(uint16_t instruction)
+{
+    switch (instruction >> 12)
+    {
+    case OP_LD:
+    case OP_LDI:
+    case OP_LDR:
+    case OP_ST:
+    case OP_STI:
+    case OP_STR:
+    case OP_TRAP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+// Address waiting to be walked by control-flow recovery, with the register values known on the way there.
+struct DiscoverEntry
+{
+    uint16_t address;
+
+    // Value of each register, or -1 if it is not a known constant.
+    int32_t constants[8];
+};
+
+
+/**
+ * @brief Constructs a Translator working on the memory of the given CPU.
+ *
+ * @param cpu Pointer to the CPU object whose memory holds the loaded images.
+ * @param alu Pointer to the ArithmeticLogicUnit object used for sign extension.
+ */
+Translator::Translator(CPU* cpu, ArithmeticLogicUnit* alu)
+{
+    cpuPtr = cpu;
+    aluPtr = alu;
+}
+
+
+/**
+ * @brief Recovers the static control flow reachable from the entry point.
+ *
+ * Follows fall-through paths, direct branches and subroutine calls through the loaded words,
+ * marking every reached word as code and every jump target as a block leader. The word after
+ * a subroutine call is also a leader, since RET comes back to it through the dispatch table.
+ *
+ * Registers set by LEA, or by LD from a loaded word such as a .FILL of a label, are tracked along
+ * the walk, so a JMP or JSRR through them also reaches its target, as in "LD R5, ENTRY; JMP R5".
+ * Other indirect jumps, and targets computed at run time, are only reached through the interpreter.
+ *
+ * @param entry The address execution starts at.
+ */
+void Translator::Discover(uint16_t entry)
+{
+    std::vector<DiscoverEntry> worklist;
+    DiscoverEntry start;
+    start.address = entry;
+    for (int32_t& constant : start.constants)
+    {
+        constant = -1;
+    }
+    worklist.push_back(start);
+    flags[entry] |= TF_LEADER;
+
+    while (!worklist.empty())
+    {
+        DiscoverEntry walk = worklist.back();
+        worklist.pop_back();
+        uint16_t address = walk.address;
+        int32_t* constants = walk.constants;
+
+        // Queues a jump target as a block leader, with the registers known at the jump
+        auto reach = [&](uint16_t target)
+        {
+            DiscoverEntry entry;
+            entry.address = target;
+            memcpy(entry.constants, constants, sizeof(entry.constants));
+            flags[target] |= TF_LEADER;
+            worklist.push_back(entry);
+        };
+
+        // Walk straight-line code until control leaves it or it joins already translated code
+        while ((flags[address] & TF_LOADED) && !(flags[address] & TF_CODE))
+        {
+            uint16_t instruction = cpuPtr->memory[address];
+            uint16_t next = address + 1;
+            uint16_t DR = (instruction >> 9) & 0x0007;
+            uint16_t SR1 = (instruction >> 6) & 0x0007;
+            uint16_t pcRelative = next + aluPtr->SignExtend(instruction & 0x01FF, 9);
+            flags[address] |= TF_CODE;
+
+            switch (instruction >> 12)
+            {
+            case OP_BR:
+                if (DR)
+                {
+                    reach(pcRelative);
+                }
+                flags[next] |= TF_BLOCK;
+                break;
+            case OP_JSR:
+                if ((instruction >> 11) & 0x0001)
+                {
+                    reach(next + aluPtr->SignExtend(instruction & 0x07FF, 11));
+                }
+                else if (constants[SR1] >= 0)
+                {
+                    reach((uint16_t)constants[SR1]);
+                }
+                constants[Registers::R_7] = -1;
+                flags[next] |= TF_LEADER;
+                break;
+            case OP_JMP:
+                if (constants[SR1] >= 0)
+                {
+                    reach((uint16_t)constants[SR1]);
+                }
+                flags[next] |= TF_BLOCK;
+                break;
+            case OP_TRAP:
+                constants[Registers::R_0] = -1;
+                constants[Registers::R_7] = -1;
+                flags[next] |= TF_BLOCK;
+                break;
+            case OP_LEA:
+                constants[DR] = pcRelative;
+                break;
+            case OP_LD:
+                constants[DR] = (flags[pcRelative] & TF_LOADED) ? cpuPtr->memory[pcRelative] : -1;
+                break;
+            case OP_ADD:
+            case OP_AND:
+            case OP_NOT:
+            case OP_LDI:
+            case OP_LDR:
+                constants[DR] = -1;
+                break;
+            }
+
+            if (!FallsThrough(instruction) || next == 0)
+            {
+                break;
+            }
+            address = next;
+        }
+    }
+}
+
+
+/**
+ * @brief Tells whether the instruction at the given address is the last of its block.
+ *
+ * @param address The address of a translated instruction.
+ * @return True if control leaves the block after it, or the next word starts another block.
+ */
+bool Translator::EndsBlock(uint16_t address) const
+{
+    uint32_t next = address + 1;
+    return !FallsThrough(cpuPtr->memory[address]) || next == MEMORY_MAX ||
+        !(flags[next] & TF_CODE) || (flags[next] & (TF_LEADER | TF_BLOCK));
+}
+
+
+/**
+ * @brief Emits a jump to the given address.
+ *
+ * Translated targets are reached with a direct goto; anything else goes through the dispatcher.
+ *
+ * @param out The output stream.
+ * @param target The address to continue at.
+ */
+void Translator::EmitTarget(FILE* out, uint16_t target) const
+{
+    if (flags[target] & TF_CODE)
+    {
+        fprintf(out, "goto L_%04X;\n", target);
+    }
+    else
+    {
+        fprintf(out, "{ pc = 0x%04X; goto dispatch; }\n", target);
+    }
+}
+
+
+/**
+ * @brief Emits the C++ statements for one instruction.
+ *
+ * Each statement keeps the semantics of the matching VmCore handler or Trap method,
+ * with the registers held in locals.
+ *
+ * @param out The output stream.
+ * @param address The address of the instruction.
+ * @param instruction The 16-bit instruction.
+ */
+void Translator::EmitInstruction(FILE* out, uint16_t address, uint16_t instruction) const
+{
+    uint16_t next = address + 1;
+    uint16_t DR = (instruction >> 9) & 0x0007;
+    uint16_t SR1 = (instruction >> 6) & 0x0007;
+    uint16_t pcOffset = aluPtr->SignExtend(instruction & 0x01FF, 9);
+    uint16_t offset = aluPtr->SignExtend(instruction & 0x003F, 6);
+    uint16_t imm5 = aluPtr->SignExtend(instruction & 0x001F, 5);
+
+    fprintf(out, "    // %04X: %04X\n", address, instruction);
+
+    switch (instruction >> 12)
+    {
+    case OP_ADD:
+    case OP_AND:
+    {
+        const char* op = (instruction >> 12) == OP_ADD ? "+" : "&";
+        if ((instruction >> 5) & 0x0001)
+        {
+            fprintf(out, "    r%u = (uint16_t)(r%u %s 0x%04X);\n", DR, SR1, op, imm5);
+        }
+        else
+        {
+            fprintf(out, "    r%u = (uint16_t)(r%u %s r%u);\n", DR, SR1, op, instruction & 0x0007);
+        }
+        fprintf(out, "    cond = LC3_FLAGS(r%u);\n", DR);
+        break;
+    }
+    case OP_NOT:
+        fprintf(out, "    r%u = (uint16_t)~r%u;\n", DR, SR1);
+        fprintf(out, "    cond = LC3_FLAGS(r%u);\n", DR);
+        break;
+    case OP_BR:
+        if (DR == 0x0007)
+        {
+            fprintf(out, "    ");
+            EmitTarget(out, next + pcOffset);
+        }
+        else if (DR)
+        {
+            fprintf(out, "    if (cond & 0x%X) ", DR);
+            EmitTarget(out, next + pcOffset);
+        }
+        break;
+    case OP_JMP:
+        fprintf(out, "    pc = r%u;\n    goto dispatch;\n", SR1);
+        break;
+    case OP_JSR:
+        fprintf(out, "    r7 = 0x%04X;\n", next);
+        if ((instruction >> 11) & 0x0001)
+        {
+            fprintf(out, "    ");
+            EmitTarget(out, next + aluPtr->SignExtend(instruction & 0x07FF, 11));
+        }
+        else
+        {
+            fprintf(out, "    pc = r%u;\n    goto dispatch;\n", SR1);
+        }
+        break;
+    case OP_LD:
+        fprintf(out, "    r%u = memoryIO.Read(0x%04X);\n", DR, (uint16_t)(next + pcOffset));
+        fprintf(out, "    cond = LC3_FLAGS(r%u);\n", DR);
+        break;
+    case OP_LDR:
+        fprintf(out, "    r%u = memoryIO.Read((uint16_t)(r%u + 0x%04X));\n", DR, SR1, offset);
+        fprintf(out, "    cond = LC3_FLAGS(r%u);\n", DR);
+        break;
+    case OP_LDI:
+        fprintf(out, "    r%u = memoryIO.Read(memoryIO.Read(0x%04X));\n", DR, (uint16_t)(next + pcOffset));
+        fprintf(out, "    cond = LC3_FLAGS(r%u);\n", DR);
+        break;
+    case OP_LEA:
+        fprintf(out, "    r%u = 0x%04X;\n", DR, (uint16_t)(next + pcOffset));
+        fprintf(out, "    cond = LC3_FLAGS(r%u);\n", DR);
+        break;
+    case OP_ST:
+        fprintf(out, "    LC3_STORE(0x%04X, r%u, 0x%04X);\n", (uint16_t)(next + pcOffset), DR, next);
+        break;
+    case OP_STI:
+        fprintf(out, "    LC3_STORE(memoryIO.Read(0x%04X), r%u, 0x%04X);\n", (uint16_t)(next + pcOffset), DR, next);
+        break;
+    case OP_STR:
+        fprintf(out, "    LC3_STORE((uint16_t)(r%u + 0x%04X), r%u, 0x%04X);\n", SR1, offset, DR, next);
+        break;
+    case OP_TRAP:
+        fprintf(out, "    LC3_SAVE();\n");
+        fprintf(out, "    registers[R_PC] = 0x%04X;\n", next);
+        fprintf(out, "    trap.Proxy(0x%04X);\n", instruction);
+        fprintf(out, "    LC3_LOAD();\n");
+        fprintf(out, "    if (!cpu.running) return;\n");
+        break;
+    case OP_RTI:
+    case OP_RES:
+    default:
+        fprintf(out, "    abort();\n");
+        break;
+    }
+}
+
+
+/**
+ * @brief Emits the function that runs the translated program.
+ *
+ * Every basic block becomes a labelled region. Indirect jumps go through a switch over the block
+ * leaders; targets that were not translated hand execution over to the interpreter. A write that
+ * lands on translated code marks the block holding it stale and hands over too; the interpreter
+ * runs until it reaches a block that is still valid, and a stale block is never entered again.
+ * The interpreter's own stores bypass the translated check, so MemoryIO marks the pages they write
+ * and the blocks whose words changed there are marked stale before translated code runs again.
+ *
+ * The instruction count is added in one sum per run of instructions that cannot see it, before
+ * the instruction that ends the run, so it is exact whenever a load, a store, a trap or the end of
+ * a block observes it.
+ *
+ * @param out The output stream.
+ */
+void Translator::EmitRunFunction(FILE* out) const
+{
+    // Tables of translated code ranges and block leaders, used to build lookup arrays at run time
+    fprintf(out, "static const uint16_t codeRanges[][2] =\n{\n");
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        if (flags[address] & TF_CODE)
+        {
+            uint32_t end = address;
+            while (end + 1 < MEMORY_MAX && (flags[end + 1] & TF_CODE))
+            {
+                ++end;
+            }
+            fprintf(out, "    { 0x%04X, 0x%04X },\n", address, end);
+            address = end;
+        }
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint16_t leaders[] =\n{");
+    int column = 0;
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        if ((flags[address] & TF_CODE) && (flags[address] & TF_LEADER))
+        {
+            fprintf(out, "%s0x%04X,", (column++ % 8) ? " " : "\n    ", address);
+        }
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const uint16_t blockStarts[] =\n{");
+    column = 0;
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        if ((flags[address] & TF_CODE) && (flags[address] & (TF_LEADER | TF_BLOCK)))
+        {
+            fprintf(out, "%s0x%04X,", (column++ % 8) ? " " : "\n    ", address);
+        }
+    }
+    fprintf(out, "\n};\n\n\n");
+
+    fprintf(out,
+        "static bool isCode[MEMORY_MAX];\n"
+        "static bool isLeader[MEMORY_MAX];\n"
+        "static bool stale[MEMORY_MAX];\n"
+        "static uint16_t blockOf[MEMORY_MAX];\n"
+        "\n"
+        "// Pages MemoryIO marked written, and the words the program was translated from\n"
+        "static uint8_t writtenPages[PAGE_COUNT];\n"
+        "static uint16_t translatedWords[MEMORY_MAX];\n"
+        "\n"
+        "\n"
+        "// Marks stale every block whose code differs from its translation on a page written since the last call\n"
+        "static void RetireWritten(const uint16_t* memory)\n"
+        "{\n"
+        "    for (uint32_t page = 0; page < PAGE_COUNT; ++page)\n"
+        "    {\n"
+        "        if (!writtenPages[page])\n"
+        "        {\n"
+        "            continue;\n"
+        "        }\n"
+        "        writtenPages[page] = 0;\n"
+        "        for (uint32_t word = page << PAGE_SHIFT; word < (page + 1) << PAGE_SHIFT; ++word)\n"
+        "        {\n"
+        "            if (isCode[word] && memory[word] != translatedWords[word])\n"
+        "            {\n"
+        "                stale[blockOf[word]] = true;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "}\n"
+        "\n"
+        "\n"
+        "static void RunTranslated(CPU& cpu, MemoryIO& memoryIO, Trap& trap, VirtualMachine& virtualMachine)\n"
+        "{\n"
+        "    memcpy(translatedWords, cpu.memory, sizeof(translatedWords));\n"
+        "    for (const auto& range : codeRanges)\n"
+        "    {\n"
+        "        memset(isCode + range[0], 1, range[1] - range[0] + 1);\n"
+        "    }\n"
+        "    for (uint16_t leader : leaders)\n"
+        "    {\n"
+        "        isLeader[leader] = true;\n"
+        "    }\n"
+        "    // Every code range starts with a block, and a block runs up to the next start\n"
+        "    size_t nextBlock = 0;\n"
+        "    for (uint32_t word = 0; word < MEMORY_MAX; ++word)\n"
+        "    {\n"
+        "        if (nextBlock < sizeof(blockStarts) / sizeof(blockStarts[0]) && blockStarts[nextBlock] == word)\n"
+        "        {\n"
+        "            ++nextBlock;\n"
+        "        }\n"
+        "        blockOf[word] = nextBlock ? blockStarts[nextBlock - 1] : 0;\n"
+        "    }\n"
+        "\n"
+        "    uint16_t* registers = cpu.registers;\n"
+        "    uint16_t r0, r1, r2, r3, r4, r5, r6, r7, cond;\n"
+        "    uint16_t pc = registers[R_PC];\n"
+        "    uint16_t address;\n"
+        "\n"
+        "#define LC3_LOAD() (r0 = registers[R_0], r1 = registers[R_1], r2 = registers[R_2], r3 = registers[R_3], \\\n"
+        "    r4 = registers[R_4], r5 = registers[R_5], r6 = registers[R_6], r7 = registers[R_7], cond = registers[R_COND])\n"
+        "#define LC3_SAVE() (registers[R_0] = r0, registers[R_1] = r1, registers[R_2] = r2, registers[R_3] = r3, \\\n"
+        "    registers[R_4] = r4, registers[R_5] = r5, registers[R_6] = r6, registers[R_7] = r7, registers[R_COND] = cond)\n"
+        "#define LC3_STORE(target, value, resume) \\\n"
+        "    { address = (target); memoryIO.Write(address, value); \\\n"
+        "      if (isCode[address]) { stale[blockOf[address]] = true; pc = (resume); goto interpret; } }\n"
+        "\n"
+        "    LC3_LOAD();\n"
+        "    goto dispatch;\n"
+        "\n");
+
+    uint32_t uncounted = 0;
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        if (!(flags[address] & TF_CODE))
+        {
+            continue;
+        }
+
+        uint16_t instruction = cpuPtr->memory[address];
+
+        if (flags[address] & TF_LEADER)
+        {
+            fprintf(out, "L_%04X:\n", address);
+        }
+        if (flags[address] & (TF_LEADER | TF_BLOCK))
+        {
+            fprintf(out, "    if (stale[0x%04X]) { pc = 0x%04X; goto interpret; }\n", address, address);
+        }
+
+        if (++uncounted, ObservesCount(instruction) || EndsBlock((uint16_t)address))
+        {
+            fprintf(out, "    cpu.instructionCount += %u;\n", uncounted);
+            uncounted = 0;
+        }
+
+        EmitInstruction(out, (uint16_t)address, instruction);
+
+        // Leave through the dispatcher when the code run ends without a jump
+        if (FallsThrough(instruction) && (address + 1 == MEMORY_MAX || !(flags[address + 1] & TF_CODE)))
+        {
+            fprintf(out, "    pc = 0x%04X;\n    goto dispatch;\n", (uint16_t)(address + 1));
+        }
+    }
+
+    fprintf(out, "\ndispatch:\n    switch (pc)\n    {\n");
+    for (uint32_t address = 0; address < MEMORY_MAX; ++address)
+    {
+        if ((flags[address] & TF_CODE) && (flags[address] & TF_LEADER))
+        {
+            fprintf(out, "    case 0x%04X: goto L_%04X;\n", address, address);
+        }
+    }
+    fprintf(out,
+        "    default: break;\n"
+        "    }\n"
+        "\n"
+        "interpret:\n"
+        "    // Not a translated block, or the program wrote over its own code: hand over to the interpreter\n"
+        "    // until it reaches a block whose translation is still valid\n"
+        "    LC3_SAVE();\n"
+        "    registers[R_PC] = pc;\n"
+        "    do\n"
+        "    {\n"
+        "        do\n"
+        "        {\n"
+        "            virtualMachine.Step();\n"
+        "        } while (cpu.running && (!isLeader[registers[R_PC]] || stale[registers[R_PC]]));\n"
+        "\n"
+        "        // The interpreter's stores did not go through LC3_STORE, so the block reached may have been patched\n"
+        "        RetireWritten(cpu.memory);\n"
+        "    } while (cpu.running && stale[registers[R_PC]]);\n"
+        "\n"
+        "    if (!cpu.running) return;\n"
+        "    LC3_LOAD();\n"
+        "    pc = registers[R_PC];\n"
+        "    goto dispatch;\n"
+        "}\n\n\n");
+}
+
+
+/**
+ * @brief Emits the image data and a main function wiring the machine the same way main.cpp does.
+ *
+ * @param out The output stream.
+ */
+void Translator::EmitMain(FILE* out) const
+{
+    for (size_t i = 0; i < cpuPtr->segments.size(); ++i)
+    {
+        const ImageSegment& segment = cpuPtr->segments[i];
+        fprintf(out, "static const uint16_t segment%zu[] =\n{", i);
+        for (uint32_t j = 0; j < segment.length; ++j)
+        {
+            fprintf(out, "%s0x%04X,", (j % 8) ? " " : "\n    ", cpuPtr->memory[segment.origin + j]);
+        }
+        fprintf(out, "\n};\n\n");
+    }
+
+    fprintf(out,
+        "\n"
+        "int main()\n"
+        "{\n"
+        "    Options options;\n"
+        "    CPU cpu;\n"
+        "    OS os;\n"
+        "    Timer timer(&cpu, options.timerInstructionsPerTick, options.timerRealTime);\n"
+        "    Trap trap(cpu.memory, cpu.registers, &cpu, &os);\n"
+        "    MemoryIO memoryIO(cpu.memory, &os, &timer);\n"
+        "    ArithmeticLogicUnit alu(cpu.memory, cpu.registers, &memoryIO, &cpu);\n"
+        "    VirtualMachine virtualMachine(&cpu, &os, &trap, &memoryIO, &alu);\n"
+        "\n");
+    for (size_t i = 0; i < cpuPtr->segments.size(); ++i)
+    {
+        const ImageSegment& segment = cpuPtr->segments[i];
+        fprintf(out, "    memcpy(cpu.memory + 0x%04X, segment%zu, sizeof(segment%zu));\n", segment.origin, i, i);
+        fprintf(out, "    cpu.segments.push_back({ 0x%04X, %u });\n", segment.origin, segment.length);
+    }
+    fprintf(out,
+        "\n"
+        "    // Stores of the interpreter the translated code falls back to mark their pages, for RetireWritten\n"
+        "    memoryIO.SetDirtyPages(writtenPages);\n"
+        "\n"
+        "    signal(SIGINT, OS::HandleInterruptWrapper);\n"
+        "    os.DisableInputBuffering();\n"
+        "    RunTranslated(cpu, memoryIO, trap, virtualMachine);\n"
+        "    os.RestoreInputBuffering();\n"
+        "}\n");
+}
+
+
+/**
+ * @brief Translates the loaded images into a C++ translation unit.
+ *
+ * The generated file is compiled together with the virtual machine sources, except main.cpp,
+ * into a standalone executable.
+ *
+ * @param outputPath The path of the C++ file to write.
+ * @return Returns 1 if the file was written, 0 otherwise.
+ */
+int Translator::Translate(const char* outputPath)
+{
+    memset(flags, 0, sizeof(flags));
+    for (const ImageSegment& segment : cpuPtr->segments)
+    {
+        memset(flags + segment.origin, TF_LOADED, segment.length);
+    }
+
+    Discover(cpuPtr->registers[Registers::R_PC]);
+
+    FILE* out = fopen(outputPath, "w");
+    if (!out)
+    {
+        return 0;
+    }
+
+    fprintf(out,
+        "// Generated by lc3 --translate. Do not edit.\n"
+        "// Compile together with the virtual machine sources, except main.cpp.\n"
+        "\n"
+        "\n"
+        "#define _CRT_SECURE_NO_DEPRECATE\n"
+        "\n"
+        "\n"
+        "#include <cstdlib>\n"
+        "#include <cstring>\n"
+        "\n"
+        "\n"
+        "#include \"Trap.h\"\n"
+        "#include \"MemoryIO.h\"\n"
+        "#include \"ArithmeticLogicUnit.h\"\n"
+        "#include \"OS.h\"\n"
+        "#include \"CPU.h\"\n"
+        "#include \"Timer.h\"\n"
+        "#include \"Options.h\"\n"
+        "#include \"VirtualMachine.h\"\n"
+        "\n"
+        "\n"
+        "#define LC3_FLAGS(value) ((value) == 0 ? FL_ZERO : ((value) >> 15) ? FL_NEGATIVE : FL_POSITIVE)\n"
+        "\n"
+        "\n");
+
+    EmitRunFunction(out);
+    EmitMain(out);
+
+    fclose(out);
+    return 1;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef TRANSLATOR_H
+#define TRANSLATOR_H
+
+
+#include <cstdint>
+#include <cstdio>
+
+#include "CPU.h"
+
+
+class ArithmeticLogicUnit;
+
+
+enum TranslatorFlags : uint8_t
+{
+    // The word was loaded from an image file.
+    TF_LOADED = (1 << 0),
+
+    // The word was reached by control-flow recovery and is translated as an instruction.
+    TF_CODE = (1 << 1),
+
+    // The word starts a basic block that can be entered by a jump.
+    TF_LEADER = (1 << 2),
+
+    // The word starts a block for instruction counting (a leader or the word after a control transfer).
+    TF_BLOCK = (1 << 3)
+};
+
+
+class Translator
+{
+private:
+    CPU* cpuPtr;
+    ArithmeticLogicUnit* aluPtr;
+
+    // Analysis state for every address of the image.
+    uint8_t flags[MEMORY_MAX];
+
+    void Discover(uint16_t entry);
+    bool EndsBlock(uint16_t address) const;
+    void EmitTarget(FILE* out, uint16_t target) const;
+    void EmitInstruction(FILE* out, uint16_t address, uint16_t instruction) const;
+    void EmitRunFunction(FILE* out) const;
+    void EmitMain(FILE* out) const;
+
+public:
+    Translator(CPU* cpu, ArithmeticLogicUnit* alu);
+
+    int Translate(const char* outputPath);
+};
+#endif
\ No newline at end of file
@@ -10,23 +10,194 @@ Copyright 
 
 #include "Trap.h"
 #include "CPU.h"
+#include "OS.h"
+#include "Metrics.h"
+#include "LatencyTrace.h"
+#include "Mmu.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRAP_SSE2
+#endif
+
+
+/**
+ * @brief Counts the words before the first null word, looking at no more than limit words.
+ *
+ * @param words The string in memory.
+ * @param limit Number of words up to the end of memory.
+ * @return Length of the string, or limit if it is not terminated before the end of memory.
+ */
+static uint32_t StringLength(const uint16_t* words, uint32_t limit)
+{
+    uint32_t i = 0;
+#ifdef TRAP_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= limit; i += 8)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(words + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(block, zero));
+        if (mask)
+        {
+            // Two mask bits per word
+            for (int bit = 0; ; bit += 2)
+            {
+                if (mask & (1 << bit))
+                {
+                    return i + bit / 2;
+                }
+            }
+        }
+    }
+#endif
+    while (i < limit && words[i])
+    {
+        ++i;
+    }
+    return i;
+}
+
+
+/**
+ * @brief Keeps the low byte of every word, as PUTS prints one character per word.
+ */
+static void NarrowWords(const uint16_t* words, uint32_t count, char* out)
+{
+    uint32_t i = 0;
+#ifdef TRAP_SSE2
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i first = _mm_and_si128(_mm_loadu_si128((const __m128i*)(words + i)), lowBytes);
+        __m128i second = _mm_and_si128(_mm_loadu_si128((const __m128i*)(words + i + 8)), lowBytes);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(first, second));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        out[i] = (char)words[i];
+    }
+}
+
+
+/**
+ * @brief Unpacks two characters per word, low byte first, as PUTSP prints them.
+ *
+ * A null high byte is skipped. Blocks without one are already in output order in host memory.
+ *
+ * @return Number of characters written.
+ */
+static uint32_t UnpackWords(const uint16_t* words, uint32_t count, char* out)
+{
+    uint32_t i = 0;
+    uint32_t length = 0;
+#ifdef TRAP_SSE2
+    const __m128i highBytes = _mm_set1_epi16((short)0xFF00);
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 8 <= count)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(words + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, highBytes), zero)) == 0)
+        {
+            _mm_storeu_si128((__m128i*)(out + length), block);
+            length += 16;
+            i += 8;
+            continue;
+        }
+
+        for (uint32_t end = i + 8; i < end; ++i)
+        {
+            out[length++] = (char)words[i];
+            out[length] = (char)(words[i] >> 8);
+            length += out[length] != 0;
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        out[length++] = (char)words[i];
+        out[length] = (char)(words[i] >> 8);
+        length += out[length] != 0;
+    }
+    return length;
+}
 
 
 /**
- * @brief Constructs a Trap object with references to memory, registers, and CPU.
+ * @brief Constructs a Trap object with references to memory, registers, CPU, and OS.
  *
  * This constructor initializes the Trap object with references to the memory, registers,
- * and CPU components of the virtual machine.
+ * CPU and OS components of the virtual machine.
  *
  * @param memory Pointer to the memory array of the virtual machine.
  * @param registers Pointer to the registers array of the virtual machine.
  * @param cpu Pointer to the CPU object controlling the virtual machine's operation.
+ * @param os Pointer to the OS object performing console input and output.
  */
-Trap::Trap(uint16_t* memory, uint16_t* registers, CPU* cpu)
+Trap::Trap(uint16_t* memory, uint16_t* registers, CPU* cpu, OS* os)
 {
     memoryPtr = memory;
     registersPtr = registers;
     cpuPtr = cpu;
+    osPtr = os;
+
+    // Room for every word of memory unpacked into two characters
+    outputBuffer.resize(2 * MEMORY_MAX);
+}
+
+
+/**
+ * @brief Attaches the live metrics that count trap calls per vector.
+ *
+ * @param metrics Pointer to the Metrics object, or nullptr to skip counting.
+ */
+void Trap::SetMetrics(Metrics* metrics)
+{
+    metricsPtr = metrics;
+}
+
+
+/**
+ * @brief Attaches the latency trace told when GETC and IN hand a character to the program.
+ *
+ * @param latencyTrace Pointer to the LatencyTrace object, or nullptr to stop tracing.
+ */
+void Trap::SetLatencyTrace(LatencyTrace* latencyTrace)
+{
+    latencyTracePtr = latencyTrace;
+}
+
+
+/**
+ * @brief Attaches the MMU through which string outputs read the memory of the running process.
+ *
+ * @param mmu Pointer to the Mmu object, or nullptr to read CPU::memory.
+ */
+void Trap::SetMmu(Mmu* mmu)
+{
+    mmuPtr = mmu;
+    stringBuffer.resize(mmu ? MEMORY_MAX : 0);
+}
+
+
+/**
+ * @brief Finds the null-terminated string at the address in register R0.
+ *
+ * @param length Receives the length of the string, which stops at the end of memory if it is not terminated before.
+ * @return The words of the string.
+ */
+const uint16_t* Trap::FindString(uint32_t* length)
+{
+    uint16_t address = registersPtr[Registers::R_0];
+    if (mmuPtr)
+    {
+        // Consecutive pages may map frames anywhere in host memory
+        *length = mmuPtr->ReadString(address, stringBuffer.data());
+        return stringBuffer.data();
+    }
+
+    *length = StringLength(memoryPtr + address, MEMORY_MAX - address);
+    return memoryPtr + address;
 }
 
 
@@ -42,6 +213,11 @@ void Trap::Proxy(uint16_t instruction)
     // Save the return address
     registersPtr[Registers::R_7] = registersPtr[Registers::R_PC];
 
+    if (metricsPtr)
+    {
+        metricsPtr->CountTrap(instruction & 0x00FF);
+    }
+
     // Switch based on the trap vector
     switch (instruction & 0x00FF)
     {
@@ -75,7 +251,11 @@ void Trap::Proxy(uint16_t instruction)
 void Trap::GETC()
 {
     // Read character from console
-    registersPtr[Registers::R_0] = (uint16_t)getchar();
+    registersPtr[Registers::R_0] = (uint16_t)osPtr->GetChar();
+    if (latencyTracePtr)
+    {
+        latencyTracePtr->Consume();
+    }
     // Update condition flags based on the result
     cpuPtr->UpdateFlags(Registers::R_0);
 }
@@ -88,9 +268,9 @@ void Trap::GETC()
 void Trap::OUTC()
 {
     // Output character to console
-    putc((char)registersPtr[Registers::R_0], stdout);
+    osPtr->PutChar((char)registersPtr[Registers::R_0]);
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    osPtr->FlushOutput();
 }
 
 
@@ -101,17 +281,15 @@ void Trap::OUTC()
  */
 void Trap::PUTS()
 {
-    // Iterate through memory and output characters until null terminator is encountered
-    uint16_t* c = memoryPtr + registersPtr[Registers::R_0];
-    while (*c)
-    {
-        // Output character to console
-        putc((char)*c, stdout);
-        // Move to the next character in memory
-        ++c;
-    }
+    // Find the null terminator, stopping at the end of memory instead of running past it
+    uint32_t length;
+    const uint16_t* words = FindString(&length);
+
+    // Output one character per word in a single write
+    NarrowWords(words, length, outputBuffer.data());
+    osPtr->PutBytes(outputBuffer.data(), length);
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    osPtr->FlushOutput();
 }
 
 
@@ -122,14 +300,18 @@ void Trap::PUTS()
  */
 void Trap::INC()
 {
-    printf("Enter a character: ");
+    osPtr->PutString("Enter a character: ");
 
     // Read character from console
-    char c = getchar();
+    char c = osPtr->GetChar();
+    if (latencyTracePtr)
+    {
+        latencyTracePtr->Consume();
+    }
     // Output character to console
-    putc(c, stdout);
+    osPtr->PutChar(c);
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    osPtr->FlushOutput();
     // Store ASCII value of character in register R0
     registersPtr[Registers::R_0] = (uint16_t)c;
     // Update condition flags based on the result
@@ -144,24 +326,16 @@ void Trap::INC()
  */
 void Trap::PUTSP()
 {
-    // Iterate through memory and output characters until null terminator is encountered
-    uint16_t* c = memoryPtr + registersPtr[Registers::R_0];
-    while (*c)
-    {
-        // Extract lower 8 bits of the word
-        char char1 = (*c) & 0x00FF;
-        // Output lower byte to console
-        putc(char1, stdout);
-        // Extract upper 8 bits of the word
-        char char2 = (*c) >> 8;
-        // Output upper byte to console if not null
-        if (char2) putc(char2, stdout);
-        // Move to the next word in memory
-        ++c;
-    }
+    // Find the null terminator, stopping at the end of memory instead of running past it
+    uint32_t length;
+    const uint16_t* words = FindString(&length);
+
+    // Output the lower, then the upper byte of every word, skipping a null upper byte, in a single write
+    uint32_t characters = UnpackWords(words, length, outputBuffer.data());
+    osPtr->PutBytes(outputBuffer.data(), characters);
 
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    osPtr->FlushOutput();
 }
 
 
@@ -172,9 +346,9 @@ void Trap::PUTSP()
  */
 void Trap::HALT()
 {
-    puts("HALT");
+    osPtr->PutString("HALT\n");
     // Flush output buffer to ensure immediate display
-    fflush(stdout);
+    osPtr->FlushOutput();
     // Set 'running' flag to false to halt execution
     cpuPtr->running = 0;
 }
@@ -13,9 +13,14 @@ Copyright 
 
 
 #include <cstdint>
+#include <vector>
 
 
 class CPU;
+class OS;
+class Metrics;
+class LatencyTrace;
+class Mmu;
 
 
 enum TrapCodes : uint16_t
@@ -35,9 +40,25 @@ private:
     uint16_t* memoryPtr;
     uint16_t* registersPtr;
     CPU* cpuPtr;
+    OS* osPtr;
+    Metrics* metricsPtr = nullptr;
+    LatencyTrace* latencyTracePtr = nullptr;
+    Mmu* mmuPtr = nullptr;
+
+    // Characters of one string output, written to the OS in a single call.
+    std::vector<char> outputBuffer;
+
+    // Words of a string gathered from the pages of a process, with an MMU attached.
+    std::vector<uint16_t> stringBuffer;
+
+    const uint16_t* FindString(uint32_t* length);
 
 public:
-    Trap(uint16_t* memory, uint16_t* registers, CPU* cpu);
+    Trap(uint16_t* memory, uint16_t* registers, CPU* cpu, OS* os);
+
+    void SetMetrics(Metrics* metrics);
+    void SetLatencyTrace(LatencyTrace* latencyTrace);
+    void SetMmu(Mmu* mmu);
 
     void Proxy(uint16_t instruction);
 
@@ -14,6 +14,41 @@ Copyright 
 #include "MemoryIO.h"
 #include "OS.h"
 #include "Trap.h"
+#include "Options.h"
+#include "DecodeCache.h"
+#include "IrTier.h"
+#include "PerfCounters.h"
+#include "Recorder.h"
+#include "Debugger.h"
+#include "GdbStub.h"
+#include "Metrics.h"
+#include "ObjectFile.h"
+#include "StateHash.h"
+#include "CodeMap.h"
+#include "CycleModel.h"
+#include "Mmu.h"
+#include "VmCore.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+// Decode cache still to be persisted if the process exits early, e.g. from the Ctrl+C handler.
+static DecodeCache* exitDecodeCache = nullptr;
+static const char* exitCacheDirectory = nullptr;
+
+
+/**
+ * @brief Persists the pending decode cache when the process exits before the program halts.
+ */
+static void SaveDecodeCacheAtExit()
+{
+    if (exitDecodeCache)
+    {
+        exitDecodeCache->Save(exitCacheDirectory);
+    }
+}
 
 
 VirtualMachine::VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO, ArithmeticLogicUnit* alu)
@@ -26,26 +61,98 @@ VirtualMachine::VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO,
 }
 
 
-void VirtualMachine::RunVirtualMachine(int argc, const char* argv[])
+/**
+ * @brief Loads every image file given on the command line into memory.
+ *
+ * Exits the program with code 1 if an image cannot be read.
+ *
+ * @param options Parsed command-line options holding the image paths.
+ */
+void VirtualMachine::LoadImages(const Options* options)
 {
-    // Check if at least one image file is provided as a command-line argument
-    if (argc < 2)
+    // Iterate over the image files given on the command line
+    for (const char* imagePath : options->imagePaths)
     {
-        // Display usage information and exit if no image files are provided
-        printf("lc3 [image-file1] ...\n");
-        exit(2);
+        // Attempt to read the image file specified by the current command-line argument
+        if (!cpuPtr->ReadImage(imagePath, aluPtr))
+        {
+            // Print error message if image file cannot be loaded and exit with error code 1
+            printf("failed to load image: %s\n", imagePath);
+            exit(1);
+        }
     }
 
-    // Iterate over command-line arguments (excluding the program name)
-    for (int j = 1; j < argc; ++j)
+    ObjectFile objectFile(cpuPtr);
+    if (options->symbolsPath && !objectFile.ReadSymbols(options->symbolsPath))
     {
-        // Attempt to read the image file specified by the current command-line argument
-        if (!cpuPtr->ReadImage(argv[j], aluPtr))
+        printf("failed to load symbols: %s\n", options->symbolsPath);
+        exit(1);
+    }
+}
+
+
+/**
+ * @brief Loads every image file given on the command line as its own process, or as several copies.
+ *
+ * Exits the program with code 1 if an image cannot be read.
+ *
+ * @param options Parsed command-line options holding the image paths and the number of copies.
+ */
+void VirtualMachine::LoadProcesses(const Options* options)
+{
+    for (const char* imagePath : options->imagePaths)
+    {
+        memset(cpuPtr->memory, 0, sizeof(cpuPtr->memory));
+        cpuPtr->segments.clear();
+        memset(cpuPtr->registers, 0, sizeof(cpuPtr->registers));
+        cpuPtr->registers[Registers::R_COND] = ConditionFlags::FL_ZERO;
+        cpuPtr->registers[Registers::R_PC] = PC::PC_START;
+
+        if (!cpuPtr->ReadImage(imagePath, aluPtr))
         {
-            // Print error message if image file cannot be loaded and exit with error code 1
-            printf("failed to load image: %s\n", argv[j]);
+            printf("failed to load image: %s\n", imagePath);
             exit(1);
         }
+
+        uint32_t process = mmuPtr->CreateProcess(imagePath);
+        for (uint32_t copy = 1; copy < options->mmuProcesses; ++copy)
+        {
+            mmuPtr->Clone(process);
+        }
+    }
+
+    // The processes have their own copies; the flat memory only keeps the device registers
+    memset(cpuPtr->memory, 0, sizeof(cpuPtr->memory));
+    cpuPtr->segments.clear();
+}
+
+
+void VirtualMachine::RunVirtualMachine(const Options* options)
+{
+    if (mmuPtr)
+    {
+        LoadProcesses(options);
+    }
+    else
+    {
+        LoadImages(options);
+    }
+
+    if (stateHashPtr)
+    {
+        // Images are loaded without going through MemoryIO, so hash them once in full
+        stateHashPtr->Recompute();
+    }
+
+    if (codeMapPtr)
+    {
+        // Before anything is decoded, so every page decoded later can be reclassified
+        codeMapPtr->Classify();
+    }
+
+    if (cycleModelPtr)
+    {
+        cycleModelPtr->Start();
     }
 
     // Set up a signal handler for interrupt signal (Ctrl+C)
@@ -54,58 +161,560 @@ void VirtualMachine::RunVirtualMachine(int argc, const char* argv[])
     // Disable input buffering to allow direct console input
     osPtr->DisableInputBuffering();
 
+    if (perfCountersPtr)
+    {
+        perfCountersPtr->Start();
+    }
+
+    if (recorderPtr)
+    {
+        RunRecorded(options);
+    }
+    else if (gdbStubPtr)
+    {
+        // Serve the remote debugger, then run on freely once it detaches
+        if (gdbStubPtr->Serve())
+        {
+            Run();
+        }
+    }
+    else if (debuggerPtr)
+    {
+        // Breakpoints need the plain interpreter, which checks them between instructions
+        if (debuggerPtr->RunConsole())
+        {
+            debuggerPtr->Run();
+        }
+    }
+    else if (mmuPtr)
+    {
+        RunProcesses(options);
+    }
+    else if (decodeCachePtr)
+    {
+        // Key the persisted decode cache by the image contents before the program changes them
+        decodeCachePtr->HashImage();
+        if (options->cacheDirectory)
+        {
+            decodeCachePtr->Load(options->cacheDirectory);
+
+            exitDecodeCache = decodeCachePtr;
+            exitCacheDirectory = options->cacheDirectory;
+            atexit(SaveDecodeCacheAtExit);
+        }
+
+        if (metricsPtr)
+        {
+            RunMetered();
+        }
+        else
+        {
+            RunDecoded(UINT64_MAX);
+        }
+
+        if (options->cacheDirectory)
+        {
+            decodeCachePtr->Save(options->cacheDirectory);
+            exitDecodeCache = nullptr;
+        }
+    }
+    else if (metricsPtr)
+    {
+        // The run is sliced at the publishing interval rather than checked per instruction
+        RunMetered();
+    }
+    else
+    {
+        Run();
+    }
+
+    if (metricsPtr)
+    {
+        metricsPtr->Publish(false);
+    }
+
+    if (cycleModelPtr)
+    {
+        cycleModelPtr->Finish();
+    }
+
+    if (perfCountersPtr)
+    {
+        perfCountersPtr->Stop();
+    }
+
+    osPtr->RestoreInputBuffering();
+
+    if (perfCountersPtr)
+    {
+        perfCountersPtr->Report(stderr, cpuPtr->instructionCount);
+    }
+}
+
+
+/**
+ * @brief Executes instructions until the program halts.
+ *
+ * Runs on a VmCore whose memory accesses bypass MemoryIO unless something attached to it observes them.
+ */
+void VirtualMachine::Run()
+{
+    RunCore(UINT64_MAX);
+}
+
+
+/**
+ * @brief Executes instructions on a VmCore until the program halts or the instruction count reaches limit.
+ *
+ * Like Step, aborts on an RTI or reserved opcode.
+ *
+ * @param limit Instruction count at which to return.
+ */
+void VirtualMachine::RunCore(uint64_t limit)
+{
+    int result;
+    if (cycleModelPtr)
+    {
+        // The cycle model is also told about writes, so memory is always observed
+        VmCore<ObservedMemory, MachineIo, CycleAccounting> core(cpuPtr, ObservedMemory(memoryIOPtr), MachineIo(memoryIOPtr, trapPtr), CycleAccounting(cycleModelPtr));
+        result = core.Run(limit);
+    }
+    else if (memoryIOPtr->Observed())
+    {
+        VmCore<ObservedMemory, MachineIo, NoInstrumentation> core(cpuPtr, ObservedMemory(memoryIOPtr), MachineIo(memoryIOPtr, trapPtr), NoInstrumentation());
+        result = core.Run(limit);
+    }
+    else
+    {
+        VmCore<FlatMemory, MachineIo, NoInstrumentation> core(cpuPtr, FlatMemory(cpuPtr->memory), MachineIo(memoryIOPtr, trapPtr), NoInstrumentation());
+        result = core.Run(limit);
+    }
+
+    if (result == VC_ILLEGAL)
+    {
+        abort();
+    }
+}
+
+
+/**
+ * @brief Executes the single instruction at the program counter.
+ *
+ * Runs on a VmCore with a limit of one instruction, so stepping shares the core's semantics.
+ */
+void VirtualMachine::Step()
+{
+    RunCore(cpuPtr->instructionCount + 1);
+    PublishDue();
+}
+
+
+/**
+ * @brief Executes instructions on a VmCore until the program halts, the instruction count reaches
+ * limit, or the debugger needs to look at the next instruction.
+ *
+ * Plain memory bypasses MemoryIO unless something attached observes it; the debugger only does
+ * while a watchpoint is set. The run also returns when the metrics are due to be published.
+ *
+ * @param debugger The Debugger whose breakpoint pages and watchpoint hits stop the run.
+ * @param limit Instruction count at which to return.
+ */
+void VirtualMachine::RunDebugged(Debugger* debugger, uint64_t limit)
+{
+    if (metricsPtr)
+    {
+        limit = std::min(limit, nextPublish);
+    }
+
+    int result;
+    if (memoryIOPtr->Observed())
+    {
+        VmCore<ObservedMemory, MachineIo, DebugStops> core(cpuPtr, ObservedMemory(memoryIOPtr), MachineIo(memoryIOPtr, trapPtr), DebugStops(debugger));
+        result = core.Run(limit);
+    }
+    else
+    {
+        VmCore<FlatMemory, MachineIo, DebugStops> core(cpuPtr, FlatMemory(cpuPtr->memory), MachineIo(memoryIOPtr, trapPtr), DebugStops(debugger));
+        result = core.Run(limit);
+    }
+
+    if (result == VC_ILLEGAL)
+    {
+        abort();
+    }
+    PublishDue();
+}
+
+
+/**
+ * @brief Publishes the metrics once the publish interval has elapsed, for the run loops that
+ * return to their caller often: stepping, debugging and recording.
+ */
+void VirtualMachine::PublishDue()
+{
+    if (metricsPtr && cpuPtr->instructionCount >= nextPublish)
+    {
+        metricsPtr->Publish(true);
+        nextPublish = cpuPtr->instructionCount + METRICS_PUBLISH_INTERVAL;
+    }
+}
+
+
+/**
+ * @brief Attaches the decode cache used by RunDecoded.
+ *
+ * @param decodeCache Pointer to the DecodeCache object, or nullptr to use the plain interpreter.
+ */
+void VirtualMachine::SetDecodeCache(DecodeCache* decodeCache)
+{
+    decodeCachePtr = decodeCache;
+}
+
+
+/**
+ * @brief Attaches the IR tier RunDecoded hands hot regions to.
+ *
+ * @param irTier Pointer to the IrTier object, or nullptr to only execute decoded instructions.
+ */
+void VirtualMachine::SetIrTier(IrTier* irTier)
+{
+    irTierPtr = irTier;
+}
+
+
+/**
+ * @brief Attaches the code map classified once the images are loaded.
+ *
+ * @param codeMap Pointer to the CodeMap object, or nullptr to leave every page unclassified.
+ */
+void VirtualMachine::SetCodeMap(CodeMap* codeMap)
+{
+    codeMapPtr = codeMap;
+}
+
+
+/**
+ * @brief Attaches the performance counters measured around the run loop.
+ *
+ * @param perfCounters Pointer to the PerfCounters object, or nullptr to skip measuring.
+ */
+void VirtualMachine::SetPerfCounters(PerfCounters* perfCounters)
+{
+    perfCountersPtr = perfCounters;
+}
+
+
+/**
+ * @brief Attaches the recorder that records or replays the run.
+ *
+ * @param recorder Pointer to the Recorder object, or nullptr to run unrecorded.
+ */
+void VirtualMachine::SetRecorder(Recorder* recorder)
+{
+    recorderPtr = recorder;
+}
+
+
+/**
+ * @brief Attaches the debugger console opened before the program resumes.
+ *
+ * @param debugger Pointer to the Debugger object, or nullptr to run without a console.
+ */
+void VirtualMachine::SetDebugger(Debugger* debugger)
+{
+    debuggerPtr = debugger;
+}
+
+
+/**
+ * @brief Attaches the remote debugger stub that controls the run.
+ *
+ * @param gdbStub Pointer to the GdbStub object, or nullptr to run without one.
+ */
+void VirtualMachine::SetGdbStub(GdbStub* gdbStub)
+{
+    gdbStubPtr = gdbStub;
+}
+
+
+/**
+ * @brief Attaches the live metrics published while the program runs.
+ *
+ * @param metrics Pointer to the Metrics object, or nullptr to run unobserved.
+ */
+void VirtualMachine::SetMetrics(Metrics* metrics)
+{
+    metricsPtr = metrics;
+}
+
+
+/**
+ * @brief Attaches the state hash that is seeded once the images are loaded.
+ *
+ * @param stateHash Pointer to the StateHash object, or nullptr to skip hashing.
+ */
+void VirtualMachine::SetStateHash(StateHash* stateHash)
+{
+    stateHashPtr = stateHash;
+}
+
+
+/**
+ * @brief Attaches the cycle model started once the images are loaded and told about every control transfer.
+ *
+ * @param cycleModel Pointer to the CycleModel object, or nullptr to only count instructions.
+ */
+void VirtualMachine::SetCycleModel(CycleModel* cycleModel)
+{
+    cycleModelPtr = cycleModel;
+}
+
+
+/**
+ * @brief Attaches the MMU whose processes RunVirtualMachine loads and runs instead of one program.
+ *
+ * @param mmu Pointer to the Mmu object, or nullptr to run one program in flat memory.
+ */
+void VirtualMachine::SetMmu(Mmu* mmu)
+{
+    mmuPtr = mmu;
+}
+
+
+/**
+ * @brief Runs the MMU's processes round robin until all of them halt.
+ *
+ * A process is switched out when its quantum of instructions ends, which the core checks as its
+ * instruction limit, and after every trap it executes.
+ *
+ * @param options Options holding the quantum.
+ */
+void VirtualMachine::RunProcesses(const Options* options)
+{
+    VmCore<MappedMemory, ProcessIo, NoInstrumentation> core(cpuPtr, MappedMemory(mmuPtr), ProcessIo(memoryIOPtr, trapPtr, mmuPtr), NoInstrumentation());
+
+    uint32_t count = mmuPtr->ProcessCount();
+    uint32_t live = count;
+    nextPublish = cpuPtr->instructionCount + METRICS_PUBLISH_INTERVAL;
+
+    for (uint32_t next = 0; live; next = (next + 1) % count)
+    {
+        if (!mmuPtr->Switch(next))
+        {
+            continue;
+        }
+
+        int result = core.Run(cpuPtr->instructionCount + options->mmuQuantum);
+        if (result == VC_HALTED)
+        {
+            mmuPtr->Exit();
+            --live;
+        }
+        else if (result == VC_ILLEGAL)
+        {
+            abort();
+        }
+
+        if (metricsPtr && cpuPtr->instructionCount >= nextPublish)
+        {
+            metricsPtr->Publish(true);
+            nextPublish = cpuPtr->instructionCount + METRICS_PUBLISH_INTERVAL;
+        }
+    }
+}
+
+
+/**
+ * @brief Executes instructions until the program halts, publishing the metrics at a fixed instruction interval.
+ *
+ * Runs from the decode cache when one is attached, on a VmCore otherwise.
+ */
+void VirtualMachine::RunMetered()
+{
     while (cpuPtr->running)
     {
+        uint64_t limit = cpuPtr->instructionCount + METRICS_PUBLISH_INTERVAL;
+        if (decodeCachePtr)
+        {
+            RunDecoded(limit);
+        }
+        else
+        {
+            RunCore(limit);
+        }
+
+        if (cpuPtr->running)
+        {
+            metricsPtr->Publish(true);
+        }
+    }
+}
+
+
+/**
+ * @brief Executes instructions while recording or replaying.
+ *
+ * When recording, a checkpoint is written before the first instruction and whenever the checkpoint
+ * interval has elapsed. When replaying, the machine starts from the recording's first checkpoint
+ * and optionally seeks. An attached debugger opens its console first and stops at breakpoints.
+ *
+ * The core runs up to the next checkpoint in one go: it writes the instruction count back before
+ * every device access and trap, where input is recorded or replayed.
+ *
+ * @param options Options holding the recording and seek settings.
+ */
+void VirtualMachine::RunRecorded(const Options* options)
+{
+    if (options->recordPath)
+    {
+        recorderPtr->Checkpoint();
+    }
+    else
+    {
+        recorderPtr->Rewind();
+        if (options->seek)
+        {
+            recorderPtr->Seek(options->seekInstruction);
+        }
+    }
+
+    bool quit = debuggerPtr && !debuggerPtr->RunConsole();
+
+    while (cpuPtr->running && !quit)
+    {
+        if (debuggerPtr && debuggerPtr->ShouldBreak() && !debuggerPtr->RunConsole())
+        {
+            quit = true;
+            break;
+        }
+
+        if (debuggerPtr)
+        {
+            // The instruction at the program counter may be a breakpoint the program resumes from
+            Step();
+            RunDebugged(debuggerPtr, recorderPtr->NextCheckpoint());
+        }
+        else
+        {
+            RunCore(metricsPtr ? std::min(recorderPtr->NextCheckpoint(), nextPublish) : recorderPtr->NextCheckpoint());
+            PublishDue();
+        }
+
+        if (cpuPtr->instructionCount >= recorderPtr->NextCheckpoint())
+        {
+            recorderPtr->Checkpoint();
+        }
+    }
+
+    if (options->recordPath)
+    {
+        recorderPtr->StopRecording(quit);
+    }
+}
 
-        // Fetch Instruction. Read the memory location pointed by program counter.
-        uint16_t instruction = memoryIOPtr->Read(cpuPtr->registers[Registers::R_PC]++);
 
-        // Extract the opcode from the instruction by considering bits [15:12]
-        uint16_t operation = (instruction >> 12);
+/**
+ * @brief Executes instructions from the decode cache until the program halts or the instruction count reaches limit.
+ *
+ * Each word is decoded once and then executed from its decoded form; writes to memory
+ * invalidate the affected entries through MemoryIO. With an IR tier attached, every address
+ * reached other than by falling through is offered to it, and the hot ones run as regions.
+ *
+ * @param limit Instruction count at which to return; a fused pair or a region may run past it.
+ */
+void VirtualMachine::RunDecoded(uint64_t limit)
+{
+    uint16_t* registers = cpuPtr->registers;
+    uint16_t fallthrough = registers[Registers::R_PC];
 
-        switch (operation)
+    while (cpuPtr->running && cpuPtr->instructionCount < limit)
+    {
+        uint16_t pc = registers[Registers::R_PC];
+
+        // Fetching from device registers has side effects, leave that to the plain interpreter
+        if (pc >= MemoryMappedRegisters::MR_DEVICES)
+        {
+            Step();
+            continue;
+        }
+
+        if (irTierPtr && pc != fallthrough && irTierPtr->Enter(pc))
+        {
+            // A region that stopped where it started leaves that instruction to the interpreter
+            if (registers[Registers::R_PC] == pc)
+            {
+                fallthrough = pc;
+            }
+            continue;
+        }
+
+        const DecodedInstruction& decoded = decodeCachePtr->Fetch(pc);
+        registers[Registers::R_PC] = pc + 1;
+        fallthrough = pc + 1;
+        ++cpuPtr->instructionCount;
+
+        switch (decoded.handler)
         {
         case OP_ADD:
-            aluPtr->ADD(instruction);
+            aluPtr->ADD(decoded);
             break;
         case OP_AND:
-            aluPtr->AND(instruction);
+            aluPtr->AND(decoded);
             break;
         case OP_NOT:
-            aluPtr->NOT(instruction);
+            aluPtr->NOT(decoded);
             break;
         case OP_BR:
-            aluPtr->BR(instruction);
+            aluPtr->BR(decoded);
             break;
         case OP_JMP:
-            aluPtr->JMP(instruction);
+            aluPtr->JMP(decoded);
             break;
         case OP_JSR:
-            aluPtr->JSR(instruction);
+            aluPtr->JSR(decoded);
             break;
         case OP_LD:
-            aluPtr->LD(instruction);
+            aluPtr->LD(decoded);
             break;
         case OP_LDI:
-            aluPtr->LDI(instruction);
+            aluPtr->LDI(decoded);
             break;
         case OP_LDR:
-            aluPtr->LDR(instruction);
+            aluPtr->LDR(decoded);
             break;
         case OP_LEA:
-            aluPtr->LEA(instruction);
+            aluPtr->LEA(decoded);
             break;
         case OP_ST:
-            aluPtr->ST(instruction);
+            aluPtr->ST(decoded);
             break;
         case OP_STI:
-            aluPtr->STI(instruction);
+            aluPtr->STI(decoded);
             break;
         case OP_STR:
-            aluPtr->STR(instruction);
+            aluPtr->STR(decoded);
             break;
         case OP_TRAP:
-            trapPtr->Proxy(instruction);
+            trapPtr->Proxy(decoded.instruction);
+            break;
+        case DH_ADD_BR:
+            aluPtr->ADD_BR(decoded, decodeCachePtr->Fetch(pc + 1));
+            ++cpuPtr->instructionCount;
+            ++fallthrough;
+            break;
+        case DH_LDR_ADD:
+            aluPtr->LDR_ADD(decoded, decodeCachePtr->Fetch(pc + 1));
+            ++cpuPtr->instructionCount;
+            ++fallthrough;
+            break;
+        case DH_AND_ADD:
+            aluPtr->AND_ADD(decoded, decodeCachePtr->Fetch(pc + 1));
+            ++cpuPtr->instructionCount;
+            ++fallthrough;
+            break;
+        case DH_ST_JSR:
+            aluPtr->ST_JSR(decoded, decodeCachePtr->Fetch(pc + 1));
+            ++cpuPtr->instructionCount;
             break;
         case OP_RES:
         case OP_RTI:
@@ -114,6 +723,4 @@ void VirtualMachine::RunVirtualMachine(int argc, const char* argv[])
             break;
         }
     }
-
-    osPtr->RestoreInputBuffering();
 }
\ No newline at end of file
@@ -20,6 +20,18 @@ class OS;
 class Trap;
 class MemoryIO;
 class ArithmeticLogicUnit;
+class Options;
+class DecodeCache;
+class PerfCounters;
+class Recorder;
+class Debugger;
+class GdbStub;
+class Metrics;
+class StateHash;
+class IrTier;
+class CodeMap;
+class CycleModel;
+class Mmu;
 
 
 class VirtualMachine
@@ -30,9 +42,46 @@ private:
 	Trap* trapPtr;
 	MemoryIO* memoryIOPtr;
 	ArithmeticLogicUnit* aluPtr;
+	DecodeCache* decodeCachePtr = nullptr;
+	PerfCounters* perfCountersPtr = nullptr;
+	Recorder* recorderPtr = nullptr;
+	Debugger* debuggerPtr = nullptr;
+	GdbStub* gdbStubPtr = nullptr;
+	Metrics* metricsPtr = nullptr;
+	StateHash* stateHashPtr = nullptr;
+	IrTier* irTierPtr = nullptr;
+	CodeMap* codeMapPtr = nullptr;
+	CycleModel* cycleModelPtr = nullptr;
+	Mmu* mmuPtr = nullptr;
+
+	// Instruction count at which the metrics are published next by the stepping run loops.
+	uint64_t nextPublish = 0;
+
+	void PublishDue();
 
 public:
 	VirtualMachine(CPU* cpu, OS* os, Trap* trap, MemoryIO* memoryIO, ArithmeticLogicUnit* alu);
-	void RunVirtualMachine(int argc, const char* argv[]);
+	void LoadImages(const Options* options);
+	void LoadProcesses(const Options* options);
+	void RunVirtualMachine(const Options* options);
+	void Run();
+	void RunCore(uint64_t limit);
+	void Step();
+	void RunDebugged(Debugger* debugger, uint64_t limit);
+	void SetDecodeCache(DecodeCache* decodeCache);
+	void RunDecoded(uint64_t limit);
+	void SetIrTier(IrTier* irTier);
+	void SetCodeMap(CodeMap* codeMap);
+	void SetPerfCounters(PerfCounters* perfCounters);
+	void SetRecorder(Recorder* recorder);
+	void SetDebugger(Debugger* debugger);
+	void SetGdbStub(GdbStub* gdbStub);
+	void RunRecorded(const Options* options);
+	void SetMetrics(Metrics* metrics);
+	void RunMetered();
+	void SetStateHash(StateHash* stateHash);
+	void SetCycleModel(CycleModel* cycleModel);
+	void SetMmu(Mmu* mmu);
+	void RunProcesses(const Options* options);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,403 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef VM_CORE_H
+#define VM_CORE_H
+
+
+#include <cstdint>
+#include <cstring>
+
+#include "CPU.h"
+#include "MemoryIO.h"
+#include "Trap.h"
+#include "OS.h"
+#include "ArithmeticLogicUnit.h"
+
+
+enum VmCoreResults : uint8_t
+{
+    VC_LIMIT = 0,     // the instruction limit was reached
+    VC_HALTED,        // the program halted
+    VC_ILLEGAL,       // the next instruction is an RTI or reserved opcode; it was left unexecuted
+    VC_INTERRUPTED    // the I/O policy asked to stop after a device access or trap, or the instrumentation before an instruction
+};
+
+
+// Machine state held by value while the core runs. Nothing outside the core can point into it, so
+// stores to memory do not force the registers to be reloaded.
+struct alignas(64) CoreState
+{
+    uint16_t registers[REGISTER_COUNT];
+    uint8_t result;
+    uint64_t instructionCount;
+    uint64_t limit;
+};
+
+
+// Memory policy reading and writing the memory array directly, for runs nothing observes.
+class FlatMemory
+{
+private:
+    uint16_t* memoryPtr;
+
+public:
+    FlatMemory(uint16_t* memory)
+    {
+        memoryPtr = memory;
+    }
+
+    uint16_t Fetch(uint16_t address) const
+    {
+        return memoryPtr[address];
+    }
+
+    uint16_t Load(uint16_t address) const
+    {
+        return memoryPtr[address];
+    }
+
+    void Store(uint16_t address, uint16_t value)
+    {
+        memoryPtr[address] = value;
+    }
+};
+
+
+// Memory policy going through MemoryIO, so that attached decode caches, dirty page tables, state
+// hashes, watchpoints and access profiles see every access.
+class ObservedMemory
+{
+private:
+    MemoryIO* memoryIOPtr;
+
+public:
+    ObservedMemory(MemoryIO* memoryIO)
+    {
+        memoryIOPtr = memoryIO;
+    }
+
+    uint16_t Fetch(uint16_t address) const
+    {
+        return memoryIOPtr->Fetch(address);
+    }
+
+    uint16_t Load(uint16_t address) const
+    {
+        return memoryIOPtr->Read(address);
+    }
+
+    void Store(uint16_t address, uint16_t value)
+    {
+        memoryIOPtr->Write(address, value);
+    }
+};
+
+
+// I/O policy handing device registers to MemoryIO and trap instructions to Trap.
+class MachineIo
+{
+protected:
+    MemoryIO* memoryIOPtr;
+    Trap* trapPtr;
+
+public:
+    MachineIo(MemoryIO* memoryIO, Trap* trap)
+    {
+        memoryIOPtr = memoryIO;
+        trapPtr = trap;
+    }
+
+    uint16_t ReadDevice(uint16_t address)
+    {
+        return memoryIOPtr->Read(address);
+    }
+
+    void WriteDevice(uint16_t address, uint16_t value)
+    {
+        memoryIOPtr->Write(address, value);
+    }
+
+    void Execute(uint16_t instruction)
+    {
+        trapPtr->Proxy(instruction);
+    }
+
+    bool Interrupted() const
+    {
+        return false;
+    }
+};
+
+
+// I/O policy for runs fed scripted input, which stop once the program asks for more than it was given.
+class ScriptedIo : public MachineIo
+{
+private:
+    OS* osPtr;
+
+public:
+    ScriptedIo(MemoryIO* memoryIO, Trap* trap, OS* os) : MachineIo(memoryIO, trap)
+    {
+        osPtr = os;
+    }
+
+    bool Interrupted() const
+    {
+        return osPtr->InputExhausted();
+    }
+};
+
+
+// Instrumentation policy observing nothing; its hooks compile away.
+class NoInstrumentation
+{
+public:
+    void OnControl(uint16_t, uint16_t)
+    {
+    }
+
+    bool StopsAt(uint16_t) const
+    {
+        return false;
+    }
+};
+
+
+/**
+ * @brief Interpreter core with its memory, devices and instrumentation chosen at compile time.
+ *
+ * The registers and instruction count are copied into a CoreState for the length of a Run and
+ * written back to the CPU whenever another component may look at them: around device accesses,
+ * traps and on return. Every handler is inlined into the dispatch loop.
+ *
+ * MemoryPolicy provides Fetch, Load and Store for addresses below the device registers. IoPolicy provides
+ * ReadDevice, WriteDevice, Execute for traps and Interrupted, which is checked after each of them.
+ * InstrumentationPolicy provides OnControl, called with the address and the next program counter of
+ * every BR, JMP and JSR, and StopsAt, asked before every instruction whether to return without
+ * executing it.
+ */
+template <class MemoryPolicy, class IoPolicy, class InstrumentationPolicy>
+class VmCore
+{
+private:
+    CPU* cpuPtr;
+    MemoryPolicy memory;
+    IoPolicy io;
+    InstrumentationPolicy instrumentation;
+
+    static uint16_t SignExtend(uint16_t value, int bits)
+    {
+        return (uint16_t)((int16_t)(value << (16 - bits)) >> (16 - bits));
+    }
+
+    static void UpdateFlags(CoreState& state, uint16_t r)
+    {
+        uint16_t value = state.registers[r];
+        state.registers[Registers::R_COND] = value == 0 ? ConditionFlags::FL_ZERO
+            : (value >> 15) ? ConditionFlags::FL_NEGATIVE : ConditionFlags::FL_POSITIVE;
+    }
+
+    void Flush(const CoreState& state)
+    {
+        memcpy(cpuPtr->registers, state.registers, sizeof(state.registers));
+        cpuPtr->instructionCount = state.instructionCount;
+    }
+
+    void Reload(CoreState& state)
+    {
+        memcpy(state.registers, cpuPtr->registers, sizeof(state.registers));
+        state.instructionCount = cpuPtr->instructionCount;
+    }
+
+    static void Stop(CoreState& state, uint8_t result)
+    {
+        state.result = result;
+        state.limit = state.instructionCount;
+    }
+
+    void CheckInterrupted(CoreState& state)
+    {
+        if (io.Interrupted())
+        {
+            Stop(state, VC_INTERRUPTED);
+        }
+    }
+
+    uint16_t Fetch(CoreState& state, uint16_t address)
+    {
+        if (address < MemoryMappedRegisters::MR_DEVICES)
+        {
+            return memory.Fetch(address);
+        }
+        return Load(state, address);
+    }
+
+    uint16_t Load(CoreState& state, uint16_t address)
+    {
+        if (address < MemoryMappedRegisters::MR_DEVICES)
+        {
+            return memory.Load(address);
+        }
+
+        // Devices may look at the machine, e.g. the timer counts instructions
+        Flush(state);
+        uint16_t value = io.ReadDevice(address);
+        CheckInterrupted(state);
+        return value;
+    }
+
+    void Store(CoreState& state, uint16_t address, uint16_t value)
+    {
+        if (address < MemoryMappedRegisters::MR_DEVICES)
+        {
+            memory.Store(address, value);
+            return;
+        }
+
+        Flush(state);
+        io.WriteDevice(address, value);
+        CheckInterrupted(state);
+    }
+
+public:
+    VmCore(CPU* cpu, MemoryPolicy memoryPolicy, IoPolicy ioPolicy, InstrumentationPolicy instrumentationPolicy)
+        : memory(memoryPolicy), io(ioPolicy), instrumentation(instrumentationPolicy)
+    {
+        cpuPtr = cpu;
+    }
+
+    /**
+     * @brief Executes instructions until the program halts or the instruction count reaches limit.
+     *
+     * @param limit Instruction count at which to return, e.g. UINT64_MAX to run to completion.
+     * @return The VmCoreResults reason for returning. The CPU holds the machine state on return.
+     */
+    int Run(uint64_t limit)
+    {
+        if (!cpuPtr->running)
+        {
+            return VC_HALTED;
+        }
+
+        CoreState state;
+        Reload(state);
+        state.result = VC_LIMIT;
+        state.limit = limit;
+
+        uint16_t* registers = state.registers;
+
+        while (state.instructionCount < state.limit)
+        {
+            uint16_t pc = registers[Registers::R_PC];
+            if (instrumentation.StopsAt(pc))
+            {
+                Stop(state, VC_INTERRUPTED);
+                break;
+            }
+            uint16_t instruction = Fetch(state, pc);
+            registers[Registers::R_PC] = pc + 1;
+            ++state.instructionCount;
+
+            uint16_t dr = (instruction >> 9) & 0x0007;
+            uint16_t sr1 = (instruction >> 6) & 0x0007;
+
+            switch (instruction >> 12)
+            {
+            case OP_ADD:
+                registers[dr] = registers[sr1] + ((instruction & 0x0020) ? SignExtend(instruction & 0x001F, 5) : registers[instruction & 0x0007]);
+                UpdateFlags(state, dr);
+                break;
+            case OP_AND:
+                registers[dr] = registers[sr1] & ((instruction & 0x0020) ? SignExtend(instruction & 0x001F, 5) : registers[instruction & 0x0007]);
+                UpdateFlags(state, dr);
+                break;
+            case OP_NOT:
+                registers[dr] = ~registers[sr1];
+                UpdateFlags(state, dr);
+                break;
+            case OP_BR:
+                if (dr & registers[Registers::R_COND])
+                {
+                    registers[Registers::R_PC] += SignExtend(instruction & 0x01FF, 9);
+                }
+                instrumentation.OnControl(pc, registers[Registers::R_PC]);
+                break;
+            case OP_JMP:
+                registers[Registers::R_PC] = registers[sr1];
+                instrumentation.OnControl(pc, registers[Registers::R_PC]);
+                break;
+            case OP_JSR:
+                // JSRR R7 jumps to the return address just written, as in ArithmeticLogicUnit::JSR
+                registers[Registers::R_7] = registers[Registers::R_PC];
+                if (instruction & 0x0800)
+                {
+                    registers[Registers::R_PC] += SignExtend(instruction & 0x07FF, 11);
+                }
+                else
+                {
+                    registers[Registers::R_PC] = registers[sr1];
+                }
+                instrumentation.OnControl(pc, registers[Registers::R_PC]);
+                break;
+            case OP_LD:
+                registers[dr] = Load(state, registers[Registers::R_PC] + SignExtend(instruction & 0x01FF, 9));
+                UpdateFlags(state, dr);
+                break;
+            case OP_LDI:
+                registers[dr] = Load(state, Load(state, registers[Registers::R_PC] + SignExtend(instruction & 0x01FF, 9)));
+                UpdateFlags(state, dr);
+                break;
+            case OP_LDR:
+                registers[dr] = Load(state, registers[sr1] + SignExtend(instruction & 0x003F, 6));
+                UpdateFlags(state, dr);
+                break;
+            case OP_LEA:
+                registers[dr] = registers[Registers::R_PC] + SignExtend(instruction & 0x01FF, 9);
+                UpdateFlags(state, dr);
+                break;
+            case OP_ST:
+                Store(state, registers[Registers::R_PC] + SignExtend(instruction & 0x01FF, 9), registers[dr]);
+                break;
+            case OP_STI:
+                Store(state, Load(state, registers[Registers::R_PC] + SignExtend(instruction & 0x01FF, 9)), registers[dr]);
+                break;
+            case OP_STR:
+                Store(state, registers[sr1] + SignExtend(instruction & 0x003F, 6), registers[dr]);
+                break;
+            case OP_TRAP:
+                Flush(state);
+                io.Execute(instruction);
+                Reload(state);
+                if (!cpuPtr->running)
+                {
+                    Stop(state, VC_HALTED);
+                }
+                else
+                {
+                    CheckInterrupted(state);
+                }
+                break;
+            case OP_RES:
+            case OP_RTI:
+            default:
+                // Leave the machine before the instruction, for the caller to report or abort on
+                registers[Registers::R_PC] = pc;
+                --state.instructionCount;
+                Stop(state, VC_ILLEGAL);
+                break;
+            }
+        }
+
+        Flush(state);
+        return state.result;
+    }
+};
+#endif
\ No newline at end of file
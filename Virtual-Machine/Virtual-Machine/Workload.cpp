@@ -0,0 +1,483 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#define _CRT_SECURE_NO_DEPRECATE
+
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Workload.h"
+
+
+enum WorkloadLayout : uint16_t
+{
+    // Kernels start with a jump over their data, which therefore sits at a known address.
+    WORKLOAD_ORIGIN = 0x3000,
+    WORKLOAD_DATA = 0x3004,
+
+    // Pointer chasing loads unrolled per loop iteration.
+    WORKLOAD_CHASE_UNROLL = 16
+};
+
+
+static const char* kindNames[WK_COUNT] = { "mix", "branchy", "straight", "chase", "io", "smc", "poll", "patch" };
+
+
+/**
+ * @brief Constructs a generator.
+ *
+ * @param size Size of the loop body, or of the kernel's data for chase; 0 for the kernel's default.
+ * @param iterations Number of times the loop body runs, from 1 to 2^31.
+ * @param seed Seed of the random choices, so that a seed always produces the same program.
+ */
+Workload::Workload(uint32_t size, uint64_t iterations, uint64_t seed)
+{
+    this->size = size;
+    this->iterations = iterations;
+    this->seed = seed;
+    randomState = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+
+/**
+ * @brief Looks up a kernel by name.
+ *
+ * @param name One of mix, branchy, straight, chase, io, smc, poll and patch.
+ * @param kind Receives the WorkloadKinds value.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int Workload::ParseKind(const char* name, uint32_t* kind)
+{
+    for (uint32_t i = 0; i < WK_COUNT; ++i)
+    {
+        if (strcmp(name, kindNames[i]) == 0)
+        {
+            *kind = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Returns the size a kernel uses when none is given.
+ */
+uint32_t Workload::DefaultSize(uint32_t kind)
+{
+    switch (kind)
+    {
+    case WK_MIX:
+        return 256;
+    case WK_CHASE:
+        return 4096;
+    case WK_BRANCHY:
+    case WK_STRAIGHT:
+        return 64;
+    case WK_POLL:
+        return 1;
+    default:
+        return 32;
+    }
+}
+
+
+/**
+ * @brief Sets the relative weights of ALU, memory and branch instructions in the mix kernel.
+ */
+void Workload::SetMix(uint32_t alu, uint32_t memory, uint32_t branch)
+{
+    aluWeight = alu;
+    memoryWeight = memory;
+    branchWeight = branch;
+}
+
+
+/**
+ * @brief Returns the next value of the xorshift64* generator.
+ */
+uint32_t Workload::Random()
+{
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (uint32_t)((randomState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+/**
+ * @brief Appends a formatted line to the source.
+ */
+void Workload::Emit(const char* format, ...)
+{
+    char line[128];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+
+    source += line;
+    source += '\n';
+}
+
+
+/**
+ * @brief Emits the kernel's data words.
+ */
+void Workload::Data(const uint16_t* words, uint32_t count)
+{
+    Emit("DATA");
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Emit("        .FILL x%04X", words[i]);
+    }
+}
+
+
+/**
+ * @brief Emits the start of a kernel, up to the first instruction of its loop body.
+ *
+ * R4 holds the address of the data and R5 the address of the loop body. R6 and the word before
+ * the data count the iterations left; R3 is clobbered between iterations.
+ *
+ * @param kind Name of the kernel, for the header comment.
+ * @param data The kernel's data words, placed at WORKLOAD_DATA.
+ * @param dataCount Number of data words.
+ * @param r0 Initial value of R0.
+ */
+void Workload::Begin(const char* kind, const uint16_t* data, uint32_t dataCount, uint16_t r0)
+{
+    // R6 counts the low 16 bits of the iterations, where 0 stands for 65536
+    uint16_t low = (uint16_t)iterations;
+    uint16_t high = (uint16_t)(iterations >> 16);
+    if (low == 0)
+    {
+        --high;
+    }
+
+    source.clear();
+    Emit("; %s kernel: size %u, %llu iterations, seed %llu", kind, size, (unsigned long long)iterations, (unsigned long long)seed);
+    Emit("        .ORIG x%04X", WORKLOAD_ORIGIN);
+    Emit("        LD R5, ENTRY");
+    Emit("        JMP R5");
+    Emit("ENTRY   .FILL MAIN");
+    Emit("HIGH    .FILL x%04X", high);
+    Data(data, dataCount);
+    Emit("LOW     .FILL x%04X", low);
+    Emit("BASE    .FILL DATA");
+    Emit("START   .FILL x%04X", r0);
+    Emit("MAIN    LD R4, BASE");
+    Emit("        LD R6, LOW");
+    Emit("        LD R0, START");
+    Emit("        AND R1, R1, #0");
+    Emit("        AND R2, R2, #0");
+    Emit("        AND R3, R3, #0");
+    Emit("        LEA R5, LOOP");
+    Emit("LOOP");
+}
+
+
+/**
+ * @brief Emits the end of the loop body, which counts down the iterations, and the halt.
+ */
+void Workload::End()
+{
+    Emit("TAIL    ADD R6, R6, #-1");
+    Emit("        BRz NEXT");
+    Emit("        JMP R5");
+    Emit("NEXT    LDR R3, R4, #-1");
+    Emit("        ADD R3, R3, #-1");
+    Emit("        STR R3, R4, #-1");
+    Emit("        BRn DONE");
+    Emit("        JMP R5");
+    Emit("DONE    HALT");
+    Emit("        .END");
+}
+
+
+/**
+ * @brief Random ALU operations, loads and stores to a 32-word table, and branches skipping one instruction.
+ */
+void Workload::Mix()
+{
+    uint16_t table[32];
+    for (uint16_t& word : table)
+    {
+        word = (uint16_t)Random();
+    }
+    Begin("mix", table, 32, 0);
+
+    uint32_t total = aluWeight + memoryWeight + branchWeight;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        char label[16];
+        snprintf(label, sizeof(label), "L%u", i);
+
+        uint32_t choice = Random() % total;
+        uint32_t dr = Random() % 4;
+        uint32_t sr = Random() % 4;
+        if (choice < aluWeight)
+        {
+            uint32_t operation = Random() % 8;
+            if (operation == 0)
+            {
+                Emit("%-7s NOT R%u, R%u", label, dr, sr);
+            }
+            else if (Random() % 2)
+            {
+                Emit("%-7s %s R%u, R%u, #%d", label, operation < 6 ? "ADD" : "AND", dr, sr, (int)(Random() % 32) - 16);
+            }
+            else
+            {
+                Emit("%-7s %s R%u, R%u, R%u", label, operation < 6 ? "ADD" : "AND", dr, sr, Random() % 4);
+            }
+        }
+        else if (choice < aluWeight + memoryWeight)
+        {
+            Emit("%-7s %s R%u, R4, #%u", label, Random() % 3 ? "LDR" : "STR", dr, Random() % 32);
+        }
+        else
+        {
+            static const char* conditions[] = { "BRn", "BRz", "BRp", "BRnz", "BRnp", "BRzp", "BRnzp" };
+            char target[16];
+            if (i + 2 < size)
+            {
+                snprintf(target, sizeof(target), "L%u", i + 2);
+            }
+            else
+            {
+                snprintf(target, sizeof(target), "TAIL");
+            }
+            Emit("%-7s %s %s", label, conditions[Random() % 7], target);
+        }
+    }
+    End();
+}
+
+
+/**
+ * @brief Steps a linear congruential generator, x = 5x + 1, and branches on its sign, or adds its low bits.
+ *
+ * Both variants execute seven instructions per step, so their difference is the cost of the branch.
+ *
+ * @param branch True for the branchy kernel, false for the straight-line one.
+ */
+void Workload::Branchy(bool branch)
+{
+    Begin(branch ? "branchy" : "straight", nullptr, 0, (uint16_t)Random());
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        Emit("        ADD R1, R0, R0");
+        Emit("        ADD R1, R1, R1");
+        Emit("        ADD R0, R1, R0");
+        Emit("        ADD R0, R0, #1");
+        if (branch)
+        {
+            Emit("        BRn N%u", i);
+            Emit("        ADD R2, R2, #1");
+            Emit("        BR J%u", i);
+            Emit("N%-6u ADD R2, R2, #-1", i);
+            Emit("        ADD R2, R2, #3");
+            Emit("J%u", i);
+        }
+        else
+        {
+            Emit("        AND R1, R0, #7");
+            Emit("        ADD R2, R2, R1");
+            Emit("        ADD R2, R2, #1");
+        }
+    }
+    End();
+}
+
+
+/**
+ * @brief Follows next pointers around a single random cycle through all nodes.
+ */
+void Workload::Chase()
+{
+    // Sattolo's shuffle yields one cycle visiting every node
+    std::vector<uint32_t> order(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        order[i] = i;
+    }
+    for (uint32_t i = size - 1; i > 0; --i)
+    {
+        uint32_t j = Random() % i;
+        uint32_t swapped = order[i];
+        order[i] = order[j];
+        order[j] = swapped;
+    }
+
+    std::vector<uint16_t> nodes(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        nodes[order[i]] = (uint16_t)(WORKLOAD_DATA + order[(i + 1) % size]);
+    }
+    Begin("chase", nodes.data(), size, (uint16_t)(WORKLOAD_DATA + order[0]));
+
+    for (uint32_t i = 0; i < WORKLOAD_CHASE_UNROLL; ++i)
+    {
+        Emit("        LDR R0, R0, #0");
+    }
+    End();
+}
+
+
+/**
+ * @brief Writes a line of size characters with PUTS, then again one character at a time with OUT.
+ */
+void Workload::Output()
+{
+    std::vector<uint16_t> text;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        text.push_back((uint16_t)('a' + i % 26));
+    }
+    text.push_back('\n');
+    text.push_back(0);
+    Begin("io", text.data(), (uint32_t)text.size(), 0);
+
+    Emit("        ADD R0, R4, #0");
+    Emit("        PUTS");
+    uint32_t reach = size < 32 ? size : 32;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        Emit("        LDR R0, R4, #%u", i % reach);
+        Emit("        OUT");
+    }
+    Emit("        AND R0, R0, #0");
+    Emit("        ADD R0, R0, #10");
+    Emit("        OUT");
+    End();
+}
+
+
+/**
+ * @brief Patches an ADD R1, R1, #imm with an immediate taken from the iteration count, then executes it.
+ */
+void Workload::SelfModifying()
+{
+    // ADD R1, R1, #0, completed with the immediate at run time
+    uint16_t addR1 = 0x1260;
+    Begin("smc", &addR1, 1, 0);
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        Emit("        LDR R2, R4, #0");
+        Emit("        AND R3, R6, #15");
+        Emit("        ADD R2, R2, R3");
+        Emit("        ST R2, P%u", i);
+        Emit("P%-6u NOP", i);
+    }
+    End();
+}
+
+
+/**
+ * @brief Polls the keyboard status register size times per iteration, adding the key from the data register to R2 when one is ready.
+ *
+ * Every iteration starts with the LDI of the status register, a loop head that reads a device first.
+ */
+void Workload::Poll()
+{
+    static const uint16_t keyboard[] = { 0xFE00, 0xFE02 };
+    Begin("poll", keyboard, 2, 0);
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        Emit("        LDI R1, DATA");
+        Emit("        BRzp K%u", i);
+        Emit("        LDR R0, R4, #1");
+        Emit("        LDR R0, R0, #0");
+        Emit("        ADD R2, R2, R0");
+        Emit("K%u", i);
+    }
+    End();
+}
+
+
+/**
+ * @brief Patches an ADD R1, R1, #imm into the loop body and into a subroutine, then calls the subroutine.
+ *
+ * The body rewrites itself first, so a translated binary interprets the store into the subroutine,
+ * whose translation must not run afterwards.
+ */
+void Workload::Patch()
+{
+    // ADD R1, R1, #0, completed with the immediate at run time
+    uint16_t addR1 = 0x1260;
+    Begin("patch", &addR1, 1, 0);
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        Emit("        LDR R2, R4, #0");
+        Emit("        AND R3, R6, #15");
+        Emit("        ADD R2, R2, R3");
+        Emit("        ST R2, P%u", i);
+        Emit("P%-6u NOP", i);
+        Emit("        ST R2, S%u", i);
+        Emit("        JSR S%u", i);
+        Emit("        BR O%u", i);
+        Emit("S%-6u NOP", i);
+        Emit("        RET");
+        Emit("O%u", i);
+    }
+    End();
+}
+
+
+/**
+ * @brief Generates the assembly source of a kernel.
+ *
+ * @param kind The WorkloadKinds kernel.
+ * @return The source, ready for Assembler::Assemble.
+ */
+std::string Workload::Generate(uint32_t kind)
+{
+    if (size == 0)
+    {
+        size = DefaultSize(kind);
+    }
+
+    switch (kind)
+    {
+    case WK_MIX:
+        Mix();
+        break;
+    case WK_BRANCHY:
+        Branchy(true);
+        break;
+    case WK_STRAIGHT:
+        Branchy(false);
+        break;
+    case WK_CHASE:
+        Chase();
+        break;
+    case WK_IO:
+        Output();
+        break;
+    case WK_SMC:
+        SelfModifying();
+        break;
+    case WK_POLL:
+        Poll();
+        break;
+    case WK_PATCH:
+        Patch();
+        break;
+    }
+    return source;
+}
\ No newline at end of file
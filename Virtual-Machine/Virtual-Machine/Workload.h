@@ -0,0 +1,75 @@
+/*
+Author: Mehmet Arslan
+GitHub: https://github.com/htmos6
+
+This code is licensed under the MIT License.
+
+Copyright  2024 Mehmet Arslan
+*/
+
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+
+#include <cstdint>
+#include <string>
+
+
+enum WorkloadKinds : uint8_t
+{
+    WK_MIX = 0,  // random ALU, load/store and short forward branches in a chosen proportion
+    WK_BRANCHY,  // a pseudo-random number generator steering a data-dependent branch
+    WK_STRAIGHT, // the same generator and work as WK_BRANCHY without the branch
+    WK_CHASE,    // pointer chasing around a randomly linked cycle of nodes
+    WK_IO,       // output traps, a string and single characters per line
+    WK_SMC,      // self-modifying code, patching instructions right before executing them
+    WK_POLL,     // keyboard polling through the status and data registers, summing the keys read
+    WK_PATCH,    // self-modifying code patching a subroutine and then calling it
+    WK_COUNT
+};
+
+
+// Generator of LC-3 assembly benchmark kernels, to be assembled with Assembler.
+//
+// Every kernel repeats a loop body a given number of times and then halts. The body's length is
+// set by its size; the same seed produces the same program.
+class Workload
+{
+private:
+    uint32_t size;
+    uint64_t iterations;
+    uint64_t seed;
+    uint64_t randomState;
+
+    // Relative weights of ALU, memory and branch instructions in WK_MIX.
+    uint32_t aluWeight = 50;
+    uint32_t memoryWeight = 30;
+    uint32_t branchWeight = 20;
+
+    std::string source;
+
+    uint32_t Random();
+    void Emit(const char* format, ...);
+    void Data(const uint16_t* words, uint32_t count);
+    void Begin(const char* kind, const uint16_t* data, uint32_t dataCount, uint16_t r0);
+    void End();
+
+    void Mix();
+    void Branchy(bool branch);
+    void Chase();
+    void Output();
+    void SelfModifying();
+    void Poll();
+    void Patch();
+
+public:
+    Workload(uint32_t size, uint64_t iterations, uint64_t seed);
+
+    static int ParseKind(const char* name, uint32_t* kind);
+    static uint32_t DefaultSize(uint32_t kind);
+    void SetMix(uint32_t alu, uint32_t memory, uint32_t branch);
+
+    std::string Generate(uint32_t kind);
+};
+#endif
\ No newline at end of file
@@ -15,17 +15,381 @@ Copyright 
 #include "OS.h"
 #include "Trap.h"
 #include "VirtualMachine.h"
+#include "Options.h"
+#include "Timer.h"
+#include "Translator.h"
+#include "DecodeCache.h"
+#include "IrTier.h"
+#include "CodeMap.h"
+#include "CycleModel.h"
+#include "Mmu.h"
+#include "BlockDevice.h"
+#include "LatencyTrace.h"
+#include "PerfCounters.h"
+#include "Fuzzer.h"
+#include "Recorder.h"
+#include "Debugger.h"
+#include "GdbStub.h"
+#include "Metrics.h"
+#include "JobServer.h"
+#include "ObjectFile.h"
+#include "Terminal.h"
+#include "StateHash.h"
+#include "AccessProfile.h"
+#include "CacheModel.h"
+#include "Assembler.h"
+#include "Workload.h"
 
 int main(int argc, const char* argv[])
 {
+    Options options;
+    if (!options.Parse(argc, argv))
+    {
+        // Display usage information and exit if no image files are provided
+        options.PrintUsage();
+        exit(2);
+    }
+
+    if (options.metricsWatch)
+    {
+        // Observe another VM instead of running one
+        return Metrics::Watch(options.metricsWatch, stdout);
+    }
+
+    if (options.servePort)
+    {
+        // Keep the images loaded and run jobs for clients instead of running the program once
+        JobServer server(&options);
+        if (!server.Preload())
+        {
+            exit(1);
+        }
+        if (!server.Listen(options.servePort))
+        {
+            printf("failed to listen on port %u\n", options.servePort);
+            exit(1);
+        }
+        server.Serve(options.serveWorkers);
+        return 0;
+    }
+
+    if (options.generate || options.assembleOutput)
+    {
+        // Produce an image, or a kernel's source, instead of running anything
+        Assembler assembler;
+        int assembled;
+        if (options.generate)
+        {
+            Workload workload(options.generateSize, options.generateIterations, options.generateSeed);
+            workload.SetMix(options.generateAlu, options.generateMemory, options.generateBranch);
+            std::string source = workload.Generate(options.generateKind);
+            if (!options.assembleOutput)
+            {
+                fputs(source.c_str(), stdout);
+                return 0;
+            }
+            assembled = assembler.Assemble(source);
+        }
+        else if (options.imagePaths.size() != 1)
+        {
+            printf("--assemble takes exactly one source file\n");
+            exit(1);
+        }
+        else
+        {
+            assembled = assembler.AssembleFile(options.imagePaths[0]);
+        }
+
+        if (!assembled)
+        {
+            printf("assembly failed: %s\n", assembler.Error().c_str());
+            exit(1);
+        }
+        if (!assembler.SaveImage(options.assembleOutput))
+        {
+            printf("failed to write image: %s\n", options.assembleOutput);
+            exit(1);
+        }
+
+        // The symbol table goes next to the image, as lc3as writes it
+        std::string symbolsPath = options.assembleOutput;
+        size_t dot = symbolsPath.find_last_of('.');
+        size_t slash = symbolsPath.find_last_of("/\\");
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        {
+            symbolsPath.erase(dot);
+        }
+        symbolsPath += ".sym";
+        if (!assembler.SaveSymbols(symbolsPath.c_str()))
+        {
+            printf("failed to write symbols: %s\n", symbolsPath.c_str());
+            exit(1);
+        }
+        return 0;
+    }
+
     CPU cpu;
     OS os;
-    Trap trap(cpu.memory, cpu.registers, &cpu);
-    MemoryIO memoryIO(cpu.memory, &os);
+    Timer timer(&cpu, options.timerInstructionsPerTick, options.timerRealTime);
+    Trap trap(cpu.memory, cpu.registers, &cpu, &os);
+    MemoryIO memoryIO(cpu.memory, &os, &timer);
     ArithmeticLogicUnit alu(cpu.memory, cpu.registers, &memoryIO, &cpu);
 
     VirtualMachine virtualMachine(&cpu, &os, &trap, &memoryIO, &alu);
-    virtualMachine.RunVirtualMachine(argc, argv);
+    DecodeCache decodeCache(cpu.memory, &cpu, &alu);
+    IrTier irTier(&cpu, &memoryIO, options.tierThreshold);
+    CodeMap codeMap(&cpu);
+    Mmu mmu(&cpu);
+
+    // Processes live in the MMU's frames rather than CPU::memory, which everything observing memory
+    // reads, and stepping through the debugger, gdb or a recording runs a single program
+    bool mapped = options.mmu && !options.recordPath && !options.replayPath && !options.debug && !options.gdbPort;
+    bool hashed = options.stateHash && !mapped;
+    bool profiled = options.accessProfile && !mapped;
+
+    // Decoded instructions are not fetched from memory and skip the interpreter's control transfer
+    // hooks, so profiling and cycle accounting keep to the interpreter
+    bool decoded = options.decode && !options.accessProfile && !options.cycles && !mapped;
+    bool tiered = options.tier && decoded;
+    if (decoded)
+    {
+        memoryIO.SetDecodeCache(&decodeCache);
+        virtualMachine.SetDecodeCache(&decodeCache);
+
+        // Lets stores to pages that only hold data skip invalidating decoded code
+        decodeCache.SetCodeMap(&codeMap);
+        memoryIO.SetCodeMap(&codeMap);
+        virtualMachine.SetCodeMap(&codeMap);
+    }
+    if (tiered)
+    {
+        memoryIO.SetIrTier(&irTier);
+        virtualMachine.SetIrTier(&irTier);
+        irTier.SetCodeMap(&codeMap);
+    }
+
+    PerfCounters perfCounters;
+    if (options.perf)
+    {
+        virtualMachine.SetPerfCounters(&perfCounters);
+    }
+
+    Recorder recorder(&cpu, &os, &timer, &memoryIO, &virtualMachine);
+    if (options.recordPath && !recorder.StartRecording(options.recordPath, options.checkpointInterval))
+    {
+        printf("failed to create recording: %s\n", options.recordPath);
+        exit(1);
+    }
+    if (options.replayPath && !recorder.LoadRecording(options.replayPath))
+    {
+        printf("failed to load recording: %s\n", options.replayPath);
+        exit(1);
+    }
+    if (options.recordPath || options.replayPath)
+    {
+        os.SetRecorder(&recorder);
+        virtualMachine.SetRecorder(&recorder);
+    }
+
+    Debugger debugger(&cpu, &os, &virtualMachine, &recorder);
+    if (options.debug || options.seek)
+    {
+        memoryIO.SetDebugger(&debugger);
+        virtualMachine.SetDebugger(&debugger);
+    }
+
+    GdbStub gdbStub(&cpu, &memoryIO, &virtualMachine, &debugger);
+    if (options.gdbPort)
+    {
+        if (!gdbStub.Listen(options.gdbPort))
+        {
+            printf("failed to listen on port %u\n", options.gdbPort);
+            exit(1);
+        }
+        memoryIO.SetDebugger(&debugger);
+        virtualMachine.SetGdbStub(&gdbStub);
+    }
+
+    Metrics metrics(&cpu);
+    if (options.metrics)
+    {
+        if (!metrics.Open())
+        {
+            printf("failed to create the metrics segment\n");
+            exit(1);
+        }
+        os.SetMetrics(&metrics);
+        trap.SetMetrics(&metrics);
+        virtualMachine.SetMetrics(&metrics);
+    }
+
+    Terminal terminal(options.terminalColumns, options.terminalRows, options.terminalFramesPerSecond, options.headless);
+    if (options.terminal)
+    {
+        os.SetTerminal(&terminal);
+    }
+
+    StateHash stateHash(&cpu);
+    if (hashed)
+    {
+        memoryIO.SetStateHash(&stateHash);
+        virtualMachine.SetStateHash(&stateHash);
+    }
+
+    AccessProfile accessProfile(&cpu, options.heatmapWindow);
+    CacheModel cacheModel(options.hostCacheSize, options.hostCacheWays, options.hostCacheLine);
+    if (profiled)
+    {
+        if (options.hostCache)
+        {
+            accessProfile.SetCacheModel(&cacheModel);
+        }
+        memoryIO.SetAccessProfile(&accessProfile);
+    }
+
+    // Debugger and gdb runs use their own instrumentation policy, and seeks in a recording restore checkpoints
+    CycleModel cycleModel(&cpu);
+    bool cycled = options.cycles && !options.recordPath && !options.replayPath && !options.debug && !options.gdbPort && !mapped;
+    if (cycled)
+    {
+        if (!cycleModel.Configure(options.cycleCosts))
+        {
+            printf("invalid cycle costs: %s\n", options.cycleCosts);
+            exit(1);
+        }
+        memoryIO.SetCycleModel(&cycleModel);
+        virtualMachine.SetCycleModel(&cycleModel);
+    }
+
+    if (options.translateOutput)
+    {
+        // Translate the images ahead of time instead of running them
+        virtualMachine.LoadImages(&options);
+        Translator translator(&cpu, &alu);
+        if (!translator.Translate(options.translateOutput))
+        {
+            printf("failed to write translation: %s\n", options.translateOutput);
+            exit(1);
+        }
+        return 0;
+    }
+
+    if (options.packOutput)
+    {
+        // Combine the images into one extended object file instead of running them
+        virtualMachine.LoadImages(&options);
+        ObjectFile objectFile(&cpu);
+        if (!objectFile.Save(options.packOutput))
+        {
+            printf("failed to write object file: %s\n", options.packOutput);
+            exit(1);
+        }
+        return 0;
+    }
+
+    if (options.fuzz)
+    {
+        // Explore the program's input space instead of running it interactively
+        virtualMachine.LoadImages(&options);
+        Fuzzer fuzzer(&cpu, &os, &timer, &memoryIO, &trap);
+        fuzzer.Run(&options);
+        return 0;
+    }
+
+    LatencyTrace latencyTrace(options.latencyPath);
+    if (options.latencyPath)
+    {
+        if (!latencyTrace.Start())
+        {
+            printf("failed to create latency trace: %s\n", options.latencyPath);
+            exit(1);
+        }
+        os.SetLatencyTrace(&latencyTrace);
+        memoryIO.SetLatencyTrace(&latencyTrace);
+        trap.SetLatencyTrace(&latencyTrace);
+    }
+
+    BlockDevice disk(&memoryIO);
+    if (options.diskPath)
+    {
+        if (!disk.Open(options.diskPath))
+        {
+            printf("failed to open disk: %s\n", options.diskPath);
+            exit(1);
+        }
+        memoryIO.SetBlockDevice(&disk);
+    }
+
+    if (mapped)
+    {
+        trap.SetMmu(&mmu);
+        memoryIO.SetMmu(&mmu);
+        virtualMachine.SetMmu(&mmu);
+    }
+
+    virtualMachine.RunVirtualMachine(&options);
+
+    if (mapped && options.perf)
+    {
+        mmu.Report(stderr);
+    }
+
+    if (options.diskPath && options.perf)
+    {
+        disk.Report(stderr);
+    }
+
+    if (decoded && options.perf)
+    {
+        codeMap.Report(stderr);
+    }
+
+    if (tiered && options.perf)
+    {
+        irTier.Report(stderr);
+    }
+
+    if (hashed)
+    {
+        fprintf(stderr, "state hash: %016llx\n", (unsigned long long)stateHash.Value());
+    }
+
+    if (profiled)
+    {
+        accessProfile.Finish();
+        accessProfile.Report(stderr);
+        if (options.heatmapPath && !accessProfile.SaveHeatmap(options.heatmapPath))
+        {
+            printf("failed to write heatmap: %s\n", options.heatmapPath);
+            exit(1);
+        }
+    }
+
+    if (cycled)
+    {
+        cycleModel.Report(stderr);
+    }
+
+    if (options.terminal)
+    {
+        terminal.Present();
+        if (options.perf)
+        {
+            terminal.Report(stderr);
+        }
+        if (options.screenshotPath && !terminal.SaveScreenshot(options.screenshotPath))
+        {
+            printf("failed to write screenshot: %s\n", options.screenshotPath);
+            exit(1);
+        }
+    }
+
+    if (options.latencyPath)
+    {
+        // The final frame above flushed whatever output was still held back
+        latencyTrace.Flushed();
+        latencyTrace.Stop();
+    }
 }
 
 